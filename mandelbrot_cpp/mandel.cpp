@@ -1,21 +1,27 @@
 #include "mandel.hpp"
-#include "../spt/natv_collection.hpp"
+#include "../spt/natv_grid.hpp"
+#include <cmath>
 
 /**
- * @brief Calculates the Mandelbrot iteration count for a given point.
+ * @brief Iterates a point and records its iteration count, final |z|² and smoothed count.
  * @details This function determines if a point (x0, y0) is in the Mandelbrot
  *          set by iterating the equation z_{n+1} = z_n^2 + c, where c is the
- *          point and z starts at 0. It returns the number of iterations it
- *          takes for the magnitude of z to exceed 2, up to a maximum limit.
+ *          point and z starts at 0, until the magnitude of z exceeds 2 or the
+ *          maximum number of iterations is reached.
  * @param x0 The real part of the complex number c.
  * @param y0 The imaginary part of the complex number c.
  * @param max_iters The maximum number of iterations to perform.
- * @return The number of iterations before escaping, or max_iters if it does not.
+ * @param count Receives the number of iterations before escaping, or max_iters.
+ * @param norm Receives |z|² after the last iteration.
+ * @param smooth Receives the continuous iteration count, or max_iters if the point does not escape.
  */
-std::size_t get_count(
+void get_escape(
     double x0,
     double y0,
-    std::size_t max_iters)
+    std::size_t max_iters,
+    std::size_t &count,
+    double &norm,
+    double &smooth)
 {
     double x = 0.0;
     double y = 0.0;
@@ -29,7 +35,12 @@ std::size_t get_count(
         x = x_temp;
         ++i;
     }
-    return i;
+
+    count = i;
+    norm = x * x + y * y;
+    smooth = (i < max_iters)
+                 ? i + 1 - std::log2(0.5 * std::log(norm))
+                 : (double)max_iters;
 }
 
 /**
@@ -53,20 +64,6 @@ std::vector<Color> mandelbrot::create_image(
     std::size_t height,
     std::size_t max_iters) const
 {
-    double scale = view_height() / height;
-    double top = view_top();
-    double left = view_left();
-
-    auto mandel_fn = [=](std::size_t idx) -> std::size_t
-    {
-        std::size_t row = idx / width;
-        std::size_t col = idx % width;
-        double y = top - (row * scale);
-        double x = left + (col * scale);
-
-        return get_count(x, y, max_iters);
-    };
-
     auto color_fn = [=](std::size_t val) -> Color
     {
         if (val == max_iters)
@@ -79,8 +76,31 @@ std::vector<Color> mandelbrot::create_image(
         return Color{red, green, blue};
     };
 
-    Collection<std::size_t> data(width * height, mandel_fn);
-    Collection<Color> colors(data.map<Color>(color_fn));
+    Grid<std::size_t> data(std::get<0>(create_escape_data(width, height, max_iters)));
+    Grid<Color> colors(data.map<Color>(color_fn));
 
     return colors.to_vector();
 }
+
+/**
+ * @brief Generates the count, |z|² and smoothed count grids in a single pass.
+ */
+std::tuple<Grid<std::size_t>, Grid<double>, Grid<double>> mandelbrot::create_escape_data(
+    std::size_t width,
+    std::size_t height,
+    std::size_t max_iters) const
+{
+    double scale = view_height() / height;
+    double top = view_top();
+    double left = view_left();
+
+    return generate_unzip<std::size_t, double, double>(
+        height, width,
+        [=](std::size_t row, std::size_t col, std::size_t &count, double &norm, double &smooth)
+        {
+            double y = top - (row * scale);
+            double x = left + (col * scale);
+
+            get_escape(x, y, max_iters, count, norm, smooth);
+        });
+}
@@ -7,6 +7,8 @@
 #define MANDEL_HPP
 
 #include "../spt/image.hpp"
+#include "../spt/natv_grid.hpp"
+#include <tuple>
 #include <vector>
 
 /**
@@ -41,6 +43,7 @@ public:
 
     /**
      * @brief Generates the color data for the Mandelbrot set image.
+     * @details Colors the iteration counts produced by `create_escape_data`.
      * @param width The width of the image in pixels.
      * @param height The height of the image in pixels.
      * @param max_iters The maximum number of iterations for the calculation.
@@ -51,6 +54,22 @@ public:
         std::size_t height,
         std::size_t max_iters) const;
 
+    /**
+     * @brief Generates the escape data for every pixel of the view in a single pass.
+     * @details Each point is iterated once and yields three values: the iteration count (as
+     *          used by `create_image`), the final |z|² and the continuous, smoothed iteration
+     *          count `n + 1 - log2(log|z|)` used for band-free coloring. Points which do not
+     *          escape get `max_iters` for both counts.
+     * @param width The width of the image in pixels.
+     * @param height The height of the image in pixels.
+     * @param max_iters The maximum number of iterations for the calculation.
+     * @return A tuple of the count, |z|² and smoothed count grids, each `height` rows by `width` columns.
+     */
+    std::tuple<Grid<std::size_t>, Grid<double>, Grid<double>> create_escape_data(
+        std::size_t width,
+        std::size_t height,
+        std::size_t max_iters) const;
+
     /**
      * @brief Gets the leftmost coordinate of the view.
      * @return The leftmost coordinate.
@@ -8,21 +8,383 @@
  */
 
 #include "../spt/natv_collection.hpp"
+#include "../spt/half.hpp"
+#include "../spt/natv_matrix.hpp"
+#include "../spt/fft.hpp"
+#include "../spt/vmath.hpp"
 #include "../spt/perf_common.hpp"
 #include "../spt/timer.hpp"
 
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <random>
 #include <vector>
 #include <string>
 
+/**
+ * @brief Every storage and accumulator pair understood by `--precision`.
+ * @details The accumulator is always the storage type or something wider.
+ */
+const std::vector<std::string> all_precisions = {
+	"double:double",
+	"float:float",
+	"float:double",
+	"float16:float16",
+	"float16:float",
+	"float16:double",
+	"bfloat16:bfloat16",
+	"bfloat16:float",
+	"bfloat16:double"};
+
+/**
+ * @brief Runs a single performance test with a given storage and accumulator type.
+ * @details Mirrors `run_test`, but generates the collections in the storage type `STORE`
+ *          and performs the final sum in the accumulator type `ACC`.
+ * @tparam STORE The element type of the collections.
+ * @tparam ACC The type the sum is accumulated in.
+ * @tparam FN The type of the generator function for creating collection elements.
+ * @param size The number of elements for the collections in the test.
+ * @param fn The block generator function (see `Span`), filling doubles which are rounded to `STORE`.
+ * @param precision The name of the storage and accumulator pair being tested.
+ * @return A result struct containing the performance metrics of the test.
+ */
+template <typename STORE, typename ACC, typename FN>
+result<double> run_precision_test(std::size_t size, FN fn, const std::string &precision)
+{
+	auto store_fn = [&](Span<STORE> out, std::size_t start)
+	{
+		double block[span_block];
+		fn(Span<double>(block, out.size()), start);
+		convert_n(block, out.data(), out.size());
+	};
+
+	result<double> res;
+	res.size = size;
+	res.precision = precision;
+
+	long long start = time_ns();
+	Collection<STORE> u(size, store_fn);
+	res.gen_time_1 = time_ns() - start;
+
+	start = time_ns();
+	Collection<STORE> v(size, store_fn);
+	res.gen_time_2 = time_ns() - start;
+
+	start = time_ns();
+	Collection<STORE> w = u * v;
+	res.zip_time = time_ns() - start;
+
+	start = time_ns();
+	res.value = (double)sum<STORE, ACC>(w);
+	res.reduce_time = time_ns() - start;
+
+	report(res);
+
+	return res;
+}
+
+/**
+ * @brief Runs a single performance test for a storage and accumulator pair named at run time.
+ * @tparam FN The type of the generator function for creating collection elements.
+ * @param precision The pair to test, as `<storage>:<accumulator>`.
+ * @param size The number of elements for the collections in the test.
+ * @param fn The generator function to use for creating collection elements.
+ * @return A result struct containing the performance metrics of the test.
+ */
+template <typename FN>
+result<double> run_precision(const std::string &precision, std::size_t size, FN fn)
+{
+	if (precision == "double:double")
+		return run_precision_test<double, double>(size, fn, precision);
+	if (precision == "float:float")
+		return run_precision_test<float, float>(size, fn, precision);
+	if (precision == "float:double")
+		return run_precision_test<float, double>(size, fn, precision);
+	if (precision == "float16:float16")
+		return run_precision_test<float16, float16>(size, fn, precision);
+	if (precision == "float16:float")
+		return run_precision_test<float16, float>(size, fn, precision);
+	if (precision == "float16:double")
+		return run_precision_test<float16, double>(size, fn, precision);
+	if (precision == "bfloat16:bfloat16")
+		return run_precision_test<bfloat16, bfloat16>(size, fn, precision);
+	if (precision == "bfloat16:float")
+		return run_precision_test<bfloat16, float>(size, fn, precision);
+	if (precision == "bfloat16:double")
+		return run_precision_test<bfloat16, double>(size, fn, precision);
+
+	std::cout << "Unsupported precision: " << precision << std::endl;
+	exit(1);
+}
+
+/**
+ * @brief Times a kernel, repeating it until the total time is long enough to give a stable mean.
+ * @tparam FN The type of the kernel function.
+ * @param fn The kernel to run. It is run once untimed first, to warm the caches.
+ * @return The mean time of one run, in seconds.
+ */
+template <typename FN>
+double time_kernel(FN fn)
+{
+	const long long min_time = 200000000LL;
+
+	fn();
+	std::size_t runs = 0;
+	long long start = time_ns();
+	long long elapsed = 0;
+	do
+	{
+		fn();
+		++runs;
+		elapsed = time_ns() - start;
+	} while (elapsed < min_time);
+	return elapsed * 1e-9 / runs;
+}
+
+/**
+ * @brief Benchmarks GEMM and GEMV on square matrices of one element type.
+ * @tparam T The element type.
+ * @param type_name The name of the element type, used in the kernel names.
+ * @param n The matrix dimension.
+ * @param peak The detected double precision peak in GFLOP/s. Scaled by the number of
+ *             elements of T per double for narrower types.
+ * @param results The vector to append the results to.
+ */
+template <typename T>
+void run_gemm_bench(const std::string &type_name, std::size_t n, double peak, std::vector<kernel_result> &results)
+{
+	auto fn = [](std::size_t row, std::size_t col)
+	{ return T((row * 7 + col * 13) % 17) / T(17) - T(0.5); };
+	double type_peak = peak * sizeof(double) / sizeof(T);
+
+	Matrix<T> a(n, n, fn);
+	Matrix<T> b(n, n, fn);
+	Matrix<T> c = Matrix<T>::zeros(n, n);
+	double seconds = time_kernel([&]()
+								 { gemm(T(1), a, b, T(0), c); });
+	results.push_back(kernel_result{"gemm<" + type_name + ">", n, seconds, 2.0 * n * n * n / seconds * 1e-9, type_peak});
+	report(results.back());
+
+	Collection<T> x(n, [](std::size_t idx)
+					{ return T(idx % 5) - T(2); });
+	Collection<T> y = Collection<T>::allocate(n);
+	seconds = time_kernel([&]()
+						  { gemv(T(1), a, x, T(0), y); });
+	results.push_back(kernel_result{"gemv<" + type_name + ">", n, seconds, 2.0 * n * n / seconds * 1e-9, type_peak});
+	report(results.back());
+}
+
+/**
+ * @brief Benchmarks the complex and real FFTs of one size and element type.
+ * @details Rates are reported with the conventional count of `5 n log2(n)` flops for a
+ *          complex transform of size `n`, and half that for a real one.
+ * @tparam T The element type.
+ * @param type_name The name of the element type, used in the kernel names.
+ * @param n The transform size. Rounded up to a power of two.
+ * @param peak The detected double precision peak in GFLOP/s. Scaled by the number of
+ *             elements of T per double for narrower types.
+ * @param results The vector to append the results to.
+ */
+template <typename T>
+void run_fft_bench(const std::string &type_name, std::size_t n, double peak, std::vector<kernel_result> &results)
+{
+	std::size_t size = 1;
+	while (size < n)
+		size *= 2;
+	double log2n = std::log2((double)size);
+	double type_peak = peak * sizeof(double) / sizeof(T);
+
+	ComplexCollection<T> x(size, [](std::size_t idx)
+						   { return std::complex<T>(T(idx % 13) - T(6), T(idx % 7) * T(0.5)); });
+	double seconds = time_kernel([&]()
+								 { fft(x); });
+	results.push_back(kernel_result{"fft<" + type_name + ">", size, seconds, 5.0 * size * log2n / seconds * 1e-9, type_peak});
+	report(results.back());
+
+	Collection<T> r(size, [](std::size_t idx)
+					{ return T(idx % 13) - T(6); });
+	seconds = time_kernel([&]()
+						  { rfft(r); });
+	results.push_back(kernel_result{"rfft<" + type_name + ">", size, seconds, 2.5 * size * log2n / seconds * 1e-9, type_peak});
+	report(results.back());
+}
+
+/**
+ * @brief Benchmarks the named math operations of vmath.hpp against the standard library.
+ * @details Each function is mapped over a collection once with its named operation, which
+ *          runs the vectorized bulk kernel, and once with a lambda calling the `std::`
+ *          function. The rate column holds billions of elements per second rather than
+ *          flops, since the functions differ in cost.
+ * @tparam T The element type.
+ * @param type_name The name of the element type, used in the kernel names.
+ * @param n The number of elements.
+ * @param peak The detected double precision peak in GFLOP/s. Scaled by the number of
+ *             elements of T per double for narrower types.
+ * @param results The vector to append the results to.
+ */
+template <typename T>
+void run_math_bench(const std::string &type_name, std::size_t n, double peak, std::vector<kernel_result> &results)
+{
+	double type_peak = peak * sizeof(double) / sizeof(T);
+	Collection<T> x(n, [](std::size_t idx)
+					{ return T(0.5) + T(idx % 1000) * T(0.0015); });
+	Collection<T> y(n, [](std::size_t idx)
+					{ return T(idx % 17) * T(0.25) - T(2); });
+
+	auto run = [&](const std::string &name, auto kernel)
+	{
+		double seconds = time_kernel(kernel);
+		results.push_back(kernel_result{name + "<" + type_name + ">", n, seconds, n / seconds * 1e-9, type_peak});
+		report(results.back());
+	};
+	run("math_exp", [&]()
+		{ x.template map<T>(math_exp); });
+	run("std_exp", [&]()
+		{ x.template map<T>([](T v)
+							{ return std::exp(v); }); });
+	run("math_log", [&]()
+		{ x.template map<T>(math_log); });
+	run("std_log", [&]()
+		{ x.template map<T>([](T v)
+							{ return std::log(v); }); });
+	run("math_sin", [&]()
+		{ x.template map<T>(math_sin); });
+	run("std_sin", [&]()
+		{ x.template map<T>([](T v)
+							{ return std::sin(v); }); });
+	run("math_tanh", [&]()
+		{ x.template map<T>(math_tanh); });
+	run("std_tanh", [&]()
+		{ x.template map<T>([](T v)
+							{ return std::tanh(v); }); });
+	run("math_sqrt", [&]()
+		{ x.template map<T>(math_sqrt); });
+	run("std_sqrt", [&]()
+		{ x.template map<T>([](T v)
+							{ return std::sqrt(v); }); });
+	run("math_pow", [&]()
+		{ x.template zip<T>(y, math_pow); });
+	run("std_pow", [&]()
+		{ x.template zip<T>(y, [](T a, T b)
+							{ return std::pow(a, b); }); });
+}
+
+/**
+ * @brief Benchmarks fused generate-reduce against materializing the generated collections.
+ * @details Times the map/reduce test (two random collections, their product and its sum)
+ *          and a Monte Carlo estimate of pi, once through collections and once through
+ *          `generate_reduce` and `generate_transform_reduce`, which store nothing. Both forms
+ *          of each test draw the same random values, from the same streams, so they differ
+ *          only in what they store. The rate column holds billions of elements per second.
+ * @param n The number of elements, or samples.
+ * @param peak The detected double precision peak in GFLOP/s.
+ * @param results The vector to append the results to.
+ */
+void run_fused_bench(std::size_t n, double peak, std::vector<kernel_result> &results)
+{
+	const std::uint64_t seed = 42;
+	const philox_uniform<double> dist(0.0, 1.0);
+	auto draw = [&](std::uint64_t stream, std::size_t idx)
+	{ return dist(philox4x32(stream, idx)); };
+	auto in_circle = [](const philox_block &bits)
+	{
+		double x = philox_unit_double(bits.word[0], bits.word[1]);
+		double y = philox_unit_double(bits.word[2], bits.word[3]);
+		return x * x + y * y < 1.0 ? 1.0 : 0.0;
+	};
+
+	// Every result is stored, so that the fused kernels are not optimized away.
+	volatile double sink = 0.0;
+	auto run = [&](const std::string &name, auto kernel)
+	{
+		double seconds = time_kernel(kernel);
+		results.push_back(kernel_result{name, n, seconds, n / seconds * 1e-9, peak});
+		report(results.back());
+	};
+	run("materialized_dot", [&]()
+		{
+			Collection<double> u = Collection<double>::random(n, dist, seed);
+			Collection<double> v = Collection<double>::random(n, dist, seed + 1);
+			sink = sum(u * v); });
+	run("fused_dot", [&]()
+		{ sink = generate_reduce(n, 0.0, [&](std::size_t idx)
+								 { return draw(seed, idx) * draw(seed + 1, idx); },
+								 std::plus<double>()); });
+	run("materialized_pi", [&]()
+		{
+			Collection<double> hits(n, [&](Span<double> out, std::size_t start)
+									{
+										for (std::size_t k = 0; k < out.size(); ++k)
+											out[k] = in_circle(philox4x32(seed, start + k)); });
+			sink = sum(hits); });
+	run("fused_pi", [&]()
+		{ sink = generate_transform_reduce(
+			  n, 0.0, [&](std::size_t idx)
+			  { return philox4x32(seed, idx); },
+			  in_circle, std::plus<double>()); });
+}
+
+/**
+ * @brief Runs the numeric kernel benchmarks named by `--bench` options.
+ * @param tc The parsed test case. Its sizes are passed to each benchmark.
+ * @param benches The names of the benchmarks to run.
+ */
+void run_benches(const test_case &tc, const std::vector<std::string> &benches)
+{
+	double peak = detect_peak_gflops();
+	std::cout << "Detected peak (double): " << peak << " GFLOP/s on " << thread_count() << " threads" << std::endl;
+
+	std::vector<kernel_result> results;
+	for (const auto &bench : benches)
+	{
+		if (bench == "gemm")
+		{
+			for (auto size : tc.test_cases)
+			{
+				run_gemm_bench<double>("double", size, peak, results);
+				run_gemm_bench<float>("float", size, peak, results);
+			}
+		}
+		else if (bench == "fft")
+		{
+			for (auto size : tc.test_cases)
+			{
+				run_fft_bench<double>("double", size, peak, results);
+				run_fft_bench<float>("float", size, peak, results);
+			}
+		}
+		else if (bench == "math")
+		{
+			for (auto size : tc.test_cases)
+			{
+				run_math_bench<double>("double", size, peak, results);
+				run_math_bench<float>("float", size, peak, results);
+			}
+		}
+		else if (bench == "fused")
+		{
+			for (auto size : tc.test_cases)
+				run_fused_bench(size, peak, results);
+		}
+		else
+		{
+			std::cout << "Unsupported benchmark: " << bench << std::endl;
+			exit(1);
+		}
+	}
+	write_kernel_results(tc, results);
+}
+
 /**
  * @brief Main entry point for the performance test program.
  * @details Parses command-line arguments, runs performance tests for various
  *          collection sizes, and writes the results to a file. The tests
  *          involve creating a collection of random doubles and performing
- *          map/reduce operations.
+ *          map/reduce operations. Each `--precision` option repeats the tests
+ *          with the named storage and accumulator types, and `--bench` options
+ *          run numeric kernel benchmarks instead.
  * @param argc The number of command-line arguments.
  * @param argv An array of command-line arguments.
  * @return 0 on successful execution.
@@ -31,17 +393,40 @@ int main(int argc, char **argv)
 {
 	std::vector<std::string> args(argv, argv + argc);
 	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<double> dist(0.0, 1.0);
+	const std::uint64_t seed = std::uint64_t(rd()) << 32 | rd();
+	const philox_uniform<double> dist(0.0, 1.0);
 
 	test_case tc = parse_args(args);
+	std::vector<std::string> benches = option_values(tc, "bench");
+	if (!benches.empty())
+	{
+		run_benches(tc, benches);
+		return 0;
+	}
+
 	std::vector<result<double>> results;
-	for (auto size : tc.test_cases)
-		results.push_back(
-			run_test<Collection<double>, double>(
-				size,
-				[&](std::size_t)
-				{ return dist(gen); }));
+	// Each element is drawn from its own counter, so the collections are filled in parallel.
+	auto fn = [&](Span<double> out, std::size_t start)
+	{ philox_fill(out.data(), start, out.size(), dist, seed); };
+
+	std::vector<std::string> precisions;
+	for (const auto &precision : option_values(tc, "precision"))
+		if (precision == "all")
+			precisions.insert(precisions.end(), all_precisions.begin(), all_precisions.end());
+		else
+			precisions.push_back(precision);
+
+	if (precisions.empty())
+	{
+		for (auto size : tc.test_cases)
+			results.push_back(run_test<Collection<double>, double>(size, fn));
+	}
+	else
+	{
+		for (const auto &precision : precisions)
+			for (auto size : tc.test_cases)
+				results.push_back(run_precision(precision, size, fn));
+	}
 	write_results(tc, results);
 
 	return 0;
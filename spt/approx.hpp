@@ -0,0 +1,287 @@
+/**
+ * @file approx.hpp
+ * @brief Defines sampling-based approximate sums, means and counts over a Collection, each
+ *        with a confidence interval.
+ * @details The collection is divided into `approx_strata` contiguous strata of equal size, and
+ *          every stratum is sampled the same number of times, at random positions drawn with
+ *          replacement. The total is estimated as the sum over strata of the stratum size
+ *          times the stratum's sample mean, and its variance as the sum of the squared stratum
+ *          sizes times the stratum sample variances over the sample counts. Stratifying removes
+ *          the variation between strata from the error, which matters for data that drifts
+ *          along the collection, such as time series.
+ *
+ *          Sampling proceeds in rounds, each doubling the samples per stratum, until the
+ *          half-width of the confidence interval is within the requested relative error of
+ *          the estimate, or the time budget is spent. Once the next round would read more than
+ *          `1 / approx_exact_ratio` of the collection, the exact answer is computed instead,
+ *          with an interval of zero width.
+ *
+ *          A stratum whose samples are all equal has a sample variance of zero, which says
+ *          nothing about the rare elements the samples missed. Its variance is instead bounded
+ *          by assuming that up to `-ln(1 - confidence) / n` of its elements (the rule of three
+ *          for a 95% confidence) differ from the sampled value by the whole range of values
+ *          seen in the collection. While every sample is equal there is no such range, and the
+ *          interval is infinite, so a rare heavy tail or a rare match is either sampled or
+ *          falls through to the exact answer rather than being reported as exact.
+ *
+ *          Each stratum draws its positions from its own generator seeded from the seed and
+ *          the stratum index, so a given seed gives the same estimate for any thread count.
+ */
+
+#ifndef APPROX_HPP
+#define APPROX_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+/**
+ * @brief Number of strata the collection is divided into for sampling.
+ */
+constexpr std::size_t approx_strata = 256;
+
+/**
+ * @brief Number of samples per stratum in the first round.
+ * @details Enough for each stratum's sample variance to be meaningful.
+ */
+constexpr std::size_t approx_initial_samples = 32;
+
+/**
+ * @brief The exact answer is computed once a round would sample more than
+ *        `1 / approx_exact_ratio` of the collection.
+ * @details A random read, plus drawing its position, costs some 30 times a sequential read,
+ *          so sampling more than about a thirtieth of the collection is no faster than reading
+ *          all of it.
+ */
+constexpr std::size_t approx_exact_ratio = 32;
+
+/**
+ * @struct approx_result
+ * @brief An approximate answer and its confidence interval.
+ */
+struct approx_result
+{
+	/** @brief The estimate. */
+	double value;
+
+	/**
+	 * @brief The half-width of the confidence interval around the estimate; 0 only if exact,
+	 *        and infinite if every sample was equal.
+	 */
+	double error;
+
+	/** @brief The probability that the interval holds the exact answer. */
+	double confidence;
+
+	/** @brief The number of elements read, or the collection size if the answer is exact. */
+	std::size_t samples;
+
+	/**
+	 * @brief Gets the lower end of the confidence interval.
+	 * @return `value - error`.
+	 */
+	inline double lower() const { return value - error; }
+
+	/**
+	 * @brief Gets the upper end of the confidence interval.
+	 * @return `value + error`.
+	 */
+	inline double upper() const { return value + error; }
+};
+
+/**
+ * @brief Gets the two-sided critical value of the standard normal distribution.
+ * @details Solves `erfc(z / sqrt(2)) = 1 - confidence` by bisection.
+ * @param confidence The probability the interval `[-z, z]` should hold, between 0 and 1.
+ * @return The critical value `z`; 1.96 for a confidence of 0.95.
+ */
+inline double approx_critical(double confidence)
+{
+	assert_true(confidence > 0.0 && confidence < 1.0, "approx: Confidence must be between 0 and 1");
+	double lo = 0.0;
+	double hi = 40.0;
+	for (int iter = 0; iter < 100; ++iter)
+	{
+		double mid = (lo + hi) / 2.0;
+		if (std::erfc(mid / std::sqrt(2.0)) > 1.0 - confidence)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return (lo + hi) / 2.0;
+}
+
+/**
+ * @brief Estimates the total of a function over the elements of a collection by stratified sampling.
+ * @tparam T The element type of the collection.
+ * @tparam FN The type of the function.
+ * @param c The collection.
+ * @param fn A function taking an element and returning a double.
+ * @param relative_error The wanted half-width of the interval, relative to the estimate.
+ * @param confidence The probability the interval should hold the exact total.
+ * @param time_budget The time in seconds after which no further round is started, or 0 for no limit.
+ * @param seed The seed of the sample positions.
+ * @return The estimated total.
+ */
+template <typename T, typename FN>
+approx_result approx_total(const Collection<T> &c, FN fn, double relative_error, double confidence,
+						   double time_budget, std::uint64_t seed)
+{
+	assert_true(relative_error >= 0.0, "approx: Relative error must not be negative");
+	double z = approx_critical(confidence);
+	auto start = std::chrono::steady_clock::now();
+	std::size_t size = c.size();
+	const T *src = c.data();
+
+	struct alignas(parallel_align) stratum
+	{
+		std::mt19937_64 engine;
+		std::size_t begin;
+		std::size_t end;
+		std::size_t count;
+		double mean;
+		double m2;
+		double lo;
+		double hi;
+	};
+	std::size_t strata = std::min(approx_strata, size);
+	std::vector<stratum> parts(strata);
+	for (std::size_t h = 0; h < strata; ++h)
+	{
+		std::seed_seq seq{std::uint32_t(seed), std::uint32_t(seed >> 32), std::uint32_t(h)};
+		parts[h] = stratum{std::mt19937_64(seq), size * h / strata, size * (h + 1) / strata, 0, 0.0, 0.0,
+						   std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity()};
+	}
+
+	double unseen = -std::log(1.0 - confidence);
+	std::size_t sampled = 0;
+	std::size_t batch = approx_initial_samples;
+	while (strata > 0 && strata * (sampled + batch) * approx_exact_ratio <= size)
+	{
+		// Welford's update keeps each stratum's mean and sum of squared deviations.
+		parallel_tasks(strata, [&](std::size_t h)
+					   {
+						   stratum &part = parts[h];
+						   std::uniform_int_distribution<std::size_t> pick(part.begin, part.end - 1);
+						   for (std::size_t k = 0; k < batch; ++k)
+						   {
+							   double x = double(fn(src[pick(part.engine)]));
+							   ++part.count;
+							   double delta = x - part.mean;
+							   part.mean += delta / double(part.count);
+							   part.m2 += delta * (x - part.mean);
+							   part.lo = std::min(part.lo, x);
+							   part.hi = std::max(part.hi, x);
+						   } });
+		sampled += batch;
+		batch = sampled;
+
+		double lo = std::numeric_limits<double>::infinity();
+		double hi = -std::numeric_limits<double>::infinity();
+		for (const stratum &part : parts)
+		{
+			lo = std::min(lo, part.lo);
+			hi = std::max(hi, part.hi);
+		}
+		double range = hi - lo;
+		double total = 0.0;
+		double variance = 0.0;
+		for (const stratum &part : parts)
+		{
+			double weight = double(part.end - part.begin);
+			double count = double(part.count);
+			double spread = part.lo < part.hi ? part.m2 / (count - 1.0) : unseen / count * range * range;
+			total += weight * part.mean;
+			variance += weight * weight * spread / count;
+		}
+		double error = range > 0.0 ? z * std::sqrt(variance) : std::numeric_limits<double>::infinity();
+		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (error <= relative_error * std::abs(total) || (time_budget > 0.0 && elapsed >= time_budget))
+			return approx_result{total, error, confidence, strata * sampled};
+	}
+
+	double exact = parallel_reduce(
+		size, 0.0, [&](std::size_t begin, std::size_t end)
+		{
+			double acc = 0.0;
+			for (std::size_t idx = begin; idx < end; ++idx)
+				acc += double(fn(src[idx]));
+			return acc; },
+		[](double a, double b)
+		{ return a + b; });
+	return approx_result{exact, 0.0, confidence, size};
+}
+
+/**
+ * @brief Estimates the sum of a collection by stratified sampling.
+ * @tparam T The element type of the collection.
+ * @param c The collection.
+ * @param relative_error The wanted half-width of the interval, relative to the estimate.
+ * @param confidence The probability the interval should hold the exact sum.
+ * @param time_budget The time in seconds after which no further round is started, or 0 for no limit.
+ * @param seed The seed of the sample positions.
+ * @return The estimated sum.
+ */
+template <typename T>
+approx_result approx_sum(const Collection<T> &c, double relative_error = 0.001, double confidence = 0.95,
+						 double time_budget = 0.0, std::uint64_t seed = 0)
+{
+	return approx_total(
+		c, [](const T &value)
+		{ return double(value); },
+		relative_error, confidence, time_budget, seed);
+}
+
+/**
+ * @brief Estimates the mean of a collection by stratified sampling.
+ * @tparam T The element type of the collection.
+ * @param c The collection. Must not be empty.
+ * @param relative_error The wanted half-width of the interval, relative to the estimate.
+ * @param confidence The probability the interval should hold the exact mean.
+ * @param time_budget The time in seconds after which no further round is started, or 0 for no limit.
+ * @param seed The seed of the sample positions.
+ * @return The estimated mean.
+ */
+template <typename T>
+approx_result approx_mean(const Collection<T> &c, double relative_error = 0.001, double confidence = 0.95,
+						  double time_budget = 0.0, std::uint64_t seed = 0)
+{
+	assert_true(c.size() > 0, "approx_mean: Collection must not be empty");
+	approx_result res = approx_sum(c, relative_error, confidence, time_budget, seed);
+	res.value /= double(c.size());
+	res.error /= double(c.size());
+	return res;
+}
+
+/**
+ * @brief Estimates the number of elements of a collection satisfying a predicate by stratified sampling.
+ * @tparam T The element type of the collection.
+ * @tparam PRED The type of the predicate.
+ * @param c The collection.
+ * @param pred A function taking an element and returning whether it counts.
+ * @param relative_error The wanted half-width of the interval, relative to the estimate.
+ * @param confidence The probability the interval should hold the exact count.
+ * @param time_budget The time in seconds after which no further round is started, or 0 for no limit.
+ * @param seed The seed of the sample positions.
+ * @return The estimated count.
+ */
+template <typename T, typename PRED>
+approx_result approx_count_if(const Collection<T> &c, PRED pred, double relative_error = 0.001,
+							  double confidence = 0.95, double time_budget = 0.0, std::uint64_t seed = 0)
+{
+	return approx_total(
+		c, [&pred](const T &value)
+		{ return pred(value) ? 1.0 : 0.0; },
+		relative_error, confidence, time_budget, seed);
+}
+
+#endif // APPROX_HPP
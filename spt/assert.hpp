@@ -69,4 +69,30 @@ void assert_equal(const T &actual, const T &expected, std::string msg)
     }
 }
 
+/**
+ * @brief Asserts that two values differ by no more than a tolerance.
+ * @details If the values are further apart than `tolerance`, it throws an `assertion_error`
+ *          that includes the custom message as well as the actual and expected values.
+ *          Intended for floating point results whose rounding depends on evaluation order.
+ * @tparam T The type of the values to compare. Must support subtraction, `operator<` and `operator<<`.
+ * @param actual The value produced by the code under test.
+ * @param expected The value that was expected.
+ * @param tolerance The largest permitted absolute difference.
+ * @param msg A message to include in the `assertion_error` if the values are too far apart.
+ */
+template <typename T>
+void assert_near(const T &actual, const T &expected, const T &tolerance, std::string msg)
+{
+    T diff = actual < expected ? expected - actual : actual - expected;
+    if (!(diff <= tolerance))
+    {
+        std::stringstream ss;
+        ss.precision(17);
+        ss << "Tolerance test failed: " << msg << "\n"
+           << "expected=" << expected << ": " << "actual=" << actual << ": " << "tolerance=" << tolerance;
+
+        throw assertion_error(ss.str());
+    }
+}
+
 #endif // ASSERT_HPP
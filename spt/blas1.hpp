@@ -0,0 +1,794 @@
+/**
+ * @file blas1.hpp
+ * @brief Defines BLAS level-1 style kernels on Collection: axpy, axpby, scal, asum, nrm2,
+ *        iamax, rot, rotg and fused multiply-add.
+ * @details Every routine reads (and, for the in-place routines, writes) each element exactly
+ *          once, so none of them needs a temporary collection or a second pass over memory.
+ *          All of them split their input across threads with `parallel_for` or
+ *          `parallel_reduce`.
+ *
+ *          The streaming kernels (axpy, scal, rot, ...) are plain loops over raw arrays which
+ *          the compiler vectorizes. The reductions cannot be vectorized by the compiler
+ *          without reassociating floating point sums, so for `float` and `double` they use
+ *          AVX-512 or AVX2 intrinsics with several accumulators when the compiler targets
+ *          those instruction sets (for example with the `MAP_REDUCE_NATIVE_ARCH` CMake
+ *          option), and otherwise a portable kernel with `widening_lanes` accumulators.
+ *
+ *          Results follow the reference BLAS: `iamax` returns the first index of the largest
+ *          magnitude (0-based, or the index of the first NaN if there is one) and `rotg`
+ *          constructs the same rotation as the reference `drotg`.
+ */
+
+#ifndef BLAS1_HPP
+#define BLAS1_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief The type of the scalar operands of the BLAS kernels on `Collection<T>`.
+ * @details Always `T`, but written so that the scalar does not take part in template argument
+ *          deduction: `axpy(2.0, xs, ys)` works for float collections too.
+ * @tparam T The element type of the collections.
+ */
+template <typename T>
+using blas_scalar_t = typename std::common_type<T>::type;
+
+/**
+ * @brief Number of elements handled at a time by the blocked reductions (`nrm2`, `iamax`).
+ * @details Small enough for a block to stay in L1 cache between the two sweeps made over it,
+ *          so each element is still read from memory only once.
+ */
+constexpr std::size_t blas_block = 256;
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+/**
+ * @brief Adds together the four lanes of an AVX register of doubles.
+ * @param v The register.
+ * @return The sum of the lanes.
+ */
+inline double blas_hsum(__m256d v)
+{
+	__m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+/**
+ * @brief Adds together the eight lanes of an AVX register of floats.
+ * @param v The register.
+ * @return The sum of the lanes.
+ */
+inline float blas_hsum(__m256 v)
+{
+	__m128 quad = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	quad = _mm_add_ps(quad, _mm_movehl_ps(quad, quad));
+	return _mm_cvtss_f32(_mm_add_ss(quad, _mm_shuffle_ps(quad, quad, 1)));
+}
+
+/**
+ * @brief Gets the largest of the four lanes of an AVX register of doubles.
+ * @param v The register.
+ * @return The largest lane.
+ */
+inline double blas_hmax(__m256d v)
+{
+	__m128d pair = _mm_max_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+	return _mm_cvtsd_f64(_mm_max_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+
+/**
+ * @brief Gets the largest of the eight lanes of an AVX register of floats.
+ * @param v The register.
+ * @return The largest lane.
+ */
+inline float blas_hmax(__m256 v)
+{
+	__m128 quad = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+	quad = _mm_max_ps(quad, _mm_movehl_ps(quad, quad));
+	return _mm_cvtss_f32(_mm_max_ss(quad, _mm_shuffle_ps(quad, quad, 1)));
+}
+#endif
+
+#if defined(__AVX512F__)
+// The reductions below use the zero-masked forms of the AVX-512 intrinsics: the unmasked
+// forms start from _mm512_undefined_*, which GCC 12 reports as maybe-uninitialized.
+
+/**
+ * @brief Adds together the eight lanes of an AVX-512 register of doubles.
+ * @param v The register.
+ * @return The sum of the lanes.
+ */
+inline double blas_hsum(__m512d v)
+{
+	return blas_hsum(_mm256_add_pd(_mm512_maskz_extractf64x4_pd((__mmask8)0xff, v, 0), _mm512_maskz_extractf64x4_pd((__mmask8)0xff, v, 1)));
+}
+
+/**
+ * @brief Adds together the sixteen lanes of an AVX-512 register of floats.
+ * @param v The register.
+ * @return The sum of the lanes.
+ */
+inline float blas_hsum(__m512 v)
+{
+	__m512d halves = _mm512_castps_pd(v);
+	__m256 high = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xff, halves, 1));
+	return blas_hsum(_mm256_add_ps(_mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xff, halves, 0)), high));
+}
+
+/**
+ * @brief Gets the largest of the eight lanes of an AVX-512 register of doubles.
+ * @param v The register.
+ * @return The largest lane.
+ */
+inline double blas_hmax(__m512d v)
+{
+	return blas_hmax(_mm256_max_pd(_mm512_maskz_extractf64x4_pd((__mmask8)0xff, v, 0), _mm512_maskz_extractf64x4_pd((__mmask8)0xff, v, 1)));
+}
+
+/**
+ * @brief Gets the largest of the sixteen lanes of an AVX-512 register of floats.
+ * @param v The register.
+ * @return The largest lane.
+ */
+inline float blas_hmax(__m512 v)
+{
+	__m512d halves = _mm512_castps_pd(v);
+	__m256 high = _mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xff, halves, 1));
+	return blas_hmax(_mm256_max_ps(_mm256_castpd_ps(_mm512_maskz_extractf64x4_pd((__mmask8)0xff, halves, 0)), high));
+}
+#endif
+
+/**
+ * @brief Sums the magnitudes of an array of values.
+ * @tparam T The element type.
+ * @param x The values.
+ * @param size The number of values.
+ * @return The sum of `|x[i]|`.
+ */
+template <typename T>
+T blas_sum_abs(const T *x, std::size_t size)
+{
+	T lanes[widening_lanes] = {};
+	std::size_t idx = 0;
+	for (; idx + widening_lanes <= size; idx += widening_lanes)
+		for (std::size_t lane = 0; lane < widening_lanes; ++lane)
+			lanes[lane] += std::abs(x[idx + lane]);
+	for (; idx < size; ++idx)
+		lanes[0] += std::abs(x[idx]);
+	return combine_lanes(lanes);
+}
+
+/**
+ * @brief Sums the magnitudes of an array of doubles.
+ * @param x The values.
+ * @param size The number of values.
+ * @return The sum of `|x[i]|`.
+ */
+inline double blas_sum_abs(const double *x, std::size_t size)
+{
+	double res = 0.0;
+	std::size_t idx = 0;
+#if defined(__AVX512F__)
+	__m512d acc0 = _mm512_setzero_pd();
+	__m512d acc1 = _mm512_setzero_pd();
+	for (; idx + 16 <= size; idx += 16)
+	{
+		acc0 = _mm512_add_pd(acc0, _mm512_abs_pd(_mm512_loadu_pd(x + idx)));
+		acc1 = _mm512_add_pd(acc1, _mm512_abs_pd(_mm512_loadu_pd(x + idx + 8)));
+	}
+	res = blas_hsum(_mm512_add_pd(acc0, acc1));
+#elif defined(__AVX2__)
+	const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	for (; idx + 8 <= size; idx += 8)
+	{
+		acc0 = _mm256_add_pd(acc0, _mm256_and_pd(mask, _mm256_loadu_pd(x + idx)));
+		acc1 = _mm256_add_pd(acc1, _mm256_and_pd(mask, _mm256_loadu_pd(x + idx + 4)));
+	}
+	res = blas_hsum(_mm256_add_pd(acc0, acc1));
+#endif
+	return res + blas_sum_abs<double>(x + idx, size - idx);
+}
+
+/**
+ * @brief Sums the magnitudes of an array of floats.
+ * @param x The values.
+ * @param size The number of values.
+ * @return The sum of `|x[i]|`.
+ */
+inline float blas_sum_abs(const float *x, std::size_t size)
+{
+	float res = 0.0f;
+	std::size_t idx = 0;
+#if defined(__AVX512F__)
+	__m512 acc0 = _mm512_setzero_ps();
+	__m512 acc1 = _mm512_setzero_ps();
+	for (; idx + 32 <= size; idx += 32)
+	{
+		acc0 = _mm512_add_ps(acc0, _mm512_abs_ps(_mm512_loadu_ps(x + idx)));
+		acc1 = _mm512_add_ps(acc1, _mm512_abs_ps(_mm512_loadu_ps(x + idx + 16)));
+	}
+	res = blas_hsum(_mm512_add_ps(acc0, acc1));
+#elif defined(__AVX2__)
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	for (; idx + 16 <= size; idx += 16)
+	{
+		acc0 = _mm256_add_ps(acc0, _mm256_and_ps(mask, _mm256_loadu_ps(x + idx)));
+		acc1 = _mm256_add_ps(acc1, _mm256_and_ps(mask, _mm256_loadu_ps(x + idx + 8)));
+	}
+	res = blas_hsum(_mm256_add_ps(acc0, acc1));
+#endif
+	return res + blas_sum_abs<float>(x + idx, size - idx);
+}
+
+/**
+ * @brief Gets the largest magnitude in an array of values, ignoring NaNs.
+ * @tparam T The element type.
+ * @param x The values.
+ * @param size The number of values.
+ * @return The largest `|x[i]|`, or 0 for an empty array.
+ */
+template <typename T>
+T blas_max_abs(const T *x, std::size_t size)
+{
+	T lanes[widening_lanes] = {};
+	std::size_t idx = 0;
+	for (; idx + widening_lanes <= size; idx += widening_lanes)
+		for (std::size_t lane = 0; lane < widening_lanes; ++lane)
+		{
+			T value = std::abs(x[idx + lane]);
+			lanes[lane] = value > lanes[lane] ? value : lanes[lane];
+		}
+	for (; idx < size; ++idx)
+	{
+		T value = std::abs(x[idx]);
+		lanes[0] = value > lanes[0] ? value : lanes[0];
+	}
+	T res = lanes[0];
+	for (std::size_t lane = 1; lane < widening_lanes; ++lane)
+		res = lanes[lane] > res ? lanes[lane] : res;
+	return res;
+}
+
+/**
+ * @brief Gets the largest magnitude in an array of doubles, ignoring NaNs.
+ * @param x The values.
+ * @param size The number of values.
+ * @return The largest `|x[i]|`, or 0 for an empty array.
+ */
+inline double blas_max_abs(const double *x, std::size_t size)
+{
+	double res = 0.0;
+	std::size_t idx = 0;
+	// max(value, acc) returns acc when value is NaN, so NaNs never replace the running maximum.
+#if defined(__AVX512F__)
+	__m512d acc = _mm512_setzero_pd();
+	for (; idx + 8 <= size; idx += 8)
+		acc = _mm512_maskz_max_pd((__mmask8)0xff, _mm512_abs_pd(_mm512_loadu_pd(x + idx)), acc);
+	res = blas_hmax(acc);
+#elif defined(__AVX2__)
+	const __m256d mask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+	__m256d acc = _mm256_setzero_pd();
+	for (; idx + 4 <= size; idx += 4)
+		acc = _mm256_max_pd(_mm256_and_pd(mask, _mm256_loadu_pd(x + idx)), acc);
+	res = blas_hmax(acc);
+#endif
+	return std::max(res, blas_max_abs<double>(x + idx, size - idx));
+}
+
+/**
+ * @brief Gets the largest magnitude in an array of floats, ignoring NaNs.
+ * @param x The values.
+ * @param size The number of values.
+ * @return The largest `|x[i]|`, or 0 for an empty array.
+ */
+inline float blas_max_abs(const float *x, std::size_t size)
+{
+	float res = 0.0f;
+	std::size_t idx = 0;
+#if defined(__AVX512F__)
+	__m512 acc = _mm512_setzero_ps();
+	for (; idx + 16 <= size; idx += 16)
+		acc = _mm512_maskz_max_ps((__mmask16)0xffff, _mm512_abs_ps(_mm512_loadu_ps(x + idx)), acc);
+	res = blas_hmax(acc);
+#elif defined(__AVX2__)
+	const __m256 mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 acc = _mm256_setzero_ps();
+	for (; idx + 8 <= size; idx += 8)
+		acc = _mm256_max_ps(_mm256_and_ps(mask, _mm256_loadu_ps(x + idx)), acc);
+	res = blas_hmax(acc);
+#endif
+	return std::max(res, blas_max_abs<float>(x + idx, size - idx));
+}
+
+/**
+ * @brief Sums the squares of an array of values after multiplying them by a scale factor.
+ * @tparam T The element type.
+ * @param x The values.
+ * @param size The number of values.
+ * @param factor The factor each value is multiplied by before squaring.
+ * @return The sum of `(x[i] * factor)²`.
+ */
+template <typename T>
+T blas_sum_sq(const T *x, std::size_t size, T factor)
+{
+	T lanes[widening_lanes] = {};
+	std::size_t idx = 0;
+	for (; idx + widening_lanes <= size; idx += widening_lanes)
+		for (std::size_t lane = 0; lane < widening_lanes; ++lane)
+		{
+			T value = x[idx + lane] * factor;
+			lanes[lane] += value * value;
+		}
+	for (; idx < size; ++idx)
+	{
+		T value = x[idx] * factor;
+		lanes[0] += value * value;
+	}
+	return combine_lanes(lanes);
+}
+
+/**
+ * @brief Sums the squares of an array of doubles after multiplying them by a scale factor.
+ * @param x The values.
+ * @param size The number of values.
+ * @param factor The factor each value is multiplied by before squaring.
+ * @return The sum of `(x[i] * factor)²`.
+ */
+inline double blas_sum_sq(const double *x, std::size_t size, double factor)
+{
+	double res = 0.0;
+	std::size_t idx = 0;
+#if defined(__AVX512F__)
+	const __m512d scale = _mm512_set1_pd(factor);
+	__m512d acc0 = _mm512_setzero_pd();
+	__m512d acc1 = _mm512_setzero_pd();
+	for (; idx + 16 <= size; idx += 16)
+	{
+		__m512d v0 = _mm512_mul_pd(_mm512_loadu_pd(x + idx), scale);
+		__m512d v1 = _mm512_mul_pd(_mm512_loadu_pd(x + idx + 8), scale);
+		acc0 = _mm512_fmadd_pd(v0, v0, acc0);
+		acc1 = _mm512_fmadd_pd(v1, v1, acc1);
+	}
+	res = blas_hsum(_mm512_add_pd(acc0, acc1));
+#elif defined(__AVX2__)
+	const __m256d scale = _mm256_set1_pd(factor);
+	__m256d acc0 = _mm256_setzero_pd();
+	__m256d acc1 = _mm256_setzero_pd();
+	for (; idx + 8 <= size; idx += 8)
+	{
+		__m256d v0 = _mm256_mul_pd(_mm256_loadu_pd(x + idx), scale);
+		__m256d v1 = _mm256_mul_pd(_mm256_loadu_pd(x + idx + 4), scale);
+		acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(v0, v0));
+		acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(v1, v1));
+	}
+	res = blas_hsum(_mm256_add_pd(acc0, acc1));
+#endif
+	return res + blas_sum_sq<double>(x + idx, size - idx, factor);
+}
+
+/**
+ * @brief Sums the squares of an array of floats after multiplying them by a scale factor.
+ * @param x The values.
+ * @param size The number of values.
+ * @param factor The factor each value is multiplied by before squaring.
+ * @return The sum of `(x[i] * factor)²`.
+ */
+inline float blas_sum_sq(const float *x, std::size_t size, float factor)
+{
+	float res = 0.0f;
+	std::size_t idx = 0;
+#if defined(__AVX512F__)
+	const __m512 scale = _mm512_set1_ps(factor);
+	__m512 acc0 = _mm512_setzero_ps();
+	__m512 acc1 = _mm512_setzero_ps();
+	for (; idx + 32 <= size; idx += 32)
+	{
+		__m512 v0 = _mm512_mul_ps(_mm512_loadu_ps(x + idx), scale);
+		__m512 v1 = _mm512_mul_ps(_mm512_loadu_ps(x + idx + 16), scale);
+		acc0 = _mm512_fmadd_ps(v0, v0, acc0);
+		acc1 = _mm512_fmadd_ps(v1, v1, acc1);
+	}
+	res = blas_hsum(_mm512_add_ps(acc0, acc1));
+#elif defined(__AVX2__)
+	const __m256 scale = _mm256_set1_ps(factor);
+	__m256 acc0 = _mm256_setzero_ps();
+	__m256 acc1 = _mm256_setzero_ps();
+	for (; idx + 16 <= size; idx += 16)
+	{
+		__m256 v0 = _mm256_mul_ps(_mm256_loadu_ps(x + idx), scale);
+		__m256 v1 = _mm256_mul_ps(_mm256_loadu_ps(x + idx + 8), scale);
+		acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(v0, v0));
+		acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(v1, v1));
+	}
+	res = blas_hsum(_mm256_add_ps(acc0, acc1));
+#endif
+	return res + blas_sum_sq<float>(x + idx, size - idx, factor);
+}
+
+/**
+ * @brief Computes `y = a * x + y` in place.
+ * @tparam T The element type of the collections.
+ * @param a The scalar multiplier.
+ * @param x The collection to scale and add.
+ * @param y The collection to add to. Must have the same size as `x`.
+ */
+template <typename T>
+void axpy(blas_scalar_t<T> a, const Collection<T> &x, Collection<T> &y)
+{
+	assert_equal(x.size(), y.size(), "axpy: Collections differ in size");
+	const T *xs = x.data();
+	T *ys = y.data();
+	parallel_for(y.size(), [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t idx = begin; idx < end; ++idx)
+						 ys[idx] = a * xs[idx] + ys[idx]; });
+}
+
+/**
+ * @brief Computes `y = a * x + b * y` in place.
+ * @tparam T The element type of the collections.
+ * @param a The multiplier of `x`.
+ * @param x The first collection.
+ * @param b The multiplier of `y`.
+ * @param y The second collection, which receives the result. Must have the same size as `x`.
+ */
+template <typename T>
+void axpby(blas_scalar_t<T> a, const Collection<T> &x, blas_scalar_t<T> b, Collection<T> &y)
+{
+	assert_equal(x.size(), y.size(), "axpby: Collections differ in size");
+	const T *xs = x.data();
+	T *ys = y.data();
+	parallel_for(y.size(), [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t idx = begin; idx < end; ++idx)
+						 ys[idx] = a * xs[idx] + b * ys[idx]; });
+}
+
+/**
+ * @brief Computes `x = a * x` in place.
+ * @tparam T The element type of the collection.
+ * @param a The scalar multiplier.
+ * @param x The collection to scale.
+ */
+template <typename T>
+void scal(blas_scalar_t<T> a, Collection<T> &x)
+{
+	T *xs = x.data();
+	parallel_for(x.size(), [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t idx = begin; idx < end; ++idx)
+						 xs[idx] = a * xs[idx]; });
+}
+
+/**
+ * @brief Creates the element-wise fused multiply-add `x * y + z` in a single pass.
+ * @details Compiled to hardware FMA instructions where the target has them.
+ * @tparam T The element type of the collections.
+ * @param x The first factor.
+ * @param y The second factor.
+ * @param z The addend.
+ * @return A new collection with as many elements as the shortest input.
+ */
+template <typename T>
+Collection<T> fmadd(const Collection<T> &x, const Collection<T> &y, const Collection<T> &z)
+{
+	return zip([](T xi, T yi, T zi)
+			   { return xi * yi + zi; },
+			   x, y, z);
+}
+
+/**
+ * @brief Creates the fused multiply-add `a * x + y` of a scalar and two collections in a single pass.
+ * @details The out-of-place form of `axpy`.
+ * @tparam T The element type of the collections.
+ * @param a The scalar multiplier.
+ * @param x The collection to scale.
+ * @param y The addend.
+ * @return A new collection with as many elements as the shorter input.
+ */
+template <typename T>
+Collection<T> fmadd(blas_scalar_t<T> a, const Collection<T> &x, const Collection<T> &y)
+{
+	return zip([a](T xi, T yi)
+			   { return a * xi + yi; },
+			   x, y);
+}
+
+/**
+ * @brief Calculates the sum of the magnitudes of the elements (the 1-norm).
+ * @tparam T The element type of the collection.
+ * @param x The collection.
+ * @return The sum of `|x[i]|`.
+ */
+template <typename T>
+T asum(const Collection<T> &x)
+{
+	const T *xs = x.data();
+	return parallel_reduce(
+		x.size(), T(0), [&](std::size_t begin, std::size_t end)
+		{ return blas_sum_abs(xs + begin, end - begin); },
+		std::plus<T>());
+}
+
+/**
+ * @brief A partial Euclidean norm, kept as `scale * sqrt(ssq)` so it cannot overflow or underflow.
+ * @tparam T The element type.
+ */
+template <typename T>
+struct blas_norm
+{
+	/** @brief The largest magnitude seen so far, or 0. */
+	T scale;
+
+	/** @brief The sum of the squares of the elements divided by `scale²`. */
+	T ssq;
+};
+
+/**
+ * @brief Combines two partial Euclidean norms.
+ * @tparam T The element type.
+ * @param a The first partial norm.
+ * @param b The second partial norm.
+ * @return The partial norm of both sets of elements, rescaled to the larger scale.
+ */
+template <typename T>
+blas_norm<T> blas_norm_combine(blas_norm<T> a, blas_norm<T> b)
+{
+	if (a.scale < b.scale)
+		std::swap(a, b);
+	if (b.scale == T(0))
+		return a;
+	T ratio = b.scale / a.scale;
+	return blas_norm<T>{a.scale, a.ssq + b.ssq * ratio * ratio};
+}
+
+/**
+ * @brief Calculates the partial Euclidean norm of an array.
+ * @details Each block of `blas_block` elements is swept twice while it is in L1 cache: once
+ *          for its largest magnitude and once for its sum of squares scaled by a power of two
+ *          near that magnitude, so the scaling is exact and the squares can neither overflow
+ *          nor underflow. The scale is the power of two at or below the largest magnitude,
+ *          rather than the one above it, which for values in the top binade would be
+ *          infinite.
+ * @tparam T The element type.
+ * @param x The values.
+ * @param size The number of values.
+ * @return The partial norm of the values. Its scale is NaN if any value is NaN, and
+ *         otherwise infinite if any value is infinite.
+ */
+template <typename T>
+blas_norm<T> blas_nrm2_range(const T *x, std::size_t size)
+{
+	blas_norm<T> res{T(0), T(0)};
+	T special = T(0);
+	for (std::size_t first = 0; first < size; first += blas_block)
+	{
+		std::size_t count = std::min(blas_block, size - first);
+		T block_max = blas_max_abs(x + first, count);
+		if (!(block_max > T(0)) || std::isinf(block_max))
+		{
+			// All zeros or NaNs, or an infinity: the plain sum of magnitudes tells which.
+			T block_sum = blas_sum_abs(x + first, count);
+			if (std::isnan(block_sum))
+				return blas_norm<T>{block_sum, T(1)};
+			if (std::isinf(block_sum))
+				special = block_sum;
+			continue;
+		}
+
+		int exponent;
+		std::frexp(block_max, &exponent);
+		T scale = std::ldexp(T(1), exponent - 1);
+		T factor = std::ldexp(T(1), 1 - exponent);
+		T ssq;
+		if (std::isfinite(factor))
+			ssq = blas_sum_sq(x + first, count, factor);
+		else
+		{
+			// The block holds only subnormals, whose power-of-two scale has no finite reciprocal.
+			ssq = T(0);
+			for (std::size_t idx = 0; idx < count; ++idx)
+			{
+				T value = x[first + idx] / scale;
+				ssq += value * value;
+			}
+		}
+		if (std::isnan(ssq))
+			return blas_norm<T>{ssq, T(1)};
+		res = blas_norm_combine(res, blas_norm<T>{scale, ssq});
+	}
+	if (special != T(0))
+		return blas_norm<T>{special, T(1)};
+	return res;
+}
+
+/**
+ * @brief Calculates the Euclidean norm (2-norm) of a collection without overflow or underflow.
+ * @details Squaring the elements directly overflows once any element exceeds the square root of
+ *          the largest representable value, and underflows to zero for tiny elements. The sum
+ *          of squares is instead accumulated relative to a running scale, as in the reference
+ *          BLAS, in a single pass over the collection.
+ * @tparam T The element type of the collection.
+ * @param x The collection.
+ * @return The square root of the sum of the squares of the elements. NaN if any element is
+ *         NaN, and otherwise infinite if any element is infinite.
+ */
+template <typename T>
+T nrm2(const Collection<T> &x)
+{
+	const T *xs = x.data();
+	blas_norm<T> norm = parallel_reduce(
+		x.size(), blas_norm<T>{T(0), T(0)}, [&](std::size_t begin, std::size_t end)
+		{ return blas_nrm2_range(xs + begin, end - begin); },
+		[](blas_norm<T> a, blas_norm<T> b)
+		{
+			if (std::isnan(a.scale) || std::isnan(b.scale))
+				return blas_norm<T>{std::numeric_limits<T>::quiet_NaN(), T(1)};
+			if (std::isinf(a.scale) || std::isinf(b.scale))
+				return blas_norm<T>{std::numeric_limits<T>::infinity(), T(1)};
+			return blas_norm_combine(a, b); });
+	return norm.scale * std::sqrt(norm.ssq);
+}
+
+/**
+ * @brief Picks the better of two candidates for `iamax`.
+ * @details A NaN beats any number, and otherwise the larger magnitude wins; between NaNs or
+ *          equal magnitudes the lower index wins. The partial results of the chunks are
+ *          combined with this, so the result does not depend on how the collection is split.
+ * @tparam T The element type.
+ * @param a The first candidate, as a magnitude (NaN for a NaN element) and an index.
+ * @param b The second candidate.
+ * @return The better candidate.
+ */
+template <typename T>
+std::pair<T, std::size_t> blas_iamax_combine(const std::pair<T, std::size_t> &a, const std::pair<T, std::size_t> &b)
+{
+	bool a_nan = std::isnan(a.first);
+	if (a_nan != std::isnan(b.first))
+		return a_nan ? a : b;
+	if (b.first > a.first || (!(a.first > b.first) && b.second < a.second))
+		return b;
+	return a;
+}
+
+/**
+ * @brief Finds the first NaN, or else the first element of largest magnitude, in an array.
+ * @details Each block's largest magnitude is found with the vectorized `blas_max_abs`, and
+ *          only a block which beats the best so far is searched for the position. Each block
+ *          is also checked for NaNs with a branch-free test, and the scan stops at the first.
+ * @tparam T The element type.
+ * @param x The values.
+ * @param first The index of `x[0]` within the collection.
+ * @param size The number of values.
+ * @return The first NaN and its index if there is one, and otherwise the largest magnitude and
+ *         its first index, or `(-1, first + size)` if there are no values.
+ */
+template <typename T>
+std::pair<T, std::size_t> blas_iamax_range(const T *x, std::size_t first, std::size_t size)
+{
+	std::pair<T, std::size_t> best(T(-1), first + size);
+	for (std::size_t block = 0; block < size; block += blas_block)
+	{
+		std::size_t count = std::min(blas_block, size - block);
+		bool nan = false;
+		for (std::size_t idx = 0; idx < count; ++idx)
+			nan |= x[block + idx] != x[block + idx];
+		if (nan)
+			for (std::size_t idx = 0;; ++idx)
+				if (std::isnan(x[block + idx]))
+					return std::make_pair(x[block + idx], first + block + idx);
+		T block_max = blas_max_abs(x + block, count);
+		if (block_max > best.first)
+		{
+			for (std::size_t idx = 0; idx < count; ++idx)
+				if (std::abs(x[block + idx]) == block_max)
+				{
+					best = std::make_pair(block_max, first + block + idx);
+					break;
+				}
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief Finds the index of the first element of largest magnitude.
+ * @tparam T The element type of the collection.
+ * @param x The collection. Must not be empty.
+ * @return The 0-based index of the first element with the largest `|x[i]|`, or of the first
+ *         NaN if there is any.
+ */
+template <typename T>
+std::size_t iamax(const Collection<T> &x)
+{
+	assert_true(x.size() > 0, "iamax: Collection is empty");
+	const T *xs = x.data();
+	std::pair<T, std::size_t> best = parallel_reduce(
+		x.size(), std::make_pair(T(-1), x.size()), [&](std::size_t begin, std::size_t end)
+		{ return blas_iamax_range(xs + begin, begin, end - begin); },
+		blas_iamax_combine<T>);
+	return best.second;
+}
+
+/**
+ * @brief Applies a plane (Givens) rotation to two collections in place.
+ * @details Computes `x' = c * x + s * y` and `y' = c * y - s * x` for every pair of elements.
+ * @tparam T The element type of the collections.
+ * @param x The first collection.
+ * @param y The second collection. Must have the same size as `x`.
+ * @param c The cosine of the rotation.
+ * @param s The sine of the rotation.
+ */
+template <typename T>
+void rot(Collection<T> &x, Collection<T> &y, blas_scalar_t<T> c, blas_scalar_t<T> s)
+{
+	assert_equal(x.size(), y.size(), "rot: Collections differ in size");
+	T *xs = x.data();
+	T *ys = y.data();
+	parallel_for(x.size(), [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t idx = begin; idx < end; ++idx)
+					 {
+						 T xi = xs[idx];
+						 T yi = ys[idx];
+						 xs[idx] = c * xi + s * yi;
+						 ys[idx] = c * yi - s * xi;
+					 } });
+}
+
+/**
+ * @brief Constructs the plane (Givens) rotation which zeroes the second component of `(a, b)`.
+ * @details Follows the reference BLAS `drotg`: on return `a` holds `r`, `b` holds the
+ *          reconstruction value `z`, and `[c s; -s c] * [a; b] = [r; 0]`. The inputs are scaled
+ *          by `|a| + |b|` before squaring, so the calculation cannot overflow.
+ * @tparam T The scalar type.
+ * @param a On entry the first component; on return `r`.
+ * @param b On entry the second component; on return `z`.
+ * @param c Receives the cosine of the rotation.
+ * @param s Receives the sine of the rotation.
+ */
+template <typename T>
+void rotg(T &a, T &b, T &c, T &s)
+{
+	T roe = std::abs(a) > std::abs(b) ? a : b;
+	T scale = std::abs(a) + std::abs(b);
+	if (scale == T(0))
+	{
+		c = T(1);
+		s = T(0);
+		a = T(0);
+		b = T(0);
+		return;
+	}
+	T as = a / scale;
+	T bs = b / scale;
+	T r = scale * std::sqrt(as * as + bs * bs);
+	r = std::copysign(T(1), roe) * r;
+	c = a / r;
+	s = b / r;
+	T z = T(1);
+	if (std::abs(a) > std::abs(b))
+		z = s;
+	if (std::abs(b) >= std::abs(a) && c != T(0))
+		z = T(1) / c;
+	a = r;
+	b = z;
+}
+
+#endif // BLAS1_HPP
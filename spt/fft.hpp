@@ -0,0 +1,870 @@
+/**
+ * @file fft.hpp
+ * @brief Defines fast Fourier transforms over complex and real collections: forward and
+ *        inverse complex transforms, real-to-complex transforms and 2D transforms, for
+ *        power-of-two sizes.
+ * @details The transforms work on `ComplexCollection`, whose separate real and imaginary
+ *          arrays let every butterfly run as a plain loop over contiguous arrays of `T`.
+ *
+ *          Each size has a plan, built once and kept in a cache shared by all threads, which
+ *          holds the precomputed twiddle factors. Twiddles are computed in long double, so
+ *          they are correctly rounded to `T` and the transform error grows only with the
+ *          logarithm of the size.
+ *
+ *          Sizes up to `fft_direct_max` run as a Stockham autosort FFT: a sequence of radix
+ *          8, 4 and 2 passes which alternate between two buffers and leave the result in
+ *          natural order, with no bit-reversal permutation. The passes are arranged so that
+ *          the innermost loop runs along contiguous elements whenever the stride allows it.
+ *
+ *          Larger sizes `n = rows * cols` use the six-step (four-step) algorithm: the input is
+ *          viewed as a matrix, its columns are transformed and multiplied by twiddle factors,
+ *          and its rows are transformed and written transposed. Each small transform fits in
+ *          cache, and the transposes are fused into the transforms: blocks of `fft_batch`
+ *          columns or rows are gathered a cache line at a time and transformed together, so
+ *          the data crosses the memory bus twice instead of once per pass. The blocks of each
+ *          step, like the butterflies of large Stockham passes, are split across threads.
+ *
+ *          The forward transform computes `X[k] = sum_j x[j] exp(-2 pi i j k / n)`; the inverse
+ *          uses `exp(+2 pi i j k / n)` and divides by `n`, so it undoes the forward one.
+ */
+
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/natv_complex.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief The largest size transformed by a single Stockham FFT. Larger sizes use the six-step algorithm.
+ * @details At this size the two buffers of a double precision transform take 8 MiB, about
+ *          the size of a last-level cache. Beyond it every Stockham pass streams from memory,
+ *          while the six-step algorithm reads and writes the data twice.
+ */
+constexpr std::size_t fft_direct_max = std::size_t(1) << 18;
+
+/**
+ * @brief The smallest stride at which a Stockham pass runs its innermost loop along the stride.
+ * @details Below it the runs of contiguous elements are shorter than a vector register, so the
+ *          pass loops over butterflies instead.
+ */
+constexpr std::size_t fft_min_stride = 8;
+
+/**
+ * @brief The number of columns or rows of a matrix transformed together by the six-step and 2D transforms.
+ * @details Two cache lines of doubles. Each block is gathered into interleaved sequences, so
+ *          every Stockham pass over it runs its inner loop along the block.
+ */
+constexpr std::size_t fft_batch = 16;
+
+/**
+ * @brief Checks whether a size is a power of two.
+ * @param n The size.
+ * @return True if `n` is a positive power of two.
+ */
+inline bool fft_is_power_of_two(std::size_t n)
+{
+	return n > 0 && (n & (n - 1)) == 0;
+}
+
+/**
+ * @brief Computes the twiddle factor `exp(-2 pi i k / n)`.
+ * @details Evaluated in long double, so that the result is correctly rounded to T.
+ * @tparam T The type of the parts.
+ * @param k The exponent. Reduced modulo `n`.
+ * @param n The transform size.
+ * @param re Receives the real part.
+ * @param im Receives the imaginary part.
+ */
+template <typename T>
+void fft_twiddle(std::size_t k, std::size_t n, T &re, T &im)
+{
+	const long double pi = 3.141592653589793238462643383279502884L;
+	long double angle = -2.0L * pi * static_cast<long double>(k % n) / static_cast<long double>(n);
+	re = static_cast<T>(std::cos(angle));
+	im = static_cast<T>(std::sin(angle));
+}
+
+/**
+ * @struct FftPlan
+ * @brief The precomputed decomposition and twiddle factors of a transform of one size.
+ * @tparam T The type of the parts.
+ */
+template <typename T>
+struct FftPlan
+{
+	/** @brief The transform size. */
+	std::size_t n = 0;
+
+	/** @brief The radix of each Stockham pass, in order. Empty for six-step plans. */
+	std::vector<std::size_t> radices;
+
+	/**
+	 * @brief The twiddle factors of each Stockham pass.
+	 * @details The pass splitting a length `len` into `m = len / radix` has the factors
+	 *          `exp(-2 pi i j p / len)` at `(j - 1) * m + p`, for `j` in `[1, radix)` and
+	 *          `p` in `[0, m)`.
+	 */
+	std::vector<std::vector<T>> twiddle_re, twiddle_im;
+
+	/** @brief The number of rows of the matrix view of a six-step plan, or 0 for a Stockham plan. */
+	std::size_t rows = 0;
+
+	/** @brief The number of columns of the matrix view of a six-step plan, or 0 for a Stockham plan. */
+	std::size_t cols = 0;
+
+	/** @brief The plans of the column (size `rows`) and row (size `cols`) transforms of a six-step plan. */
+	std::shared_ptr<const FftPlan<T>> col_plan, row_plan;
+
+	/** @brief The six-step twiddle factors `exp(-2 pi i r c / n)`, at `r * cols + c`. */
+	std::vector<T> step_re, step_im;
+
+	/** @brief The factors `exp(-2 pi i k / (2 n))` for `k` in `[0, n]`, used by real transforms of size `2 n`. */
+	std::vector<T> real_re, real_im;
+};
+
+template <typename T>
+std::shared_ptr<const FftPlan<T>> fft_plan(std::size_t n);
+
+/**
+ * @brief Builds the plan of one transform size.
+ * @details Sizes up to `fft_direct_max` get a Stockham plan, using radix 8 passes where they
+ *          fit and radix 4 and 2 passes for the rest. Larger sizes get a six-step plan with
+ *          `rows <= cols`, as close to square as a power of two allows.
+ * @tparam T The type of the parts.
+ * @param n The transform size. Must be a power of two.
+ * @return The new plan.
+ */
+template <typename T>
+std::shared_ptr<const FftPlan<T>> make_fft_plan(std::size_t n)
+{
+	auto plan = std::make_shared<FftPlan<T>>();
+	plan->n = n;
+	plan->real_re.resize(n + 1);
+	plan->real_im.resize(n + 1);
+	for (std::size_t k = 0; k <= n; ++k)
+		fft_twiddle(k, 2 * n, plan->real_re[k], plan->real_im[k]);
+
+	std::size_t log2n = 0;
+	while ((std::size_t(1) << log2n) < n)
+		++log2n;
+
+	if (n > fft_direct_max)
+	{
+		plan->rows = std::size_t(1) << (log2n / 2);
+		plan->cols = n / plan->rows;
+		plan->col_plan = fft_plan<T>(plan->rows);
+		plan->row_plan = fft_plan<T>(plan->cols);
+		plan->step_re.resize(n);
+		plan->step_im.resize(n);
+		for (std::size_t r = 0; r < plan->rows; ++r)
+			for (std::size_t c = 0; c < plan->cols; ++c)
+				fft_twiddle(r * c, n, plan->step_re[r * plan->cols + c], plan->step_im[r * plan->cols + c]);
+		return plan;
+	}
+
+	for (std::size_t bits = log2n; bits > 0;)
+	{
+		std::size_t take = bits == 1 ? 1 : bits == 2 || bits == 4 ? 2 : 3;
+		plan->radices.push_back(std::size_t(1) << take);
+		bits -= take;
+	}
+	std::size_t len = n;
+	for (std::size_t radix : plan->radices)
+	{
+		std::size_t m = len / radix;
+		std::vector<T> re((radix - 1) * m), im((radix - 1) * m);
+		for (std::size_t j = 1; j < radix; ++j)
+			for (std::size_t p = 0; p < m; ++p)
+				fft_twiddle(j * p, len, re[(j - 1) * m + p], im[(j - 1) * m + p]);
+		plan->twiddle_re.push_back(std::move(re));
+		plan->twiddle_im.push_back(std::move(im));
+		len = m;
+	}
+	return plan;
+}
+
+/**
+ * @brief Gets the plan of a transform size from the shared cache, building it on first use.
+ * @details Plans are never evicted. Threads asking for a size which is not cached yet may
+ *          both build it; the first one stored is kept.
+ * @tparam T The type of the parts.
+ * @param n The transform size. Must be a power of two.
+ * @return The plan, shared with every other user of the same size.
+ */
+template <typename T>
+std::shared_ptr<const FftPlan<T>> fft_plan(std::size_t n)
+{
+	static std::mutex lock;
+	static std::map<std::size_t, std::shared_ptr<const FftPlan<T>>> cache;
+
+	assert_true(fft_is_power_of_two(n), "fft: Size must be a power of two");
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto found = cache.find(n);
+		if (found != cache.end())
+			return found->second;
+	}
+	auto plan = make_fft_plan<T>(n);
+	std::lock_guard<std::mutex> guard(lock);
+	return cache.emplace(n, plan).first->second;
+}
+
+/**
+ * @struct fft_value
+ * @brief A complex value held as two scalars, used inside butterflies.
+ * @details Unlike `std::complex`, its products are the plain textbook formulas, so loops of
+ *          butterflies vectorize.
+ * @tparam T The type of the parts.
+ */
+template <typename T>
+struct fft_value
+{
+	/** @brief The real part. */
+	T re;
+	/** @brief The imaginary part. */
+	T im;
+};
+
+/** @brief Adds two butterfly values. */
+template <typename T>
+inline fft_value<T> operator+(fft_value<T> a, fft_value<T> b) { return {a.re + b.re, a.im + b.im}; }
+
+/** @brief Subtracts two butterfly values. */
+template <typename T>
+inline fft_value<T> operator-(fft_value<T> a, fft_value<T> b) { return {a.re - b.re, a.im - b.im}; }
+
+/** @brief Multiplies two butterfly values. */
+template <typename T>
+inline fft_value<T> operator*(fft_value<T> a, fft_value<T> b) { return {a.re * b.re - a.im * b.im, a.re * b.im + a.im * b.re}; }
+
+/**
+ * @brief Multiplies a butterfly value by the quarter turn of a transform: `-i` forward, `i` inverse.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param a The value.
+ * @return The rotated value.
+ */
+template <bool INV, typename T>
+inline fft_value<T> fft_rotate(fft_value<T> a)
+{
+	if constexpr (INV)
+		return {-a.im, a.re};
+	else
+		return {a.im, -a.re};
+}
+
+/**
+ * @brief Computes a size 4 DFT.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param a0,a1,a2,a3 The inputs.
+ * @param b The outputs, `b[0]` to `b[3]`.
+ */
+template <bool INV, typename T>
+inline void fft_dft4(fft_value<T> a0, fft_value<T> a1, fft_value<T> a2, fft_value<T> a3, fft_value<T> *b)
+{
+	fft_value<T> t0 = a0 + a2, t1 = a0 - a2;
+	fft_value<T> t2 = a1 + a3, t3 = fft_rotate<INV>(a1 - a3);
+	b[0] = t0 + t2;
+	b[1] = t1 + t3;
+	b[2] = t0 - t2;
+	b[3] = t1 - t3;
+}
+
+/**
+ * @brief Computes a DFT of size 2, 4 or 8.
+ * @details Size 8 combines the size 4 DFTs of the even and odd inputs; its odd terms are
+ *          rotated by the eighth turns `(1 -+ i) / sqrt(2)`, `-+i` and `(-1 -+ i) / sqrt(2)`.
+ * @tparam R The size.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param a The R inputs.
+ * @param b The R outputs.
+ */
+template <std::size_t R, bool INV, typename T>
+inline void fft_dft(const fft_value<T> *a, fft_value<T> *b)
+{
+	if constexpr (R == 2)
+	{
+		b[0] = a[0] + a[1];
+		b[1] = a[0] - a[1];
+	}
+	else if constexpr (R == 4)
+		fft_dft4<INV>(a[0], a[1], a[2], a[3], b);
+	else
+	{
+		static_assert(R == 8, "fft: Unsupported radix");
+		const T h = T(0.707106781186547524400844362104849039L);
+		fft_value<T> e[4], o[4];
+		fft_dft4<INV>(a[0], a[2], a[4], a[6], e);
+		fft_dft4<INV>(a[1], a[3], a[5], a[7], o);
+		if constexpr (INV)
+		{
+			o[1] = {h * (o[1].re - o[1].im), h * (o[1].re + o[1].im)};
+			o[3] = {-h * (o[3].re + o[3].im), h * (o[3].re - o[3].im)};
+		}
+		else
+		{
+			o[1] = {h * (o[1].re + o[1].im), h * (o[1].im - o[1].re)};
+			o[3] = {h * (o[3].im - o[3].re), -h * (o[3].re + o[3].im)};
+		}
+		o[2] = fft_rotate<INV>(o[2]);
+		for (std::size_t j = 0; j < 4; ++j)
+		{
+			b[j] = e[j] + o[j];
+			b[j + 4] = e[j] - o[j];
+		}
+	}
+}
+
+/**
+ * @brief Runs one radix-R pass of a Stockham FFT.
+ * @details The pass splits sequences of length `len`, interleaved with stride `stride`, into
+ *          `R` sequences of length `m = len / R`. For each butterfly `p` in `[0, m)` and offset
+ *          `q` in `[0, stride)` it reads `x[q + stride * (p + k * m)]` for `k` in `[0, R)`,
+ *          takes their DFT and writes output `j`, times `exp(-+2 pi i j p / len)`, to
+ *          `y[q + stride * (R * p + j)]`. Both the loads and the stores are contiguous in `q`,
+ *          which is the inner loop once the stride reaches `fft_min_stride`. Butterflies are
+ *          gathered into tiles of `fft_min_stride`, so that each step of a tile is a loop of
+ *          fixed length over local arrays, which the compiler vectorizes without having to
+ *          prove that the `2 * R` input and output streams do not alias.
+ * @tparam R The radix.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param xr,xi The input parts.
+ * @param yr,yi The output parts. Must not overlap the input.
+ * @param len The length of the sequences being split.
+ * @param stride The stride between their elements.
+ * @param twr,twi The twiddle factors of the pass, as stored in `FftPlan`.
+ * @param begin The first butterfly `p` to run.
+ * @param end One past the last butterfly `p` to run.
+ */
+template <std::size_t R, bool INV, typename T>
+void fft_pass(const T *xr, const T *xi, T *yr, T *yi, std::size_t len, std::size_t stride,
+			  const T *twr, const T *twi, std::size_t begin, std::size_t end)
+{
+	const std::size_t tile = fft_min_stride;
+	std::size_t m = len / R;
+	T ar[R][tile], ai[R][tile];
+	auto twiddled = [&](std::size_t v, const fft_value<T> *w)
+	{
+		fft_value<T> a[R], b[R];
+		for (std::size_t k = 0; k < R; ++k)
+			a[k] = {ar[k][v], ai[k][v]};
+		fft_dft<R, INV>(a, b);
+		ar[0][v] = b[0].re;
+		ai[0][v] = b[0].im;
+		for (std::size_t j = 1; j < R; ++j)
+		{
+			fft_value<T> z = b[j] * w[j];
+			ar[j][v] = z.re;
+			ai[j][v] = z.im;
+		}
+	};
+	auto twiddle = [&](std::size_t j, std::size_t p)
+	{
+		return fft_value<T>{twr[(j - 1) * m + p], INV ? -twi[(j - 1) * m + p] : twi[(j - 1) * m + p]};
+	};
+
+	if (stride >= tile)
+	{
+		for (std::size_t p = begin; p < end; ++p)
+		{
+			fft_value<T> w[R];
+			for (std::size_t j = 1; j < R; ++j)
+				w[j] = twiddle(j, p);
+			for (std::size_t q0 = 0; q0 < stride; q0 += tile)
+			{
+				for (std::size_t k = 0; k < R; ++k)
+				{
+					std::size_t in = stride * (p + k * m) + q0;
+					for (std::size_t v = 0; v < tile; ++v)
+					{
+						ar[k][v] = xr[in + v];
+						ai[k][v] = xi[in + v];
+					}
+				}
+				for (std::size_t v = 0; v < tile; ++v)
+					twiddled(v, w);
+				for (std::size_t j = 0; j < R; ++j)
+				{
+					std::size_t out = stride * (R * p + j) + q0;
+					for (std::size_t v = 0; v < tile; ++v)
+					{
+						yr[out + v] = ar[j][v];
+						yi[out + v] = ai[j][v];
+					}
+				}
+			}
+		}
+		return;
+	}
+
+	for (std::size_t q = 0; q < stride; ++q)
+		for (std::size_t p0 = begin; p0 < end; p0 += tile)
+		{
+			std::size_t count = std::min(tile, end - p0);
+			for (std::size_t k = 0; k < R; ++k)
+				for (std::size_t v = 0; v < count; ++v)
+				{
+					ar[k][v] = xr[q + stride * (p0 + v + k * m)];
+					ai[k][v] = xi[q + stride * (p0 + v + k * m)];
+				}
+			for (std::size_t v = 0; v < count; ++v)
+			{
+				fft_value<T> w[R];
+				for (std::size_t j = 1; j < R; ++j)
+					w[j] = twiddle(j, p0 + v);
+				twiddled(v, w);
+			}
+			for (std::size_t v = 0; v < count; ++v)
+				for (std::size_t j = 0; j < R; ++j)
+				{
+					yr[q + stride * (R * (p0 + v) + j)] = ar[j][v];
+					yi[q + stride * (R * (p0 + v) + j)] = ai[j][v];
+				}
+		}
+}
+
+/**
+ * @brief Runs a Stockham FFT of `batch` interleaved sequences.
+ * @details Element `j` of sequence `b` is at `b + batch * j`. A batch of interleaved
+ *          sequences is the same as one sequence whose elements are vectors of `batch`, so
+ *          the passes simply start at stride `batch`. They alternate between the output and
+ *          the work buffer, starting with whichever makes the last pass land in the output.
+ *          The butterflies of each pass are split across threads once they cover
+ *          `parallel_grain` elements.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param plan A Stockham plan of the sequence length.
+ * @param in_re,in_im The input parts, `batch * plan.n` elements. Not modified.
+ * @param out_re,out_im The output parts, `batch * plan.n` elements. Must not overlap the input.
+ * @param work A buffer of `2 * batch * plan.n` elements.
+ * @param batch The number of sequences.
+ */
+template <bool INV, typename T>
+void fft_stockham(const FftPlan<T> &plan, const T *in_re, const T *in_im, T *out_re, T *out_im, T *work,
+				  std::size_t batch)
+{
+	std::size_t size = plan.n * batch;
+	if (plan.radices.empty())
+	{
+		std::copy(in_re, in_re + size, out_re);
+		std::copy(in_im, in_im + size, out_im);
+		return;
+	}
+
+	T *buf_re[2] = {out_re, work};
+	T *buf_im[2] = {out_im, work + size};
+	std::size_t dst = plan.radices.size() % 2 == 1 ? 0 : 1;
+	const T *src_re = in_re;
+	const T *src_im = in_im;
+	std::size_t len = plan.n, stride = batch;
+	for (std::size_t pass = 0; pass < plan.radices.size(); ++pass)
+	{
+		std::size_t radix = plan.radices[pass];
+		const T *twr = plan.twiddle_re[pass].data();
+		const T *twi = plan.twiddle_im[pass].data();
+		T *dst_re = buf_re[dst];
+		T *dst_im = buf_im[dst];
+		parallel_for(len / radix, [&](std::size_t begin, std::size_t end)
+					 {
+						 if (radix == 8)
+							 fft_pass<8, INV>(src_re, src_im, dst_re, dst_im, len, stride, twr, twi, begin, end);
+						 else if (radix == 4)
+							 fft_pass<4, INV>(src_re, src_im, dst_re, dst_im, len, stride, twr, twi, begin, end);
+						 else
+							 fft_pass<2, INV>(src_re, src_im, dst_re, dst_im, len, stride, twr, twi, begin, end); },
+					 std::max<std::size_t>(1, parallel_grain / (radix * stride)));
+		src_re = dst_re;
+		src_im = dst_im;
+		dst ^= 1;
+		len /= radix;
+		stride *= radix;
+	}
+}
+
+/**
+ * @brief Transforms every column of a row-major matrix.
+ * @details Columns are taken up to `fft_batch` at a time: their elements are gathered, one
+ *          run of contiguous elements per row, into a per-thread buffer where they form
+ *          interleaved sequences, transformed together, optionally multiplied by per-element
+ *          factors, and scattered back the same way. Blocks of columns are split across threads.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param plan A Stockham plan of the number of rows.
+ * @param cols The number of columns.
+ * @param src_re,src_im The source parts.
+ * @param dst_re,dst_im The destination parts. May be the source.
+ * @param scale_re,scale_im The factors to multiply the results by, in the same layout and
+ *        conjugated for the inverse transform, or null for none.
+ */
+template <bool INV, typename T>
+void fft_columns(const FftPlan<T> &plan, std::size_t cols, const T *src_re, const T *src_im, T *dst_re, T *dst_im,
+				 const T *scale_re = nullptr, const T *scale_im = nullptr)
+{
+	const std::size_t batch = fft_batch;
+	std::size_t rows = plan.n;
+	std::size_t size = rows * batch;
+	parallel_for((cols + batch - 1) / batch, [&](std::size_t begin, std::size_t end)
+				 {
+					 std::vector<T> buffer(6 * size);
+					 T *in_re = buffer.data(), *in_im = in_re + size;
+					 T *out_re = in_im + size, *out_im = out_re + size;
+					 for (std::size_t block = begin; block < end; ++block)
+					 {
+						 std::size_t c0 = block * batch;
+						 std::size_t width = std::min(batch, cols - c0);
+						 for (std::size_t r = 0; r < rows; ++r)
+							 for (std::size_t b = 0; b < width; ++b)
+							 {
+								 in_re[r * width + b] = src_re[r * cols + c0 + b];
+								 in_im[r * width + b] = src_im[r * cols + c0 + b];
+							 }
+						 fft_stockham<INV>(plan, in_re, in_im, out_re, out_im, out_im + size, width);
+						 for (std::size_t r = 0; r < rows; ++r)
+							 for (std::size_t b = 0; b < width; ++b)
+							 {
+								 fft_value<T> z = {out_re[r * width + b], out_im[r * width + b]};
+								 if (scale_re)
+								 {
+									 std::size_t at = r * cols + c0 + b;
+									 z = z * fft_value<T>{scale_re[at], INV ? -scale_im[at] : scale_im[at]};
+								 }
+								 dst_re[r * cols + c0 + b] = z.re;
+								 dst_im[r * cols + c0 + b] = z.im;
+							 }
+					 } },
+				 std::max<std::size_t>(1, parallel_grain / size));
+}
+
+/**
+ * @brief Transforms every row of a row-major matrix, optionally writing the result transposed.
+ * @details Rows are taken up to `fft_batch` at a time and gathered column by column into a
+ *          per-thread buffer, so that they form interleaved sequences and are transformed
+ *          together. A transposed result is then written one run of contiguous elements per
+ *          output row, which fuses the transpose into the transform. Blocks of
+ *          rows are split across threads.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param plan A Stockham plan of the number of columns.
+ * @param rows The number of rows.
+ * @param src_re,src_im The source parts.
+ * @param dst_re,dst_im The destination parts. May be the source unless `transposed` is set.
+ * @param transposed Write the transform of row `r` to column `r` of a `cols x rows` result.
+ */
+template <bool INV, typename T>
+void fft_rows(const FftPlan<T> &plan, std::size_t rows, const T *src_re, const T *src_im, T *dst_re, T *dst_im,
+			  bool transposed)
+{
+	const std::size_t batch = fft_batch;
+	std::size_t cols = plan.n;
+	std::size_t size = cols * batch;
+	parallel_for((rows + batch - 1) / batch, [&](std::size_t begin, std::size_t end)
+				 {
+					 std::vector<T> buffer(6 * size);
+					 T *in_re = buffer.data(), *in_im = in_re + size;
+					 T *out_re = in_im + size, *out_im = out_re + size;
+					 for (std::size_t block = begin; block < end; ++block)
+					 {
+						 std::size_t r0 = block * batch;
+						 std::size_t width = std::min(batch, rows - r0);
+						 for (std::size_t b = 0; b < width; ++b)
+							 for (std::size_t c = 0; c < cols; ++c)
+							 {
+								 in_re[c * width + b] = src_re[(r0 + b) * cols + c];
+								 in_im[c * width + b] = src_im[(r0 + b) * cols + c];
+							 }
+						 fft_stockham<INV>(plan, in_re, in_im, out_re, out_im, out_im + size, width);
+						 if (transposed)
+						 {
+							 for (std::size_t c = 0; c < cols; ++c)
+								 for (std::size_t b = 0; b < width; ++b)
+								 {
+									 dst_re[c * rows + r0 + b] = out_re[c * width + b];
+									 dst_im[c * rows + r0 + b] = out_im[c * width + b];
+								 }
+						 }
+						 else
+						 {
+							 for (std::size_t b = 0; b < width; ++b)
+								 for (std::size_t c = 0; c < cols; ++c)
+								 {
+									 dst_re[(r0 + b) * cols + c] = out_re[c * width + b];
+									 dst_im[(r0 + b) * cols + c] = out_im[c * width + b];
+								 }
+						 }
+					 } },
+				 std::max<std::size_t>(1, parallel_grain / size));
+}
+
+/**
+ * @brief Runs one transform with a plan.
+ * @details A Stockham plan runs directly. A six-step plan views the input as a `rows x cols`
+ *          matrix, `x[c + cols * r]` at row `r` and column `c`; transforms its columns into the
+ *          work buffer and multiplies them by the twiddle factors; then transforms its rows
+ *          and writes them transposed, so that `X[r + rows * k]` lands in natural order. Both
+ *          steps move whole cache lines in and out of per-thread buffers, so the data is read
+ *          and written only twice, and the transposes of the textbook six-step algorithm
+ *          disappear into them. The result is not scaled.
+ * @tparam INV True for the inverse transform.
+ * @tparam T The type of the parts.
+ * @param plan The plan of the transform size.
+ * @param in_re,in_im The input parts, `plan.n` elements. Not modified.
+ * @param out_re,out_im The output parts, `plan.n` elements. Must not overlap the input.
+ * @param work A buffer of `2 * plan.n` elements.
+ */
+template <bool INV, typename T>
+void fft_run(const FftPlan<T> &plan, const T *in_re, const T *in_im, T *out_re, T *out_im, T *work)
+{
+	if (plan.rows == 0)
+	{
+		fft_stockham<INV>(plan, in_re, in_im, out_re, out_im, work, 1);
+		return;
+	}
+	T *tmp_re = work;
+	T *tmp_im = work + plan.n;
+	fft_columns<INV>(*plan.col_plan, plan.cols, in_re, in_im, tmp_re, tmp_im, plan.step_re.data(), plan.step_im.data());
+	fft_rows<INV>(*plan.row_plan, plan.rows, tmp_re, tmp_im, out_re, out_im, true);
+}
+
+/**
+ * @brief Multiplies both parts of a complex array by a real factor.
+ * @tparam T The type of the parts.
+ * @param re,im The parts.
+ * @param n The number of elements.
+ * @param factor The factor.
+ */
+template <typename T>
+void fft_scale(T *re, T *im, std::size_t n, T factor)
+{
+	parallel_for(n, [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t idx = begin; idx < end; ++idx)
+					 {
+						 re[idx] *= factor;
+						 im[idx] *= factor;
+					 } });
+}
+
+/**
+ * @brief Computes the forward or inverse transform of a complex collection.
+ * @tparam INV True for the inverse transform, which is scaled by `1 / n`.
+ * @tparam T The type of the parts.
+ * @param x The input. Its size must be a power of two.
+ * @return The transform.
+ */
+template <bool INV, typename T>
+ComplexCollection<T> fft_transform(const ComplexCollection<T> &x)
+{
+	std::size_t n = x.size();
+	auto plan = fft_plan<T>(n);
+	ComplexCollection<T> res = ComplexCollection<T>::allocate(n);
+	Collection<T> work = Collection<T>::allocate(2 * n);
+	fft_run<INV>(*plan, x.real().data(), x.imag().data(), res.real_data(), res.imag_data(), work.data());
+	if (INV)
+		fft_scale(res.real_data(), res.imag_data(), n, T(1) / T(n));
+	return res;
+}
+
+/**
+ * @brief Computes the discrete Fourier transform of a complex collection.
+ * @details `X[k] = sum_j x[j] exp(-2 pi i j k / n)`, without scaling.
+ * @code
+ * ComplexCollection<double> spectrum = fft(signal);
+ * @endcode
+ * @tparam T The type of the parts.
+ * @param x The input. Its size must be a power of two.
+ * @return A new collection of the `n` frequency components.
+ */
+template <typename T>
+ComplexCollection<T> fft(const ComplexCollection<T> &x)
+{
+	return fft_transform<false>(x);
+}
+
+/**
+ * @brief Computes the inverse discrete Fourier transform of a complex collection.
+ * @details `x[j] = (1 / n) sum_k X[k] exp(2 pi i j k / n)`, so `ifft(fft(x))` gives back `x`.
+ * @tparam T The type of the parts.
+ * @param x The frequency components. Their number must be a power of two.
+ * @return A new collection of the `n` samples.
+ */
+template <typename T>
+ComplexCollection<T> ifft(const ComplexCollection<T> &x)
+{
+	return fft_transform<true>(x);
+}
+
+/**
+ * @brief Computes the discrete Fourier transform of a real collection.
+ * @details The spectrum of real input is conjugate symmetric, so only the components `0` to
+ *          `n / 2` are returned. The even and odd samples are packed into the real and
+ *          imaginary parts of a complex sequence of `n / 2` elements, which takes one
+ *          transform of half the size; its output `Z` is then split into the transforms of
+ *          the even and odd samples, `E[k] = (Z[k] + conj(Z[n/2 - k])) / 2` and
+ *          `O[k] = (Z[k] - conj(Z[n/2 - k])) / 2i`, and combined as `X[k] = E[k] + w^k O[k]`.
+ * @tparam T The type of the samples.
+ * @param x The input. Its size must be a power of two.
+ * @return A new collection of the `n / 2 + 1` non-redundant frequency components.
+ */
+template <typename T>
+ComplexCollection<T> rfft(const Collection<T> &x)
+{
+	std::size_t n = x.size();
+	assert_true(fft_is_power_of_two(n), "fft: Size must be a power of two");
+	if (n == 1)
+		return ComplexCollection<T>(1, [v = x.get(0)](std::size_t)
+									{ return std::complex<T>(v, T(0)); });
+
+	std::size_t half = n / 2;
+	auto plan = fft_plan<T>(half);
+	const T *src = x.data();
+	ComplexCollection<T> packed(half, [src](std::size_t idx)
+								{ return std::complex<T>(src[2 * idx], src[2 * idx + 1]); });
+	ComplexCollection<T> z = ComplexCollection<T>::allocate(half);
+	Collection<T> work = Collection<T>::allocate(2 * half);
+	fft_run<false>(*plan, packed.real().data(), packed.imag().data(), z.real_data(), z.imag_data(), work.data());
+
+	const T *zr = z.real().data();
+	const T *zi = z.imag().data();
+	const T *wr = plan->real_re.data();
+	const T *wi = plan->real_im.data();
+	ComplexCollection<T> res = ComplexCollection<T>::allocate(half + 1);
+	T *out_re = res.real_data();
+	T *out_im = res.imag_data();
+	parallel_for(half + 1, [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t k = begin; k < end; ++k)
+					 {
+						 std::size_t a = k % half;
+						 std::size_t b = (half - k) % half;
+						 fft_value<T> e = {(zr[a] + zr[b]) / T(2), (zi[a] - zi[b]) / T(2)};
+						 fft_value<T> o = {(zi[a] + zi[b]) / T(2), (zr[b] - zr[a]) / T(2)};
+						 fft_value<T> t = fft_value<T>{wr[k], wi[k]} * o;
+						 out_re[k] = e.re + t.re;
+						 out_im[k] = e.im + t.im;
+					 } });
+	return res;
+}
+
+/**
+ * @brief Computes the real samples whose spectrum is given by its non-redundant components.
+ * @details Undoes `rfft`: the transforms of the even and odd samples are recovered as
+ *          `E[k] = (X[k] + conj(X[n/2 - k])) / 2` and `O[k] = (X[k] - conj(X[n/2 - k])) / 2 * w^-k`,
+ *          packed as `E + iO`, and one inverse transform of size `n / 2` gives the even samples
+ *          in its real parts and the odd ones in its imaginary parts. The imaginary parts of
+ *          `X[0]` and `X[n / 2]` are ignored.
+ * @tparam T The type of the samples.
+ * @param spectrum The `n / 2 + 1` components.
+ * @param n The number of samples. Must be a power of two.
+ * @return A new collection of the `n` samples.
+ */
+template <typename T>
+Collection<T> irfft(const ComplexCollection<T> &spectrum, std::size_t n)
+{
+	assert_true(fft_is_power_of_two(n), "fft: Size must be a power of two");
+	assert_equal(spectrum.size(), n / 2 + 1, "irfft: Spectrum must hold n / 2 + 1 components");
+	if (n == 1)
+		return Collection<T>(1, [v = spectrum.real().get(0)](std::size_t)
+							 { return v; });
+
+	std::size_t half = n / 2;
+	auto plan = fft_plan<T>(half);
+	const T *xr = spectrum.real().data();
+	const T *xi = spectrum.imag().data();
+	const T *wr = plan->real_re.data();
+	const T *wi = plan->real_im.data();
+	ComplexCollection<T> packed = ComplexCollection<T>::allocate(half);
+	T *pr = packed.real_data();
+	T *pi = packed.imag_data();
+	parallel_for(half, [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t k = begin; k < end; ++k)
+					 {
+						 std::size_t b = half - k;
+						 fft_value<T> e = {(xr[k] + xr[b]) / T(2), (xi[k] - xi[b]) / T(2)};
+						 fft_value<T> d = {(xr[k] - xr[b]) / T(2), (xi[k] + xi[b]) / T(2)};
+						 fft_value<T> o = d * fft_value<T>{wr[k], -wi[k]};
+						 pr[k] = e.re - o.im;
+						 pi[k] = e.im + o.re;
+					 } });
+
+	ComplexCollection<T> z = ComplexCollection<T>::allocate(half);
+	Collection<T> work = Collection<T>::allocate(2 * half);
+	fft_run<true>(*plan, pr, pi, z.real_data(), z.imag_data(), work.data());
+	const T *zr = z.real().data();
+	const T *zi = z.imag().data();
+	T scale = T(1) / T(half);
+	return Collection<T>(n, [zr, zi, scale](std::size_t idx)
+						 { return (idx % 2 == 0 ? zr[idx / 2] : zi[idx / 2]) * scale; });
+}
+
+/**
+ * @brief Computes the forward or inverse 2D transform of a row-major complex matrix.
+ * @details Transforms the rows into the result, then its columns in place, each in blocks
+ *          of `fft_batch` transformed together.
+ * @tparam INV True for the inverse transform, which is scaled by `1 / (rows * cols)`.
+ * @tparam T The type of the parts.
+ * @param x The matrix, `rows * cols` elements in row-major order.
+ * @param rows The number of rows. Must be a power of two, at most `fft_direct_max`.
+ * @param cols The number of columns. Must be a power of two, at most `fft_direct_max`.
+ * @return The transform, in the same layout.
+ */
+template <bool INV, typename T>
+ComplexCollection<T> fft2_transform(const ComplexCollection<T> &x, std::size_t rows, std::size_t cols)
+{
+	assert_equal(x.size(), rows * cols, "fft2: Size must equal rows * cols");
+	assert_true(rows <= fft_direct_max && cols <= fft_direct_max, "fft2: Sides must not exceed fft_direct_max");
+	auto row_plan = fft_plan<T>(cols);
+	auto col_plan = fft_plan<T>(rows);
+	std::size_t n = rows * cols;
+	ComplexCollection<T> res = ComplexCollection<T>::allocate(n);
+	fft_rows<INV>(*row_plan, rows, x.real().data(), x.imag().data(), res.real_data(), res.imag_data(), false);
+	fft_columns<INV>(*col_plan, cols, res.real_data(), res.imag_data(), res.real_data(), res.imag_data());
+	if (INV)
+		fft_scale(res.real_data(), res.imag_data(), n, T(1) / T(n));
+	return res;
+}
+
+/**
+ * @brief Computes the 2D discrete Fourier transform of a row-major complex matrix.
+ * @details `X[k, l] = sum_{r, c} x[r, c] exp(-2 pi i (r k / rows + c l / cols))`, without scaling.
+ * @tparam T The type of the parts.
+ * @param x The matrix, `rows * cols` elements in row-major order.
+ * @param rows The number of rows. Must be a power of two, at most `fft_direct_max`.
+ * @param cols The number of columns. Must be a power of two, at most `fft_direct_max`.
+ * @return A new collection of the frequency components, in the same layout.
+ */
+template <typename T>
+ComplexCollection<T> fft2(const ComplexCollection<T> &x, std::size_t rows, std::size_t cols)
+{
+	return fft2_transform<false>(x, rows, cols);
+}
+
+/**
+ * @brief Computes the inverse 2D discrete Fourier transform of a row-major complex matrix.
+ * @details Scaled by `1 / (rows * cols)`, so `ifft2(fft2(x, r, c), r, c)` gives back `x`.
+ * @tparam T The type of the parts.
+ * @param x The frequency components, `rows * cols` elements in row-major order.
+ * @param rows The number of rows. Must be a power of two, at most `fft_direct_max`.
+ * @param cols The number of columns. Must be a power of two, at most `fft_direct_max`.
+ * @return A new collection of the samples, in the same layout.
+ */
+template <typename T>
+ComplexCollection<T> ifft2(const ComplexCollection<T> &x, std::size_t rows, std::size_t cols)
+{
+	return fft2_transform<true>(x, rows, cols);
+}
+
+#endif // FFT_HPP
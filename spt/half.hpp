@@ -0,0 +1,379 @@
+/**
+ * @file half.hpp
+ * @brief Defines 16-bit floating point storage types and bulk conversion kernels.
+ * @details `float16` is IEEE 754 binary16 (5 exponent bits, 10 mantissa bits) and `bfloat16`
+ *          is the upper half of a binary32 (8 exponent bits, 7 mantissa bits). Both are
+ *          storage formats: arithmetic is carried out in `float` and rounded back, and
+ *          reductions over large collections should accumulate in a wider type through
+ *          `sum<T, ACC>` and `dot<T, ACC>`.
+ *
+ *          Narrowing always rounds to nearest, ties to even. The bulk `convert_n` overloads
+ *          use F16C or AVX-512 conversion instructions when the compiler targets them (for
+ *          example with the `MAP_REDUCE_NATIVE_ARCH` CMake option), and otherwise fall back
+ *          to bit manipulation which produces identical results.
+ */
+
+#ifndef HALF_HPP
+#define HALF_HPP
+
+#include "../spt/natv_collection.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+
+#if defined(__F16C__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Reinterprets the bits of a float as an unsigned integer.
+ * @param value The float to reinterpret.
+ * @return The IEEE 754 bit pattern of `value`.
+ */
+inline std::uint32_t float_bits(float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+/**
+ * @brief Reinterprets an unsigned integer as the bits of a float.
+ * @param bits The IEEE 754 bit pattern.
+ * @return The float with bit pattern `bits`.
+ */
+inline float bits_float(std::uint32_t bits)
+{
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/**
+ * @brief Converts a float to binary16 bits, rounding to nearest even.
+ * @details Handles overflow to infinity, NaN, and gradual underflow to subnormals.
+ * @param value The float to convert.
+ * @return The binary16 bit pattern.
+ */
+inline std::uint16_t float_to_half_bits(float value)
+{
+#if defined(__F16C__)
+	return (std::uint16_t)_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+#else
+	std::uint32_t bits = float_bits(value);
+	std::uint32_t sign = bits & 0x80000000u;
+	bits ^= sign;
+
+	std::uint32_t res;
+	if (bits >= 0x47800000u)
+	{
+		// Too large for binary16 (>= 65536), infinity or NaN.
+		res = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+	}
+	else if (bits < 0x38800000u)
+	{
+		// Below the smallest normal binary16; let the FPU do the subnormal rounding.
+		res = float_bits(bits_float(bits) + 0.5f) - float_bits(0.5f);
+	}
+	else
+	{
+		std::uint32_t mant_odd = (bits >> 13) & 1u;
+		bits += 0xc8000fffu + mant_odd;
+		res = bits >> 13;
+	}
+	return (std::uint16_t)(res | (sign >> 16));
+#endif
+}
+
+/**
+ * @brief Converts binary16 bits to a float. The conversion is exact.
+ * @param bits The binary16 bit pattern.
+ * @return The float with the same value.
+ */
+inline float half_bits_to_float(std::uint16_t bits)
+{
+#if defined(__F16C__)
+	return _cvtsh_ss(bits);
+#else
+	const std::uint32_t shifted_exp = 0x7c00u << 13;
+	std::uint32_t res = ((std::uint32_t)bits & 0x7fffu) << 13;
+	std::uint32_t exp = res & shifted_exp;
+	res += (127u - 15u) << 23;
+
+	if (exp == shifted_exp)
+		res += (128u - 16u) << 23;
+	else if (exp == 0)
+		res = float_bits(bits_float(res + (1u << 23)) - bits_float(113u << 23));
+
+	return bits_float(res | (((std::uint32_t)bits & 0x8000u) << 16));
+#endif
+}
+
+/**
+ * @brief Converts a float to bfloat16 bits, rounding to nearest even.
+ * @details NaNs are kept quiet so that truncation cannot turn them into infinities.
+ * @param value The float to convert.
+ * @return The bfloat16 bit pattern.
+ */
+inline std::uint16_t float_to_bfloat_bits(float value)
+{
+	std::uint32_t bits = float_bits(value);
+	std::uint32_t rounded = (bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16;
+	std::uint32_t quiet_nan = (bits >> 16) | 0x40u;
+	return (std::uint16_t)((bits & 0x7fffffffu) > 0x7f800000u ? quiet_nan : rounded);
+}
+
+/**
+ * @brief Converts bfloat16 bits to a float. The conversion is exact.
+ * @param bits The bfloat16 bit pattern.
+ * @return The float with the same value.
+ */
+inline float bfloat_bits_to_float(std::uint16_t bits)
+{
+	return bits_float((std::uint32_t)bits << 16);
+}
+
+/**
+ * @struct float16
+ * @brief IEEE 754 binary16 storage type.
+ * @details Converts implicitly to `float`, so it can be passed anywhere a `float` is
+ *          expected; construction from a wider type is explicit since it rounds.
+ */
+struct float16
+{
+	/** @brief The binary16 bit pattern. */
+	std::uint16_t bits;
+
+	/** @brief Default constructor. Leaves the value uninitialized, like a built-in type. */
+	float16() = default;
+
+	/**
+	 * @brief Constructs a value by rounding a float to nearest even.
+	 * @param value The value to round.
+	 */
+	explicit float16(float value) : bits(float_to_half_bits(value)) {}
+
+	/**
+	 * @brief Converts to float. The conversion is exact.
+	 * @return The value as a float.
+	 */
+	inline operator float() const { return half_bits_to_float(bits); }
+};
+
+/**
+ * @struct bfloat16
+ * @brief Brain floating point storage type: the upper 16 bits of an IEEE 754 binary32.
+ * @details Converts implicitly to `float`, so it can be passed anywhere a `float` is
+ *          expected; construction from a wider type is explicit since it rounds.
+ */
+struct bfloat16
+{
+	/** @brief The bfloat16 bit pattern. */
+	std::uint16_t bits;
+
+	/** @brief Default constructor. Leaves the value uninitialized, like a built-in type. */
+	bfloat16() = default;
+
+	/**
+	 * @brief Constructs a value by rounding a float to nearest even.
+	 * @param value The value to round.
+	 */
+	explicit bfloat16(float value) : bits(float_to_bfloat_bits(value)) {}
+
+	/**
+	 * @brief Converts to float. The conversion is exact.
+	 * @return The value as a float.
+	 */
+	inline operator float() const { return bfloat_bits_to_float(bits); }
+};
+
+/** @brief Adds two float16 values, computing in float and rounding the result. */
+inline float16 operator+(float16 a, float16 b) { return float16((float)a + (float)b); }
+/** @brief Subtracts two float16 values, computing in float and rounding the result. */
+inline float16 operator-(float16 a, float16 b) { return float16((float)a - (float)b); }
+/** @brief Multiplies two float16 values, computing in float and rounding the result. */
+inline float16 operator*(float16 a, float16 b) { return float16((float)a * (float)b); }
+/** @brief Divides two float16 values, computing in float and rounding the result. */
+inline float16 operator/(float16 a, float16 b) { return float16((float)a / (float)b); }
+
+/** @brief Adds two bfloat16 values, computing in float and rounding the result. */
+inline bfloat16 operator+(bfloat16 a, bfloat16 b) { return bfloat16((float)a + (float)b); }
+/** @brief Subtracts two bfloat16 values, computing in float and rounding the result. */
+inline bfloat16 operator-(bfloat16 a, bfloat16 b) { return bfloat16((float)a - (float)b); }
+/** @brief Multiplies two bfloat16 values, computing in float and rounding the result. */
+inline bfloat16 operator*(bfloat16 a, bfloat16 b) { return bfloat16((float)a * (float)b); }
+/** @brief Divides two bfloat16 values, computing in float and rounding the result. */
+inline bfloat16 operator/(bfloat16 a, bfloat16 b) { return bfloat16((float)a / (float)b); }
+
+/**
+ * @brief Arithmetic between float16 and bfloat16 collections is carried out in float.
+ */
+template <>
+struct promote<float16, bfloat16>
+{
+	/** @brief The promoted element type. */
+	using type = float;
+};
+
+/**
+ * @brief Arithmetic between bfloat16 and float16 collections is carried out in float.
+ */
+template <>
+struct promote<bfloat16, float16>
+{
+	/** @brief The promoted element type. */
+	using type = float;
+};
+
+/**
+ * @brief Arithmetic between a 16-bit float collection and an integer collection is carried
+ *        out in float, mirroring the built-in promotion of `int` with `float`.
+ * @details Without this, `std::common_type` would pick the integer type, since the 16-bit
+ *          types convert implicitly to float and from there to any integer.
+ * @tparam H The 16-bit float type.
+ * @tparam I The integer type.
+ */
+template <typename H, typename I>
+struct promote<H, I, std::enable_if_t<(std::is_same<H, float16>::value || std::is_same<H, bfloat16>::value) && std::is_integral<I>::value>>
+{
+	/** @brief The promoted element type. */
+	using type = float;
+};
+
+/**
+ * @brief Arithmetic between an integer collection and a 16-bit float collection is carried
+ *        out in float, mirroring the built-in promotion of `int` with `float`.
+ * @tparam I The integer type.
+ * @tparam H The 16-bit float type.
+ */
+template <typename I, typename H>
+struct promote<I, H, std::enable_if_t<std::is_integral<I>::value && (std::is_same<H, float16>::value || std::is_same<H, bfloat16>::value)>>
+{
+	/** @brief The promoted element type. */
+	using type = float;
+};
+
+/**
+ * @brief Writes a float16 to a stream as its float value.
+ * @param os The output stream.
+ * @param value The value to write.
+ * @return The output stream.
+ */
+inline std::ostream &operator<<(std::ostream &os, float16 value) { return os << (float)value; }
+
+/**
+ * @brief Writes a bfloat16 to a stream as its float value.
+ * @param os The output stream.
+ * @param value The value to write.
+ * @return The output stream.
+ */
+inline std::ostream &operator<<(std::ostream &os, bfloat16 value) { return os << (float)value; }
+
+/**
+ * @brief Widens an array of float16 values to float.
+ * @param src The values to convert.
+ * @param dst The array to write the converted values to.
+ * @param size The number of values to convert.
+ */
+inline void convert_n(const float16 *src, float *dst, std::size_t size)
+{
+	std::size_t idx = 0;
+#if defined(__AVX512F__)
+	for (; idx + 16 <= size; idx += 16)
+		_mm512_storeu_ps(dst + idx, _mm512_maskz_cvtph_ps((__mmask16)0xffff, _mm256_loadu_si256((const __m256i *)(src + idx))));
+#endif
+#if defined(__F16C__)
+	for (; idx + 8 <= size; idx += 8)
+		_mm256_storeu_ps(dst + idx, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + idx))));
+#endif
+	for (; idx < size; ++idx)
+		dst[idx] = half_bits_to_float(src[idx].bits);
+}
+
+/**
+ * @brief Widens an array of float16 values to double.
+ * @param src The values to convert.
+ * @param dst The array to write the converted values to.
+ * @param size The number of values to convert.
+ */
+inline void convert_n(const float16 *src, double *dst, std::size_t size)
+{
+	std::size_t idx = 0;
+#if defined(__AVX512FP16__)
+	for (; idx + 8 <= size; idx += 8)
+		_mm512_storeu_pd(dst + idx, _mm512_cvtph_pd(_mm_castsi128_ph(_mm_loadu_si128((const __m128i *)(src + idx)))));
+#elif defined(__F16C__)
+	for (; idx + 8 <= size; idx += 8)
+	{
+		__m256 wide = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)(src + idx)));
+		_mm256_storeu_pd(dst + idx, _mm256_cvtps_pd(_mm256_castps256_ps128(wide)));
+		_mm256_storeu_pd(dst + idx + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(wide, 1)));
+	}
+#endif
+	for (; idx < size; ++idx)
+		dst[idx] = half_bits_to_float(src[idx].bits);
+}
+
+/**
+ * @brief Narrows an array of floats to float16, rounding to nearest even.
+ * @param src The values to convert.
+ * @param dst The array to write the converted values to.
+ * @param size The number of values to convert.
+ */
+inline void convert_n(const float *src, float16 *dst, std::size_t size)
+{
+	std::size_t idx = 0;
+#if defined(__AVX512F__)
+	for (; idx + 16 <= size; idx += 16)
+		_mm256_storeu_si256((__m256i *)(dst + idx), _mm512_maskz_cvtps_ph((__mmask16)0xffff, _mm512_loadu_ps(src + idx), _MM_FROUND_TO_NEAREST_INT));
+#endif
+#if defined(__F16C__)
+	for (; idx + 8 <= size; idx += 8)
+		_mm_storeu_si128((__m128i *)(dst + idx), _mm256_cvtps_ph(_mm256_loadu_ps(src + idx), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for (; idx < size; ++idx)
+		dst[idx].bits = float_to_half_bits(src[idx]);
+}
+
+/**
+ * @brief Widens an array of bfloat16 values to float.
+ * @details A plain shift per element, which the compiler vectorizes for any target.
+ * @param src The values to convert.
+ * @param dst The array to write the converted values to.
+ * @param size The number of values to convert.
+ */
+inline void convert_n(const bfloat16 *src, float *dst, std::size_t size)
+{
+	for (std::size_t idx = 0; idx < size; ++idx)
+		dst[idx] = bfloat_bits_to_float(src[idx].bits);
+}
+
+/**
+ * @brief Widens an array of bfloat16 values to double.
+ * @param src The values to convert.
+ * @param dst The array to write the converted values to.
+ * @param size The number of values to convert.
+ */
+inline void convert_n(const bfloat16 *src, double *dst, std::size_t size)
+{
+	for (std::size_t idx = 0; idx < size; ++idx)
+		dst[idx] = bfloat_bits_to_float(src[idx].bits);
+}
+
+/**
+ * @brief Narrows an array of floats to bfloat16, rounding to nearest even.
+ * @details Branch-free integer rounding, which the compiler vectorizes for any target.
+ * @param src The values to convert.
+ * @param dst The array to write the converted values to.
+ * @param size The number of values to convert.
+ */
+inline void convert_n(const float *src, bfloat16 *dst, std::size_t size)
+{
+	for (std::size_t idx = 0; idx < size; ++idx)
+		dst[idx].bits = float_to_bfloat_bits(src[idx]);
+}
+
+#endif // HALF_HPP
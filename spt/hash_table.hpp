@@ -0,0 +1,572 @@
+/**
+ * @file hash_table.hpp
+ * @brief Defines ConcurrentHashTable, an open-addressing hash table for keyed aggregation
+ *        that many threads can insert into and update at once.
+ * @details Slots are arranged in groups of `hash_group_size`, as in a Swiss table: each slot
+ *          has a control byte holding 7 bits of its key's hash, or a marker for an empty slot,
+ *          and a lookup compares the control bytes of a whole group with its own hash bits in
+ *          one SSE2 compare, so keys are only compared for the few slots that match. A key's
+ *          groups are probed in triangular order from the group chosen by its hash.
+ *
+ *          Each group has its own spin lock, held while the group is searched and updated.
+ *          Slots are never emptied, so a key can only be inserted into the first group of its
+ *          probe sequence that has a free slot, and two threads inserting the same key meet on
+ *          that group's lock: a key is stored once, and every update to it is applied.
+ *
+ *          When the table is more than 7/8 full, a slot array twice the size is allocated and
+ *          the groups are moved into it by the threads using the table, a batch of
+ *          `hash_migrate_batch` groups at a time, while other operations go on. A moved group
+ *          is marked, under its lock, so operations reaching it continue in the new array;
+ *          lookups first wait for the last group to be moved.
+ *          Entries moved into a slot array where their key already arrived are combined, so
+ *          the combining function must be associative and commutative. Slot arrays that have
+ *          been moved out of are only freed with the table, since threads may still be reading
+ *          them; together they take less memory than the current array.
+ */
+
+#ifndef HASH_TABLE_HPP
+#define HASH_TABLE_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/sketch.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Number of slots in a group, whose control bytes are matched together.
+ * @details One SSE2 register of control bytes.
+ */
+constexpr std::size_t hash_group_size = 16;
+
+/**
+ * @brief Number of groups a thread moves at a time while the table grows.
+ */
+constexpr std::size_t hash_migrate_batch = 64;
+
+/**
+ * @brief Number of keys ahead whose group `insert_all` prefetches.
+ */
+constexpr std::size_t hash_prefetch_distance = 8;
+
+/**
+ * @brief Control byte of an empty slot. Full slots hold 7 bits of their key's hash.
+ */
+constexpr std::uint8_t hash_empty = 0x80;
+
+/**
+ * @brief Finds the control bytes of a group equal to a given byte.
+ * @param ctrl The control bytes of the group, aligned to 16 bytes.
+ * @param byte The byte to look for.
+ * @return A mask with bit `i` set if control byte `i` is equal to `byte`.
+ */
+inline std::uint32_t hash_match(const std::uint8_t *ctrl, std::uint8_t byte)
+{
+#if defined(__SSE2__)
+	__m128i group = _mm_load_si128(reinterpret_cast<const __m128i *>(ctrl));
+	return std::uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(char(byte)))));
+#else
+	std::uint32_t mask = 0;
+	for (std::size_t slot = 0; slot < hash_group_size; ++slot)
+		mask |= std::uint32_t(ctrl[slot] == byte) << slot;
+	return mask;
+#endif
+}
+
+/**
+ * @struct hash_group
+ * @brief The control bytes of a group of slots, with the group's spin lock.
+ * @details Kept together in one half cache line, so that locking and matching a group
+ *          touch a single line.
+ */
+struct alignas(32) hash_group
+{
+	/** @brief The control byte of each slot of the group. */
+	std::uint8_t ctrl[hash_group_size];
+
+	/** @brief Set while a thread holds the group. */
+	std::atomic<bool> locked{false};
+
+	/** @brief Set, under the lock, once the group's entries have been moved. */
+	bool moved = false;
+
+	/**
+	 * @brief Constructs a group of empty slots.
+	 */
+	hash_group()
+	{
+		std::fill(ctrl, ctrl + hash_group_size, hash_empty);
+	}
+
+	/**
+	 * @brief Acquires the lock, yielding to other threads while it is held.
+	 */
+	void lock()
+	{
+		while (locked.exchange(true, std::memory_order_acquire))
+			while (locked.load(std::memory_order_relaxed))
+				std::this_thread::yield();
+	}
+
+	/**
+	 * @brief Releases the lock.
+	 */
+	void unlock()
+	{
+		locked.store(false, std::memory_order_release);
+	}
+};
+
+/**
+ * @struct hash_entry
+ * @brief The key and value of a slot, stored together so a hit touches one cache line.
+ * @tparam K The key type.
+ * @tparam V The value type.
+ */
+template <typename K, typename V>
+struct hash_entry
+{
+	/** @brief The key. */
+	K key;
+
+	/** @brief The value. */
+	V value;
+};
+
+/**
+ * @struct hash_slot_array
+ * @brief One generation of the slots of a ConcurrentHashTable.
+ * @tparam K The key type.
+ * @tparam V The value type.
+ */
+template <typename K, typename V>
+struct hash_slot_array
+{
+	/** @brief The number of groups, a power of two. */
+	const std::size_t groups;
+
+	/** @brief The control bytes and lock of each group. */
+	std::unique_ptr<hash_group[]> group_data;
+
+	/** @brief The key and value of each slot, group after group. */
+	Collection<hash_entry<K, V>> entries;
+
+	/** @brief The number of full slots. */
+	std::atomic<std::size_t> used{0};
+
+	/** @brief The larger array the groups are being moved to, if any. */
+	std::atomic<hash_slot_array *> next{nullptr};
+
+	/** @brief The first group not yet claimed by a moving thread. */
+	std::atomic<std::size_t> migrate_cursor{0};
+
+	/** @brief The number of groups moved. */
+	std::atomic<std::size_t> migrated{0};
+
+	/**
+	 * @brief Constructs an array of empty slots.
+	 * @param group_count The number of groups, a power of two.
+	 */
+	explicit hash_slot_array(std::size_t group_count)
+		: groups(group_count), group_data(new hash_group[group_count]),
+		  entries(Collection<hash_entry<K, V>>::allocate(group_count * hash_group_size))
+	{
+	}
+};
+
+/**
+ * @class ConcurrentHashTable
+ * @brief A hash table mapping keys to aggregated values, safe to update from many threads.
+ * @details `insert_or_update` may be called from any number of threads at once, along with
+ *          `find`. `size` and `to_collections` give exact results when no update is running.
+ * @tparam K The key type. Needs `==` and a hash (see `sketch_hash`).
+ * @tparam V The value type.
+ * @tparam COMBINE The type of the function combining the value of a key with a new one. Must
+ *                 be associative and commutative.
+ */
+template <typename K, typename V, typename COMBINE = std::plus<V>>
+class ConcurrentHashTable
+{
+private:
+	using slot_array = hash_slot_array<K, V>;
+
+	/** @brief The function combining the value of a key with a new one. */
+	COMBINE _combine;
+
+	/** @brief The newest slot array whose predecessors have all been moved. */
+	std::atomic<slot_array *> _current;
+
+	/** @brief Every slot array allocated, freed with the table. */
+	std::vector<std::unique_ptr<slot_array>> _arrays;
+
+	/** @brief Guards `_arrays`. */
+	std::mutex _arrays_lock;
+
+	/**
+	 * @brief Allocates a slot array owned by the table.
+	 * @param groups The number of groups.
+	 * @return The new array.
+	 */
+	slot_array *new_array(std::size_t groups)
+	{
+		std::lock_guard<std::mutex> guard(_arrays_lock);
+		_arrays.push_back(std::make_unique<slot_array>(groups));
+		return _arrays.back().get();
+	}
+
+	/**
+	 * @brief Gets the array an array is growing into, starting the growth if needed.
+	 * @param arr The array.
+	 * @return The larger array.
+	 */
+	slot_array *grow(slot_array *arr)
+	{
+		slot_array *next = arr->next.load(std::memory_order_acquire);
+		if (next != nullptr)
+			return next;
+		std::lock_guard<std::mutex> guard(_arrays_lock);
+		next = arr->next.load(std::memory_order_acquire);
+		if (next == nullptr)
+		{
+			_arrays.push_back(std::make_unique<slot_array>(arr->groups * 2));
+			next = _arrays.back().get();
+			arr->next.store(next, std::memory_order_release);
+		}
+		return next;
+	}
+
+	/**
+	 * @brief Moves batches of groups of a growing array until none is left to claim.
+	 * @param arr The growing array.
+	 */
+	void help_migrate(slot_array *arr)
+	{
+		slot_array *next = arr->next.load(std::memory_order_acquire);
+		while (true)
+		{
+			std::size_t first = arr->migrate_cursor.fetch_add(hash_migrate_batch);
+			if (first >= arr->groups)
+				return;
+			std::size_t last = std::min(arr->groups, first + hash_migrate_batch);
+			for (std::size_t group = first; group < last; ++group)
+			{
+				hash_group &g = arr->group_data[group];
+				const hash_entry<K, V> *entries = arr->entries.data() + group * hash_group_size;
+				g.lock();
+				for (std::size_t slot = 0; slot < hash_group_size; ++slot)
+					if (g.ctrl[slot] != hash_empty)
+						update(next, sketch_hash(entries[slot].key), entries[slot].key, entries[slot].value);
+				g.moved = true;
+				g.unlock();
+			}
+			if (arr->migrated.fetch_add(last - first) + (last - first) == arr->groups)
+				advance();
+		}
+	}
+
+	/**
+	 * @brief Moves `_current` past every array whose groups have all been moved.
+	 */
+	void advance()
+	{
+		slot_array *cur = _current.load(std::memory_order_acquire);
+		while (true)
+		{
+			slot_array *next = cur->next.load(std::memory_order_acquire);
+			if (next == nullptr || cur->migrated.load(std::memory_order_acquire) < cur->groups)
+				return;
+			_current.compare_exchange_strong(cur, next, std::memory_order_acq_rel);
+			cur = _current.load(std::memory_order_acquire);
+		}
+	}
+
+	/**
+	 * @brief Inserts a key into an array and its successors, or combines a value into it.
+	 * @param arr The array to start from.
+	 * @param hash The hash of the key.
+	 * @param key The key.
+	 * @param value The value to insert or combine.
+	 */
+	void update(slot_array *arr, std::uint64_t hash, const K &key, const V &value)
+	{
+		std::uint8_t tag = std::uint8_t(hash & 0x7f);
+		while (true)
+		{
+			if (arr->next.load(std::memory_order_acquire) != nullptr)
+				help_migrate(arr);
+			std::size_t mask = arr->groups - 1;
+			std::size_t group = std::size_t(hash >> 7) & mask;
+			for (std::size_t step = 1; step <= arr->groups; group = (group + step++) & mask)
+			{
+				hash_group &g = arr->group_data[group];
+				hash_entry<K, V> *entries = arr->entries.data() + group * hash_group_size;
+				g.lock();
+				if (g.moved)
+				{
+					g.unlock();
+					break;
+				}
+				for (std::uint32_t match = hash_match(g.ctrl, tag); match != 0; match &= match - 1)
+				{
+					hash_entry<K, V> &entry = entries[__builtin_ctz(match)];
+					if (entry.key == key)
+					{
+						entry.value = _combine(entry.value, value);
+						g.unlock();
+						return;
+					}
+				}
+				std::uint32_t empty = hash_match(g.ctrl, hash_empty);
+				if (empty != 0)
+				{
+					std::size_t slot = std::size_t(__builtin_ctz(empty));
+					entries[slot] = hash_entry<K, V>{key, value};
+					g.ctrl[slot] = tag;
+					g.unlock();
+					std::size_t used = arr->used.fetch_add(1, std::memory_order_relaxed) + 1;
+					if (used > arr->groups * hash_group_size / 8 * 7)
+						grow(arr);
+					return;
+				}
+				g.unlock();
+			}
+			// A moved group, or no free slot: the key belongs in the next array.
+			arr = grow(arr);
+		}
+	}
+
+	/**
+	 * @brief Helps move the groups of a growing array, and waits until all of them are moved.
+	 * @param arr The growing array.
+	 * @return The array it grew into, which then holds every entry of `arr`.
+	 */
+	slot_array *finish_migration(slot_array *arr)
+	{
+		slot_array *next = arr->next.load(std::memory_order_acquire);
+		help_migrate(arr);
+		while (arr->migrated.load(std::memory_order_acquire) < arr->groups)
+			std::this_thread::yield();
+		return next;
+	}
+
+	/**
+	 * @brief Gets the current array, first finishing any growth in progress.
+	 * @return The array holding every entry.
+	 */
+	slot_array *settled()
+	{
+		slot_array *arr = _current.load(std::memory_order_acquire);
+		while (arr->next.load(std::memory_order_acquire) != nullptr)
+			arr = finish_migration(arr);
+		return arr;
+	}
+
+public:
+	/**
+	 * @brief Constructs an empty table.
+	 * @param capacity The number of keys the table holds before it first grows.
+	 * @param combine The function combining the value of a key with a new one.
+	 */
+	explicit ConcurrentHashTable(std::size_t capacity = 1024, COMBINE combine = COMBINE())
+		: _combine(combine), _current(nullptr)
+	{
+		std::size_t groups = 1;
+		while (groups * hash_group_size / 8 * 7 < capacity)
+			groups *= 2;
+		_current.store(new_array(groups));
+	}
+
+	ConcurrentHashTable(const ConcurrentHashTable &) = delete;
+	ConcurrentHashTable &operator=(const ConcurrentHashTable &) = delete;
+
+	/**
+	 * @brief Inserts a key with a value, or combines the value into the key's value.
+	 * @details Safe to call from many threads at once.
+	 * @param key The key.
+	 * @param value The value.
+	 */
+	void insert_or_update(const K &key, const V &value)
+	{
+		update(_current.load(std::memory_order_acquire), sketch_hash(key), key, value);
+	}
+
+	/**
+	 * @brief Inserts or updates the keys of a keyed collection, in parallel.
+	 * @param keys The keys.
+	 * @param values The values, one per key.
+	 */
+	void insert_all(const Collection<K> &keys, const Collection<V> &values)
+	{
+		assert_equal(keys.size(), values.size(), "insert_all: Key and value counts differ");
+		const K *ks = keys.data();
+		const V *vs = values.data();
+		parallel_for(keys.size(), [&](std::size_t begin, std::size_t end)
+					 {
+						 // Hash keys a few iterations ahead and fetch their groups, hiding the cache misses.
+						 std::uint64_t hashes[hash_prefetch_distance];
+						 auto fetch = [&](std::size_t idx)
+						 {
+							 slot_array *arr = _current.load(std::memory_order_relaxed);
+							 std::uint64_t hash = sketch_hash(ks[idx]);
+							 hashes[idx % hash_prefetch_distance] = hash;
+							 __builtin_prefetch(&arr->group_data[std::size_t(hash >> 7) & (arr->groups - 1)]);
+						 };
+						 for (std::size_t idx = begin; idx < std::min(end, begin + hash_prefetch_distance); ++idx)
+							 fetch(idx);
+						 for (std::size_t idx = begin; idx < end; ++idx)
+						 {
+							 std::uint64_t hash = hashes[idx % hash_prefetch_distance];
+							 if (idx + hash_prefetch_distance < end)
+								 fetch(idx + hash_prefetch_distance);
+							 update(_current.load(std::memory_order_acquire), hash, ks[idx], vs[idx]);
+						 } });
+	}
+
+	/**
+	 * @brief Looks up the value of a key.
+	 * @details Safe to call while other threads update the table; an update running at the
+	 *          same time may or may not be seen. A lookup reaching a group that has been moved
+	 *          first helps finish the growth: until every group is moved, the key may still be
+	 *          in a later group of the old array, or in both arrays with part of its value in
+	 *          each.
+	 * @param key The key.
+	 * @param value Set to the key's value if the key is found.
+	 * @return true if the key is in the table.
+	 */
+	bool find(const K &key, V &value)
+	{
+		std::uint64_t hash = sketch_hash(key);
+		std::uint8_t tag = std::uint8_t(hash & 0x7f);
+		slot_array *arr = _current.load(std::memory_order_acquire);
+		while (true)
+		{
+			std::size_t mask = arr->groups - 1;
+			std::size_t group = std::size_t(hash >> 7) & mask;
+			for (std::size_t step = 1; step <= arr->groups; group = (group + step++) & mask)
+			{
+				hash_group &g = arr->group_data[group];
+				const hash_entry<K, V> *entries = arr->entries.data() + group * hash_group_size;
+				g.lock();
+				if (g.moved)
+				{
+					g.unlock();
+					break;
+				}
+				for (std::uint32_t match = hash_match(g.ctrl, tag); match != 0; match &= match - 1)
+				{
+					const hash_entry<K, V> &entry = entries[__builtin_ctz(match)];
+					if (entry.key == key)
+					{
+						value = entry.value;
+						g.unlock();
+						return true;
+					}
+				}
+				bool empty = hash_match(g.ctrl, hash_empty) != 0;
+				g.unlock();
+				if (empty)
+					return false;
+			}
+			// A moved group, or no free slot: the key can only be in the next array, once it
+			// holds every entry of this one.
+			if (arr->next.load(std::memory_order_acquire) == nullptr)
+				return false;
+			arr = finish_migration(arr);
+		}
+	}
+
+	/**
+	 * @brief Gets the number of keys in the table.
+	 * @details Finishes any growth in progress first. Exact when no update is running.
+	 * @return The number of keys.
+	 */
+	std::size_t size()
+	{
+		return settled()->used.load();
+	}
+
+	/**
+	 * @brief Gets the number of slots of the current array.
+	 * @return The capacity, in slots.
+	 */
+	std::size_t slots()
+	{
+		return settled()->groups * hash_group_size;
+	}
+
+	/**
+	 * @brief Copies the keys and values of the table into collections, in parallel.
+	 * @details Finishes any growth in progress first. Must not run alongside updates. The
+	 *          entries are listed in slot order.
+	 * @return The keys, and their values in the same order.
+	 */
+	std::pair<Collection<K>, Collection<V>> to_collections()
+	{
+		slot_array *arr = settled();
+		std::size_t size = arr->groups * hash_group_size;
+		const hash_group *groups = arr->group_data.get();
+		const hash_entry<K, V> *entries = arr->entries.data();
+		auto full = [groups](std::size_t slot)
+		{ return groups[slot / hash_group_size].ctrl[slot % hash_group_size] != hash_empty; };
+		std::size_t chunks = parallel_chunks(size);
+		std::vector<std::size_t> offsets(chunks + 1, 0);
+		parallel_tasks(chunks, [&](std::size_t chunk)
+					   {
+						   std::size_t count = 0;
+						   for (std::size_t slot = chunk_begin(size, chunks, chunk); slot < chunk_begin(size, chunks, chunk + 1); ++slot)
+							   count += full(slot) ? 1 : 0;
+						   offsets[chunk + 1] = count; });
+		for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+			offsets[chunk + 1] += offsets[chunk];
+
+		Collection<K> keys = Collection<K>::allocate(offsets[chunks]);
+		Collection<V> values = Collection<V>::allocate(offsets[chunks]);
+		K *key_out = keys.data();
+		V *val_out = values.data();
+		parallel_tasks(chunks, [&](std::size_t chunk)
+					   {
+						   std::size_t pos = offsets[chunk];
+						   for (std::size_t slot = chunk_begin(size, chunks, chunk); slot < chunk_begin(size, chunks, chunk + 1); ++slot)
+							   if (full(slot))
+							   {
+								   key_out[pos] = entries[slot].key;
+								   val_out[pos++] = entries[slot].value;
+							   } });
+		return std::make_pair(std::move(keys), std::move(values));
+	}
+};
+
+/**
+ * @brief Aggregates the values of a keyed collection by key, in parallel.
+ * @tparam K The key type.
+ * @tparam V The value type.
+ * @tparam COMBINE The type of the combining function.
+ * @param keys The keys.
+ * @param values The values, one per key.
+ * @param combine A function combining two values. Must be associative and commutative.
+ * @return The distinct keys, in an unspecified order, and the combined value of each.
+ */
+template <typename K, typename V, typename COMBINE = std::plus<V>>
+std::pair<Collection<K>, Collection<V>> aggregate_by_key(const Collection<K> &keys, const Collection<V> &values,
+														 COMBINE combine = COMBINE())
+{
+	ConcurrentHashTable<K, V, COMBINE> table(1024, combine);
+	table.insert_all(keys, values);
+	return table.to_collections();
+}
+
+#endif // HASH_TABLE_HPP
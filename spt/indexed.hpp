@@ -0,0 +1,373 @@
+/**
+ * @file indexed.hpp
+ * @brief Defines FenwickCollection and SegmentTreeCollection, collections which keep an index
+ *        of partial reductions up to date under `set`, for O(log n) point updates and range
+ *        reductions.
+ * @details Both index blocks of `indexed_block` consecutive elements rather than single
+ *          elements, so the index takes a small fraction of the memory of the values and its
+ *          upper levels stay in cache. A range reduction scans the partial blocks at its two
+ *          ends directly, which is a short sequential read, and takes the whole blocks in
+ *          between from the index.
+ *
+ *          FenwickCollection suits operations with an inverse, such as addition: `set` adds
+ *          the difference between the new and old value to O(log n) block totals, and a range
+ *          is the difference of two prefixes. For floating point values those differences
+ *          round, so a long run of updates can drift from a fresh sum by a few ulps of the
+ *          largest partial total.
+ *
+ *          SegmentTreeCollection takes any associative operation, such as min or max, and need
+ *          not be commutative: `set` reduces the element's block again and recombines the
+ *          O(log n) nodes above it, and ranges are reduced in element order.
+ *
+ *          Neither is safe to update from several threads at once.
+ */
+
+#ifndef INDEXED_HPP
+#define INDEXED_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+/**
+ * @brief Number of consecutive elements summarized by one entry of an index.
+ * @details A partial block at either end of a range costs at most this many sequential
+ *          reads, about as much as the O(log n) scattered index reads of the rest of the
+ *          query, while the index takes only `1 / indexed_block` of the memory of the values.
+ */
+constexpr std::size_t indexed_block = 64;
+
+/**
+ * @brief Reduces a range of elements in order.
+ * @tparam T The element type.
+ * @tparam OP The type of the operation.
+ * @param src The elements.
+ * @param begin The first index of the range.
+ * @param end One past the last index of the range.
+ * @param acc The value to reduce the range into.
+ * @param op The associative operation.
+ * @return `acc` combined with every element of the range, from left to right.
+ */
+template <typename T, typename OP>
+T indexed_scan(const T *src, std::size_t begin, std::size_t end, T acc, const OP &op)
+{
+	for (std::size_t idx = begin; idx < end; ++idx)
+		acc = op(acc, src[idx]);
+	return acc;
+}
+
+/**
+ * @class FenwickCollection
+ * @brief A collection with a Fenwick tree over its block totals, for an invertible operation.
+ * @tparam T The element type.
+ * @tparam OP The type of the operation. Must be associative and commutative.
+ * @tparam INV The type of the inverse: `inv(op(a, b), b)` must give back `a`.
+ */
+template <typename T, typename OP = std::plus<T>, typename INV = std::minus<T>>
+class FenwickCollection
+{
+private:
+	/** @brief The elements. */
+	Collection<T> _values;
+
+	/** @brief The Fenwick tree over the block totals, indexed from 1. */
+	Collection<T> _tree;
+
+	/** @brief The result of reducing no elements. */
+	T _identity;
+
+	/** @brief The operation. */
+	OP _op;
+
+	/** @brief The inverse of the operation. */
+	INV _inv;
+
+	/** @brief The reduction of the whole collection, if `_total_valid`. */
+	mutable T _total;
+
+	/** @brief Whether `_total` is up to date. */
+	mutable bool _total_valid = false;
+
+	/**
+	 * @brief Reduces the first blocks of the collection.
+	 * @param blocks The number of blocks.
+	 * @return The reduction of the elements of those blocks.
+	 */
+	T block_prefix(std::size_t blocks) const
+	{
+		const T *tree = _tree.data();
+		T acc = _identity;
+		for (; blocks > 0; blocks &= blocks - 1)
+			acc = _op(acc, tree[blocks]);
+		return acc;
+	}
+
+	/**
+	 * @brief Reduces the first elements of the collection.
+	 * @param end The number of elements.
+	 * @return The reduction of the elements before `end`.
+	 */
+	T prefix(std::size_t end) const
+	{
+		std::size_t blocks = end / indexed_block;
+		return indexed_scan(_values.data(), blocks * indexed_block, end, block_prefix(blocks), _op);
+	}
+
+public:
+	/**
+	 * @brief Constructs an indexed collection, taking ownership of the elements.
+	 * @details The block totals are computed in parallel, and the tree is built from them in
+	 *          one linear pass.
+	 * @param values The elements.
+	 * @param identity The result of reducing no elements.
+	 * @param op The operation.
+	 * @param inv The inverse of the operation.
+	 */
+	explicit FenwickCollection(Collection<T> &&values, T identity = T(0), OP op = OP(), INV inv = INV())
+		: _values(std::move(values)),
+		  _tree(Collection<T>::allocate((_values.size() + indexed_block - 1) / indexed_block + 1)),
+		  _identity(identity), _op(op), _inv(inv), _total(identity)
+	{
+		const T *src = _values.data();
+		T *tree = _tree.data();
+		std::size_t size = _values.size();
+		std::size_t blocks = _tree.size() - 1;
+		tree[0] = _identity;
+		parallel_for(blocks, [&](std::size_t begin, std::size_t end)
+					 {
+						 for (std::size_t block = begin; block < end; ++block)
+							 tree[block + 1] = indexed_scan(src, block * indexed_block, std::min(size, (block + 1) * indexed_block),
+															_identity, _op); },
+					 std::max<std::size_t>(1, parallel_grain / indexed_block));
+		for (std::size_t node = 1; node <= blocks; ++node)
+		{
+			std::size_t parent = node + (node & (~node + 1));
+			if (parent <= blocks)
+				tree[parent] = _op(tree[parent], tree[node]);
+		}
+	}
+
+	/**
+	 * @brief Gets the number of elements in the collection.
+	 * @return The size of the collection.
+	 */
+	inline std::size_t size() const { return _values.size(); }
+
+	/**
+	 * @brief Gets the elements.
+	 * @return The underlying collection.
+	 */
+	inline const Collection<T> &values() const { return _values; }
+
+	/**
+	 * @brief Gets the element at a specific index.
+	 * @param idx The index of the element.
+	 * @return A copy of the element at the specified index.
+	 */
+	inline T get(std::size_t idx) const { return _values.get(idx); }
+
+	/**
+	 * @brief Sets the element at a specific index, updating the index in O(log n).
+	 * @param idx The index of the element to set.
+	 * @param value The new value for the element.
+	 */
+	void set(std::size_t idx, const T &value)
+	{
+		assert_true(idx < _values.size(), "set: Index out of bounds");
+		T *slot = _values.data() + idx;
+		T delta = _inv(value, *slot);
+		*slot = value;
+		T *tree = _tree.data();
+		std::size_t blocks = _tree.size() - 1;
+		for (std::size_t node = idx / indexed_block + 1; node <= blocks; node += node & (~node + 1))
+			tree[node] = _op(tree[node], delta);
+		_total_valid = false;
+	}
+
+	/**
+	 * @brief Reduces the whole collection.
+	 * @details The result is kept until the next `set`.
+	 * @return The reduction of every element, or the identity for an empty collection.
+	 */
+	T reduce() const
+	{
+		if (!_total_valid)
+		{
+			_total = block_prefix(_tree.size() - 1);
+			_total_valid = true;
+		}
+		return _total;
+	}
+
+	/**
+	 * @brief Reduces a range of the collection in O(log n).
+	 * @param begin The first index of the range.
+	 * @param end One past the last index of the range.
+	 * @return The reduction of the elements in `[begin, end)`.
+	 */
+	T reduce(std::size_t begin, std::size_t end) const
+	{
+		assert_true(begin <= end && end <= _values.size(), "reduce: Range out of bounds");
+		if (end - begin <= indexed_block)
+			return indexed_scan(_values.data(), begin, end, _identity, _op);
+		return _inv(prefix(end), prefix(begin));
+	}
+};
+
+/**
+ * @class SegmentTreeCollection
+ * @brief A collection with a segment tree over its block reductions, for any associative operation.
+ * @tparam T The element type.
+ * @tparam OP The type of the operation. Must be associative.
+ */
+template <typename T, typename OP>
+class SegmentTreeCollection
+{
+private:
+	/** @brief The elements. */
+	Collection<T> _values;
+
+	/** @brief The number of leaves of the tree, a power of two at least the number of blocks. */
+	std::size_t _leaves;
+
+	/** @brief The tree: node 1 is the root, node `k` has children `2k` and `2k + 1`. */
+	Collection<T> _tree;
+
+	/** @brief The result of reducing no elements. */
+	T _identity;
+
+	/** @brief The operation. */
+	OP _op;
+
+	/**
+	 * @brief Reduces one block of elements.
+	 * @param block The index of the block.
+	 * @return The reduction of the elements of the block.
+	 */
+	T block_total(std::size_t block) const
+	{
+		std::size_t begin = std::min(_values.size(), block * indexed_block);
+		std::size_t end = std::min(_values.size(), begin + indexed_block);
+		return indexed_scan(_values.data(), begin, end, _identity, _op);
+	}
+
+	/**
+	 * @brief Gets the number of leaves of the tree for a number of elements.
+	 * @param size The number of elements.
+	 * @return The smallest power of two no less than the number of blocks.
+	 */
+	static std::size_t leaf_count(std::size_t size)
+	{
+		std::size_t leaves = 1;
+		while (leaves * indexed_block < size)
+			leaves *= 2;
+		return leaves;
+	}
+
+public:
+	/**
+	 * @brief Constructs an indexed collection, taking ownership of the elements.
+	 * @details The leaves are computed in parallel, then each level of the tree in parallel.
+	 * @param values The elements.
+	 * @param identity The result of reducing no elements.
+	 * @param op The operation.
+	 */
+	SegmentTreeCollection(Collection<T> &&values, T identity, OP op = OP())
+		: _values(std::move(values)), _leaves(leaf_count(_values.size())),
+		  _tree(Collection<T>::allocate(2 * _leaves)), _identity(identity), _op(op)
+	{
+		T *tree = _tree.data();
+		tree[0] = _identity;
+		std::size_t grain = std::max<std::size_t>(1, parallel_grain / indexed_block);
+		parallel_for(_leaves, [&](std::size_t begin, std::size_t end)
+					 {
+						 for (std::size_t block = begin; block < end; ++block)
+							 tree[_leaves + block] = block_total(block); },
+					 grain);
+		for (std::size_t level = _leaves / 2; level > 0; level /= 2)
+			parallel_for(level, [&](std::size_t begin, std::size_t end)
+						 {
+							 for (std::size_t node = level + begin; node < level + end; ++node)
+								 tree[node] = _op(tree[2 * node], tree[2 * node + 1]); },
+						 grain);
+	}
+
+	/**
+	 * @brief Gets the number of elements in the collection.
+	 * @return The size of the collection.
+	 */
+	inline std::size_t size() const { return _values.size(); }
+
+	/**
+	 * @brief Gets the elements.
+	 * @return The underlying collection.
+	 */
+	inline const Collection<T> &values() const { return _values; }
+
+	/**
+	 * @brief Gets the element at a specific index.
+	 * @param idx The index of the element.
+	 * @return A copy of the element at the specified index.
+	 */
+	inline T get(std::size_t idx) const { return _values.get(idx); }
+
+	/**
+	 * @brief Sets the element at a specific index, updating the index in O(log n).
+	 * @param idx The index of the element to set.
+	 * @param value The new value for the element.
+	 */
+	void set(std::size_t idx, const T &value)
+	{
+		_values.set(idx, value);
+		T *tree = _tree.data();
+		std::size_t node = _leaves + idx / indexed_block;
+		tree[node] = block_total(idx / indexed_block);
+		for (node /= 2; node > 0; node /= 2)
+			tree[node] = _op(tree[2 * node], tree[2 * node + 1]);
+	}
+
+	/**
+	 * @brief Reduces the whole collection.
+	 * @details The root of the tree, which `set` keeps up to date, so this takes constant time.
+	 * @return The reduction of every element, or the identity for an empty collection.
+	 */
+	inline T reduce() const { return _tree.data()[1]; }
+
+	/**
+	 * @brief Reduces a range of the collection in O(log n), in element order.
+	 * @param begin The first index of the range.
+	 * @param end One past the last index of the range.
+	 * @return The reduction of the elements in `[begin, end)`.
+	 */
+	T reduce(std::size_t begin, std::size_t end) const
+	{
+		assert_true(begin <= end && end <= _values.size(), "reduce: Range out of bounds");
+		const T *src = _values.data();
+		std::size_t first = (begin + indexed_block - 1) / indexed_block;
+		std::size_t last = end / indexed_block;
+		if (first >= last)
+			return indexed_scan(src, begin, end, _identity, _op);
+
+		const T *tree = _tree.data();
+		T left = indexed_scan(src, begin, first * indexed_block, _identity, _op);
+		T right = indexed_scan(src, last * indexed_block, end, _identity, _op);
+		// Climb from both ends of the whole blocks, keeping the left and right parts apart so
+		// that the result stays in element order.
+		T inner_right = _identity;
+		for (std::size_t lo = first + _leaves, hi = last + _leaves; lo < hi; lo /= 2, hi /= 2)
+		{
+			if (lo & 1)
+				left = _op(left, tree[lo++]);
+			if (hi & 1)
+				inner_right = _op(tree[--hi], inner_right);
+		}
+		return _op(_op(left, inner_right), right);
+	}
+};
+
+#endif // INDEXED_HPP
@@ -0,0 +1,498 @@
+/**
+ * @file join.hpp
+ * @brief Defines equi-joins between keyed collections: a radix-partitioned parallel hash join
+ *        and a sort-merge join for inputs already sorted by key, each either materialized or
+ *        fused with a reduction.
+ * @details A keyed collection is a collection of keys and a collection of values of the same
+ *          length, record `i` being `(keys[i], values[i])`. A join pairs every record of the
+ *          left input with every record of the right input that has an equal key, duplicates
+ *          included on both sides.
+ *
+ *          The hash join partitions both inputs by the top bits of the key hashes, so that
+ *          the right records of one partition fit in `join_partition_bytes` and each partition
+ *          can be joined by itself with a hash table that stays in cache. Partitions are
+ *          scattered in two passes (a histogram per thread chunk, then a stable scatter) and
+ *          joined in parallel. Keys need `==` and a hash (see `sketch_hash`).
+ *
+ *          The merge join needs both inputs sorted by key, and only `<` on keys. The left input
+ *          is split into chunks at key boundaries, and each chunk is merged with the part of
+ *          the right input found for it by binary search.
+ *
+ *          Materialized joins return one record per matching pair: the key, the left value
+ *          and the right value. A fused join instead folds each pair into a per-task
+ *          accumulator, and combines the accumulators in task order, so aggregates over a join
+ *          are computed without storing it. Merge joins list the pairs in key order; hash
+ *          joins list them partition by partition, so their order depends on the thread count.
+ */
+
+#ifndef JOIN_HPP
+#define JOIN_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/sketch.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Target size, in bytes, of the right-hand records of one hash join partition.
+ * @details Chosen so that a partition's hash table, four slots per record, stays within a
+ *          typical L2 cache while it is built and probed.
+ */
+constexpr std::size_t join_partition_bytes = 256 * 1024;
+
+/**
+ * @brief Largest number of key-hash bits used to partition a hash join.
+ * @details Bounds the per-chunk histograms of the scatter, and keeps the scatter writing to
+ *          few enough partitions at a time for the write streams to stay in cache.
+ */
+constexpr unsigned join_max_bits = 12;
+
+/**
+ * @struct join_entry
+ * @brief A record as scattered into a hash join partition: its key and its value.
+ * @details Carrying the value with the key lets a partition be joined without reading back
+ *          into the input, whose records it visits in scattered order.
+ * @tparam K The key type.
+ * @tparam V The value type.
+ */
+template <typename K, typename V>
+struct join_entry
+{
+	/** @brief The key. */
+	K key;
+
+	/** @brief The value. */
+	V value;
+};
+
+/**
+ * @struct join_result
+ * @brief The records of a materialized join, one per matching pair of input records.
+ * @tparam K The key type.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ */
+template <typename K, typename A, typename B>
+struct join_result
+{
+	/** @brief The key of each pair. */
+	Collection<K> keys;
+
+	/** @brief The value of the left record of each pair. */
+	Collection<A> left;
+
+	/** @brief The value of the right record of each pair. */
+	Collection<B> right;
+};
+
+/**
+ * @brief Gets the number of key-hash bits a hash join partitions on.
+ * @details Enough bits for the right records of a partition to fit in `join_partition_bytes`,
+ *          and for four partitions per thread, so that a small right input does not leave the
+ *          probing to a single thread. Inputs too small to be worth splitting get no bits.
+ * @param na The number of left records.
+ * @param nb The number of right records.
+ * @param entry_bytes The size of one partitioned right record.
+ * @return The number of bits, at most `join_max_bits`.
+ */
+inline unsigned join_partition_bits(std::size_t na, std::size_t nb, std::size_t entry_bytes)
+{
+	if (na + nb < parallel_grain)
+		return 0;
+	std::size_t wanted = std::max(nb * entry_bytes / join_partition_bytes, 4 * thread_count());
+	unsigned bits = 0;
+	while (bits < join_max_bits && (std::size_t(1) << bits) < wanted)
+		++bits;
+	return bits;
+}
+
+/**
+ * @brief Scatters the records of an input into hash partitions.
+ * @details Each thread chunk counts its records per partition; a prefix sum over the
+ *          partitions, then the chunks, gives each chunk its place in every partition, and the
+ *          chunks then scatter in parallel. Within a partition the records keep their input
+ *          order.
+ * @tparam K The key type.
+ * @tparam V The value type.
+ * @param keys The keys of the input.
+ * @param vals The values of the input.
+ * @param bits The number of top hash bits selecting the partition.
+ * @param starts Set to the index of the first record of each partition, followed by the
+ *               number of records.
+ * @return The records, partition after partition.
+ */
+template <typename K, typename V>
+Collection<join_entry<K, V>> join_scatter(const Collection<K> &keys, const Collection<V> &vals, unsigned bits,
+										  std::vector<std::size_t> &starts)
+{
+	std::size_t size = keys.size();
+	std::size_t partitions = std::size_t(1) << bits;
+	std::size_t chunks = parallel_chunks(size);
+	const K *src_k = keys.data();
+	const V *src_v = vals.data();
+	auto partition = [bits](const K &key)
+	{ return bits == 0 ? std::size_t(0) : std::size_t(sketch_hash(key) >> (64 - bits)); };
+
+	std::vector<std::size_t> counts(chunks * partitions, 0);
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t *count = counts.data() + chunk * partitions;
+					   for (std::size_t idx = chunk_begin(size, chunks, chunk); idx < chunk_begin(size, chunks, chunk + 1); ++idx)
+						   ++count[partition(src_k[idx])]; });
+	starts.assign(partitions + 1, 0);
+	std::size_t offset = 0;
+	for (std::size_t p = 0; p < partitions; ++p)
+	{
+		starts[p] = offset;
+		for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+		{
+			std::size_t count = counts[chunk * partitions + p];
+			counts[chunk * partitions + p] = offset;
+			offset += count;
+		}
+	}
+	starts[partitions] = offset;
+
+	Collection<join_entry<K, V>> res = Collection<join_entry<K, V>>::allocate(size);
+	join_entry<K, V> *out = res.data();
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t *pos = counts.data() + chunk * partitions;
+					   for (std::size_t idx = chunk_begin(size, chunks, chunk); idx < chunk_begin(size, chunks, chunk + 1); ++idx)
+						   out[pos[partition(src_k[idx])]++] = join_entry<K, V>{src_k[idx], src_v[idx]}; });
+	return res;
+}
+
+/**
+ * @brief Finds the matching pairs of two keyed inputs by a radix-partitioned hash join.
+ * @details Each partition inserts its distinct right keys into an open-addressing table, at
+ *          most a quarter full, indexed by the low hash bits, then probes it with its left
+ *          records. A key's slot holds the first and last of its right records, which are
+ *          chained in input order, so a run of equal keys takes one slot and the build stays
+ *          linear however many duplicates there are. A probe stops at its key's slot and
+ *          walks the chain. Partitions are joined in parallel.
+ * @tparam K The key type.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ * @tparam START The type of the function told the number of tasks.
+ * @tparam MATCH The type of the function told each matching pair.
+ * @param keys_a The keys of the left input.
+ * @param vals_a The values of the left input.
+ * @param keys_b The keys of the right input.
+ * @param vals_b The values of the right input.
+ * @param start A function taking the number of tasks, called once before any match.
+ * @param match A function taking a task index, and the key, left value and right value of a
+ *              matching pair. Calls for the same task come from one thread.
+ */
+template <typename K, typename A, typename B, typename START, typename MATCH>
+void hash_join_pairs(const Collection<K> &keys_a, const Collection<A> &vals_a, const Collection<K> &keys_b,
+					 const Collection<B> &vals_b, START start, MATCH match)
+{
+	unsigned bits = join_partition_bits(keys_a.size(), keys_b.size(), sizeof(join_entry<K, B>));
+	std::vector<std::size_t> starts_a, starts_b;
+	Collection<join_entry<K, A>> part_a = join_scatter(keys_a, vals_a, bits, starts_a);
+	Collection<join_entry<K, B>> part_b = join_scatter(keys_b, vals_b, bits, starts_b);
+	std::size_t partitions = std::size_t(1) << bits;
+	start(partitions);
+
+	parallel_tasks(partitions, [&](std::size_t p)
+				   {
+					   const join_entry<K, A> *probe = part_a.data() + starts_a[p];
+					   const join_entry<K, B> *build = part_b.data() + starts_b[p];
+					   std::size_t na = starts_a[p + 1] - starts_a[p];
+					   std::size_t nb = starts_b[p + 1] - starts_b[p];
+					   if (na == 0 || nb == 0)
+						   return;
+
+					   struct slot
+					   {
+						   K key;
+						   std::size_t head;
+						   std::size_t tail;
+					   };
+					   const std::size_t none = std::numeric_limits<std::size_t>::max();
+					   std::size_t buckets = 2;
+					   while (buckets < 4 * nb)
+						   buckets *= 2;
+					   std::vector<slot> table(buckets, slot{K(), none, none});
+					   std::vector<std::size_t> next(nb, none);
+					   for (std::size_t k = 0; k < nb; ++k)
+					   {
+						   std::size_t bucket = std::size_t(sketch_hash(build[k].key)) & (buckets - 1);
+						   while (table[bucket].head != none && !(table[bucket].key == build[k].key))
+							   bucket = (bucket + 1) & (buckets - 1);
+						   slot &run = table[bucket];
+						   if (run.head == none)
+							   run = slot{build[k].key, k, k};
+						   else
+						   {
+							   next[run.tail] = k;
+							   run.tail = k;
+						   }
+					   }
+					   for (std::size_t k = 0; k < na; ++k)
+					   {
+						   const K &key = probe[k].key;
+						   std::size_t bucket = std::size_t(sketch_hash(key)) & (buckets - 1);
+						   while (table[bucket].head != none && !(table[bucket].key == key))
+							   bucket = (bucket + 1) & (buckets - 1);
+						   for (std::size_t idx = table[bucket].head; idx != none; idx = next[idx])
+							   match(p, key, probe[k].value, build[idx].value);
+					   } });
+}
+
+/**
+ * @brief Finds the matching pairs of two keyed inputs sorted by key, by a merge join.
+ * @details The left input is split into one chunk per thread, each boundary moved back to
+ *          the first record with its key so that a run of equal keys is never split. A run of
+ *          equal keys on both sides gives every pair of the two runs.
+ * @tparam K The key type.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ * @tparam START The type of the function told the number of tasks.
+ * @tparam MATCH The type of the function told each matching pair.
+ * @param keys_a The keys of the left input, in ascending order.
+ * @param vals_a The values of the left input.
+ * @param keys_b The keys of the right input, in ascending order.
+ * @param vals_b The values of the right input.
+ * @param start A function taking the number of tasks, called once before any match.
+ * @param match A function taking a task index, and the key, left value and right value of a
+ *              matching pair. Calls for the same task come from one thread, in key order.
+ */
+template <typename K, typename A, typename B, typename START, typename MATCH>
+void merge_join_pairs(const Collection<K> &keys_a, const Collection<A> &vals_a, const Collection<K> &keys_b,
+					  const Collection<B> &vals_b, START start, MATCH match)
+{
+	const K *a = keys_a.data();
+	const K *b = keys_b.data();
+	const A *va = vals_a.data();
+	const B *vb = vals_b.data();
+	std::size_t na = keys_a.size(), nb = keys_b.size();
+	std::size_t chunks = parallel_chunks(na + nb);
+	std::vector<std::size_t> splits(chunks + 1, na);
+	for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+	{
+		std::size_t split = chunk_begin(na, chunks, chunk);
+		splits[chunk] = split < na ? std::size_t(std::lower_bound(a, a + split, a[split]) - a) : na;
+	}
+	start(chunks);
+
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t i = splits[chunk];
+					   std::size_t end_a = splits[chunk + 1];
+					   if (i >= end_a)
+						   return;
+					   std::size_t j = std::size_t(std::lower_bound(b, b + nb, a[i]) - b);
+					   while (i < end_a && j < nb)
+					   {
+						   if (a[i] < b[j])
+							   ++i;
+						   else if (b[j] < a[i])
+							   ++j;
+						   else
+						   {
+							   std::size_t run_a = i + 1;
+							   while (run_a < end_a && !(a[i] < a[run_a]))
+								   ++run_a;
+							   std::size_t run_b = j + 1;
+							   while (run_b < nb && !(b[j] < b[run_b]))
+								   ++run_b;
+							   for (std::size_t ia = i; ia < run_a; ++ia)
+								   for (std::size_t ib = j; ib < run_b; ++ib)
+									   match(chunk, a[ia], va[ia], vb[ib]);
+							   i = run_a;
+							   j = run_b;
+						   }
+					   } });
+}
+
+/**
+ * @brief Materializes the pairs found by a join.
+ * @details Each task lists its records; a prefix sum over the tasks then places them, and the
+ *          tasks copy their records into the result in parallel.
+ * @tparam K The key type.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ * @tparam PAIRS The type of the pair finder.
+ * @param pairs A function taking the `start` and `match` functions of `hash_join_pairs` or
+ *              `merge_join_pairs`, and running the join with them.
+ * @return The joined records.
+ */
+template <typename K, typename A, typename B, typename PAIRS>
+join_result<K, A, B> join_collect(PAIRS pairs)
+{
+	struct alignas(parallel_align) task_records
+	{
+		std::vector<K> keys;
+		std::vector<A> left;
+		std::vector<B> right;
+	};
+	std::vector<task_records> records;
+	pairs([&](std::size_t tasks)
+		  { records.resize(tasks); },
+		  [&](std::size_t task, const K &key, const A &a, const B &b)
+		  {
+			  task_records &rec = records[task];
+			  rec.keys.push_back(key);
+			  rec.left.push_back(a);
+			  rec.right.push_back(b); });
+
+	std::vector<std::size_t> starts(records.size() + 1, 0);
+	for (std::size_t task = 0; task < records.size(); ++task)
+		starts[task + 1] = starts[task] + records[task].keys.size();
+	join_result<K, A, B> res{Collection<K>::allocate(starts.back()), Collection<A>::allocate(starts.back()),
+							 Collection<B>::allocate(starts.back())};
+	K *out_k = res.keys.data();
+	A *out_a = res.left.data();
+	B *out_b = res.right.data();
+	parallel_tasks(records.size(), [&](std::size_t task)
+				   {
+					   const task_records &rec = records[task];
+					   std::copy(rec.keys.begin(), rec.keys.end(), out_k + starts[task]);
+					   std::copy(rec.left.begin(), rec.left.end(), out_a + starts[task]);
+					   std::copy(rec.right.begin(), rec.right.end(), out_b + starts[task]); });
+	return res;
+}
+
+/**
+ * @brief Folds the pairs found by a join into a single result, without materializing them.
+ * @tparam R The type of the result.
+ * @tparam FN The type of the fold function.
+ * @tparam COMBINE The type of the function combining two partial results.
+ * @tparam PAIRS The type of the pair finder.
+ * @param identity The result of an empty join.
+ * @param fn A function taking a partial result, a key, a left value and a right value, and
+ *           returning the new partial result.
+ * @param combine A function combining two partial results.
+ * @param pairs A function taking the `start` and `match` functions of `hash_join_pairs` or
+ *              `merge_join_pairs`, and running the join with them.
+ * @return The combined result.
+ */
+template <typename R, typename FN, typename COMBINE, typename PAIRS>
+R join_fold(R identity, FN fn, COMBINE combine, PAIRS pairs)
+{
+	struct alignas(parallel_align) slot
+	{
+		R value;
+	};
+	std::vector<slot> partials;
+	pairs([&](std::size_t tasks)
+		  { partials.assign(tasks, slot{identity}); },
+		  [&](std::size_t task, const auto &key, const auto &a, const auto &b)
+		  { partials[task].value = fn(partials[task].value, key, a, b); });
+
+	R res = identity;
+	for (const slot &partial : partials)
+		res = combine(res, partial.value);
+	return res;
+}
+
+/**
+ * @brief Joins two keyed collections on equal keys with a radix-partitioned hash join.
+ * @tparam K The key type. Needs `==` and a hash.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ * @param keys_a The keys of the left input.
+ * @param vals_a The values of the left input, one per key.
+ * @param keys_b The keys of the right input.
+ * @param vals_b The values of the right input, one per key.
+ * @return One record per matching pair, in an unspecified order.
+ */
+template <typename K, typename A, typename B>
+join_result<K, A, B> hash_join(const Collection<K> &keys_a, const Collection<A> &vals_a,
+							   const Collection<K> &keys_b, const Collection<B> &vals_b)
+{
+	assert_equal(keys_a.size(), vals_a.size(), "hash_join: Left key and value counts differ");
+	assert_equal(keys_b.size(), vals_b.size(), "hash_join: Right key and value counts differ");
+	return join_collect<K, A, B>([&](auto start, auto match)
+								 { hash_join_pairs(keys_a, vals_a, keys_b, vals_b, start, match); });
+}
+
+/**
+ * @brief Joins two keyed collections on equal keys with a hash join, folding the pairs into a result.
+ * @tparam R The type of the result.
+ * @tparam K The key type. Needs `==` and a hash.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ * @tparam FN The type of the fold function.
+ * @tparam COMBINE The type of the function combining two partial results.
+ * @param keys_a The keys of the left input.
+ * @param vals_a The values of the left input, one per key.
+ * @param keys_b The keys of the right input.
+ * @param vals_b The values of the right input, one per key.
+ * @param identity The result of an empty join.
+ * @param fn A function taking a partial result, a key, a left value and a right value, and
+ *           returning the new partial result.
+ * @param combine A function combining two partial results. Must be associative.
+ * @return The combined result.
+ */
+template <typename R, typename K, typename A, typename B, typename FN, typename COMBINE>
+R hash_join_reduce(const Collection<K> &keys_a, const Collection<A> &vals_a, const Collection<K> &keys_b,
+				   const Collection<B> &vals_b, R identity, FN fn, COMBINE combine)
+{
+	assert_equal(keys_a.size(), vals_a.size(), "hash_join_reduce: Left key and value counts differ");
+	assert_equal(keys_b.size(), vals_b.size(), "hash_join_reduce: Right key and value counts differ");
+	return join_fold(identity, fn, combine, [&](auto start, auto match)
+					 { hash_join_pairs(keys_a, vals_a, keys_b, vals_b, start, match); });
+}
+
+/**
+ * @brief Joins two keyed collections sorted by key with a merge join.
+ * @details The order of the keys is not checked.
+ * @tparam K The key type. Needs `<`.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ * @param keys_a The keys of the left input, in ascending order.
+ * @param vals_a The values of the left input, one per key.
+ * @param keys_b The keys of the right input, in ascending order.
+ * @param vals_b The values of the right input, one per key.
+ * @return One record per matching pair, in key order, then in left and right input order.
+ */
+template <typename K, typename A, typename B>
+join_result<K, A, B> merge_join(const Collection<K> &keys_a, const Collection<A> &vals_a,
+								const Collection<K> &keys_b, const Collection<B> &vals_b)
+{
+	assert_equal(keys_a.size(), vals_a.size(), "merge_join: Left key and value counts differ");
+	assert_equal(keys_b.size(), vals_b.size(), "merge_join: Right key and value counts differ");
+	return join_collect<K, A, B>([&](auto start, auto match)
+								 { merge_join_pairs(keys_a, vals_a, keys_b, vals_b, start, match); });
+}
+
+/**
+ * @brief Joins two keyed collections sorted by key with a merge join, folding the pairs into a result.
+ * @details The order of the keys is not checked. Pairs are folded in key order within each task.
+ * @tparam R The type of the result.
+ * @tparam K The key type. Needs `<`.
+ * @tparam A The value type of the left input.
+ * @tparam B The value type of the right input.
+ * @tparam FN The type of the fold function.
+ * @tparam COMBINE The type of the function combining two partial results.
+ * @param keys_a The keys of the left input, in ascending order.
+ * @param vals_a The values of the left input, one per key.
+ * @param keys_b The keys of the right input, in ascending order.
+ * @param vals_b The values of the right input, one per key.
+ * @param identity The result of an empty join.
+ * @param fn A function taking a partial result, a key, a left value and a right value, and
+ *           returning the new partial result.
+ * @param combine A function combining two partial results. Must be associative.
+ * @return The combined result.
+ */
+template <typename R, typename K, typename A, typename B, typename FN, typename COMBINE>
+R merge_join_reduce(const Collection<K> &keys_a, const Collection<A> &vals_a, const Collection<K> &keys_b,
+					const Collection<B> &vals_b, R identity, FN fn, COMBINE combine)
+{
+	assert_equal(keys_a.size(), vals_a.size(), "merge_join_reduce: Left key and value counts differ");
+	assert_equal(keys_b.size(), vals_b.size(), "merge_join_reduce: Right key and value counts differ");
+	return join_fold(identity, fn, combine, [&](auto start, auto match)
+					 { merge_join_pairs(keys_a, vals_a, keys_b, vals_b, start, match); });
+}
+
+#endif // JOIN_HPP
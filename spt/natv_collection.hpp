@@ -1,5 +1,4 @@
-﻿
-/**
+﻿/**
  * @brief A template class for a fixed-size collection of elements.
  * @details This class provides a container for a sequence of elements of type T,
  *          along with methods for map and reduce-style operations. It manages its own memory.
@@ -7,17 +6,172 @@
  */
 
 #include "../spt/assert.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/philox.hpp"
 
 #include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <algorithm>
 #include <iostream>
 #include <numeric>
 #include <iterator>
+#include <memory>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #ifndef COLLECTION_HPP
 #define COLLECTION_HPP
 
+template <typename T>
+class Collection;
+
+/**
+ * @brief Tells whether a type is a Collection.
+ * @details Used to keep the scalar overloads of the arithmetic operators and `zip` from
+ *          matching collection operands.
+ * @tparam T The type to test.
+ */
+template <typename T>
+struct is_collection : std::false_type
+{
+};
+
+/**
+ * @brief Specialization which recognises any `Collection<U>`.
+ * @tparam U The element type of the collection.
+ */
+template <typename U>
+struct is_collection<Collection<U>> : std::true_type
+{
+};
+
+/**
+ * @brief Tells whether a function object provides a bulk kernel over arrays.
+ * @details True when `fn.apply_n(in..., out, n)` can be called with one `const` pointer per
+ *          source collection, a pointer to the output and an element count. The map and zip
+ *          constructors then hand each chunk to `apply_n` instead of calling `fn` per element;
+ *          the named operations of vmath.hpp use it to run their vectorized kernels.
+ * @tparam FN The type of the function object.
+ * @tparam T The element type of the output.
+ * @tparam US The element types of the sources.
+ */
+template <typename FN, typename T, typename... US>
+struct has_apply_n
+{
+private:
+	template <typename F>
+	static auto test(int) -> decltype(std::declval<const F &>().apply_n(std::declval<const US *>()..., std::declval<T *>(), std::size_t(0)), std::true_type());
+	template <typename F>
+	static std::false_type test(...);
+
+public:
+	/** @brief True if FN has a matching `apply_n`. */
+	static constexpr bool value = decltype(test<FN>(0))::value;
+};
+
+/**
+ * @brief Number of elements handed to a block callback at a time.
+ * @details Each thread's chunk is cut into blocks of at most this many elements, so that the
+ *          inputs and outputs of a block, and any scratch arrays a callback keeps per block,
+ *          stay in cache while the callback works through them.
+ */
+constexpr std::size_t span_block = 2048;
+
+/**
+ * @class Span
+ * @brief A view of a contiguous block of elements, passed to block callbacks.
+ * @details The generating, map and zip constructors, and the N-ary `zip`, accept a callback
+ *          taking one `Span<const U>` per input, a `Span<T>` for the output and the index of
+ *          the block's first element, instead of a per-element function:
+ * @code
+ * Collection<double> ys = xs.map<double>([](Span<const double> in, Span<double> out, std::size_t start)
+ *                                        { for (std::size_t k = 0; k < in.size(); ++k) out[k] = 2 * in[k]; });
+ * @endcode
+ *          The library still chooses the partition across threads and the block size (see
+ *          `span_block`), so per-block setup is amortized over up to `span_block` elements and
+ *          the loop over the block can be vectorized by hand. Callbacks run concurrently on
+ *          different blocks and must be safe to call from several threads.
+ * @tparam T The element type, `const` for a read-only view.
+ */
+template <typename T>
+class Span
+{
+private:
+	/** @brief Pointer to the first element of the view. */
+	T *_data;
+
+	/** @brief The number of elements in the view. */
+	std::size_t _size;
+
+public:
+	/**
+	 * @brief Constructs a view of a block of elements.
+	 * @param data Pointer to the first element.
+	 * @param size The number of elements.
+	 */
+	Span(T *data, std::size_t size)
+		: _data(data), _size(size) {}
+
+	/**
+	 * @brief Gets the number of elements in the view.
+	 * @return The size of the view.
+	 */
+	inline std::size_t size() const { return _size; }
+
+	/**
+	 * @brief Gets a pointer to the first element of the view.
+	 * @return Pointer to the viewed elements.
+	 */
+	inline T *data() const { return _data; }
+
+	/**
+	 * @brief Gets an element of the view, without bounds checking.
+	 * @param idx The index of the element within the view.
+	 * @return A reference to the element.
+	 */
+	inline T &operator[](std::size_t idx) const { return _data[idx]; }
+
+	/**
+	 * @brief Gets a pointer to the first element, for range-based for loops.
+	 * @return Pointer to the first element.
+	 */
+	inline T *begin() const { return _data; }
+
+	/**
+	 * @brief Gets a pointer past the last element, for range-based for loops.
+	 * @return Pointer past the last element.
+	 */
+	inline T *end() const { return _data + _size; }
+};
+
+/**
+ * @brief Runs a function over a range of indices in blocks of at most `span_block`, in parallel.
+ * @details The range is split into one chunk per thread, as by `parallel_for`, and each chunk
+ *          is walked in blocks.
+ * @tparam FN The type of the block function.
+ * @param size The number of elements in the range.
+ * @param fn A function taking the `[begin, end)` bounds of a block.
+ */
+template <typename FN>
+void for_each_block(std::size_t size, FN fn)
+{
+	parallel_for(size, [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t first = begin; first < end; first += span_block)
+						 fn(first, std::min(end, first + span_block)); });
+}
+
+/**
+ * @brief Declared ahead of Collection so that `Collection::unzip` can forward to it; see the
+ *        definition below.
+ */
+template <typename... US, typename FN, typename T0, typename... TS>
+std::tuple<Collection<US>...> unzip(FN fn, const Collection<T0> &c0, const Collection<TS> &...cs);
+
 template <typename T>
 class Collection
 {
@@ -96,68 +250,168 @@ private:
 	/** @brief The number of elements in the collection. */
 	const std::size_t _size;
 
+	/**
+	 * @brief Allocates aligned storage for a number of default-initialized elements.
+	 * @param size The number of elements to allocate space for.
+	 * @return Pointer to the first element of the new storage.
+	 */
+	static T *allocate_storage(std::size_t size)
+	{
+		T *data = static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t(alignment)));
+		try
+		{
+			std::uninitialized_default_construct_n(data, size);
+		}
+		catch (...)
+		{
+			::operator delete(data, std::align_val_t(alignment));
+			throw;
+		}
+		return data;
+	}
+
 	/**
 	 * @brief Private constructor to initialize an empty collection of a given size.
 	 * @param size The number of elements to allocate space for.
 	 */
 	Collection(std::size_t size)
-		: _data(new T[size]), _size(size) {}
+		: _data(allocate_storage(size)), _size(size) {}
 
 public:
+	/**
+	 * @brief Alignment, in bytes, of the storage of every collection.
+	 * @details One cache line, which is also wide enough for the widest SIMD loads, so that
+	 *          vectorized kernels never straddle a line at the start of a collection.
+	 */
+	static constexpr std::size_t alignment = alignof(T) > 64 ? alignof(T) : 64;
+
+	/**
+	 * @brief Creates a collection of a given size whose elements are left default-initialized.
+	 * @details Intended for kernels built on top of Collection (such as Grid) which fill the
+	 *          storage directly through `data()` rather than through a per-element function.
+	 * @param size The number of elements to allocate space for.
+	 * @return A new collection of `size` default-initialized elements.
+	 */
+	static Collection<T> allocate(std::size_t size)
+	{
+		return Collection<T>(size);
+	}
+
+	/**
+	 * @brief Creates a collection of random elements, each computed from the seed and its index.
+	 * @details The elements are drawn from a counter-based generator (see `philox.hpp`), so the
+	 *          fill runs in parallel, vectorizes for the `philox_*` distributions, and gives the
+	 *          same elements for any number of threads.
+	 * @code
+	 * Collection<double> xs = Collection<double>::random(n, philox_normal<double>(0.0, 1.0), 42);
+	 * @endcode
+	 * @tparam DIST The type of the distribution.
+	 * @param size The number of elements.
+	 * @param dist The distribution: a `philox_uniform` or `philox_normal`, or a standard
+	 *             library distribution.
+	 * @param seed The seed. Different seeds give independent streams.
+	 * @return A new collection of `size` random elements.
+	 */
+	template <typename DIST>
+	static Collection<T> random(std::size_t size, const DIST &dist, std::uint64_t seed = 0)
+	{
+		return Collection<T>(size, [&](Span<T> out, std::size_t start)
+							 { philox_fill(out.data(), start, out.size(), dist, seed); });
+	}
+
 	/**
 	 * @brief Constructs a collection by generating elements.
+	 * @details A per-element generator is called in index order on the calling thread. A
+	 *          block generator (see `Span`) is called on blocks in parallel instead.
 	 * @tparam FN The type of the generator function.
 	 * @param size The number of elements to generate.
-	 * @param fn A function that takes an index (std::size_t) and returns an element of type T.
+	 * @param fn A function that takes an index (std::size_t) and returns an element of type T,
+	 *           or one taking a `Span<T>` to fill and the index of its first element.
 	 */
 	template <typename FN>
 	Collection(std::size_t size, FN fn)
 		: Collection(size)
 	{
-		std::size_t idx = 0;
-		std::generate(_data, _data + _size, [&]()
-					  { return fn(idx++); });
+		T *out = _data;
+		if constexpr (std::is_invocable<FN &, Span<T>, std::size_t>::value)
+			for_each_block(_size, [&](std::size_t begin, std::size_t end)
+						   { fn(Span<T>(out + begin, end - begin), begin); });
+		else
+		{
+			std::size_t idx = 0;
+			std::generate(out, out + _size, [&]()
+						  { return fn(idx++); });
+		}
 	}
 
 	/**
 	 * @brief Constructs a new collection by applying a function to each element of an existing collection (map).
+	 * @details The elements are split across threads (see `parallel_for`), so `fn` must be safe
+	 *          to call concurrently. If `fn` has a bulk kernel (see `has_apply_n`), each chunk
+	 *          is passed to it in one call; if it takes blocks (see `Span`), it is called once
+	 *          per block.
 	 * @tparam U The element type of the source collection.
 	 * @tparam FN The type of the mapping function.
 	 * @param u The source collection.
-	 * @param fn A function that takes an element of type U and returns an element of type T.
+	 * @param fn A function that takes an element of type U and returns an element of type T,
+	 *           or one taking a `Span<const U>` of inputs, a `Span<T>` of outputs and the index
+	 *           of the block's first element.
 	 */
 	template <typename U, typename FN>
 	Collection(const Collection<U> &u, FN fn)
 		: Collection(u.size())
 	{
-		auto u_iter = u.data();
-		std::generate(_data,
-					  _data + _size,
-					  [&]()
-					  { return fn(*u_iter++); });
+		const U *u_data = u.data();
+		T *out = _data;
+		if constexpr (std::is_invocable<FN &, Span<const U>, Span<T>, std::size_t>::value)
+			for_each_block(_size, [&](std::size_t begin, std::size_t end)
+						   { fn(Span<const U>(u_data + begin, end - begin), Span<T>(out + begin, end - begin), begin); });
+		else
+			parallel_for(_size, [&](std::size_t begin, std::size_t end)
+						 {
+							 if constexpr (has_apply_n<FN, T, U>::value)
+								 fn.apply_n(u_data + begin, out + begin, end - begin);
+							 else
+								 for (std::size_t idx = begin; idx < end; ++idx)
+									 out[idx] = fn(u_data[idx]); });
 	}
 
 	/**
 	 * @brief Constructs a new collection by applying a binary function to elements of two existing collections (zip).
-	 * @tparam U The element type of the first source collection (unused, defaults to T).
-	 * @tparam V The element type of the second source collection (unused, defaults to T).
+	 * @details The two source collections may have different element types, in which case each
+	 *          pair of elements is passed to `fn` as-is and no converted copy of either collection
+	 *          is made. The elements are split across threads, so `fn` must be safe to call
+	 *          concurrently. If `fn` has a bulk kernel (see `has_apply_n`), each chunk is
+	 *          passed to it in one call; if it takes blocks (see `Span`), it is called once
+	 *          per block.
+	 * @tparam U The element type of the first source collection.
+	 * @tparam V The element type of the second source collection.
 	 * @tparam FN The type of the binary function.
 	 * @param u The first source collection.
 	 * @param v The second source collection.
-	 * @param fn A function that takes an element from u and an element from v and returns a new element of type T.
+	 * @param fn A function that takes an element from u and an element from v and returns a new element of type T,
+	 *           or one taking a `Span<const U>` and a `Span<const V>` of inputs, a `Span<T>` of
+	 *           outputs and the index of the block's first element.
 	 */
-	template <typename U = T, typename V = T, typename FN>
-	Collection(const Collection<T> &u, const Collection<T> &v, FN fn)
+	template <typename U, typename V, typename FN>
+	Collection(const Collection<U> &u, const Collection<V> &v, FN fn)
 		: Collection(std::min(u.size(), v.size()))
 	{
-		auto u_iter = u.data();
-		auto v_iter = v.data();
-		std::generate(_data,
-					  _data + _size,
-					  [&]()
-					  {
-						  return fn(*u_iter++, *v_iter++);
-					  });
+		const U *u_data = u.data();
+		const V *v_data = v.data();
+		T *out = _data;
+		if constexpr (std::is_invocable<FN &, Span<const U>, Span<const V>, Span<T>, std::size_t>::value)
+			for_each_block(_size, [&](std::size_t begin, std::size_t end)
+						   { fn(Span<const U>(u_data + begin, end - begin), Span<const V>(v_data + begin, end - begin),
+								Span<T>(out + begin, end - begin), begin); });
+		else
+			parallel_for(_size, [&](std::size_t begin, std::size_t end)
+						 {
+							 if constexpr (has_apply_n<FN, T, U, V>::value)
+								 fn.apply_n(u_data + begin, v_data + begin, out + begin, end - begin);
+							 else
+								 for (std::size_t idx = begin; idx < end; ++idx)
+									 out[idx] = fn(u_data[idx], v_data[idx]); });
 	}
 
 	/**
@@ -175,7 +429,8 @@ public:
 	{
 		if (_data != nullptr)
 		{
-			delete[] _data;
+			std::destroy_n(_data, _size);
+			::operator delete(_data, std::align_val_t(alignment));
 			_data = nullptr;
 		}
 	}
@@ -193,6 +448,13 @@ public:
 	 */
 	inline const T *data() const { return _data; }
 
+	/**
+	 * @brief Gets a mutable pointer to the underlying data array.
+	 *
+	 * @return Pointer to underlying data array.
+	 */
+	inline T *data() { return _data; }
+
 	/**
 	 * @brief Copy the elements of this collection into a std::vector
 	 *
@@ -252,7 +514,11 @@ public:
 	 * @brief Creates a new collection by applying a function to each element of this collection.
 	 * @details This method iterates through each element of the current collection, applies the
 	 *          provided function `fn` to it, and stores the result in a new collection.
-	 *          This is a classic "map" operation from functional programming.
+	 *          This is a classic "map" operation from functional programming. The named math
+	 *          operations of vmath.hpp run as vectorized bulk kernels:
+	 * @code
+	 * Collection<double> ys = xs.map<double>(math_exp);
+	 * @endcode
 	 * @tparam U The element type of the new collection.
 	 * @tparam FN The type of the mapping function.
 	 * @param fn A function that takes an element of type T (the current collection's type)
@@ -284,74 +550,582 @@ public:
 	{
 		return Collection<U>(*this, v, fn);
 	}
+
+	/**
+	 * @brief Creates a new collection by combining each element of this collection with a single scalar.
+	 * @details The scalar is captured once and broadcast to every element, so no collection
+	 *          of copies is allocated.
+	 * @tparam U The element type of the new collection.
+	 * @tparam S The type of the scalar. Must not be a Collection.
+	 * @tparam FN The type of the binary function.
+	 * @param s The scalar to combine with every element.
+	 * @param fn A binary function that takes an element from `this` (type T) and the scalar
+	 *           (type S) and returns an element for the new collection (type U).
+	 * @return A new `Collection<U>` containing the combined elements.
+	 */
+	template <typename U, typename S, typename FN,
+			  typename = std::enable_if_t<!is_collection<S>::value>>
+	Collection<U> zip(const S &s, FN fn) const
+	{
+		return Collection<U>(*this, [s, &fn](const T &x)
+							 { return fn(x, s); });
+	}
+
+	/**
+	 * @brief Creates several new collections by applying a multi-output function to each element.
+	 * @details Equivalent to the free function `unzip(fn, *this)`: every output is filled in the
+	 *          same pass, so `fn` runs once per element however many results it produces.
+	 * @tparam US The element types of the new collections.
+	 * @tparam FN The type of the mapping function.
+	 * @param fn Either a function taking an element and returning a tuple (or pair) of results,
+	 *           or one taking an element followed by a reference to each output slot.
+	 * @return A tuple holding one new collection per output.
+	 */
+	template <typename... US, typename FN>
+	std::tuple<Collection<US>...> unzip(FN fn) const
+	{
+		return ::unzip<US...>(fn, *this);
+	}
+};
+
+/**
+ * @brief The element type produced by an N-ary zip.
+ * @details `U` when it is given explicitly, otherwise the decayed return type of `FN` when
+ *          called with one element of each input. The return type is only looked up when it
+ *          is needed, so a block callback (see `Span`) can be used with an explicit `U`.
+ * @tparam U The requested element type, or void to deduce it.
+ * @tparam FN The type of the combining function.
+ * @tparam TS The element types of the input collections.
+ */
+template <typename U, typename FN, typename... TS>
+struct zip_result
+{
+	/** @brief The requested element type. */
+	using type = U;
 };
 
+/**
+ * @brief Specialization which deduces the element type from the combining function.
+ * @tparam FN The type of the combining function.
+ * @tparam TS The element types of the input collections.
+ */
+template <typename FN, typename... TS>
+struct zip_result<void, FN, TS...>
+{
+	/** @brief The decayed return type of `FN`. */
+	using type = std::decay_t<std::invoke_result_t<FN &, const TS &...>>;
+};
+
+/**
+ * @brief Shorthand for `zip_result<U, FN, TS...>::type`.
+ */
+template <typename U, typename FN, typename... TS>
+using zip_result_t = typename zip_result<U, FN, TS...>::type;
+
+/**
+ * @brief Creates a new collection by combining the elements at the same index of any number of collections.
+ * @details All inputs are read in a single fused pass, so a formula over several columns
+ *          (`a * x + y`, a three-point stencil, ...) needs no intermediate collections. The
+ *          loop over each thread's chunk indexes plain arrays, so the compiler can vectorize
+ *          it, and the inputs may all have different element types. The elements are split
+ *          across threads, so `fn` must be safe to call concurrently. A block callback (see
+ *          `Span`) is called once per block instead, and needs `U` to be given.
+ * @code
+ * Collection<double> r = zip([a](double x, float y) { return a * x + y; }, xs, ys);
+ * @endcode
+ * @tparam U The element type of the new collection; deduced from `fn` when omitted.
+ * @tparam FN The type of the combining function.
+ * @tparam T0 The element type of the first input collection.
+ * @tparam TS The element types of the remaining input collections.
+ * @param fn A function taking one element from each input, in order, and returning the new element,
+ *           or one taking a `Span` of each input, a `Span<U>` of outputs and the index of the
+ *           block's first element.
+ * @param c0 The first input collection.
+ * @param cs The remaining input collections.
+ * @return A new collection with as many elements as the shortest input.
+ */
+template <typename U = void, typename FN, typename T0, typename... TS>
+Collection<zip_result_t<U, FN, T0, TS...>> zip(FN fn, const Collection<T0> &c0, const Collection<TS> &...cs)
+{
+	using R = zip_result_t<U, FN, T0, TS...>;
+	std::size_t size = std::min({c0.size(), cs.size()...});
+	Collection<R> res = Collection<R>::allocate(size);
+	R *out = res.data();
+	auto ins = std::make_tuple(c0.data(), cs.data()...);
+	if constexpr (std::is_invocable<FN &, Span<const T0>, Span<const TS>..., Span<R>, std::size_t>::value)
+		for_each_block(size, [&](std::size_t begin, std::size_t end)
+					   { std::apply([&](const T0 *p0, const TS *...ps)
+									{ fn(Span<const T0>(p0 + begin, end - begin), Span<const TS>(ps + begin, end - begin)...,
+										 Span<R>(out + begin, end - begin), begin); },
+									ins); });
+	else
+		parallel_for(size, [&](std::size_t begin, std::size_t end)
+					 { std::apply([&](const T0 *p0, const TS *...ps)
+								  {
+									  for (std::size_t idx = begin; idx < end; ++idx)
+										  out[idx] = fn(p0[idx], ps[idx]...); },
+								  ins); });
+	return res;
+}
+
+/**
+ * @brief Creates several new collections by generating a tuple of elements for each index.
+ * @details All outputs are filled in one parallel pass, so a generator which naturally
+ *          produces several results per element runs only once per element. `fn` may either
+ *          return a tuple (or pair) holding one value per output, or take a reference to each
+ *          output slot after the index and write the results in place. It must be safe to
+ *          call concurrently.
+ * @tparam US The element types of the new collections.
+ * @tparam FN The type of the generator function.
+ * @param size The number of elements to generate.
+ * @param fn Either `fn(idx)` returning a tuple of results, or `fn(idx, out0, out1, ...)`.
+ * @return A tuple holding one new collection per output.
+ */
+template <typename... US, typename FN>
+std::tuple<Collection<US>...> generate_unzip(std::size_t size, FN fn)
+{
+	std::tuple<Collection<US>...> res(Collection<US>::allocate(size)...);
+	auto outs = std::apply([](Collection<US> &...cs)
+						   { return std::make_tuple(cs.data()...); },
+						   res);
+	parallel_for(size, [&](std::size_t begin, std::size_t end)
+				 { std::apply([&](US *...ps)
+							  {
+								  for (std::size_t idx = begin; idx < end; ++idx)
+								  {
+									  if constexpr (std::is_invocable<FN &, std::size_t, US &...>::value)
+										  fn(idx, ps[idx]...);
+									  else
+										  std::tie(ps[idx]...) = fn(idx);
+								  } },
+							  outs); });
+	return res;
+}
+
+/**
+ * @brief Creates several new collections by applying a multi-output function to the elements of any number of collections.
+ * @details The multi-output counterpart of the N-ary `zip`: element `idx` of every input is
+ *          passed to `fn`, and each of its results is stored in the matching output, all in
+ *          one parallel pass.
+ * @code
+ * auto [re, im] = unzip<double, double>([](double r, double t)
+ *                                       { return std::make_pair(r * std::cos(t), r * std::sin(t)); },
+ *                                       radius, angle);
+ * @endcode
+ * @tparam US The element types of the new collections.
+ * @tparam FN The type of the mapping function.
+ * @tparam T0 The element type of the first input collection.
+ * @tparam TS The element types of the remaining input collections.
+ * @param fn Either a function taking one element from each input and returning a tuple of
+ *           results, or one taking the input elements followed by a reference to each output slot.
+ * @param c0 The first input collection.
+ * @param cs The remaining input collections.
+ * @return A tuple holding one new collection per output, each as long as the shortest input.
+ */
+template <typename... US, typename FN, typename T0, typename... TS>
+std::tuple<Collection<US>...> unzip(FN fn, const Collection<T0> &c0, const Collection<TS> &...cs)
+{
+	std::size_t size = std::min({c0.size(), cs.size()...});
+	auto ins = std::make_tuple(c0.data(), cs.data()...);
+	return generate_unzip<US...>(size, [&](std::size_t idx, US &...slots)
+								 { std::apply([&](const T0 *p0, const TS *...ps)
+											  {
+												  if constexpr (std::is_invocable<FN &, const T0 &, const TS &..., US &...>::value)
+													  fn(p0[idx], ps[idx]..., slots...);
+												  else
+													  std::tie(slots...) = fn(p0[idx], ps[idx]...); },
+											  ins); });
+}
+
+/**
+ * @brief Number of elements converted at a time by the widening kernels.
+ * @details Small enough that the converted block stays in L1 cache between being
+ *          written and being accumulated.
+ */
+constexpr std::size_t widening_block = 256;
+
+/**
+ * @brief Number of independent partial sums kept by the widening reductions.
+ * @details Splitting the accumulation over several lanes lets the compiler keep them in
+ *          one vector register rather than serializing every addition.
+ */
+constexpr std::size_t widening_lanes = 8;
+
+/**
+ * @brief Converts an array of values from one element type to another.
+ * @details The generic version is a `static_cast` per element. Storage types with a faster
+ *          bulk conversion (see `half.hpp`) provide non-template overloads, which are
+ *          preferred by overload resolution.
+ * @tparam FROM The source element type.
+ * @tparam TO The destination element type.
+ * @param src The values to convert.
+ * @param dst The array to write the converted values to.
+ * @param size The number of values to convert.
+ */
+template <typename FROM, typename TO>
+void convert_n(const FROM *src, TO *dst, std::size_t size)
+{
+	for (std::size_t idx = 0; idx < size; ++idx)
+		dst[idx] = static_cast<TO>(src[idx]);
+}
+
+/**
+ * @brief The element type produced by arithmetic between collections of element types T and U.
+ * @details Defaults to `std::common_type_t<T, U>`, so the usual arithmetic conversions apply
+ *          (`int` with `double` gives `double`, `float` with `double` gives `double`). Element
+ *          types whose common type would be surprising, such as the 16-bit storage types in
+ *          `half.hpp`, specialize this template.
+ * @tparam T The element type of the first collection.
+ * @tparam U The element type of the second collection.
+ */
+template <typename T, typename U, typename = void>
+struct promote
+{
+	/** @brief The promoted element type. */
+	using type = std::common_type_t<T, U>;
+};
+
+/**
+ * @brief Shorthand for `promote<T, U>::type`.
+ */
+template <typename T, typename U>
+using promote_t = typename promote<T, U>::type;
+
+/**
+ * @brief Applies an element-wise operation to two collections after promoting both to type R.
+ * @details When both element types are already R the operation is applied directly.
+ *          Otherwise each operand is widened a block at a time with `convert_n`, so the
+ *          conversion is vectorized and no full-size converted copy is made. Either way the
+ *          elements are split across threads (see `parallel_for`), each with its own buffers.
+ * @tparam R The promoted element type the operation is carried out in.
+ * @tparam T The element type of the first collection.
+ * @tparam U The element type of the second collection.
+ * @tparam OP The type of the binary operation on R.
+ * @param u The first collection.
+ * @param v The second collection.
+ * @param op The binary operation to apply.
+ * @return A new collection of the results, with as many elements as the shorter operand.
+ */
+template <typename R, typename T, typename U, typename OP>
+Collection<R> promoted_zip(const Collection<T> &u, const Collection<U> &v, OP op)
+{
+	if constexpr (std::is_same<T, R>::value && std::is_same<U, R>::value)
+		return Collection<R>(u, v, op);
+	else
+	{
+		std::size_t size = std::min(u.size(), v.size());
+		Collection<R> res = Collection<R>::allocate(size);
+		R *out = res.data();
+		parallel_for(size, [&](std::size_t begin, std::size_t end)
+					 {
+						 R u_buf[widening_block];
+						 R v_buf[widening_block];
+						 for (std::size_t first = begin; first < end; first += widening_block)
+						 {
+							 std::size_t count = std::min(widening_block, end - first);
+							 const R *u_src = u_buf;
+							 const R *v_src = v_buf;
+							 if constexpr (std::is_same<T, R>::value)
+								 u_src = u.data() + first;
+							 else
+								 convert_n(u.data() + first, u_buf, count);
+							 if constexpr (std::is_same<U, R>::value)
+								 v_src = v.data() + first;
+							 else
+								 convert_n(v.data() + first, v_buf, count);
+
+							 for (std::size_t idx = 0; idx < count; ++idx)
+								 out[first + idx] = op(u_src[idx], v_src[idx]);
+						 } });
+		return res;
+	}
+}
+
 /**
  * @brief Element-wise addition of two collections.
- * @tparam T The element type of the collections.
+ * @tparam T The element type of the first collection.
+ * @tparam U The element type of the second collection.
  * @param u The first collection.
  * @param v The second collection.
- * @return A new collection containing the element-wise sum.
+ * @return A new collection containing the element-wise sum, of the promoted element type.
  */
-template <typename T>
-Collection<T> operator+(const Collection<T> &u,
-						const Collection<T> &v)
+template <typename T, typename U>
+Collection<promote_t<T, U>> operator+(const Collection<T> &u,
+									  const Collection<U> &v)
 {
-	return Collection<T>(u, v, std::plus<T>());
+	return promoted_zip<promote_t<T, U>>(u, v, std::plus<promote_t<T, U>>());
 }
 
 /**
  * @brief Element-wise subtraction of two collections.
- * @tparam T The element type of the collections.
+ * @tparam T The element type of the first collection.
+ * @tparam U The element type of the second collection.
  * @param u The first collection.
  * @param v The second collection.
- * @return A new collection containing the element-wise difference.
+ * @return A new collection containing the element-wise difference, of the promoted element type.
  */
-template <typename T>
-Collection<T> operator-(const Collection<T> &u,
-						const Collection<T> &v)
+template <typename T, typename U>
+Collection<promote_t<T, U>> operator-(const Collection<T> &u,
+									  const Collection<U> &v)
 {
-	return Collection<T>(u, v, std::minus<T>());
+	return promoted_zip<promote_t<T, U>>(u, v, std::minus<promote_t<T, U>>());
 }
 
 /**
  * @brief Element-wise multiplication of two collections.
- * @tparam T The element type of the collections.
+ * @tparam T The element type of the first collection.
+ * @tparam U The element type of the second collection.
  * @param u The first collection.
  * @param v The second collection.
- * @return A new collection containing the element-wise product.
+ * @return A new collection containing the element-wise product, of the promoted element type.
  */
-template <typename T>
-Collection<T> operator*(const Collection<T> &u,
-						const Collection<T> &v)
+template <typename T, typename U>
+Collection<promote_t<T, U>> operator*(const Collection<T> &u,
+									  const Collection<U> &v)
 {
-	return Collection<T>(u, v, std::multiplies<T>());
+	return promoted_zip<promote_t<T, U>>(u, v, std::multiplies<promote_t<T, U>>());
 }
 
 /**
  * @brief Element-wise division of two collections.
- * @tparam T The element type of the collections.
+ * @tparam T The element type of the numerator collection.
+ * @tparam U The element type of the denominator collection.
  * @param u The numerator collection.
  * @param v The denominator collection.
- * @return A new collection containing the element-wise quotient.
+ * @return A new collection containing the element-wise quotient, of the promoted element type.
  */
-template <typename T>
-Collection<T> operator/(const Collection<T> &u,
-						const Collection<T> &v)
+template <typename T, typename U>
+Collection<promote_t<T, U>> operator/(const Collection<T> &u,
+									  const Collection<U> &v)
 {
-	return Collection<T>(u, v, std::divides<T>());
+	return promoted_zip<promote_t<T, U>>(u, v, std::divides<promote_t<T, U>>());
+}
+
+/**
+ * @brief Applies an element-wise function to a collection after promoting it to type R.
+ * @details When the element type is already R the function is applied directly. Otherwise
+ *          the elements are widened a block at a time with `convert_n`. Either way the elements
+ *          are split across threads.
+ * @tparam R The promoted element type the function is applied in.
+ * @tparam T The element type of the collection.
+ * @tparam FN The type of the unary function on R.
+ * @param u The collection.
+ * @param fn The unary function to apply.
+ * @return A new collection of the results.
+ */
+template <typename R, typename T, typename FN>
+Collection<R> promoted_map(const Collection<T> &u, FN fn)
+{
+	if constexpr (std::is_same<T, R>::value)
+		return Collection<R>(u, fn);
+	else
+	{
+		Collection<R> res = Collection<R>::allocate(u.size());
+		R *out = res.data();
+		parallel_for(u.size(), [&](std::size_t begin, std::size_t end)
+					 {
+						 R buf[widening_block];
+						 for (std::size_t first = begin; first < end; first += widening_block)
+						 {
+							 std::size_t count = std::min(widening_block, end - first);
+							 convert_n(u.data() + first, buf, count);
+							 for (std::size_t idx = 0; idx < count; ++idx)
+								 out[first + idx] = fn(buf[idx]);
+						 } });
+		return res;
+	}
+}
+
+/**
+ * @brief Adds a scalar to every element of a collection.
+ * @tparam T The element type of the collection.
+ * @tparam S The type of the scalar.
+ * @param u The collection.
+ * @param s The scalar.
+ * @return A new collection containing the element-wise sum, of the promoted element type.
+ */
+template <typename T, typename S, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<T, S>> operator+(const Collection<T> &u, const S &s)
+{
+	using R = promote_t<T, S>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return x + r; });
+}
+
+/**
+ * @brief Adds every element of a collection to a scalar.
+ * @tparam S The type of the scalar.
+ * @tparam T The element type of the collection.
+ * @param s The scalar.
+ * @param u The collection.
+ * @return A new collection containing the element-wise sum, of the promoted element type.
+ */
+template <typename S, typename T, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<S, T>> operator+(const S &s, const Collection<T> &u)
+{
+	using R = promote_t<S, T>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return r + x; });
+}
+
+/**
+ * @brief Subtracts a scalar from every element of a collection.
+ * @tparam T The element type of the collection.
+ * @tparam S The type of the scalar.
+ * @param u The collection.
+ * @param s The scalar.
+ * @return A new collection containing the element-wise difference, of the promoted element type.
+ */
+template <typename T, typename S, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<T, S>> operator-(const Collection<T> &u, const S &s)
+{
+	using R = promote_t<T, S>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return x - r; });
+}
+
+/**
+ * @brief Subtracts every element of a collection from a scalar.
+ * @tparam S The type of the scalar.
+ * @tparam T The element type of the collection.
+ * @param s The scalar.
+ * @param u The collection.
+ * @return A new collection containing the element-wise difference, of the promoted element type.
+ */
+template <typename S, typename T, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<S, T>> operator-(const S &s, const Collection<T> &u)
+{
+	using R = promote_t<S, T>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return r - x; });
+}
+
+/**
+ * @brief Multiplies every element of a collection by a scalar.
+ * @tparam T The element type of the collection.
+ * @tparam S The type of the scalar.
+ * @param u The collection.
+ * @param s The scalar.
+ * @return A new collection containing the element-wise product, of the promoted element type.
+ */
+template <typename T, typename S, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<T, S>> operator*(const Collection<T> &u, const S &s)
+{
+	using R = promote_t<T, S>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return x * r; });
+}
+
+/**
+ * @brief Multiplies a scalar by every element of a collection.
+ * @tparam S The type of the scalar.
+ * @tparam T The element type of the collection.
+ * @param s The scalar.
+ * @param u The collection.
+ * @return A new collection containing the element-wise product, of the promoted element type.
+ */
+template <typename S, typename T, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<S, T>> operator*(const S &s, const Collection<T> &u)
+{
+	using R = promote_t<S, T>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return r * x; });
+}
+
+/**
+ * @brief Divides every element of a collection by a scalar.
+ * @tparam T The element type of the collection.
+ * @tparam S The type of the scalar.
+ * @param u The numerator collection.
+ * @param s The scalar denominator.
+ * @return A new collection containing the element-wise quotient, of the promoted element type.
+ */
+template <typename T, typename S, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<T, S>> operator/(const Collection<T> &u, const S &s)
+{
+	using R = promote_t<T, S>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return x / r; });
+}
+
+/**
+ * @brief Divides a scalar by every element of a collection.
+ * @tparam S The type of the scalar.
+ * @tparam T The element type of the collection.
+ * @param s The scalar numerator.
+ * @param u The denominator collection.
+ * @return A new collection containing the element-wise quotient, of the promoted element type.
+ */
+template <typename S, typename T, typename = std::enable_if_t<!is_collection<S>::value>>
+Collection<promote_t<S, T>> operator/(const S &s, const Collection<T> &u)
+{
+	using R = promote_t<S, T>;
+	R r = static_cast<R>(s);
+	return promoted_map<R>(u, [r](R x)
+						   { return r / x; });
+}
+
+/**
+ * @brief Adds together the partial sums of a widening reduction.
+ * @tparam ACC The accumulator type.
+ * @param lanes The partial sums.
+ * @return The total of the partial sums.
+ */
+template <typename ACC>
+ACC combine_lanes(const ACC (&lanes)[widening_lanes])
+{
+	ACC res = lanes[0];
+	for (std::size_t lane = 1; lane < widening_lanes; ++lane)
+		res = res + lanes[lane];
+	return res;
 }
 
 /**
  * @brief Calculates the sum of all elements in a collection.
+ * @details When `ACC` differs from `T` the elements are widened a block at a time and summed
+ *          in `ACC`, so collections stored at reduced precision can be totalled without
+ *          their rounding error or range limiting the result. Each thread sums its own chunk,
+ *          and the partial sums are added in chunk order, as by `reduce`.
  * @tparam T The element type of the collection.
+ * @tparam ACC The type to accumulate in. Defaults to the element type.
  * @param u The collection to sum.
  * @return The sum of the elements.
  */
-template <typename T>
-T sum(const Collection<T> &u)
+template <typename T, typename ACC = T>
+ACC sum(const Collection<T> &u)
 {
-	return u.reduce(std::plus<T>());
+	if constexpr (std::is_same<T, ACC>::value)
+		return u.reduce(std::plus<T>());
+	else
+	{
+		return parallel_reduce(
+			u.size(), ACC(), [&](std::size_t begin, std::size_t end)
+			{
+				ACC lanes[widening_lanes] = {};
+				ACC buf[widening_block];
+				for (std::size_t first = begin; first < end; first += widening_block)
+				{
+					std::size_t count = std::min(widening_block, end - first);
+					convert_n(u.data() + first, buf, count);
+
+					std::size_t idx = 0;
+					for (; idx + widening_lanes <= count; idx += widening_lanes)
+						for (std::size_t lane = 0; lane < widening_lanes; ++lane)
+							lanes[lane] = lanes[lane] + buf[idx + lane];
+					for (; idx < count; ++idx)
+						lanes[0] = lanes[0] + buf[idx];
+				}
+				return combine_lanes(lanes); },
+			[](ACC a, ACC b)
+			{ return a + b; });
+	}
 }
 
 /**
@@ -368,15 +1142,131 @@ T prod(const Collection<T> &u)
 
 /**
  * @brief Calculates the dot product of two collections.
+ * @details When `ACC` differs from `T` both collections are widened a block at a time and
+ *          the products are formed and summed in `ACC`, without an intermediate collection,
+ *          each thread over its own chunk as in `sum`.
  * @tparam T The element type of the collections.
+ * @tparam ACC The type to accumulate in. Defaults to the element type.
  * @param u The first collection.
  * @param v The second collection.
  * @return The dot product of the two collections.
  */
-template <typename T>
-T dot(const Collection<T> &u, const Collection<T> &v)
+template <typename T, typename ACC = T>
+ACC dot(const Collection<T> &u, const Collection<T> &v)
+{
+	if constexpr (std::is_same<T, ACC>::value)
+		return sum(u * v);
+	else
+	{
+		return parallel_reduce(
+			std::min(u.size(), v.size()), ACC(), [&](std::size_t begin, std::size_t end)
+			{
+				ACC lanes[widening_lanes] = {};
+				ACC u_buf[widening_block];
+				ACC v_buf[widening_block];
+				for (std::size_t first = begin; first < end; first += widening_block)
+				{
+					std::size_t count = std::min(widening_block, end - first);
+					convert_n(u.data() + first, u_buf, count);
+					convert_n(v.data() + first, v_buf, count);
+
+					std::size_t idx = 0;
+					for (; idx + widening_lanes <= count; idx += widening_lanes)
+						for (std::size_t lane = 0; lane < widening_lanes; ++lane)
+							lanes[lane] = lanes[lane] + u_buf[idx + lane] * v_buf[idx + lane];
+					for (; idx < count; ++idx)
+						lanes[0] = lanes[0] + u_buf[idx] * v_buf[idx];
+				}
+				return combine_lanes(lanes); },
+			[](ACC a, ACC b)
+			{ return a + b; });
+	}
+}
+
+/**
+ * @brief Reduces a transformed index-space generator in parallel, without storing its values.
+ * @details Element `idx` is `transform(gen(idx))`, and is folded into the result as soon as
+ *          it is made, so memory stays constant whatever `size` is: a Monte Carlo estimate
+ *          over 1e10 samples needs no more than one over 1e3. Each thread generates its chunk
+ *          `widening_block` elements at a time into a buffer which stays in L1 cache, so the
+ *          generating loop can be vectorized on its own, and folds the buffer into
+ *          `widening_lanes` independent accumulators, which the compiler can keep in one
+ *          vector register. The partial results are combined in chunk order, so the
+ *          result only depends on the number of threads through the rounding of `reduce`.
+ * @code
+ * double inside = generate_transform_reduce(
+ *     n, 0.0, [](std::size_t idx) { return philox4x32(seed, idx); },
+ *     [](const philox_block &b)
+ *     {
+ *         double x = philox_unit_double(b.word[0], b.word[1]);
+ *         double y = philox_unit_double(b.word[2], b.word[3]);
+ *         return x * x + y * y < 1.0 ? 1.0 : 0.0;
+ *     },
+ *     std::plus<double>());
+ * @endcode
+ * @tparam R The type of the result.
+ * @tparam GEN The type of the generator.
+ * @tparam TRANSFORM The type of the transform.
+ * @tparam REDUCE The type of the reduction.
+ * @param size The number of elements.
+ * @param identity The result of reducing no elements.
+ * @param gen A function taking an index and returning a value. Called concurrently.
+ * @param transform A function taking a value of `gen` and returning an `R`. Called concurrently.
+ * @param reduce A function combining two `R`s. Must be associative and commutative.
+ * @return The reduction of the transformed values.
+ */
+template <typename R, typename GEN, typename TRANSFORM, typename REDUCE>
+R generate_transform_reduce(std::size_t size, R identity, GEN gen, TRANSFORM transform, REDUCE reduce)
+{
+	return parallel_reduce(
+		size, identity, [&](std::size_t begin, std::size_t end)
+		{
+			R lanes[widening_lanes];
+			R buf[widening_block];
+			std::fill(lanes, lanes + widening_lanes, identity);
+			for (std::size_t first = begin; first < end; first += widening_block)
+			{
+				std::size_t count = std::min(widening_block, end - first);
+				for (std::size_t k = 0; k < count; ++k)
+					buf[k] = R(transform(gen(first + k)));
+
+				std::size_t k = 0;
+				for (; k + widening_lanes <= count; k += widening_lanes)
+					for (std::size_t lane = 0; lane < widening_lanes; ++lane)
+						lanes[lane] = reduce(lanes[lane], buf[k + lane]);
+				for (; k < count; ++k)
+					lanes[0] = reduce(lanes[0], buf[k]);
+			}
+			R acc = lanes[0];
+			for (std::size_t lane = 1; lane < widening_lanes; ++lane)
+				acc = reduce(acc, lanes[lane]);
+			return acc; },
+		reduce);
+}
+
+/**
+ * @brief Reduces an index-space generator in parallel, without storing its values.
+ * @details The fused equivalent of `Collection<R>(size, gen).reduce(reduce)`; see
+ *          `generate_transform_reduce`.
+ * @code
+ * double dot = generate_reduce(n, 0.0, [&](std::size_t idx) { return f(idx) * g(idx); }, std::plus<double>());
+ * @endcode
+ * @tparam R The type of the result.
+ * @tparam GEN The type of the generator.
+ * @tparam REDUCE The type of the reduction.
+ * @param size The number of elements.
+ * @param identity The result of reducing no elements.
+ * @param gen A function taking an index and returning an `R`. Called concurrently.
+ * @param reduce A function combining two `R`s. Must be associative and commutative.
+ * @return The reduction of the generated values.
+ */
+template <typename R, typename GEN, typename REDUCE>
+R generate_reduce(std::size_t size, R identity, GEN gen, REDUCE reduce)
 {
-	return sum(u * v);
+	return generate_transform_reduce(
+		size, identity, gen, [](const auto &value)
+		{ return value; },
+		reduce);
 }
 
 /**
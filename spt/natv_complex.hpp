@@ -0,0 +1,474 @@
+/**
+ * @file natv_complex.hpp
+ * @brief Defines the ComplexCollection class, a collection of complex numbers stored as
+ *        separate real and imaginary arrays, with element-wise complex arithmetic and
+ *        complex dot products.
+ * @details A `Collection<std::complex<T>>` interleaves the real and imaginary parts, so a
+ *          vector load holds half a register of each and every multiply needs shuffles.
+ *          Without `-ffast-math`, `std::complex` multiplication also calls a library routine
+ *          to recover infinities from NaN results, which stops the loop from vectorizing.
+ *          A `ComplexCollection<T>` keeps the parts in two aligned `Collection<T>` arrays
+ *          (structure of arrays), and its kernels write complex arithmetic out on the parts
+ *          with the textbook formulas. Each kernel is then a plain loop over contiguous
+ *          arrays of `T`, which the compiler vectorizes at full width, and is split across
+ *          threads like the other element-wise kernels.
+ *
+ *          Multiplication uses `(a + bi)(c + di) = (ac - bd) + (ad + bc)i` directly, as
+ *          compilers do under `-ffast-math`: products of infinite operands may give NaN
+ *          where C's Annex G would give an infinity. `abs` is `sqrt(norm)`, which overflows
+ *          for magnitudes beyond the square root of the largest `T`, where `std::abs` would
+ *          not.
+ */
+
+#ifndef COMPLEX_HPP
+#define COMPLEX_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+/**
+ * @class ComplexCollection
+ * @brief A fixed-size collection of complex numbers stored as separate real and imaginary arrays.
+ * @tparam T The type of the real and imaginary parts (e.g. float or double).
+ */
+template <typename T>
+class ComplexCollection
+{
+private:
+	/** @brief The real parts of the elements. */
+	Collection<T> _re;
+
+	/** @brief The imaginary parts of the elements. */
+	Collection<T> _im;
+
+public:
+	/**
+	 * @brief Constructs a collection by generating elements.
+	 * @details The elements are split across threads, so `fn` must be safe to call concurrently.
+	 * @tparam FN The type of the generator function.
+	 * @param size The number of elements to generate.
+	 * @param fn A function that takes an index (std::size_t) and returns a `std::complex<T>`.
+	 */
+	template <typename FN>
+	ComplexCollection(std::size_t size, FN fn)
+		: _re(Collection<T>::allocate(size)), _im(Collection<T>::allocate(size))
+	{
+		T *re = _re.data();
+		T *im = _im.data();
+		parallel_for(size, [&](std::size_t begin, std::size_t end)
+					 {
+						 for (std::size_t idx = begin; idx < end; ++idx)
+						 {
+							 std::complex<T> z = fn(idx);
+							 re[idx] = z.real();
+							 im[idx] = z.imag();
+						 } });
+	}
+
+	/**
+	 * @brief Constructs a collection which takes ownership of separate real and imaginary arrays.
+	 * @param re The real parts.
+	 * @param im The imaginary parts. Must hold as many elements as `re`.
+	 */
+	ComplexCollection(Collection<T> &&re, Collection<T> &&im)
+		: _re(std::move(re)), _im(std::move(im))
+	{
+		assert_equal(_re.size(), _im.size(), "ComplexCollection: Real and imaginary parts differ in size");
+	}
+
+	/**
+	 * @brief Constructs a collection by splitting an interleaved collection of `std::complex`.
+	 * @param aos The source collection.
+	 */
+	explicit ComplexCollection(const Collection<std::complex<T>> &aos)
+		: ComplexCollection(aos.size(), [src = aos.data()](std::size_t idx)
+							{ return src[idx]; })
+	{
+	}
+
+	/**
+	 * @brief Move constructor. Takes ownership of the parts of another collection.
+	 * @param src The source collection to move from.
+	 */
+	ComplexCollection(ComplexCollection<T> &&src) = default;
+
+	/**
+	 * @brief Creates a collection of a given size with uninitialized (default constructed) parts.
+	 * @details Used by kernels which are about to overwrite every element.
+	 * @param size The number of elements.
+	 * @return The new collection.
+	 */
+	static ComplexCollection<T> allocate(std::size_t size)
+	{
+		return ComplexCollection<T>(Collection<T>::allocate(size), Collection<T>::allocate(size));
+	}
+
+	/**
+	 * @brief Gets the number of elements in the collection.
+	 * @return The size of the collection.
+	 */
+	inline std::size_t size() const { return _re.size(); }
+
+	/**
+	 * @brief Gets the real parts of the elements.
+	 * @return A constant reference to the real parts.
+	 */
+	inline const Collection<T> &real() const { return _re; }
+
+	/**
+	 * @brief Gets the imaginary parts of the elements.
+	 * @return A constant reference to the imaginary parts.
+	 */
+	inline const Collection<T> &imag() const { return _im; }
+
+	/**
+	 * @brief Gets a mutable pointer to the real parts.
+	 * @return The real part array.
+	 */
+	inline T *real_data() { return _re.data(); }
+
+	/**
+	 * @brief Gets a mutable pointer to the imaginary parts.
+	 * @return The imaginary part array.
+	 */
+	inline T *imag_data() { return _im.data(); }
+
+	/**
+	 * @brief Gets the element at a specific index.
+	 * @param idx The index of the element.
+	 * @return The element.
+	 */
+	std::complex<T> get(std::size_t idx) const
+	{
+		return std::complex<T>(_re.get(idx), _im.get(idx));
+	}
+
+	/**
+	 * @brief Sets the element at a specific index.
+	 * @param idx The index of the element to set.
+	 * @param value The new value for the element.
+	 */
+	void set(std::size_t idx, const std::complex<T> &value)
+	{
+		_re.set(idx, value.real());
+		_im.set(idx, value.imag());
+	}
+
+	/**
+	 * @brief Creates a new collection by applying a function to the parts of each element.
+	 * @details The function sees the real and imaginary parts as two scalars, so arithmetic
+	 *          written on them vectorizes like any other element-wise loop. The elements are
+	 *          split across threads, so `fn` must be safe to call concurrently.
+	 * @code
+	 * ComplexCollection<double> sq = zs.map([](double re, double im)
+	 *     { return std::complex<double>(re * re - im * im, 2 * re * im); });
+	 * @endcode
+	 * @tparam FN The type of the mapping function.
+	 * @param fn A function taking `(re, im)` and returning the new element as a `std::complex<T>`.
+	 * @return A new collection containing the transformed elements.
+	 */
+	template <typename FN>
+	ComplexCollection<T> map(FN fn) const
+	{
+		ComplexCollection<T> res = allocate(size());
+		const T *re = _re.data();
+		const T *im = _im.data();
+		T *out_re = res.real_data();
+		T *out_im = res.imag_data();
+		parallel_for(size(), [&](std::size_t begin, std::size_t end)
+					 {
+						 for (std::size_t idx = begin; idx < end; ++idx)
+						 {
+							 std::complex<T> z = fn(re[idx], im[idx]);
+							 out_re[idx] = z.real();
+							 out_im[idx] = z.imag();
+						 } });
+		return res;
+	}
+
+	/**
+	 * @brief Creates a new real collection by applying a function to the parts of each element.
+	 * @tparam U The element type of the new collection.
+	 * @tparam FN The type of the mapping function.
+	 * @param fn A function taking `(re, im)` and returning an element of type U.
+	 * @return A new collection containing the results.
+	 */
+	template <typename U, typename FN>
+	Collection<U> map_real(FN fn) const
+	{
+		Collection<U> res = Collection<U>::allocate(size());
+		const T *re = _re.data();
+		const T *im = _im.data();
+		U *out = res.data();
+		parallel_for(size(), [&](std::size_t begin, std::size_t end)
+					 {
+						 for (std::size_t idx = begin; idx < end; ++idx)
+							 out[idx] = fn(re[idx], im[idx]); });
+		return res;
+	}
+
+	/**
+	 * @brief Creates a new collection by combining the parts of the elements at the same index of two collections.
+	 * @tparam FN The type of the combining function.
+	 * @param other The second collection.
+	 * @param fn A function taking `(re, im, other_re, other_im)` and returning the new element as a `std::complex<T>`.
+	 * @return A new collection with as many elements as the shorter input.
+	 */
+	template <typename FN>
+	ComplexCollection<T> zip(const ComplexCollection<T> &other, FN fn) const
+	{
+		std::size_t count = std::min(size(), other.size());
+		ComplexCollection<T> res = allocate(count);
+		const T *are = _re.data();
+		const T *aim = _im.data();
+		const T *bre = other._re.data();
+		const T *bim = other._im.data();
+		T *out_re = res.real_data();
+		T *out_im = res.imag_data();
+		parallel_for(count, [&](std::size_t begin, std::size_t end)
+					 {
+						 for (std::size_t idx = begin; idx < end; ++idx)
+						 {
+							 std::complex<T> z = fn(are[idx], aim[idx], bre[idx], bim[idx]);
+							 out_re[idx] = z.real();
+							 out_im[idx] = z.imag();
+						 } });
+		return res;
+	}
+
+	/**
+	 * @brief Creates the complex conjugate of every element.
+	 * @return A new collection sharing no storage with this one.
+	 */
+	ComplexCollection<T> conj() const
+	{
+		return map([](T re, T im)
+				   { return std::complex<T>(re, -im); });
+	}
+
+	/**
+	 * @brief Computes the squared magnitude `re^2 + im^2` of every element.
+	 * @return A new collection of the squared magnitudes.
+	 */
+	Collection<T> norm() const
+	{
+		return map_real<T>([](T re, T im)
+						   { return re * re + im * im; });
+	}
+
+	/**
+	 * @brief Computes the magnitude of every element as `sqrt(re^2 + im^2)`.
+	 * @return A new collection of the magnitudes.
+	 */
+	Collection<T> abs() const
+	{
+		return map_real<T>([](T re, T im)
+						   { return std::sqrt(re * re + im * im); });
+	}
+
+	/**
+	 * @brief Converts this collection into an interleaved collection of `std::complex`.
+	 * @return A new `Collection<std::complex<T>>` holding the same elements.
+	 */
+	Collection<std::complex<T>> to_aos() const
+	{
+		const T *re = _re.data();
+		const T *im = _im.data();
+		return Collection<std::complex<T>>(size(), [re, im](std::size_t idx)
+										   { return std::complex<T>(re[idx], im[idx]); });
+	}
+
+	/**
+	 * @brief Copy the elements of this collection into a std::vector
+	 * @return A std::vector of `std::complex<T>` holding the elements in order.
+	 */
+	std::vector<std::complex<T>> to_vector() const
+	{
+		std::vector<std::complex<T>> res(size());
+		for (std::size_t idx = 0; idx < size(); ++idx)
+			res[idx] = get(idx);
+		return res;
+	}
+};
+
+/**
+ * @brief Adds two complex collections element by element.
+ * @tparam T The type of the parts.
+ * @param u The first collection.
+ * @param v The second collection.
+ * @return A new collection containing the element-wise sum.
+ */
+template <typename T>
+ComplexCollection<T> operator+(const ComplexCollection<T> &u, const ComplexCollection<T> &v)
+{
+	return u.zip(v, [](T ar, T ai, T br, T bi)
+				 { return std::complex<T>(ar + br, ai + bi); });
+}
+
+/**
+ * @brief Subtracts one complex collection from another element by element.
+ * @tparam T The type of the parts.
+ * @param u The first collection.
+ * @param v The second collection.
+ * @return A new collection containing the element-wise difference.
+ */
+template <typename T>
+ComplexCollection<T> operator-(const ComplexCollection<T> &u, const ComplexCollection<T> &v)
+{
+	return u.zip(v, [](T ar, T ai, T br, T bi)
+				 { return std::complex<T>(ar - br, ai - bi); });
+}
+
+/**
+ * @brief Multiplies two complex collections element by element.
+ * @tparam T The type of the parts.
+ * @param u The first collection.
+ * @param v The second collection.
+ * @return A new collection containing the element-wise product.
+ */
+template <typename T>
+ComplexCollection<T> operator*(const ComplexCollection<T> &u, const ComplexCollection<T> &v)
+{
+	return u.zip(v, [](T ar, T ai, T br, T bi)
+				 { return std::complex<T>(ar * br - ai * bi, ar * bi + ai * br); });
+}
+
+/**
+ * @brief Multiplies every element of a complex collection by a complex scalar.
+ * @tparam T The type of the parts.
+ * @param u The collection.
+ * @param s The scalar.
+ * @return A new collection containing the scaled elements.
+ */
+template <typename T>
+ComplexCollection<T> operator*(const ComplexCollection<T> &u, const std::complex<T> &s)
+{
+	T sr = s.real(), si = s.imag();
+	return u.map([sr, si](T re, T im)
+				 { return std::complex<T>(re * sr - im * si, re * si + im * sr); });
+}
+
+/**
+ * @brief Multiplies a complex scalar by every element of a complex collection.
+ * @tparam T The type of the parts.
+ * @param s The scalar.
+ * @param u The collection.
+ * @return A new collection containing the scaled elements.
+ */
+template <typename T>
+ComplexCollection<T> operator*(const std::complex<T> &s, const ComplexCollection<T> &u)
+{
+	return u * s;
+}
+
+/**
+ * @brief Accumulates the complex dot product of two arrays of parts.
+ * @details Keeps `widening_lanes` partial sums of each part, so the loop vectorizes without
+ *          reassociating a single running sum.
+ * @tparam T The type of the parts.
+ * @param are The real parts of the first array.
+ * @param aim The imaginary parts of the first array, negated when `conjugate` is set.
+ * @param bre The real parts of the second array.
+ * @param bim The imaginary parts of the second array.
+ * @param begin The first element to include.
+ * @param end One past the last element to include.
+ * @param conjugate Whether to conjugate the first array.
+ * @return The sum of the products over the range.
+ */
+template <typename T>
+std::complex<T> complex_dot_range(const T *are, const T *aim, const T *bre, const T *bim,
+								  std::size_t begin, std::size_t end, bool conjugate)
+{
+	T sign = conjugate ? T(-1) : T(1);
+	T lanes_re[widening_lanes] = {};
+	T lanes_im[widening_lanes] = {};
+	std::size_t idx = begin;
+	for (; idx + widening_lanes <= end; idx += widening_lanes)
+		for (std::size_t lane = 0; lane < widening_lanes; ++lane)
+		{
+			T ar = are[idx + lane], ai = sign * aim[idx + lane];
+			T br = bre[idx + lane], bi = bim[idx + lane];
+			lanes_re[lane] += ar * br - ai * bi;
+			lanes_im[lane] += ar * bi + ai * br;
+		}
+	for (; idx < end; ++idx)
+	{
+		T ar = are[idx], ai = sign * aim[idx];
+		lanes_re[0] += ar * bre[idx] - ai * bim[idx];
+		lanes_im[0] += ar * bim[idx] + ai * bre[idx];
+	}
+	return std::complex<T>(combine_lanes(lanes_re), combine_lanes(lanes_im));
+}
+
+/**
+ * @brief Computes the unconjugated complex dot product `sum u[i] * v[i]`.
+ * @details Named after the BLAS `zdotu`, so that `dot<T>` keeps naming a single function.
+ * @tparam T The type of the parts.
+ * @param u The first collection.
+ * @param v The second collection, of the same size.
+ * @return The dot product.
+ */
+template <typename T>
+std::complex<T> dotu(const ComplexCollection<T> &u, const ComplexCollection<T> &v)
+{
+	assert_equal(u.size(), v.size(), "dotu: Collection sizes differ");
+	const T *are = u.real().data(), *aim = u.imag().data();
+	const T *bre = v.real().data(), *bim = v.imag().data();
+	return parallel_reduce(
+		u.size(), std::complex<T>(), [&](std::size_t begin, std::size_t end)
+		{ return complex_dot_range(are, aim, bre, bim, begin, end, false); },
+		[](const std::complex<T> &a, const std::complex<T> &b)
+		{ return a + b; });
+}
+
+/**
+ * @brief Computes the conjugated complex dot product `sum conj(u[i]) * v[i]`.
+ * @details Named after the BLAS `zdotc`; `dotc(u, u)` is the squared 2-norm of `u`.
+ * @tparam T The type of the parts.
+ * @param u The first collection, which is conjugated.
+ * @param v The second collection, of the same size.
+ * @return The dot product.
+ */
+template <typename T>
+std::complex<T> dotc(const ComplexCollection<T> &u, const ComplexCollection<T> &v)
+{
+	assert_equal(u.size(), v.size(), "dotc: Collection sizes differ");
+	const T *are = u.real().data(), *aim = u.imag().data();
+	const T *bre = v.real().data(), *bim = v.imag().data();
+	return parallel_reduce(
+		u.size(), std::complex<T>(), [&](std::size_t begin, std::size_t end)
+		{ return complex_dot_range(are, aim, bre, bim, begin, end, true); },
+		[](const std::complex<T> &a, const std::complex<T> &b)
+		{ return a + b; });
+}
+
+/**
+ * @brief Overloads the stream insertion operator to print a complex collection.
+ * @tparam T The type of the parts.
+ * @param os The output stream.
+ * @param c The collection to print.
+ * @return A reference to the output stream.
+ */
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const ComplexCollection<T> &c)
+{
+	char delim = '[';
+	for (std::size_t idx = 0; idx < c.size(); ++idx)
+	{
+		os << delim << c.get(idx);
+		delim = ',';
+	}
+	os << ']';
+	return os;
+}
+
+#endif // COMPLEX_HPP
@@ -0,0 +1,515 @@
+/**
+ * @file natv_grid.hpp
+ * @brief Defines the Grid class, a two dimensional collection stored in row-major order.
+ * @details A Grid is a thin layer over a `Collection` which adds `(row, col)` indexed
+ *          generation, row and column views, cache-blocked tiled traversal and a
+ *          cache-oblivious transpose. Image and matrix shaped workloads can use it to
+ *          iterate over their elements without recovering the row and column of every
+ *          element from a flat index.
+ */
+
+#ifndef GRID_HPP
+#define GRID_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <iostream>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @class StridedView
+ * @brief A read-only view of evenly spaced elements in a contiguous array.
+ * @details Used to present a single row (stride 1) or column (stride equal to the
+ *          row length) of a Grid without copying it.
+ * @tparam T The type of elements being viewed.
+ */
+template <typename T>
+class StridedView
+{
+private:
+	/** @brief Pointer to the first element of the view. */
+	const T *_base;
+
+	/** @brief The number of elements in the view. */
+	std::size_t _size;
+
+	/** @brief The distance, in elements, between consecutive elements of the view. */
+	std::size_t _stride;
+
+public:
+	/**
+	 * @brief Constructs a view.
+	 * @param base Pointer to the first element of the view.
+	 * @param size The number of elements in the view.
+	 * @param stride The distance, in elements, between consecutive elements of the view.
+	 */
+	StridedView(const T *base, std::size_t size, std::size_t stride)
+		: _base(base), _size(size), _stride(stride) {}
+
+	/**
+	 * @brief Gets the number of elements in the view.
+	 * @return The size of the view.
+	 */
+	inline std::size_t size() const { return _size; }
+
+	/**
+	 * @brief Gets the distance between consecutive elements of the view.
+	 * @return The stride of the view in elements.
+	 */
+	inline std::size_t stride() const { return _stride; }
+
+	/**
+	 * @brief Gets the element at a specific position without bounds checking.
+	 * @param idx The position of the element within the view.
+	 * @return A constant reference to the element.
+	 */
+	inline const T &operator[](std::size_t idx) const { return _base[idx * _stride]; }
+
+	/**
+	 * @brief Gets the element at a specific position.
+	 * @param idx The position of the element within the view.
+	 * @return A copy of the element.
+	 */
+	inline T get(std::size_t idx) const
+	{
+		assert_true(idx < _size, "get: Index out of bounds");
+		return (*this)[idx];
+	}
+
+	/**
+	 * @brief Reduces the view to a single value using a binary function.
+	 * @tparam FN The type of the reduction function.
+	 * @param fn A binary function that takes an accumulated value and the next element, returning the new accumulated value.
+	 * @return The final reduced value. Returns `T(0)` for an empty view.
+	 */
+	template <typename FN>
+	T reduce(FN fn) const
+	{
+		if (_size == 0)
+			return T(0);
+
+		T acc = _base[0];
+		const T *ptr = _base + _stride;
+		for (std::size_t idx = 1; idx < _size; ++idx, ptr += _stride)
+			acc = fn(acc, *ptr);
+		return acc;
+	}
+
+	/**
+	 * @brief Copies the elements of the view into a new, contiguous collection.
+	 * @return A collection holding a copy of the viewed elements.
+	 */
+	Collection<T> to_collection() const
+	{
+		Collection<T> res = Collection<T>::allocate(_size);
+		T *out = res.data();
+		const T *ptr = _base;
+		for (std::size_t idx = 0; idx < _size; ++idx, ptr += _stride)
+			out[idx] = *ptr;
+		return res;
+	}
+};
+
+/**
+ * @class Grid
+ * @brief A fixed-size, two dimensional collection of elements stored in row-major order.
+ * @details The elements live in a single `Collection<T>` of `rows * cols` elements, so any
+ *          one dimensional operation is still available through `cells()`. Generation and
+ *          tiled traversal visit the grid one `tile_size` x `tile_size` block at a time so
+ *          that both the block being written and anything read alongside it stay in cache.
+ * @tparam T The type of elements in the grid.
+ */
+template <typename T>
+class Grid
+{
+public:
+	/** @brief Edge length, in elements, of the square tiles used for blocked traversal. */
+	static constexpr std::size_t tile_size = 64;
+
+private:
+	/** @brief Edge length, in elements, below which the transpose stops subdividing. */
+	static constexpr std::size_t transpose_leaf = 16;
+
+	/** @brief The number of rows in the grid. */
+	std::size_t _rows;
+
+	/** @brief The number of columns in the grid. */
+	std::size_t _cols;
+
+	/** @brief The elements of the grid in row-major order. */
+	Collection<T> _cells;
+
+	/**
+	 * @brief Recursively transposes a block of a row-major array.
+	 * @details Splits the longer side of the block in half until it is small enough to fit
+	 *          in cache at every level of the hierarchy, without knowing the cache sizes.
+	 * @param src The source array, with `cols` elements per row.
+	 * @param dst The destination array, with `rows` elements per row.
+	 * @param rows The number of rows in the source array.
+	 * @param cols The number of columns in the source array.
+	 * @param r0 The first source row of the block.
+	 * @param r1 One past the last source row of the block.
+	 * @param c0 The first source column of the block.
+	 * @param c1 One past the last source column of the block.
+	 */
+	static void transpose_block(const T *src, T *dst,
+								std::size_t rows, std::size_t cols,
+								std::size_t r0, std::size_t r1,
+								std::size_t c0, std::size_t c1)
+	{
+		if (r1 - r0 <= transpose_leaf && c1 - c0 <= transpose_leaf)
+		{
+			for (std::size_t row = r0; row < r1; ++row)
+			{
+				const T *src_row = src + row * cols;
+				for (std::size_t col = c0; col < c1; ++col)
+					dst[col * rows + row] = src_row[col];
+			}
+		}
+		else if (r1 - r0 >= c1 - c0)
+		{
+			std::size_t mid = r0 + (r1 - r0) / 2;
+			transpose_block(src, dst, rows, cols, r0, mid, c0, c1);
+			transpose_block(src, dst, rows, cols, mid, r1, c0, c1);
+		}
+		else
+		{
+			std::size_t mid = c0 + (c1 - c0) / 2;
+			transpose_block(src, dst, rows, cols, r0, r1, c0, mid);
+			transpose_block(src, dst, rows, cols, r0, r1, mid, c1);
+		}
+	}
+
+public:
+	/**
+	 * @brief Constructs a grid by generating elements from their coordinates.
+	 * @details Elements are generated tile by tile; the row and column of each element are
+	 *          tracked by the loops themselves rather than recovered by division.
+	 * @tparam FN The type of the generator function.
+	 * @param rows The number of rows in the grid.
+	 * @param cols The number of columns in the grid.
+	 * @param fn A function that takes a row and a column (both std::size_t) and returns an element of type T.
+	 */
+	template <typename FN>
+	Grid(std::size_t rows, std::size_t cols, FN fn)
+		: _rows(rows), _cols(cols), _cells(Collection<T>::allocate(rows * cols))
+	{
+		T *out = _cells.data();
+		for_each_tile([&](std::size_t r0, std::size_t r1, std::size_t c0, std::size_t c1)
+					  {
+						  for (std::size_t row = r0; row < r1; ++row)
+						  {
+							  T *out_row = out + row * _cols;
+							  for (std::size_t col = c0; col < c1; ++col)
+								  out_row[col] = fn(row, col);
+						  } });
+	}
+
+	/**
+	 * @brief Constructs a grid which takes ownership of an existing collection.
+	 * @param rows The number of rows in the grid.
+	 * @param cols The number of columns in the grid.
+	 * @param cells The elements of the grid in row-major order. Must hold exactly `rows * cols` elements.
+	 */
+	Grid(std::size_t rows, std::size_t cols, Collection<T> &&cells)
+		: _rows(rows), _cols(cols), _cells(std::move(cells))
+	{
+		assert_equal(_cells.size(), rows * cols, "Grid: Collection size does not match grid dimensions");
+	}
+
+	/**
+	 * @brief Move constructor. Takes ownership of the elements of another grid.
+	 * @param src The source grid to move from.
+	 */
+	Grid(Grid<T> &&src) = default;
+
+	/**
+	 * @brief Gets the number of rows in the grid.
+	 * @return The number of rows.
+	 */
+	inline std::size_t rows() const { return _rows; }
+
+	/**
+	 * @brief Gets the number of columns in the grid.
+	 * @return The number of columns.
+	 */
+	inline std::size_t cols() const { return _cols; }
+
+	/**
+	 * @brief Gets the total number of elements in the grid.
+	 * @return The number of rows multiplied by the number of columns.
+	 */
+	inline std::size_t size() const { return _cells.size(); }
+
+	/**
+	 * @brief Gets the underlying row-major collection.
+	 * @return A constant reference to the collection holding the elements.
+	 */
+	inline const Collection<T> &cells() const { return _cells; }
+
+	/**
+	 * @brief Gets a pointer to the underlying row-major data array.
+	 * @return Pointer to underlying data array.
+	 */
+	inline const T *data() const { return _cells.data(); }
+
+	/**
+	 * @brief Gets a mutable pointer to the underlying row-major data array.
+	 * @return Pointer to underlying data array.
+	 */
+	inline T *data() { return _cells.data(); }
+
+	/**
+	 * @brief Gets the element at a specific position.
+	 * @param row The row of the element.
+	 * @param col The column of the element.
+	 * @return A copy of the element.
+	 */
+	inline T get(std::size_t row, std::size_t col) const
+	{
+		assert_true(row < _rows && col < _cols, "get: Index out of bounds");
+		return _cells.data()[row * _cols + col];
+	}
+
+	/**
+	 * @brief Sets the element at a specific position.
+	 * @param row The row of the element.
+	 * @param col The column of the element.
+	 * @param value The new value for the element.
+	 */
+	inline void set(std::size_t row, std::size_t col, const T &value)
+	{
+		assert_true(row < _rows && col < _cols, "set: Index out of bounds");
+		_cells.data()[row * _cols + col] = value;
+	}
+
+	/**
+	 * @brief Gets a view of a single row.
+	 * @param row The row to view.
+	 * @return A view of the `cols()` elements of the row.
+	 */
+	inline StridedView<T> row(std::size_t row) const
+	{
+		assert_true(row < _rows, "row: Index out of bounds");
+		return StridedView<T>(_cells.data() + row * _cols, _cols, 1);
+	}
+
+	/**
+	 * @brief Gets a view of a single column.
+	 * @param col The column to view.
+	 * @return A view of the `rows()` elements of the column.
+	 */
+	inline StridedView<T> col(std::size_t col) const
+	{
+		assert_true(col < _cols, "col: Index out of bounds");
+		return StridedView<T>(_cells.data() + col, _rows, _cols);
+	}
+
+	/**
+	 * @brief Visits the grid one cache-sized tile at a time.
+	 * @details Tiles are visited in row-major order, and each tile is described by its half
+	 *          open row and column ranges. Tiles on the bottom and right edges are clipped to
+	 *          the grid.
+	 * @tparam FN The type of the tile function.
+	 * @param fn A function taking `(row_begin, row_end, col_begin, col_end)`.
+	 * @param tile The edge length of each tile, in elements.
+	 */
+	template <typename FN>
+	void for_each_tile(FN fn, std::size_t tile = tile_size) const
+	{
+		assert_true(tile > 0, "for_each_tile: Tile size must be positive");
+		for (std::size_t r0 = 0; r0 < _rows; r0 += tile)
+		{
+			std::size_t r1 = std::min(r0 + tile, _rows);
+			for (std::size_t c0 = 0; c0 < _cols; c0 += tile)
+				fn(r0, r1, c0, std::min(c0 + tile, _cols));
+		}
+	}
+
+	/**
+	 * @brief Visits every element of the grid, tile by tile.
+	 * @tparam FN The type of the visiting function.
+	 * @param fn A function taking `(row, col, value)` for each element.
+	 */
+	template <typename FN>
+	void for_each(FN fn) const
+	{
+		const T *src = _cells.data();
+		for_each_tile([&](std::size_t r0, std::size_t r1, std::size_t c0, std::size_t c1)
+					  {
+						  for (std::size_t row = r0; row < r1; ++row)
+						  {
+							  const T *src_row = src + row * _cols;
+							  for (std::size_t col = c0; col < c1; ++col)
+								  fn(row, col, src_row[col]);
+						  } });
+	}
+
+	/**
+	 * @brief Creates a new grid of the same shape by applying a function to each element.
+	 * @tparam U The element type of the new grid.
+	 * @tparam FN The type of the mapping function.
+	 * @param fn A function that takes an element of type T and returns an element of type U.
+	 * @return A new `Grid<U>` containing the transformed elements.
+	 */
+	template <typename U, typename FN>
+	Grid<U> map(FN fn) const
+	{
+		return Grid<U>(_rows, _cols, _cells.template map<U>(fn));
+	}
+
+	/**
+	 * @brief Combines every element with the matching element of a row vector (broadcast down the rows).
+	 * @details Element `(row, col)` of the result is `fn(get(row, col), v[col])`; the vector is
+	 *          read in place for every row, so it is never replicated.
+	 * @tparam U The element type of the new grid.
+	 * @tparam V The element type of the row vector.
+	 * @tparam FN The type of the binary function.
+	 * @param v The row vector. Must have `cols()` elements.
+	 * @param fn A function taking a grid element and a vector element and returning a U.
+	 * @return A new `Grid<U>` of the same shape.
+	 */
+	template <typename U, typename V, typename FN>
+	Grid<U> broadcast_row(const Collection<V> &v, FN fn) const
+	{
+		assert_true(v.size() == _cols, "broadcast_row: Vector length does not match column count");
+		Collection<U> res = Collection<U>::allocate(size());
+		U *dst = res.data();
+		const T *src = _cells.data();
+		const V *vec = v.data();
+		for (std::size_t row = 0; row < _rows; ++row)
+		{
+			const T *src_row = src + row * _cols;
+			U *dst_row = dst + row * _cols;
+			for (std::size_t col = 0; col < _cols; ++col)
+				dst_row[col] = fn(src_row[col], vec[col]);
+		}
+		return Grid<U>(_rows, _cols, std::move(res));
+	}
+
+	/**
+	 * @brief Combines every element with the matching element of a column vector (broadcast across the columns).
+	 * @details Element `(row, col)` of the result is `fn(get(row, col), v[row])`; each vector
+	 *          element is loaded once per row and held for the whole row.
+	 * @tparam U The element type of the new grid.
+	 * @tparam V The element type of the column vector.
+	 * @tparam FN The type of the binary function.
+	 * @param v The column vector. Must have `rows()` elements.
+	 * @param fn A function taking a grid element and a vector element and returning a U.
+	 * @return A new `Grid<U>` of the same shape.
+	 */
+	template <typename U, typename V, typename FN>
+	Grid<U> broadcast_col(const Collection<V> &v, FN fn) const
+	{
+		assert_true(v.size() == _rows, "broadcast_col: Vector length does not match row count");
+		Collection<U> res = Collection<U>::allocate(size());
+		U *dst = res.data();
+		const T *src = _cells.data();
+		for (std::size_t row = 0; row < _rows; ++row)
+		{
+			const V s = v.data()[row];
+			const T *src_row = src + row * _cols;
+			U *dst_row = dst + row * _cols;
+			for (std::size_t col = 0; col < _cols; ++col)
+				dst_row[col] = fn(src_row[col], s);
+		}
+		return Grid<U>(_rows, _cols, std::move(res));
+	}
+
+	/**
+	 * @brief Creates the transpose of this grid.
+	 * @details Uses a cache-oblivious recursive subdivision, so the copy stays cache friendly
+	 *          on both the row-major reads and the column-major writes.
+	 * @return A new grid with `cols()` rows and `rows()` columns.
+	 */
+	Grid<T> transpose() const
+	{
+		Collection<T> res = Collection<T>::allocate(size());
+		transpose_block(_cells.data(), res.data(), _rows, _cols, 0, _rows, 0, _cols);
+		return Grid<T>(_cols, _rows, std::move(res));
+	}
+
+	/**
+	 * @brief Copy the elements of this grid, in row-major order, into a std::vector
+	 *
+	 * @return Vector containing the elements of the grid
+	 */
+	inline std::vector<T> to_vector() const { return _cells.to_vector(); }
+};
+
+/**
+ * @brief Creates several grids of the same shape by generating a tuple of elements for each cell.
+ * @details The grid counterpart of `generate_unzip` for collections. Rows are split across
+ *          threads, and every output is filled in the same pass, so an expensive per-cell
+ *          computation with several results runs only once per cell. It must be safe to
+ *          call `fn` concurrently.
+ * @tparam US The element types of the new grids.
+ * @tparam FN The type of the generator function.
+ * @param rows The number of rows.
+ * @param cols The number of columns.
+ * @param fn Either `fn(row, col)` returning a tuple of results, or
+ *           `fn(row, col, out0, out1, ...)` writing them in place.
+ * @return A tuple holding one new grid per output.
+ */
+template <typename... US, typename FN>
+std::tuple<Grid<US>...> generate_unzip(std::size_t rows, std::size_t cols, FN fn)
+{
+	std::tuple<Collection<US>...> cells(Collection<US>::allocate(rows * cols)...);
+	auto outs = std::apply([](Collection<US> &...cs)
+						   { return std::make_tuple(cs.data()...); },
+						   cells);
+	std::size_t grain = std::max<std::size_t>(1, parallel_grain / std::max<std::size_t>(1, cols));
+	parallel_for(
+		rows, [&](std::size_t r0, std::size_t r1)
+		{ std::apply([&](US *...ps)
+					 {
+						 for (std::size_t row = r0; row < r1; ++row)
+							 for (std::size_t col = 0; col < cols; ++col)
+							 {
+								 std::size_t idx = row * cols + col;
+								 if constexpr (std::is_invocable<FN &, std::size_t, std::size_t, US &...>::value)
+									 fn(row, col, ps[idx]...);
+								 else
+									 std::tie(ps[idx]...) = fn(row, col);
+							 } },
+					 outs); },
+		grain);
+	return std::apply([&](Collection<US> &...cs)
+					  { return std::tuple<Grid<US>...>(Grid<US>(rows, cols, std::move(cs))...); },
+					  cells);
+}
+
+/**
+ * @brief Overloads the stream insertion operator to print a grid, one bracketed row at a time.
+ * @tparam T The element type of the grid.
+ * @param os The output stream.
+ * @param g The grid to print.
+ * @return The output stream.
+ */
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const Grid<T> &g)
+{
+	os << '[';
+	for (std::size_t row = 0; row < g.rows(); ++row)
+	{
+		if (row > 0)
+			os << ',';
+		char delim = '[';
+		for (std::size_t col = 0; col < g.cols(); ++col)
+		{
+			os << delim << g.get(row, col);
+			delim = ',';
+		}
+		os << (g.cols() == 0 ? "[]" : "]");
+	}
+	os << ']';
+	return os;
+}
+
+#endif // GRID_HPP
@@ -0,0 +1,820 @@
+/**
+ * @file natv_matrix.hpp
+ * @brief Defines the Matrix class and cache-blocked, multi-threaded GEMM and GEMV kernels.
+ * @details A Matrix is a dense, row-major two dimensional array of numbers stored in a
+ *          `Collection`. Matrix products are computed the way optimized BLAS libraries do:
+ *
+ *          - `gemm` splits the product into blocks sized for the cache hierarchy: a `kc`
+ *            deep slice of B is packed into `nr` column panels (kept in L3/L2), and an
+ *            `mc` by `kc` block of A is packed into `mr` row panels (kept in L2). A register
+ *            blocked micro-kernel then multiplies one A panel by one B panel, holding the
+ *            whole `mr` by `nr` block of C in vector registers for the full depth of the
+ *            panels. Blocks of rows of C are shared out between threads.
+ *          - `gemv` computes four rows of the product at a time, so each load of the vector
+ *            is reused four times, with rows shared out between threads.
+ *
+ *          The micro-kernels use AVX-512 or AVX2 fused multiply-add instructions for
+ *          `float` and `double` when the compiler targets them (for example with the
+ *          `MAP_REDUCE_NATIVE_ARCH` CMake option), and otherwise a portable four-wide
+ *          kernel which the compiler vectorizes with whatever instructions are available.
+ */
+
+#ifndef MATRIX_HPP
+#define MATRIX_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/blas1.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @class Matrix
+ * @brief A fixed-size, dense, row-major matrix.
+ * @tparam T The type of elements in the matrix.
+ */
+template <typename T>
+class Matrix
+{
+private:
+	/** @brief The number of rows in the matrix. */
+	std::size_t _rows;
+
+	/** @brief The number of columns in the matrix. */
+	std::size_t _cols;
+
+	/** @brief The elements of the matrix in row-major order. */
+	Collection<T> _cells;
+
+public:
+	/**
+	 * @brief Constructs a matrix by generating elements from their coordinates.
+	 * @details Rows are split across threads, so `fn` must be safe to call concurrently.
+	 * @tparam FN The type of the generator function.
+	 * @param rows The number of rows in the matrix.
+	 * @param cols The number of columns in the matrix.
+	 * @param fn A function that takes a row and a column (both std::size_t) and returns an element of type T.
+	 */
+	template <typename FN>
+	Matrix(std::size_t rows, std::size_t cols, FN fn)
+		: _rows(rows), _cols(cols), _cells(Collection<T>::allocate(rows * cols))
+	{
+		T *out = _cells.data();
+		parallel_for(
+			rows, [&](std::size_t r0, std::size_t r1)
+			{
+				for (std::size_t row = r0; row < r1; ++row)
+					for (std::size_t col = 0; col < cols; ++col)
+						out[row * cols + col] = fn(row, col); },
+			std::max<std::size_t>(1, parallel_grain / std::max<std::size_t>(1, cols)));
+	}
+
+	/**
+	 * @brief Constructs a matrix which takes ownership of an existing collection.
+	 * @param rows The number of rows in the matrix.
+	 * @param cols The number of columns in the matrix.
+	 * @param cells The elements of the matrix in row-major order. Must hold exactly `rows * cols` elements.
+	 */
+	Matrix(std::size_t rows, std::size_t cols, Collection<T> &&cells)
+		: _rows(rows), _cols(cols), _cells(std::move(cells))
+	{
+		assert_equal(_cells.size(), rows * cols, "Matrix: Collection size does not match matrix dimensions");
+	}
+
+	/**
+	 * @brief Move constructor. Takes ownership of the elements of another matrix.
+	 * @param src The source matrix to move from.
+	 */
+	Matrix(Matrix<T> &&src) = default;
+
+	/**
+	 * @brief Creates a matrix of zeros.
+	 * @param rows The number of rows in the matrix.
+	 * @param cols The number of columns in the matrix.
+	 * @return A new matrix with every element set to 0.
+	 */
+	static Matrix<T> zeros(std::size_t rows, std::size_t cols)
+	{
+		return Matrix<T>(rows, cols, [](std::size_t, std::size_t)
+						 { return T(0); });
+	}
+
+	/**
+	 * @brief Gets the number of rows in the matrix.
+	 * @return The number of rows.
+	 */
+	inline std::size_t rows() const { return _rows; }
+
+	/**
+	 * @brief Gets the number of columns in the matrix.
+	 * @return The number of columns.
+	 */
+	inline std::size_t cols() const { return _cols; }
+
+	/**
+	 * @brief Gets the total number of elements in the matrix.
+	 * @return The number of rows multiplied by the number of columns.
+	 */
+	inline std::size_t size() const { return _cells.size(); }
+
+	/**
+	 * @brief Gets the underlying row-major collection.
+	 * @return A constant reference to the collection holding the elements.
+	 */
+	inline const Collection<T> &cells() const { return _cells; }
+
+	/**
+	 * @brief Gets a pointer to the underlying row-major data array.
+	 * @return Pointer to underlying data array.
+	 */
+	inline const T *data() const { return _cells.data(); }
+
+	/**
+	 * @brief Gets a mutable pointer to the underlying row-major data array.
+	 * @return Pointer to underlying data array.
+	 */
+	inline T *data() { return _cells.data(); }
+
+	/**
+	 * @brief Gets the element at a specific position.
+	 * @param row The row of the element.
+	 * @param col The column of the element.
+	 * @return A copy of the element.
+	 */
+	inline T get(std::size_t row, std::size_t col) const
+	{
+		assert_true(row < _rows && col < _cols, "get: Index out of bounds");
+		return _cells.data()[row * _cols + col];
+	}
+
+	/**
+	 * @brief Sets the element at a specific position.
+	 * @param row The row of the element.
+	 * @param col The column of the element.
+	 * @param value The new value for the element.
+	 */
+	inline void set(std::size_t row, std::size_t col, T value)
+	{
+		assert_true(row < _rows && col < _cols, "set: Index out of bounds");
+		_cells.data()[row * _cols + col] = value;
+	}
+
+	/**
+	 * @brief Copy the elements of this matrix, in row-major order, into a std::vector
+	 *
+	 * @return Vector containing the elements of the matrix
+	 */
+	inline std::vector<T> to_vector() const { return _cells.to_vector(); }
+};
+
+/**
+ * @brief The vector operations used by the GEMM and GEMV micro-kernels.
+ * @details This portable version works on four elements at a time through plain arrays,
+ *          which the compiler maps onto whatever vector instructions it targets. `float` and
+ *          `double` have AVX-512 and AVX2 specializations.
+ * @tparam T The element type.
+ */
+template <typename T>
+struct gemm_simd
+{
+	/** @brief The number of elements in a register. */
+	static constexpr std::size_t width = 4;
+
+	/**
+	 * @brief Rows of C the GEMM micro-kernel keeps in registers.
+	 * @details Two registers per row, plus three for the B and A operands, must fit in the
+	 *          register file: 6 rows for 16 registers, 12 for the 32 of AVX-512.
+	 */
+	static constexpr std::size_t rows = 6;
+
+	/** @brief A register of `width` elements. */
+	struct reg
+	{
+		/** @brief The elements. */
+		T v[width];
+	};
+
+	/** @brief Gets a register of zeros. */
+	static reg zero()
+	{
+		reg res;
+		for (std::size_t lane = 0; lane < width; ++lane)
+			res.v[lane] = T(0);
+		return res;
+	}
+
+	/** @brief Loads `width` consecutive elements. */
+	static reg load(const T *src)
+	{
+		reg res;
+		for (std::size_t lane = 0; lane < width; ++lane)
+			res.v[lane] = src[lane];
+		return res;
+	}
+
+	/** @brief Stores `width` consecutive elements. */
+	static void store(T *dst, const reg &value)
+	{
+		for (std::size_t lane = 0; lane < width; ++lane)
+			dst[lane] = value.v[lane];
+	}
+
+	/** @brief Copies one value into every lane. */
+	static reg broadcast(T value)
+	{
+		reg res;
+		for (std::size_t lane = 0; lane < width; ++lane)
+			res.v[lane] = value;
+		return res;
+	}
+
+	/** @brief Computes `a * b + c` lane by lane. */
+	static reg fmadd(const reg &a, const reg &b, reg c)
+	{
+		for (std::size_t lane = 0; lane < width; ++lane)
+			c.v[lane] += a.v[lane] * b.v[lane];
+		return c;
+	}
+
+	/** @brief Adds two registers lane by lane. */
+	static reg add(reg a, const reg &b)
+	{
+		for (std::size_t lane = 0; lane < width; ++lane)
+			a.v[lane] += b.v[lane];
+		return a;
+	}
+
+	/** @brief Adds together the lanes of a register. */
+	static T hsum(const reg &value)
+	{
+		T res = value.v[0];
+		for (std::size_t lane = 1; lane < width; ++lane)
+			res += value.v[lane];
+		return res;
+	}
+};
+
+#if defined(__AVX512F__)
+/**
+ * @brief AVX-512 vector operations on doubles for the GEMM and GEMV micro-kernels.
+ */
+template <>
+struct gemm_simd<double>
+{
+	/** @brief The number of elements in a register. */
+	static constexpr std::size_t width = 8;
+
+	/**
+	 * @brief Rows of C the GEMM micro-kernel keeps in registers.
+	 * @details Two registers per row, plus three for the B and A operands, fit in the 32
+	 *          registers of AVX-512.
+	 */
+	static constexpr std::size_t rows = 12;
+
+	/** @brief A register of `width` elements: `__m512d`. */
+	using reg = __m512d;
+
+	/** @brief Gets a register of zeros. */
+	static reg zero() { return _mm512_setzero_pd(); }
+
+	/** @brief Loads `width` consecutive elements, which need not be aligned. */
+	static reg load(const double *src) { return _mm512_loadu_pd(src); }
+
+	/** @brief Stores `width` consecutive elements, which need not be aligned. */
+	static void store(double *dst, reg value) { _mm512_storeu_pd(dst, value); }
+
+	/** @brief Copies one value into every lane. */
+	static reg broadcast(double value) { return _mm512_set1_pd(value); }
+
+	/** @brief Computes `a * b + c` lane by lane, with a single rounding. */
+	static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_pd(a, b, c); }
+
+	/** @brief Adds two registers lane by lane. */
+	static reg add(reg a, reg b) { return _mm512_add_pd(a, b); }
+
+	/** @brief Adds together the lanes of a register. */
+	static double hsum(reg value) { return blas_hsum(value); }
+};
+
+/**
+ * @brief AVX-512 vector operations on floats for the GEMM and GEMV micro-kernels.
+ */
+template <>
+struct gemm_simd<float>
+{
+	/** @brief The number of elements in a register. */
+	static constexpr std::size_t width = 16;
+
+	/**
+	 * @brief Rows of C the GEMM micro-kernel keeps in registers.
+	 * @details Two registers per row, plus three for the B and A operands, fit in the 32
+	 *          registers of AVX-512.
+	 */
+	static constexpr std::size_t rows = 12;
+
+	/** @brief A register of `width` elements: `__m512`. */
+	using reg = __m512;
+
+	/** @brief Gets a register of zeros. */
+	static reg zero() { return _mm512_setzero_ps(); }
+
+	/** @brief Loads `width` consecutive elements, which need not be aligned. */
+	static reg load(const float *src) { return _mm512_loadu_ps(src); }
+
+	/** @brief Stores `width` consecutive elements, which need not be aligned. */
+	static void store(float *dst, reg value) { _mm512_storeu_ps(dst, value); }
+
+	/** @brief Copies one value into every lane. */
+	static reg broadcast(float value) { return _mm512_set1_ps(value); }
+
+	/** @brief Computes `a * b + c` lane by lane, with a single rounding. */
+	static reg fmadd(reg a, reg b, reg c) { return _mm512_fmadd_ps(a, b, c); }
+
+	/** @brief Adds two registers lane by lane. */
+	static reg add(reg a, reg b) { return _mm512_add_ps(a, b); }
+
+	/** @brief Adds together the lanes of a register. */
+	static float hsum(reg value) { return blas_hsum(value); }
+};
+#elif defined(__AVX2__) && defined(__FMA__)
+/**
+ * @brief AVX2 vector operations on doubles for the GEMM and GEMV micro-kernels.
+ */
+template <>
+struct gemm_simd<double>
+{
+	/** @brief The number of elements in a register. */
+	static constexpr std::size_t width = 4;
+
+	/**
+	 * @brief Rows of C the GEMM micro-kernel keeps in registers.
+	 * @details Two registers per row, plus three for the B and A operands, fit in the 16
+	 *          registers of AVX2.
+	 */
+	static constexpr std::size_t rows = 6;
+
+	/** @brief A register of `width` elements: `__m256d`. */
+	using reg = __m256d;
+
+	/** @brief Gets a register of zeros. */
+	static reg zero() { return _mm256_setzero_pd(); }
+
+	/** @brief Loads `width` consecutive elements, which need not be aligned. */
+	static reg load(const double *src) { return _mm256_loadu_pd(src); }
+
+	/** @brief Stores `width` consecutive elements, which need not be aligned. */
+	static void store(double *dst, reg value) { _mm256_storeu_pd(dst, value); }
+
+	/** @brief Copies one value into every lane. */
+	static reg broadcast(double value) { return _mm256_set1_pd(value); }
+
+	/** @brief Computes `a * b + c` lane by lane, with a single rounding. */
+	static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_pd(a, b, c); }
+
+	/** @brief Adds two registers lane by lane. */
+	static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+
+	/** @brief Adds together the lanes of a register. */
+	static double hsum(reg value) { return blas_hsum(value); }
+};
+
+/**
+ * @brief AVX2 vector operations on floats for the GEMM and GEMV micro-kernels.
+ */
+template <>
+struct gemm_simd<float>
+{
+	/** @brief The number of elements in a register. */
+	static constexpr std::size_t width = 8;
+
+	/**
+	 * @brief Rows of C the GEMM micro-kernel keeps in registers.
+	 * @details Two registers per row, plus three for the B and A operands, fit in the 16
+	 *          registers of AVX2.
+	 */
+	static constexpr std::size_t rows = 6;
+
+	/** @brief A register of `width` elements: `__m256`. */
+	using reg = __m256;
+
+	/** @brief Gets a register of zeros. */
+	static reg zero() { return _mm256_setzero_ps(); }
+
+	/** @brief Loads `width` consecutive elements, which need not be aligned. */
+	static reg load(const float *src) { return _mm256_loadu_ps(src); }
+
+	/** @brief Stores `width` consecutive elements, which need not be aligned. */
+	static void store(float *dst, reg value) { _mm256_storeu_ps(dst, value); }
+
+	/** @brief Copies one value into every lane. */
+	static reg broadcast(float value) { return _mm256_set1_ps(value); }
+
+	/** @brief Computes `a * b + c` lane by lane, with a single rounding. */
+	static reg fmadd(reg a, reg b, reg c) { return _mm256_fmadd_ps(a, b, c); }
+
+	/** @brief Adds two registers lane by lane. */
+	static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+
+	/** @brief Adds together the lanes of a register. */
+	static float hsum(reg value) { return blas_hsum(value); }
+};
+#endif
+
+/**
+ * @brief The blocking parameters of the GEMM kernel for an element type.
+ * @details `mr` by `nr` is the block of C held in registers by the micro-kernel: `mr` rows
+ *          of two registers each. `kc`, `mc` and `nc` size the packed panels of A and B for
+ *          the L1/L2, L2 and L3 caches.
+ * @tparam T The element type.
+ */
+template <typename T>
+struct gemm_blocking
+{
+	/** @brief Rows of C computed by one micro-kernel call. */
+	static constexpr std::size_t mr = gemm_simd<T>::rows;
+
+	/** @brief Columns of C computed by one micro-kernel call. */
+	static constexpr std::size_t nr = 2 * gemm_simd<T>::width;
+
+	/** @brief Depth of the packed panels. */
+	static constexpr std::size_t kc = 256;
+
+	/** @brief Rows of A packed at a time. A multiple of `mr`. */
+	static constexpr std::size_t mc = 120;
+
+	/** @brief Columns of B packed at a time. A multiple of `nr`. */
+	static constexpr std::size_t nc = 2048;
+};
+
+/**
+ * @brief Packs an `mc` by `kc` block of A into `mr` row panels, scaling it by alpha.
+ * @details Within a panel the `mr` elements of each column are contiguous, in the order the
+ *          micro-kernel broadcasts them. Rows beyond `mc` are padded with zeros.
+ * @tparam T The element type.
+ * @param alpha The factor the elements are multiplied by.
+ * @param a Pointer to the first element of the block.
+ * @param lda The distance between rows of A.
+ * @param mc The number of rows in the block.
+ * @param kc The number of columns in the block.
+ * @param packed The buffer to pack into, with room for `mc` rounded up to `mr`, times `kc` elements.
+ */
+template <typename T>
+void gemm_pack_a(T alpha, const T *a, std::size_t lda, std::size_t mc, std::size_t kc, T *packed)
+{
+	constexpr std::size_t mr = gemm_blocking<T>::mr;
+	for (std::size_t ir = 0; ir < mc; ir += mr)
+	{
+		std::size_t rows = std::min(mr, mc - ir);
+		for (std::size_t p = 0; p < kc; ++p)
+		{
+			for (std::size_t r = 0; r < rows; ++r)
+				packed[p * mr + r] = alpha * a[(ir + r) * lda + p];
+			for (std::size_t r = rows; r < mr; ++r)
+				packed[p * mr + r] = T(0);
+		}
+		packed += mr * kc;
+	}
+}
+
+/**
+ * @brief Packs a `kc` by `nc` block of B into `nr` column panels.
+ * @details Within a panel the `nr` elements of each row are contiguous, so the micro-kernel
+ *          loads them with unit-stride vector loads. Columns beyond `nc` are padded with zeros.
+ * @tparam T The element type.
+ * @param b Pointer to the first element of the block.
+ * @param ldb The distance between rows of B.
+ * @param kc The number of rows in the block.
+ * @param nc The number of columns in the block.
+ * @param packed The buffer to pack into, with room for `kc` times `nc` rounded up to `nr` elements.
+ */
+template <typename T>
+void gemm_pack_b(const T *b, std::size_t ldb, std::size_t kc, std::size_t nc, T *packed)
+{
+	constexpr std::size_t nr = gemm_blocking<T>::nr;
+	for (std::size_t jr = 0; jr < nc; jr += nr)
+	{
+		std::size_t cols = std::min(nr, nc - jr);
+		for (std::size_t p = 0; p < kc; ++p)
+		{
+			const T *src = b + p * ldb + jr;
+			for (std::size_t j = 0; j < cols; ++j)
+				packed[p * nr + j] = src[j];
+			for (std::size_t j = cols; j < nr; ++j)
+				packed[p * nr + j] = T(0);
+		}
+		packed += nr * kc;
+	}
+}
+
+/**
+ * @brief Adds the product of one packed A panel and one packed B panel to a block of C.
+ * @details The `mr` by `nr` block of the product is accumulated in `2 * mr` registers for
+ *          the whole depth of the panels and only then added to C, so C is read and written
+ *          once per `kc` deep slice.
+ * @tparam T The element type.
+ * @param kc The depth of the panels.
+ * @param a The packed A panel.
+ * @param b The packed B panel.
+ * @param c Pointer to the top left element of the block of C.
+ * @param ldc The distance between rows of C.
+ * @param rows The number of rows of the block which lie inside C (at most `mr`).
+ * @param cols The number of columns of the block which lie inside C (at most `nr`).
+ */
+template <typename T>
+void gemm_micro_kernel(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc, std::size_t rows, std::size_t cols)
+{
+	using simd = gemm_simd<T>;
+	constexpr std::size_t mr = gemm_blocking<T>::mr;
+	constexpr std::size_t nr = gemm_blocking<T>::nr;
+	constexpr std::size_t w = simd::width;
+
+	typename simd::reg acc[mr][2];
+	for (std::size_t r = 0; r < mr; ++r)
+	{
+		acc[r][0] = simd::zero();
+		acc[r][1] = simd::zero();
+	}
+
+	for (std::size_t p = 0; p < kc; ++p)
+	{
+		typename simd::reg b0 = simd::load(b + p * nr);
+		typename simd::reg b1 = simd::load(b + p * nr + w);
+		for (std::size_t r = 0; r < mr; ++r)
+		{
+			typename simd::reg ar = simd::broadcast(a[p * mr + r]);
+			acc[r][0] = simd::fmadd(ar, b0, acc[r][0]);
+			acc[r][1] = simd::fmadd(ar, b1, acc[r][1]);
+		}
+	}
+
+	if (rows == mr && cols == nr)
+	{
+		for (std::size_t r = 0; r < mr; ++r)
+		{
+			T *c_row = c + r * ldc;
+			simd::store(c_row, simd::add(simd::load(c_row), acc[r][0]));
+			simd::store(c_row + w, simd::add(simd::load(c_row + w), acc[r][1]));
+		}
+	}
+	else
+	{
+		T block[mr * nr];
+		for (std::size_t r = 0; r < mr; ++r)
+		{
+			simd::store(block + r * nr, acc[r][0]);
+			simd::store(block + r * nr + w, acc[r][1]);
+		}
+		for (std::size_t r = 0; r < rows; ++r)
+			for (std::size_t j = 0; j < cols; ++j)
+				c[r * ldc + j] += block[r * nr + j];
+	}
+}
+
+/**
+ * @brief Computes `C = alpha * A * B + beta * C` on raw row-major arrays.
+ * @details Threads each take a band of `mc` (or fewer) rows of C and run the complete blocked
+ *          algorithm over it with their own packing buffers, so they never wait for each
+ *          other. Each thread packs its own copy of the B panels; that costs `1 / mc` of the
+ *          multiplication work.
+ * @tparam T The element type.
+ * @param m The number of rows of A and C.
+ * @param n The number of columns of B and C.
+ * @param k The number of columns of A and rows of B.
+ * @param alpha The factor the product is multiplied by.
+ * @param a Pointer to A.
+ * @param lda The distance between rows of A.
+ * @param b Pointer to B.
+ * @param ldb The distance between rows of B.
+ * @param beta The factor C is multiplied by before the product is added. When 0, C is not read.
+ * @param c Pointer to C.
+ * @param ldc The distance between rows of C.
+ */
+template <typename T>
+void gemm_kernel(std::size_t m, std::size_t n, std::size_t k, T alpha,
+				 const T *a, std::size_t lda, const T *b, std::size_t ldb,
+				 T beta, T *c, std::size_t ldc)
+{
+	using blocking = gemm_blocking<T>;
+	constexpr std::size_t mr = blocking::mr;
+	constexpr std::size_t nr = blocking::nr;
+
+	// Enough row bands to keep every thread busy, each a whole number of micro-kernel rows.
+	std::size_t band = (m + thread_count() - 1) / std::max<std::size_t>(1, thread_count());
+	band = std::min(blocking::mc, (band + mr - 1) / mr * mr);
+	band = std::max(band, mr);
+	std::size_t bands = (m + band - 1) / band;
+
+	parallel_tasks(bands, [&](std::size_t task)
+				   {
+					   std::size_t i0 = task * band;
+					   std::size_t mb = std::min(band, m - i0);
+					   for (std::size_t i = i0; i < i0 + mb; ++i)
+					   {
+						   T *c_row = c + i * ldc;
+						   for (std::size_t j = 0; j < n; ++j)
+							   c_row[j] = beta == T(0) ? T(0) : beta * c_row[j];
+					   }
+					   if (k == 0 || alpha == T(0))
+						   return;
+
+					   std::size_t mb_padded = (mb + mr - 1) / mr * mr;
+					   std::size_t nc_padded = (std::min(blocking::nc, n) + nr - 1) / nr * nr;
+					   Collection<T> packed_a = Collection<T>::allocate(mb_padded * blocking::kc);
+					   Collection<T> packed_b = Collection<T>::allocate(nc_padded * blocking::kc);
+
+					   for (std::size_t jc = 0; jc < n; jc += blocking::nc)
+					   {
+						   std::size_t nc = std::min(blocking::nc, n - jc);
+						   for (std::size_t pc = 0; pc < k; pc += blocking::kc)
+						   {
+							   std::size_t kc = std::min(blocking::kc, k - pc);
+							   gemm_pack_b(b + pc * ldb + jc, ldb, kc, nc, packed_b.data());
+							   gemm_pack_a(alpha, a + i0 * lda + pc, lda, mb, kc, packed_a.data());
+							   for (std::size_t jr = 0; jr < nc; jr += nr)
+								   for (std::size_t ir = 0; ir < mb; ir += mr)
+									   gemm_micro_kernel(kc,
+														 packed_a.data() + ir * kc,
+														 packed_b.data() + jr * kc,
+														 c + (i0 + ir) * ldc + jc + jr,
+														 ldc,
+														 std::min(mr, mb - ir),
+														 std::min(nr, nc - jr));
+						   }
+					   } });
+}
+
+/**
+ * @brief Computes the matrix product `C = alpha * A * B + beta * C` in place.
+ * @tparam T The element type of the matrices.
+ * @param alpha The factor the product is multiplied by.
+ * @param a The left matrix, `m` by `k`.
+ * @param b The right matrix, `k` by `n`.
+ * @param beta The factor C is multiplied by before the product is added. When 0 the old
+ *             contents of C are ignored, even if they are NaN.
+ * @param c The result matrix, `m` by `n`.
+ */
+template <typename T>
+void gemm(blas_scalar_t<T> alpha, const Matrix<T> &a, const Matrix<T> &b, blas_scalar_t<T> beta, Matrix<T> &c)
+{
+	assert_equal(a.cols(), b.rows(), "gemm: Inner dimensions do not match");
+	assert_true(c.rows() == a.rows() && c.cols() == b.cols(), "gemm: Result dimensions do not match");
+	gemm_kernel<T>(a.rows(), b.cols(), a.cols(), alpha,
+				   a.data(), a.cols(), b.data(), b.cols(),
+				   beta, c.data(), c.cols());
+}
+
+/**
+ * @brief Computes the matrix product `A * B`.
+ * @tparam T The element type of the matrices.
+ * @param a The left matrix, `m` by `k`.
+ * @param b The right matrix, `k` by `n`.
+ * @return A new `m` by `n` matrix.
+ */
+template <typename T>
+Matrix<T> gemm(const Matrix<T> &a, const Matrix<T> &b)
+{
+	assert_equal(a.cols(), b.rows(), "gemm: Inner dimensions do not match");
+	Matrix<T> c(a.rows(), b.cols(), Collection<T>::allocate(a.rows() * b.cols()));
+	gemm_kernel<T>(a.rows(), b.cols(), a.cols(), T(1),
+				   a.data(), a.cols(), b.data(), b.cols(),
+				   T(0), c.data(), c.cols());
+	return c;
+}
+
+/**
+ * @brief Computes the matrix-vector product `y = alpha * A * x + beta * y` in place.
+ * @details Four rows are processed together so each vector load of `x` feeds four fused
+ *          multiply-adds; bands of rows are split across threads.
+ * @tparam T The element type.
+ * @param alpha The factor the product is multiplied by.
+ * @param a The matrix, `m` by `n`.
+ * @param x The vector, with `n` elements.
+ * @param beta The factor y is multiplied by before the product is added. When 0 the old
+ *             contents of y are ignored.
+ * @param y The result vector, with `m` elements.
+ */
+template <typename T>
+void gemv(blas_scalar_t<T> alpha, const Matrix<T> &a, const Collection<T> &x, blas_scalar_t<T> beta, Collection<T> &y)
+{
+	using simd = gemm_simd<T>;
+	constexpr std::size_t w = simd::width;
+	constexpr std::size_t rows_at_once = 4;
+
+	assert_equal(a.cols(), x.size(), "gemv: Vector length does not match column count");
+	assert_equal(a.rows(), y.size(), "gemv: Result length does not match row count");
+	std::size_t n = a.cols();
+	const T *as = a.data();
+	const T *xs = x.data();
+	T *ys = y.data();
+
+	auto finish = [&](std::size_t row, T dot)
+	{
+		ys[row] = (beta == T(0) ? T(0) : beta * ys[row]) + alpha * dot;
+	};
+
+	std::size_t grain = std::max<std::size_t>(rows_at_once, parallel_grain / std::max<std::size_t>(1, n));
+	parallel_for(
+		a.rows(), [&](std::size_t r0, std::size_t r1)
+		{
+			std::size_t row = r0;
+			for (; row + rows_at_once <= r1; row += rows_at_once)
+			{
+				const T *a0 = as + row * n;
+				const T *a1 = a0 + n;
+				const T *a2 = a1 + n;
+				const T *a3 = a2 + n;
+				typename simd::reg acc0 = simd::zero();
+				typename simd::reg acc1 = simd::zero();
+				typename simd::reg acc2 = simd::zero();
+				typename simd::reg acc3 = simd::zero();
+				std::size_t j = 0;
+				for (; j + w <= n; j += w)
+				{
+					typename simd::reg xv = simd::load(xs + j);
+					acc0 = simd::fmadd(simd::load(a0 + j), xv, acc0);
+					acc1 = simd::fmadd(simd::load(a1 + j), xv, acc1);
+					acc2 = simd::fmadd(simd::load(a2 + j), xv, acc2);
+					acc3 = simd::fmadd(simd::load(a3 + j), xv, acc3);
+				}
+				T dot0 = simd::hsum(acc0);
+				T dot1 = simd::hsum(acc1);
+				T dot2 = simd::hsum(acc2);
+				T dot3 = simd::hsum(acc3);
+				for (; j < n; ++j)
+				{
+					dot0 += a0[j] * xs[j];
+					dot1 += a1[j] * xs[j];
+					dot2 += a2[j] * xs[j];
+					dot3 += a3[j] * xs[j];
+				}
+				finish(row, dot0);
+				finish(row + 1, dot1);
+				finish(row + 2, dot2);
+				finish(row + 3, dot3);
+			}
+			for (; row < r1; ++row)
+			{
+				const T *a0 = as + row * n;
+				typename simd::reg acc0 = simd::zero();
+				std::size_t j = 0;
+				for (; j + w <= n; j += w)
+					acc0 = simd::fmadd(simd::load(a0 + j), simd::load(xs + j), acc0);
+				T dot0 = simd::hsum(acc0);
+				for (; j < n; ++j)
+					dot0 += a0[j] * xs[j];
+				finish(row, dot0);
+			} },
+		grain);
+}
+
+/**
+ * @brief Computes the matrix-vector product `A * x`.
+ * @tparam T The element type.
+ * @param a The matrix, `m` by `n`.
+ * @param x The vector, with `n` elements.
+ * @return A new collection with `m` elements.
+ */
+template <typename T>
+Collection<T> gemv(const Matrix<T> &a, const Collection<T> &x)
+{
+	Collection<T> y = Collection<T>::allocate(a.rows());
+	gemv(T(1), a, x, T(0), y);
+	return y;
+}
+
+/**
+ * @brief Overloads the stream insertion operator to print a matrix, one bracketed row at a time.
+ * @tparam T The element type of the matrix.
+ * @param os The output stream.
+ * @param m The matrix to print.
+ * @return The output stream.
+ */
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const Matrix<T> &m)
+{
+	os << '[';
+	for (std::size_t row = 0; row < m.rows(); ++row)
+	{
+		if (row > 0)
+			os << ',';
+		char delim = '[';
+		for (std::size_t col = 0; col < m.cols(); ++col)
+		{
+			os << delim << m.get(row, col);
+			delim = ',';
+		}
+		os << (m.cols() == 0 ? "[]" : "]");
+	}
+	os << ']';
+	return os;
+}
+
+#endif // MATRIX_HPP
@@ -0,0 +1,286 @@
+/**
+ * @file natv_soa.hpp
+ * @brief Defines the SoaCollection class, a structure-of-arrays collection of structs.
+ * @details A `Collection<S>` of a struct type stores its elements array-of-structs, so a
+ *          kernel which only reads one field still pulls every field through the cache.
+ *          A `SoaCollection<S>` instead stores each field of `S` in its own aligned
+ *          `Collection`, so single-field kernels only touch the memory they need and run
+ *          over contiguous arrays of a single scalar type.
+ *
+ *          The fields of a struct are made known by specializing `soa_fields`:
+ * @code
+ * template <>
+ * struct soa_fields<Color>
+ * {
+ *     static constexpr auto members = std::make_tuple(&Color::red, &Color::green, &Color::blue);
+ * };
+ * @endcode
+ */
+
+#ifndef SOA_HPP
+#define SOA_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief Describes the fields of a struct stored in a SoaCollection.
+ * @details Specializations must provide a `static constexpr` tuple named `members` holding a
+ *          pointer to each data member of `S` which is to be stored. Members which are not
+ *          listed are not stored, and are not restored when elements are read back out.
+ * @tparam S The struct type being described.
+ */
+template <typename S>
+struct soa_fields;
+
+/**
+ * @brief Gets the type of the data member referred to by a pointer-to-member type.
+ * @tparam M The pointer-to-member type.
+ */
+template <typename M>
+struct soa_member_type;
+
+/**
+ * @brief Specialization which extracts the member type `F` from `F S::*`.
+ * @tparam S The struct type.
+ * @tparam F The type of the data member.
+ */
+template <typename S, typename F>
+struct soa_member_type<F S::*>
+{
+	/** @brief The type of the data member. */
+	using type = F;
+};
+
+/**
+ * @brief Gets the storage used for a tuple of member pointers: one Collection per member.
+ * @tparam MS The tuple of pointer-to-member types.
+ */
+template <typename MS>
+struct soa_storage;
+
+/**
+ * @brief Specialization which maps `std::tuple<F0 S::*, F1 S::*, ...>` onto
+ *        `std::tuple<Collection<F0>, Collection<F1>, ...>`.
+ * @tparam MS The pointer-to-member types.
+ */
+template <typename... MS>
+struct soa_storage<std::tuple<MS...>>
+{
+	/** @brief The tuple of per-field collections. */
+	using type = std::tuple<Collection<typename soa_member_type<MS>::type>...>;
+};
+
+/**
+ * @class SoaCollection
+ * @brief A fixed-size collection of structs stored as one array per field.
+ * @tparam S The struct type of the elements. Must have a `soa_fields` specialization.
+ */
+template <typename S>
+class SoaCollection
+{
+private:
+	/** @brief The tuple of member pointers describing the fields of `S`. */
+	using members_type = std::decay_t<decltype(soa_fields<S>::members)>;
+
+public:
+	/** @brief The number of fields stored for each element. */
+	static constexpr std::size_t field_count = std::tuple_size<members_type>::value;
+
+	/**
+	 * @brief The type of one field of the element type.
+	 * @tparam I The position of the field in `soa_fields<S>::members`.
+	 */
+	template <std::size_t I>
+	using field_type = typename soa_member_type<std::tuple_element_t<I, members_type>>::type;
+
+private:
+	/** @brief Index sequence over the fields, used to expand per-field operations. */
+	using field_indices = std::make_index_sequence<field_count>;
+
+	/** @brief The number of elements in the collection. */
+	std::size_t _size;
+
+	/** @brief One collection per field, in the order of `soa_fields<S>::members`. */
+	typename soa_storage<members_type>::type _fields;
+
+	/**
+	 * @brief Allocates uninitialized storage for every field.
+	 * @param size The number of elements to allocate space for.
+	 * @return A tuple of per-field collections.
+	 */
+	template <std::size_t... IS>
+	static typename soa_storage<members_type>::type allocate_fields(std::size_t size, std::index_sequence<IS...>)
+	{
+		return typename soa_storage<members_type>::type(Collection<field_type<IS>>::allocate(size)...);
+	}
+
+	/**
+	 * @brief Scatters the fields of contiguous structs into the per-field arrays.
+	 * @param src Pointer to the first struct to scatter.
+	 * @param first The index of the element the first struct is written to.
+	 * @param count The number of structs to scatter.
+	 */
+	template <std::size_t... IS>
+	void scatter(const S *src, std::size_t first, std::size_t count, std::index_sequence<IS...>)
+	{
+		auto outs = std::make_tuple((std::get<IS>(_fields).data() + first)...);
+		for (std::size_t idx = 0; idx < count; ++idx)
+			((std::get<IS>(outs)[idx] = src[idx].*std::get<IS>(soa_fields<S>::members)), ...);
+	}
+
+	/**
+	 * @brief Gathers the per-field arrays back into contiguous structs.
+	 * @param dst Pointer to the first struct to write.
+	 * @param first The index of the first element to gather.
+	 * @param count The number of structs to gather.
+	 */
+	template <std::size_t... IS>
+	void gather(S *dst, std::size_t first, std::size_t count, std::index_sequence<IS...>) const
+	{
+		auto ins = std::make_tuple((std::get<IS>(_fields).data() + first)...);
+		for (std::size_t idx = 0; idx < count; ++idx)
+			((dst[idx].*std::get<IS>(soa_fields<S>::members) = std::get<IS>(ins)[idx]), ...);
+	}
+
+	/**
+	 * @brief Checks that every per-field collection holds the same number of elements.
+	 * @return True if all fields have `_size` elements.
+	 */
+	template <std::size_t... IS>
+	bool sizes_match(std::index_sequence<IS...>) const
+	{
+		return ((std::get<IS>(_fields).size() == _size) && ...);
+	}
+
+public:
+	/**
+	 * @brief Constructs a collection by generating elements.
+	 * @details Elements are generated into a small array-of-structs buffer which is then
+	 *          scattered into the field arrays, so no full-size temporary is needed.
+	 * @tparam FN The type of the generator function.
+	 * @param size The number of elements to generate.
+	 * @param fn A function that takes an index (std::size_t) and returns an element of type S.
+	 */
+	template <typename FN>
+	SoaCollection(std::size_t size, FN fn)
+		: _size(size), _fields(allocate_fields(size, field_indices()))
+	{
+		constexpr std::size_t block = 256;
+		S buffer[block];
+		for (std::size_t first = 0; first < _size; first += block)
+		{
+			std::size_t count = std::min(block, _size - first);
+			for (std::size_t idx = 0; idx < count; ++idx)
+				buffer[idx] = fn(first + idx);
+			scatter(buffer, first, count, field_indices());
+		}
+	}
+
+	/**
+	 * @brief Constructs a collection by converting an array-of-structs collection.
+	 * @param aos The source collection.
+	 */
+	explicit SoaCollection(const Collection<S> &aos)
+		: _size(aos.size()), _fields(allocate_fields(aos.size(), field_indices()))
+	{
+		scatter(aos.data(), 0, _size, field_indices());
+	}
+
+	/**
+	 * @brief Constructs a collection which takes ownership of one collection per field.
+	 * @param fields The per-field collections, in the order of `soa_fields<S>::members`.
+	 *               Must all hold the same number of elements.
+	 */
+	explicit SoaCollection(typename soa_storage<members_type>::type &&fields)
+		: _size(std::get<0>(fields).size()), _fields(std::move(fields))
+	{
+		assert_true(sizes_match(field_indices()), "SoaCollection: Field collections differ in size");
+	}
+
+	/**
+	 * @brief Move constructor. Takes ownership of the field arrays of another collection.
+	 * @param src The source collection to move from.
+	 */
+	SoaCollection(SoaCollection<S> &&src) = default;
+
+	/**
+	 * @brief Gets the number of elements in the collection.
+	 * @return The size of the collection.
+	 */
+	inline std::size_t size() const { return _size; }
+
+	/**
+	 * @brief Gets the array holding one field of every element.
+	 * @tparam I The position of the field in `soa_fields<S>::members`.
+	 * @return A constant reference to the field's collection.
+	 */
+	template <std::size_t I>
+	inline const Collection<field_type<I>> &field() const { return std::get<I>(_fields); }
+
+	/**
+	 * @brief Gets the array holding one field of every element.
+	 * @tparam I The position of the field in `soa_fields<S>::members`.
+	 * @return A mutable reference to the field's collection.
+	 */
+	template <std::size_t I>
+	inline Collection<field_type<I>> &field() { return std::get<I>(_fields); }
+
+	/**
+	 * @brief Replaces one field of every element in place.
+	 * @details Only the array for field `I` is read and written.
+	 * @tparam I The position of the field in `soa_fields<S>::members`.
+	 * @tparam FN The type of the update function.
+	 * @param fn A function that takes the current field value and returns the new one.
+	 */
+	template <std::size_t I, typename FN>
+	void transform_field(FN fn)
+	{
+		field_type<I> *data = std::get<I>(_fields).data();
+		for (std::size_t idx = 0; idx < _size; ++idx)
+			data[idx] = fn(data[idx]);
+	}
+
+	/**
+	 * @brief Gets the element at a specific index.
+	 * @param idx The index of the element.
+	 * @return The element assembled from its fields.
+	 */
+	S get(std::size_t idx) const
+	{
+		assert_true(idx < _size, "get: Index out of bounds");
+		S res{};
+		gather(&res, idx, 1, field_indices());
+		return res;
+	}
+
+	/**
+	 * @brief Sets the element at a specific index.
+	 * @param idx The index of the element to set.
+	 * @param value The new value for the element.
+	 */
+	void set(std::size_t idx, const S &value)
+	{
+		assert_true(idx < _size, "set: Index out of bounds");
+		scatter(&value, idx, 1, field_indices());
+	}
+
+	/**
+	 * @brief Converts this collection back into an array-of-structs collection.
+	 * @return A new `Collection<S>` holding the same elements.
+	 */
+	Collection<S> to_aos() const
+	{
+		Collection<S> res = Collection<S>::allocate(_size);
+		gather(res.data(), 0, _size, field_indices());
+		return res;
+	}
+};
+
+#endif // SOA_HPP
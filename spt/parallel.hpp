@@ -0,0 +1,198 @@
+/**
+ * @file parallel.hpp
+ * @brief Defines the helpers used to split element-wise kernels across threads.
+ * @details Work is divided into contiguous chunks, one per worker, and the calling thread
+ *          runs the first chunk itself. Inputs smaller than a grain are run serially on the
+ *          calling thread, so small collections pay no threading overhead. An exception
+ *          thrown by any chunk is rethrown on the calling thread once every worker has
+ *          finished.
+ */
+
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Default minimum number of elements handed to each worker thread.
+ */
+constexpr std::size_t parallel_grain = 16384;
+
+/**
+ * @brief Chunk boundaries are rounded to a multiple of this many elements.
+ * @details Keeps neighbouring workers from writing to the same cache line for any element
+ *          type of at least one byte.
+ */
+constexpr std::size_t parallel_align = 64;
+
+/**
+ * @brief The worker count requested through `set_thread_count`, or 0 for the default.
+ */
+inline std::size_t parallel_thread_override = 0;
+
+/**
+ * @brief Gets the number of threads parallel kernels may use.
+ * @return The count set by `set_thread_count`, or the hardware concurrency if none was set.
+ */
+inline std::size_t thread_count()
+{
+	if (parallel_thread_override > 0)
+		return parallel_thread_override;
+	return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+/**
+ * @brief Sets the number of threads parallel kernels may use.
+ * @param count The number of threads, or 0 to go back to the hardware concurrency.
+ */
+inline void set_thread_count(std::size_t count)
+{
+	parallel_thread_override = count;
+}
+
+/**
+ * @brief Runs a number of independent tasks, spreading them over the worker threads.
+ * @details Task `t` is run by thread `t % workers`; the calling thread takes its share too.
+ *          If any task throws, the first exception is rethrown once all threads have joined.
+ * @tparam FN The type of the task function.
+ * @param tasks The number of tasks.
+ * @param fn A function taking the task index (std::size_t).
+ */
+template <typename FN>
+void parallel_tasks(std::size_t tasks, FN fn)
+{
+	std::size_t workers = std::min(tasks, thread_count());
+	if (workers <= 1)
+	{
+		for (std::size_t task = 0; task < tasks; ++task)
+			fn(task);
+		return;
+	}
+
+	std::exception_ptr error;
+	std::mutex error_lock;
+	auto run = [&](std::size_t worker)
+	{
+		try
+		{
+			for (std::size_t task = worker; task < tasks; task += workers)
+				fn(task);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> guard(error_lock);
+			if (!error)
+				error = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	threads.reserve(workers - 1);
+	for (std::size_t worker = 1; worker < workers; ++worker)
+		threads.emplace_back(run, worker);
+	run(0);
+	for (auto &thread : threads)
+		thread.join();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+/**
+ * @brief Gets the number of chunks a range is split into by `parallel_for`.
+ * @param size The number of elements in the range.
+ * @param grain The minimum number of elements per chunk.
+ * @return The chunk count, at least 1.
+ */
+inline std::size_t parallel_chunks(std::size_t size, std::size_t grain = parallel_grain)
+{
+	std::size_t by_grain = grain == 0 ? size : size / grain;
+	return std::max<std::size_t>(1, std::min(thread_count(), by_grain));
+}
+
+/**
+ * @brief Gets the first element of one chunk of a range split into equal parts.
+ * @details Boundaries other than 0 and `size` are rounded down to a multiple of
+ *          `parallel_align` elements.
+ * @param size The number of elements in the range.
+ * @param chunks The number of chunks.
+ * @param chunk The chunk index, from 0 to `chunks` inclusive.
+ * @return The index of the first element of the chunk (or `size` for `chunk == chunks`).
+ */
+inline std::size_t chunk_begin(std::size_t size, std::size_t chunks, std::size_t chunk)
+{
+	if (chunk >= chunks)
+		return size;
+	std::size_t begin = size / chunks * chunk + std::min(chunk, size % chunks);
+	return chunk == 0 ? 0 : begin - begin % parallel_align;
+}
+
+/**
+ * @brief Runs a function over a range of indices, split into one contiguous chunk per thread.
+ * @tparam FN The type of the chunk function.
+ * @param size The number of elements in the range.
+ * @param fn A function taking the `[begin, end)` bounds of a chunk.
+ * @param grain The minimum number of elements worth giving to a thread.
+ */
+template <typename FN>
+void parallel_for(std::size_t size, FN fn, std::size_t grain = parallel_grain)
+{
+	std::size_t chunks = parallel_chunks(size, grain);
+	if (chunks == 1)
+	{
+		fn(std::size_t(0), size);
+		return;
+	}
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t begin = chunk_begin(size, chunks, chunk);
+					   std::size_t end = chunk_begin(size, chunks, chunk + 1);
+					   if (begin < end)
+						   fn(begin, end); });
+}
+
+/**
+ * @brief Reduces a range of indices in parallel.
+ * @details Each chunk is reduced by `fn` to a partial result, kept in its own cache line;
+ *          the partials are then combined in chunk order, so the result only depends on the
+ *          chunking and not on timing.
+ * @tparam R The type of the result.
+ * @tparam FN The type of the chunk reduction.
+ * @tparam COMBINE The type of the function combining two partial results.
+ * @param size The number of elements in the range.
+ * @param identity The result of reducing an empty range.
+ * @param fn A function taking the `[begin, end)` bounds of a chunk and returning its partial result.
+ * @param combine A function combining two partial results.
+ * @param grain The minimum number of elements worth giving to a thread.
+ * @return The combined result.
+ */
+template <typename R, typename FN, typename COMBINE>
+R parallel_reduce(std::size_t size, R identity, FN fn, COMBINE combine, std::size_t grain = parallel_grain)
+{
+	std::size_t chunks = parallel_chunks(size, grain);
+	if (chunks == 1)
+		return combine(identity, fn(std::size_t(0), size));
+
+	struct alignas(parallel_align) slot
+	{
+		R value;
+	};
+	std::vector<slot> partials(chunks, slot{identity});
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t begin = chunk_begin(size, chunks, chunk);
+					   std::size_t end = chunk_begin(size, chunks, chunk + 1);
+					   if (begin < end)
+						   partials[chunk].value = fn(begin, end); });
+
+	R res = identity;
+	for (const slot &partial : partials)
+		res = combine(res, partial.value);
+	return res;
+}
+
+#endif // PARALLEL_HPP
@@ -4,6 +4,7 @@
  */
 
 #include "perf_common.hpp"
+#include "parallel.hpp"
 
 #include <iostream>
 #include <fstream>
@@ -15,9 +16,18 @@
  */
 void usage(const std::string &name)
 {
-	std::cout << "Usage: " << name << "outfile size0 size1 size2 ... sizeN" << std::endl;
+	std::cout << "Usage: " << name << " outfile [--option=value ...] size0 size1 size2 ... sizeN" << std::endl;
 	std::cout << "  outfile - CSV output file to write results to" << std::endl;
 	std::cout << "  size<n> - Size of test sample to assess" << std::endl;
+	std::cout << "Options (native C++ only):" << std::endl;
+	std::cout << "  --precision=<storage>:<accumulator> - Element and accumulator types to test, may be repeated." << std::endl;
+	std::cout << "      Types are double, float, float16 and bfloat16; 'all' tests every supported pair." << std::endl;
+	std::cout << "  --bench=<kernel> - Benchmark a numeric kernel instead of map/reduce, may be repeated." << std::endl;
+	std::cout << "      Kernels are:" << std::endl;
+	std::cout << "        gemm  - sizes are square matrix dimensions; GFLOP/s is reported against the detected peak." << std::endl;
+	std::cout << "        fft   - sizes are transform lengths, rounded up to a power of two; GFLOP/s uses 5 n log2(n) flops." << std::endl;
+	std::cout << "        math  - sizes are element counts; the GFLOP/s column holds billions of elements per second." << std::endl;
+	std::cout << "        fused - sizes are element counts; the GFLOP/s column holds billions of elements per second." << std::endl;
 	std::cout << "Example: " << name << " results.csv 1000 10000 100000" << std::endl;
 }
 
@@ -36,7 +46,118 @@ test_case parse_args(const std::vector<std::string> &args)
 	test_case tc;
 	tc.output_file = args[1];
 	for (std::size_t i = 2; i < args.size(); ++i)
-		tc.test_cases.push_back(std::stoi(args[i]));
+	{
+		if (args[i].compare(0, 2, "--") == 0)
+		{
+			std::size_t eq = args[i].find('=');
+			if (eq == std::string::npos)
+				tc.options.emplace_back(args[i].substr(2), "");
+			else
+				tc.options.emplace_back(args[i].substr(2, eq - 2), args[i].substr(eq + 1));
+		}
+		else
+			tc.test_cases.push_back(std::stoi(args[i]));
+	}
 
 	return tc;
 }
+
+/**
+ * @brief Gets every value given for a named option.
+ * @param tc The parsed test case.
+ * @param name The name of the option, without the leading dashes.
+ * @return The values given for the option, in the order they appeared.
+ */
+std::vector<std::string> option_values(const test_case &tc, const std::string &name)
+{
+	std::vector<std::string> values;
+	for (const auto &option : tc.options)
+		if (option.first == name)
+			values.push_back(option.second);
+	return values;
+}
+
+/**
+ * @brief Measures the peak double precision floating point rate of the machine.
+ * @return The measured peak, in billions of double precision operations per second.
+ */
+double detect_peak_gflops()
+{
+	// Enough independent accumulators to cover the latency of two FMA pipes at 512 bits.
+	constexpr std::size_t chains = 64;
+	constexpr std::size_t iterations = 1 << 18;
+	constexpr int trials = 3;
+
+	std::size_t threads = thread_count();
+	std::vector<double> rates(threads, 0.0);
+	parallel_tasks(threads, [&](std::size_t thread)
+				   {
+					   volatile double factor = 0.999999;
+					   volatile double offset = 1e-7;
+					   double mul = factor;
+					   double add = offset;
+					   double acc[chains];
+					   for (std::size_t chain = 0; chain < chains; ++chain)
+						   acc[chain] = 1.0 + chain * 1e-3;
+
+					   for (int trial = 0; trial < trials; ++trial)
+					   {
+						   long long start = time_ns();
+						   for (std::size_t it = 0; it < iterations; ++it)
+							   for (std::size_t chain = 0; chain < chains; ++chain)
+								   acc[chain] = acc[chain] * mul + add;
+						   long long elapsed = time_ns() - start;
+						   rates[thread] = std::max(rates[thread], 2.0 * chains * iterations / (double)elapsed);
+					   }
+
+					   double total = 0.0;
+					   for (std::size_t chain = 0; chain < chains; ++chain)
+						   total += acc[chain];
+					   volatile double sink = total;
+					   (void)sink; });
+
+	double peak = 0.0;
+	for (double rate : rates)
+		peak += rate;
+	return peak;
+}
+
+/**
+ * @brief Prints the result of a single kernel benchmark to the console.
+ * @param res The result to print.
+ */
+void report(const kernel_result &res)
+{
+	std::cout << "******************" << std::endl;
+	std::cout << "kernel: " << res.kernel << std::endl;
+	std::cout << "size: " << res.size << std::endl;
+	std::cout << "time (s): " << res.seconds << std::endl;
+	std::cout << "GFLOP/s: " << res.gflops << std::endl;
+	std::cout << "peak GFLOP/s: " << res.peak_gflops
+			  << " (" << 100.0 * res.gflops / res.peak_gflops << "% of peak)" << std::endl;
+	std::cout << "******************" << std::endl;
+}
+
+/**
+ * @brief Writes kernel benchmark results to a CSV file.
+ * @param tc The test_case struct containing the output file name.
+ * @param results The results to write.
+ */
+void write_kernel_results(const test_case &tc, const std::vector<kernel_result> &results)
+{
+	std::ofstream out(tc.output_file);
+	if (!out.is_open())
+	{
+		std::cout << "Error opening file: " << tc.output_file << std::endl;
+		exit(1);
+	}
+
+	out << "kernel,size,time,gflops,peak_gflops,efficiency" << std::endl;
+	for (const auto &res : results)
+		out << res.kernel << ","
+			<< res.size << ","
+			<< res.seconds << ","
+			<< res.gflops << ","
+			<< res.peak_gflops << ","
+			<< res.gflops / res.peak_gflops << std::endl;
+}
@@ -14,6 +14,8 @@
 
 #include <vector>
 #include <string>
+#include <utility>
+#include <algorithm>
 #include <random>
 #include <iostream>
 #include <fstream>
@@ -43,6 +45,9 @@ struct result
 
 	/** @brief Time taken for the sum (reduce) operation. */
 	long long reduce_time;
+
+	/** @brief Storage and accumulator types used, as `<storage>:<accumulator>`, or empty for the default. */
+	std::string precision;
 };
 
 /**
@@ -56,8 +61,41 @@ struct test_case
 
 	/** @brief A vector of collection sizes to be tested. */
 	std::vector<std::size_t> test_cases;
+
+	/** @brief Options given as `--name=value`, in the order they appeared. */
+	std::vector<std::pair<std::string, std::string>> options;
 };
 
+/**
+ * @struct kernel_result
+ * @brief Holds the performance of one numeric kernel benchmarked with `--bench`.
+ */
+struct kernel_result
+{
+	/** @brief The name of the kernel, including its element type (for example `gemm<double>`). */
+	std::string kernel;
+
+	/** @brief The problem size; its meaning depends on the kernel (for GEMM, the matrix dimension). */
+	std::size_t size;
+
+	/** @brief Mean time of one run of the kernel (in seconds). */
+	double seconds;
+
+	/** @brief Floating point operations per second achieved (in billions). */
+	double gflops;
+
+	/** @brief The peak floating point rate of the machine for the kernel's element type (in billions per second). */
+	double peak_gflops;
+};
+
+/**
+ * @brief Gets every value given for a named option.
+ * @param tc The parsed test case.
+ * @param name The name of the option, without the leading dashes.
+ * @return The values given for the option, in the order they appeared.
+ */
+extern std::vector<std::string> option_values(const test_case &tc, const std::string &name);
+
 /**
  * @brief Parses command-line arguments into a test_case struct.
  * @param args A vector of strings representing the command-line arguments.
@@ -65,6 +103,28 @@ struct test_case
  */
 extern test_case parse_args(const std::vector<std::string> &args);
 
+/**
+ * @brief Measures the peak double precision floating point rate of the machine.
+ * @details Every worker thread runs many independent chains of multiply-adds, compiled for
+ *          the same instruction set as the kernels under test, so the result is the peak
+ *          this build can reach rather than a figure from a data sheet.
+ * @return The measured peak, in billions of double precision operations per second.
+ */
+extern double detect_peak_gflops();
+
+/**
+ * @brief Prints the result of a single kernel benchmark to the console.
+ * @param res The result to print.
+ */
+extern void report(const kernel_result &res);
+
+/**
+ * @brief Writes kernel benchmark results to a CSV file.
+ * @param tc The test_case struct containing the output file name.
+ * @param results The results to write.
+ */
+extern void write_kernel_results(const test_case &tc, const std::vector<kernel_result> &results);
+
 /**
  * @brief Runs a single performance test for a given collection size.
  * @details This function times the creation of two collections, a zip operation
@@ -113,6 +173,8 @@ extern void report(const result<T> &res)
 {
 	std::cout << "******************" << std::endl;
 	std::cout << "size: " << res.size << std::endl;
+	if (!res.precision.empty())
+		std::cout << "precision: " << res.precision << std::endl;
 	std::cout << "value: " << res.value << std::endl;
 	std::cout << "gen_time_1 (ns): " << res.gen_time_1 << std::endl;
 	std::cout << "gen_time_2 (ns): " << res.gen_time_2 << std::endl;
@@ -137,7 +199,14 @@ void write_results(const test_case &tc, const std::vector<result<T>> &results)
 		exit(1);
 	}
 
-	out << "size,value,gen_time_1,gen_time_2,zip_time,reduce_time" << std::endl;
+	bool has_precision = std::any_of(results.begin(), results.end(),
+									 [](const result<T> &res)
+									 { return !res.precision.empty(); });
+
+	out << "size,value,gen_time_1,gen_time_2,zip_time,reduce_time";
+	if (has_precision)
+		out << ",precision";
+	out << std::endl;
 	for (auto res : results)
 	{
 		out << res.size << ","
@@ -145,7 +214,10 @@ void write_results(const test_case &tc, const std::vector<result<T>> &results)
 			<< res.gen_time_1 * 1e-6 << ","
 			<< res.gen_time_2 * 1e-6 << ","
 			<< res.zip_time * 1e-6 << ","
-			<< res.reduce_time * 1e-6 << std::endl;
+			<< res.reduce_time * 1e-6;
+		if (has_precision)
+			out << "," << res.precision;
+		out << std::endl;
 	}
 }
 
@@ -0,0 +1,302 @@
+/**
+ * @file philox.hpp
+ * @brief Defines the Philox4x32-10 counter-based random number generator and distributions
+ *        which draw each value from a single counter.
+ * @details A counter-based generator has no state to advance: the random bits for element
+ *          `idx` of a stream are a fixed function of the seed and `idx`, computed by ten rounds
+ *          of multiplications and key additions over a 128-bit counter (Salmon et al.,
+ *          "Parallel Random Numbers: As Easy as 1, 2, 3"). Any element can therefore be drawn
+ *          independently, by any thread and in any order, and a fill gives the same values
+ *          whatever the number of threads. The rounds have no branches, so a loop drawing
+ *          consecutive elements vectorizes.
+ *
+ *          `philox_uniform` and `philox_normal` turn one 128-bit block into one value. Any
+ *          standard library distribution can be used too, by giving it a `PhiloxEngine` for
+ *          the element, which draws further blocks of the same element's stream as needed.
+ */
+
+#ifndef PHILOX_HPP
+#define PHILOX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+/**
+ * @brief Multiplier of the first and second counter words in each Philox round.
+ */
+constexpr std::uint32_t philox_m0 = 0xD2511F53u;
+
+/**
+ * @brief Multiplier of the third and fourth counter words in each Philox round.
+ */
+constexpr std::uint32_t philox_m1 = 0xCD9E8D57u;
+
+/**
+ * @brief Increment of the first key word between Philox rounds (the golden ratio).
+ */
+constexpr std::uint32_t philox_w0 = 0x9E3779B9u;
+
+/**
+ * @brief Increment of the second key word between Philox rounds (sqrt(3) - 1).
+ */
+constexpr std::uint32_t philox_w1 = 0xBB67AE85u;
+
+/**
+ * @struct philox_block
+ * @brief The 128 random bits produced by Philox for one counter value.
+ */
+struct philox_block
+{
+	/** @brief The four 32-bit words of the block. */
+	std::uint32_t word[4];
+};
+
+/**
+ * @brief Computes the Philox4x32-10 block for a counter and key.
+ * @param seed The key, as one 64-bit value.
+ * @param counter_lo The low 64 bits of the counter.
+ * @param counter_hi The high 64 bits of the counter.
+ * @return The random block.
+ */
+inline philox_block philox4x32(std::uint64_t seed, std::uint64_t counter_lo, std::uint64_t counter_hi = 0)
+{
+	std::uint32_t c0 = std::uint32_t(counter_lo);
+	std::uint32_t c1 = std::uint32_t(counter_lo >> 32);
+	std::uint32_t c2 = std::uint32_t(counter_hi);
+	std::uint32_t c3 = std::uint32_t(counter_hi >> 32);
+	std::uint32_t k0 = std::uint32_t(seed);
+	std::uint32_t k1 = std::uint32_t(seed >> 32);
+	for (int round = 0; round < 10; ++round)
+	{
+		std::uint64_t p0 = std::uint64_t(philox_m0) * c0;
+		std::uint64_t p1 = std::uint64_t(philox_m1) * c2;
+		std::uint32_t n0 = std::uint32_t(p1 >> 32) ^ c1 ^ k0;
+		std::uint32_t n2 = std::uint32_t(p0 >> 32) ^ c3 ^ k1;
+		c1 = std::uint32_t(p1);
+		c3 = std::uint32_t(p0);
+		c0 = n0;
+		c2 = n2;
+		k0 += philox_w0;
+		k1 += philox_w1;
+	}
+	return philox_block{{c0, c1, c2, c3}};
+}
+
+/**
+ * @brief Converts two random words to a double uniformly distributed in `[0, 1)`.
+ * @details The random bits become the mantissa of a double in `[1, 2)`, from which 1 is
+ *          subtracted. Unlike an integer to double conversion, this vectorizes without AVX-512.
+ * @param lo The low word.
+ * @param hi The high word.
+ * @return A multiple of 2^-52 in `[0, 1)`.
+ */
+inline double philox_unit_double(std::uint32_t lo, std::uint32_t hi)
+{
+	std::uint64_t bits = (std::uint64_t(hi) << 32 | lo) >> 12 | 0x3FF0000000000000ull;
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value - 1.0;
+}
+
+/**
+ * @brief Converts a random word to a float uniformly distributed in `[0, 1)`.
+ * @details Builds a float in `[1, 2)` from the random bits, as `philox_unit_double` does.
+ * @param word The word.
+ * @return A multiple of 2^-23 in `[0, 1)`.
+ */
+inline float philox_unit_float(std::uint32_t word)
+{
+	std::uint32_t bits = word >> 9 | 0x3F800000u;
+	float value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value - 1.0f;
+}
+
+/**
+ * @struct philox_uniform
+ * @brief The uniform distribution over `[lo, hi)`, drawn from one Philox block.
+ * @tparam T The floating point type of the values.
+ */
+template <typename T>
+struct philox_uniform
+{
+	static_assert(std::is_floating_point<T>::value, "philox_uniform: Use a standard distribution for integers");
+
+	/** @brief The lower end of the range. */
+	T lo;
+
+	/** @brief The upper end of the range. */
+	T hi;
+
+	/**
+	 * @brief Constructs the distribution.
+	 * @param low The lower end of the range.
+	 * @param high The upper end of the range.
+	 */
+	explicit philox_uniform(T low = T(0), T high = T(1))
+		: lo(low), hi(high) {}
+
+	/**
+	 * @brief Maps a random block to a value.
+	 * @param bits The random block.
+	 * @return A value in `[lo, hi)`.
+	 */
+	inline T operator()(const philox_block &bits) const
+	{
+		if constexpr (std::is_same<T, float>::value)
+			return lo + (hi - lo) * philox_unit_float(bits.word[0]);
+		else
+			return lo + (hi - lo) * T(philox_unit_double(bits.word[0], bits.word[1]));
+	}
+};
+
+/**
+ * @struct philox_normal
+ * @brief The normal distribution, drawn from one Philox block by the Box-Muller transform.
+ * @tparam T The floating point type of the values.
+ */
+template <typename T>
+struct philox_normal
+{
+	static_assert(std::is_floating_point<T>::value, "philox_normal: Values must be floating point");
+
+	/** @brief The mean. */
+	T mean;
+
+	/** @brief The standard deviation. */
+	T stddev;
+
+	/**
+	 * @brief Constructs the distribution.
+	 * @param mu The mean.
+	 * @param sigma The standard deviation.
+	 */
+	explicit philox_normal(T mu = T(0), T sigma = T(1))
+		: mean(mu), stddev(sigma) {}
+
+	/**
+	 * @brief Maps a random block to a value.
+	 * @details Uses the first two words for the radius and the last two for the angle.
+	 * @param bits The random block.
+	 * @return A normally distributed value.
+	 */
+	inline T operator()(const philox_block &bits) const
+	{
+		const double pi = 3.14159265358979323846;
+		double radius = std::sqrt(-2.0 * std::log(1.0 - philox_unit_double(bits.word[0], bits.word[1])));
+		double angle = 2.0 * pi * philox_unit_double(bits.word[2], bits.word[3]);
+		return mean + stddev * T(radius * std::cos(angle));
+	}
+};
+
+/**
+ * @class PhiloxEngine
+ * @brief A standard uniform random bit generator over the Philox stream of one element.
+ * @details Returns the words of the blocks for counters `(idx, 0)`, `(idx, 1)`, ... in turn,
+ *          so that a standard distribution can draw as many words as it needs for an element
+ *          without touching the streams of the others.
+ */
+class PhiloxEngine
+{
+private:
+	/** @brief The key. */
+	std::uint64_t _seed;
+
+	/** @brief The low half of the counter: the element's index. */
+	std::uint64_t _stream;
+
+	/** @brief The high half of the counter of the next block. */
+	std::uint64_t _block = 0;
+
+	/** @brief The current block. */
+	philox_block _bits{};
+
+	/** @brief The next word of the current block to return; 4 when it is used up. */
+	unsigned _next = 4;
+
+public:
+	/** @brief The type of the generated values. */
+	using result_type = std::uint32_t;
+
+	/**
+	 * @brief Constructs the engine for one element's stream.
+	 * @param seed The key.
+	 * @param stream The index of the element.
+	 */
+	PhiloxEngine(std::uint64_t seed, std::uint64_t stream)
+		: _seed(seed), _stream(stream) {}
+
+	/**
+	 * @brief Gets the smallest value the engine returns.
+	 * @return 0.
+	 */
+	static constexpr result_type min() { return 0; }
+
+	/**
+	 * @brief Gets the largest value the engine returns.
+	 * @return The largest 32-bit value.
+	 */
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	/**
+	 * @brief Gets the next word of the stream.
+	 * @return 32 random bits.
+	 */
+	result_type operator()()
+	{
+		if (_next == 4)
+		{
+			_bits = philox4x32(_seed, _stream, _block++);
+			_next = 0;
+		}
+		return _bits.word[_next++];
+	}
+};
+
+/**
+ * @brief Draws the value of one element of a random stream.
+ * @details Distributions mapping a `philox_block` to a value (such as `philox_uniform`) get
+ *          the element's block directly. Standard distributions get a fresh copy of
+ *          themselves and a `PhiloxEngine` for the element, so that no state carries over from
+ *          one element to the next.
+ * @tparam DIST The type of the distribution.
+ * @param dist The distribution.
+ * @param seed The seed of the stream.
+ * @param idx The index of the element.
+ * @return The value of the element.
+ */
+template <typename DIST>
+auto philox_sample(const DIST &dist, std::uint64_t seed, std::uint64_t idx)
+{
+	if constexpr (std::is_invocable<const DIST &, const philox_block &>::value)
+		return dist(philox4x32(seed, idx));
+	else
+	{
+		DIST local = dist;
+		PhiloxEngine engine(seed, idx);
+		return local(engine);
+	}
+}
+
+/**
+ * @brief Fills an array with consecutive elements of a random stream.
+ * @tparam T The element type.
+ * @tparam DIST The type of the distribution.
+ * @param out The array to fill.
+ * @param start The index in the stream of the first element.
+ * @param count The number of elements.
+ * @param dist The distribution.
+ * @param seed The seed of the stream.
+ */
+template <typename T, typename DIST>
+void philox_fill(T *out, std::size_t start, std::size_t count, const DIST &dist, std::uint64_t seed)
+{
+	for (std::size_t k = 0; k < count; ++k)
+		out[k] = T(philox_sample(dist, seed, start + k));
+}
+
+#endif // PHILOX_HPP
@@ -0,0 +1,274 @@
+/**
+ * @file rolling.hpp
+ * @brief Defines sliding-window (rolling) reductions on Collection: sum, mean, min, max and
+ *        any associative operation, each in O(n) time whatever the window width.
+ * @details Element `i` of a rolling result reduces the `window` input elements starting at
+ *          `i`, so an input of `n` elements gives `n - window + 1` results, and none when the
+ *          window is wider than the input.
+ *
+ *          Each kind of operation uses the cheapest incremental algorithm that applies to it:
+ *          - sum and mean add the element entering the window and subtract the one leaving
+ *            it. Floating point sums carry a compensation term, so the rounding error does
+ *            not build up along the input.
+ *          - min and max keep a monotonic queue of the candidates still able to become the
+ *            extreme, so each element is pushed and popped at most once.
+ *          - any other associative operation uses the two-stack queue: the older part of
+ *            the window is kept as suffix reductions and the newer part as one running
+ *            reduction, so each result costs one application of the operation, plus two
+ *            amortized ones to maintain the stacks. The operation need not be invertible
+ *            or commutative; elements are always combined in input order.
+ *
+ *          The results are split into chunks across threads. Each chunk rereads the
+ *          `window - 1` elements before its first full window, and chunks are at least one
+ *          window wide, so the overlap at most doubles the work.
+ */
+
+#ifndef ROLLING_HPP
+#define ROLLING_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Splits the windows of a rolling reduction into chunks and runs them across threads.
+ * @tparam R The element type of the result.
+ * @tparam T The element type of the input.
+ * @tparam FN The type of the chunk function.
+ * @param c The input collection.
+ * @param window The window width. Must be positive.
+ * @param fn A function taking the input array and the `[begin, end)` range of windows of a
+ *           chunk, and writing their results to the output array it is also given.
+ * @return The results, one per full window. `fn` is not called when there are none, since
+ *         it reads the `window - 1` elements after each window it is given.
+ */
+template <typename R, typename T, typename FN>
+Collection<R> rolling_chunks(const Collection<T> &c, std::size_t window, FN fn)
+{
+	assert_true(window > 0, "rolling: Window must be positive");
+	std::size_t count = c.size() >= window ? c.size() - window + 1 : 0;
+	Collection<R> res = Collection<R>::allocate(count);
+	if (count == 0)
+		return res;
+	const T *src = c.data();
+	R *out = res.data();
+	parallel_for(count, [&](std::size_t begin, std::size_t end)
+				 { fn(src, begin, end, out); },
+				 std::max(parallel_grain, window));
+	return res;
+}
+
+/**
+ * @brief Computes the sums of every window of a collection.
+ * @details The running sum is updated with the element entering and the element leaving the
+ *          window. For floating point elements it is kept as a value plus a compensation
+ *          term (Neumaier summation), so each result is about as accurate as summing its
+ *          window directly.
+ * @tparam T The element type of the collection.
+ * @param c The input collection.
+ * @param window The number of elements in each window. Must be positive.
+ * @return A collection of `c.size() - window + 1` sums, or an empty collection if the window is wider than the input.
+ */
+template <typename T>
+Collection<T> rolling_sum(const Collection<T> &c, std::size_t window)
+{
+	return rolling_chunks<T>(c, window, [window](const T *src, std::size_t begin, std::size_t end, T *out)
+							 {
+								 T sum = T(0);
+								 T comp = T(0);
+								 auto add = [&](T x)
+								 {
+									 if constexpr (std::is_floating_point<T>::value)
+									 {
+										 T t = sum + x;
+										 if (std::abs(sum) >= std::abs(x))
+											 comp += (sum - t) + x;
+										 else
+											 comp += (x - t) + sum;
+										 sum = t;
+									 }
+									 else
+										 sum += x;
+								 };
+								 for (std::size_t idx = begin; idx < begin + window - 1; ++idx)
+									 add(src[idx]);
+								 for (std::size_t idx = begin; idx < end; ++idx)
+								 {
+									 add(src[idx + window - 1]);
+									 out[idx] = sum + comp;
+									 add(-src[idx]);
+								 } });
+}
+
+/**
+ * @brief The element type of a rolling mean: the input type for floating point inputs, double otherwise.
+ * @tparam T The element type of the input.
+ */
+template <typename T>
+using rolling_mean_t = std::conditional_t<std::is_floating_point<T>::value, T, double>;
+
+/**
+ * @brief Computes the means of every window of a collection.
+ * @details Uses the same running sum as `rolling_sum`; integer inputs are summed as doubles.
+ * @tparam T The element type of the collection.
+ * @param c The input collection.
+ * @param window The number of elements in each window. Must be positive.
+ * @return A collection of `c.size() - window + 1` means, or an empty collection if the window is wider than the input.
+ */
+template <typename T>
+Collection<rolling_mean_t<T>> rolling_mean(const Collection<T> &c, std::size_t window)
+{
+	using R = rolling_mean_t<T>;
+	Collection<R> sums = [&]()
+	{
+		if constexpr (std::is_same<T, R>::value)
+			return rolling_sum(c, window);
+		else
+			return rolling_sum(Collection<R>(c, [](T x)
+											 { return static_cast<R>(x); }),
+							   window);
+	}();
+	R width = static_cast<R>(window);
+	R *data = sums.data();
+	parallel_for(sums.size(), [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t idx = begin; idx < end; ++idx)
+						 data[idx] /= width; });
+	return sums;
+}
+
+/**
+ * @brief Computes the extreme of every window of a collection with a monotonic queue.
+ * @details The queue holds the indices of the elements which may still become the extreme
+ *          of a later window, in input order, with their values strictly ordered by
+ *          `before`. It lives in a ring buffer of at least `window` slots, rounded up to a
+ *          power of two so that positions wrap with a mask.
+ * @tparam T The element type of the collection.
+ * @tparam CMP The type of the ordering; `before(a, b)` is true when `a` is the better extreme.
+ * @param c The input collection.
+ * @param window The number of elements in each window. Must be positive.
+ * @param before The ordering.
+ * @return The extreme of each window; on ties, the value of the latest element.
+ */
+template <typename T, typename CMP>
+Collection<T> rolling_extreme(const Collection<T> &c, std::size_t window, CMP before)
+{
+	return rolling_chunks<T>(c, window, [window, before](const T *src, std::size_t begin, std::size_t end, T *out)
+							 {
+								 std::size_t mask = 1;
+								 while (mask < window)
+									 mask <<= 1;
+								 std::vector<std::size_t> ring(mask);
+								 --mask;
+								 std::size_t head = 0, count = 0;
+								 auto push = [&](std::size_t idx)
+								 {
+									 while (count > 0 && !before(src[ring[(head + count - 1) & mask]], src[idx]))
+										 --count;
+									 ring[(head + count) & mask] = idx;
+									 ++count;
+								 };
+								 for (std::size_t idx = begin; idx < begin + window - 1; ++idx)
+									 push(idx);
+								 for (std::size_t idx = begin; idx < end; ++idx)
+								 {
+									 if (count > 0 && ring[head] < idx)
+									 {
+										 head = (head + 1) & mask;
+										 --count;
+									 }
+									 push(idx + window - 1);
+									 out[idx] = src[ring[head]];
+								 } });
+}
+
+/**
+ * @brief Computes the minimum of every window of a collection.
+ * @details Uses a monotonic queue, so each element is compared O(1) times on average. Windows
+ *          containing NaNs give an unspecified element of the window.
+ * @tparam T The element type of the collection.
+ * @param c The input collection.
+ * @param window The number of elements in each window. Must be positive.
+ * @return A collection of `c.size() - window + 1` minima, or an empty collection if the window is wider than the input.
+ */
+template <typename T>
+Collection<T> rolling_min(const Collection<T> &c, std::size_t window)
+{
+	return rolling_extreme(c, window, std::less<T>());
+}
+
+/**
+ * @brief Computes the maximum of every window of a collection.
+ * @details Uses a monotonic queue, so each element is compared O(1) times on average. Windows
+ *          containing NaNs give an unspecified element of the window.
+ * @tparam T The element type of the collection.
+ * @param c The input collection.
+ * @param window The number of elements in each window. Must be positive.
+ * @return A collection of `c.size() - window + 1` maxima, or an empty collection if the window is wider than the input.
+ */
+template <typename T>
+Collection<T> rolling_max(const Collection<T> &c, std::size_t window)
+{
+	return rolling_extreme(c, window, std::greater<T>());
+}
+
+/**
+ * @brief Reduces every window of a collection with an associative operation.
+ * @details `std::plus` is routed to `rolling_sum`. Any other operation uses the two-stack
+ *          queue: when the older stack runs out, every element of the current window but the
+ *          newest is folded into suffix reductions, `suffix[k] = op(c[k], suffix[k + 1])`,
+ *          and newer elements are folded into one running reduction. Each window is then the suffix
+ *          of its first element combined with the running reduction. The elements of each
+ *          window are combined in input order, so `op` only has to be associative.
+ * @code
+ * Collection<double> products = rolling(xs, 10, std::multiplies<double>());
+ * @endcode
+ * @tparam T The element type of the collection.
+ * @tparam OP The type of the binary operation.
+ * @param c The input collection.
+ * @param window The number of elements in each window. Must be positive.
+ * @param op An associative binary operation on T. Windows are split across threads, so it
+ *           must be safe to call concurrently.
+ * @return A collection of `c.size() - window + 1` reductions, or an empty collection if the window is wider than the input.
+ */
+template <typename T, typename OP>
+Collection<T> rolling(const Collection<T> &c, std::size_t window, OP op)
+{
+	if constexpr (std::is_same<OP, std::plus<T>>::value || std::is_same<OP, std::plus<>>::value)
+		return rolling_sum(c, window);
+	else
+		return rolling_chunks<T>(c, window, [window, op](const T *src, std::size_t begin, std::size_t end, T *out)
+								 {
+									 std::vector<T> suffix(window);
+									 std::size_t front_begin = begin, front_end = begin;
+									 T back = T();
+									 bool back_empty = true;
+									 for (std::size_t idx = begin; idx < end; ++idx)
+									 {
+										 std::size_t newest = idx + window - 1;
+										 if (idx >= front_end)
+										 {
+											 front_begin = idx;
+											 front_end = newest;
+											 if (front_end > front_begin)
+											 {
+												 std::size_t last = front_end - front_begin - 1;
+												 suffix[last] = src[front_end - 1];
+												 for (std::size_t k = last; k-- > 0;)
+													 suffix[k] = op(src[front_begin + k], suffix[k + 1]);
+											 }
+											 back_empty = true;
+										 }
+										 back = back_empty ? src[newest] : op(back, src[newest]);
+										 back_empty = false;
+										 out[idx] = idx < front_end ? op(suffix[idx - front_begin], back) : back;
+									 } });
+}
+
+#endif // ROLLING_HPP
@@ -0,0 +1,232 @@
+/**
+ * @file search.hpp
+ * @brief Defines predicate queries on Collection that stop as soon as their answer is known:
+ *        any_of, all_of, none_of, find_first and find_last, along with count_if.
+ * @details The elements are scanned in blocks of `search_block`, handed out to the worker
+ *          threads round-robin, so that the threads move through the collection side by side
+ *          from the end the query favours. Each block is first tested as a whole, in a
+ *          branch-free loop the compiler vectorizes; only a block containing a match is
+ *          rescanned element by element to locate it.
+ *
+ *          Workers share the best answer found so far and check it before each block, so
+ *          once it is settled the other workers stop within one block. A match at index 10 of
+ *          a large collection therefore costs about one block per thread, not a full scan.
+ *
+ *          The predicate is called from several threads at once and must not rely on being
+ *          called for every element, or in order.
+ */
+
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <atomic>
+
+/**
+ * @brief Number of elements each worker tests between two checks for cancellation.
+ * @details Large enough for the vectorized test to amortize the shared atomic load, small
+ *          enough that a settled query stops the other workers within a few microseconds.
+ */
+constexpr std::size_t search_block = 4096;
+
+/**
+ * @brief Tests whether any element of a range satisfies a predicate.
+ * @details Accumulates the results in an integer flag rather than branching on them, so the
+ *          loop vectorizes for simple predicates.
+ * @tparam T The element type.
+ * @tparam PRED The type of the predicate.
+ * @param src The elements.
+ * @param begin The first index of the range.
+ * @param end One past the last index of the range.
+ * @param pred A function taking an element and returning whether it matches.
+ * @return true if at least one element of the range matches.
+ */
+template <typename T, typename PRED>
+bool search_any(const T *src, std::size_t begin, std::size_t end, const PRED &pred)
+{
+	unsigned hit = 0;
+	for (std::size_t idx = begin; idx < end; ++idx)
+		hit |= unsigned(bool(pred(src[idx])));
+	return hit != 0;
+}
+
+/**
+ * @brief Runs a function over the blocks of a range, dealt round-robin to the worker threads.
+ * @details Each worker takes blocks `w, w + workers, w + 2 * workers, ...` in turn and stops
+ *          at its first block for which `fn` returns false.
+ * @tparam FN The type of the block function.
+ * @param size The number of elements in the range.
+ * @param from_end Whether block 0 is the last block of the range rather than the first.
+ * @param fn A function taking the `[begin, end)` bounds of a block and returning whether the
+ *           worker should go on to its next block.
+ */
+template <typename FN>
+void search_blocks(std::size_t size, bool from_end, FN fn)
+{
+	std::size_t blocks = (size + search_block - 1) / search_block;
+	std::size_t workers = parallel_chunks(size);
+	parallel_tasks(workers, [&](std::size_t worker)
+				   {
+					   for (std::size_t block = worker; block < blocks; block += workers)
+					   {
+						   std::size_t begin = block * search_block;
+						   std::size_t end = std::min(size, begin + search_block);
+						   if (from_end)
+						   {
+							   std::size_t last = size - begin;
+							   begin = size - end;
+							   end = last;
+						   }
+						   if (!fn(begin, end))
+							   break;
+					   } });
+}
+
+/**
+ * @brief Tests whether any element of a collection satisfies a predicate.
+ * @tparam T The element type of the collection.
+ * @tparam PRED The type of the predicate.
+ * @param c The collection to search.
+ * @param pred A function taking an element and returning whether it matches.
+ * @return true if at least one element matches; false for an empty collection.
+ */
+template <typename T, typename PRED>
+bool any_of(const Collection<T> &c, PRED pred)
+{
+	const T *src = c.data();
+	std::atomic<bool> found{false};
+	search_blocks(c.size(), false, [&](std::size_t begin, std::size_t end)
+				  {
+					  if (found.load(std::memory_order_relaxed))
+						  return false;
+					  if (!search_any(src, begin, end, pred))
+						  return true;
+					  found.store(true, std::memory_order_relaxed);
+					  return false; });
+	return found.load();
+}
+
+/**
+ * @brief Tests whether no element of a collection satisfies a predicate.
+ * @tparam T The element type of the collection.
+ * @tparam PRED The type of the predicate.
+ * @param c The collection to search.
+ * @param pred A function taking an element and returning whether it matches.
+ * @return true if no element matches, including for an empty collection.
+ */
+template <typename T, typename PRED>
+bool none_of(const Collection<T> &c, PRED pred)
+{
+	return !any_of(c, pred);
+}
+
+/**
+ * @brief Tests whether every element of a collection satisfies a predicate.
+ * @details Stops at the first element found not to match.
+ * @tparam T The element type of the collection.
+ * @tparam PRED The type of the predicate.
+ * @param c The collection to search.
+ * @param pred A function taking an element and returning whether it matches.
+ * @return true if every element matches, including for an empty collection.
+ */
+template <typename T, typename PRED>
+bool all_of(const Collection<T> &c, PRED pred)
+{
+	return !any_of(c, [&pred](const T &value)
+				   { return !pred(value); });
+}
+
+/**
+ * @brief Finds the first element of a collection that satisfies a predicate.
+ * @details Workers skip any block starting after the earliest match found so far, so every
+ *          block before the answer is scanned and none far beyond it.
+ * @tparam T The element type of the collection.
+ * @tparam PRED The type of the predicate.
+ * @param c The collection to search.
+ * @param pred A function taking an element and returning whether it matches.
+ * @return The index of the first matching element, or `c.size()` if none matches.
+ */
+template <typename T, typename PRED>
+std::size_t find_first(const Collection<T> &c, PRED pred)
+{
+	const T *src = c.data();
+	std::atomic<std::size_t> best{c.size()};
+	search_blocks(c.size(), false, [&](std::size_t begin, std::size_t end)
+				  {
+					  if (begin >= best.load(std::memory_order_relaxed))
+						  return false;
+					  if (!search_any(src, begin, end, pred))
+						  return true;
+					  std::size_t idx = begin;
+					  while (!pred(src[idx]))
+						  ++idx;
+					  std::size_t current = best.load(std::memory_order_relaxed);
+					  while (idx < current && !best.compare_exchange_weak(current, idx, std::memory_order_relaxed))
+						  ;
+					  return false; });
+	return best.load();
+}
+
+/**
+ * @brief Finds the last element of a collection that satisfies a predicate.
+ * @details The mirror image of `find_first`: the blocks are dealt from the end of the
+ *          collection, and workers skip any block ending before the latest match found so far.
+ * @tparam T The element type of the collection.
+ * @tparam PRED The type of the predicate.
+ * @param c The collection to search.
+ * @param pred A function taking an element and returning whether it matches.
+ * @return The index of the last matching element, or `c.size()` if none matches.
+ */
+template <typename T, typename PRED>
+std::size_t find_last(const Collection<T> &c, PRED pred)
+{
+	const T *src = c.data();
+	// One past the index of the latest match, so that 0 can mean none.
+	std::atomic<std::size_t> best{0};
+	search_blocks(c.size(), true, [&](std::size_t begin, std::size_t end)
+				  {
+					  if (end <= best.load(std::memory_order_relaxed))
+						  return false;
+					  if (!search_any(src, begin, end, pred))
+						  return true;
+					  std::size_t idx = end;
+					  while (!pred(src[idx - 1]))
+						  --idx;
+					  std::size_t current = best.load(std::memory_order_relaxed);
+					  while (idx > current && !best.compare_exchange_weak(current, idx, std::memory_order_relaxed))
+						  ;
+					  return false; });
+	std::size_t last = best.load();
+	return last == 0 ? c.size() : last - 1;
+}
+
+/**
+ * @brief Counts the elements of a collection that satisfy a predicate.
+ * @details Every element has to be visited, so this is a plain parallel reduction; the count
+ *          is accumulated branch-free and vectorizes for simple predicates.
+ * @tparam T The element type of the collection.
+ * @tparam PRED The type of the predicate.
+ * @param c The collection to search.
+ * @param pred A function taking an element and returning whether it matches.
+ * @return The number of matching elements.
+ */
+template <typename T, typename PRED>
+std::size_t count_if(const Collection<T> &c, PRED pred)
+{
+	const T *src = c.data();
+	return parallel_reduce(
+		c.size(), std::size_t(0), [&](std::size_t begin, std::size_t end)
+		{
+			std::size_t count = 0;
+			for (std::size_t idx = begin; idx < end; ++idx)
+				count += std::size_t(bool(pred(src[idx])));
+			return count; },
+		[](std::size_t a, std::size_t b)
+		{ return a + b; });
+}
+
+#endif // SEARCH_HPP
@@ -0,0 +1,461 @@
+/**
+ * @file setops.hpp
+ * @brief Defines union, intersection and difference of sorted collections, and the removal
+ *        of duplicates from a sorted collection.
+ * @details The set operations take collections sorted in ascending order without duplicates
+ *          (`dedup` makes any sorted collection so) and return a collection of the same kind.
+ *          As with `std::set_intersection`, the order is not checked.
+ *
+ *          Each operation picks the cheapest kernel for the sizes of its inputs:
+ *          - when one input is more than `setops_gallop_ratio` times longer than the other,
+ *            each element of the shorter one is located in the longer one by galloping
+ *            (exponential, then binary) search, so the cost grows with the shorter input and
+ *            only logarithmically with the longer one;
+ *          - otherwise, intersection and difference compare blocks of `setops_block`
+ *            elements of each input all against all, which the compiler turns into vector
+ *            compares, and advance whichever block ends at the smaller value; union is a
+ *            branch-free merge.
+ *
+ *          The work is split across threads with the merge path: the position `d` of the
+ *          merged sequence where each chunk starts is located in both inputs by a binary
+ *          search along the diagonal `i + j = d`, then moved back to the first occurrence of
+ *          its value, so that equal elements of the two inputs fall in the same chunk. Each
+ *          chunk writes its results into a scratch buffer at an offset which bounds the
+ *          results of the chunks before it, and the chunks are then packed into the result.
+ */
+
+#ifndef SETOPS_HPP
+#define SETOPS_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Number of elements in each block of the block-compare kernel.
+ * @details The `setops_block * setops_block` comparisons of a step run as a few vector
+ *          compares; 8 fills a 256-bit register with 32-bit keys.
+ */
+constexpr std::size_t setops_block = 8;
+
+/**
+ * @brief Size ratio above which the shorter input is galloped through the longer one.
+ * @details A merge costs about one step per element of both inputs, galloping about
+ *          `2 log2(gap)` steps per element of the shorter input, where `gap` is the average
+ *          distance between its elements in the longer one.
+ */
+constexpr std::size_t setops_gallop_ratio = 32;
+
+/**
+ * @struct setops_split
+ * @brief The start of one chunk of a set operation in each input.
+ */
+struct setops_split
+{
+	/** @brief The index of the first element of the chunk in the first input. */
+	std::size_t a;
+
+	/** @brief The index of the first element of the chunk in the second input. */
+	std::size_t b;
+};
+
+/**
+ * @brief Finds the first element not less than a value, searching forward from a position.
+ * @details Probes `from, from + 2, from + 6, ...`, doubling the step, until an element is
+ *          not less than `value`, then binary searches the last step, so the cost is
+ *          logarithmic in the distance moved rather than in the length of the array.
+ * @tparam T The element type.
+ * @param data The sorted array.
+ * @param from The position to search from.
+ * @param size The number of elements in the array.
+ * @param value The value to look for.
+ * @return The index of the first element at or after `from` which is not less than `value`,
+ *         or `size`.
+ */
+template <typename T>
+std::size_t gallop(const T *data, std::size_t from, std::size_t size, const T &value)
+{
+	std::size_t lo = from;
+	std::size_t step = 1;
+	while (lo + step <= size && data[lo + step - 1] < value)
+	{
+		lo += step;
+		step *= 2;
+	}
+	std::size_t hi = std::min(lo + step, size);
+	return std::lower_bound(data + lo, data + hi, value) - data;
+}
+
+/**
+ * @brief Splits two sorted inputs into chunks of about equal merged length.
+ * @details For the boundary `d` of each chunk, the merge path search finds the `i` where the
+ *          first `i` elements of `a` and the first `d - i` of `b` are the `d` smallest. The
+ *          boundary is then moved to the lower bound of the next merged value in both
+ *          inputs, so that equal elements never straddle two chunks.
+ * @tparam T The element type.
+ * @param a The first sorted array.
+ * @param na The number of elements in `a`.
+ * @param b The second sorted array.
+ * @param nb The number of elements in `b`.
+ * @param chunks The number of chunks.
+ * @return `chunks + 1` splits, from `{0, 0}` to `{na, nb}`, never decreasing.
+ */
+template <typename T>
+std::vector<setops_split> setops_partition(const T *a, std::size_t na, const T *b, std::size_t nb, std::size_t chunks)
+{
+	std::vector<setops_split> splits(chunks + 1, setops_split{na, nb});
+	splits[0] = setops_split{0, 0};
+	for (std::size_t chunk = 1; chunk < chunks; ++chunk)
+	{
+		std::size_t d = (na + nb) / chunks * chunk;
+		std::size_t lo = d > nb ? d - nb : 0;
+		std::size_t hi = std::min(d, na);
+		while (lo < hi)
+		{
+			std::size_t i = lo + (hi - lo) / 2;
+			if (a[i] < b[d - i - 1])
+				lo = i + 1;
+			else
+				hi = i;
+		}
+		std::size_t i = lo, j = d - lo;
+		if (i < na && (j >= nb || !(b[j] < a[i])))
+			splits[chunk] = setops_split{i, static_cast<std::size_t>(std::lower_bound(b, b + nb, a[i]) - b)};
+		else if (j < nb)
+			splits[chunk] = setops_split{static_cast<std::size_t>(std::lower_bound(a, a + na, b[j]) - a), j};
+	}
+	return splits;
+}
+
+/**
+ * @brief Packs the results of the chunks of a set operation into one collection.
+ * @tparam T The element type.
+ * @param scratch The buffer the chunks wrote to.
+ * @param offsets The offset of each chunk in `scratch`.
+ * @param counts The number of results of each chunk.
+ * @return The results of all chunks, in chunk order.
+ */
+template <typename T>
+Collection<T> setops_gather(const T *scratch, const std::vector<std::size_t> &offsets, const std::vector<std::size_t> &counts)
+{
+	std::vector<std::size_t> starts(counts.size() + 1, 0);
+	for (std::size_t chunk = 0; chunk < counts.size(); ++chunk)
+		starts[chunk + 1] = starts[chunk] + counts[chunk];
+	Collection<T> res = Collection<T>::allocate(starts.back());
+	T *out = res.data();
+	parallel_tasks(counts.size(), [&](std::size_t chunk)
+				   { std::copy(scratch + offsets[chunk], scratch + offsets[chunk] + counts[chunk], out + starts[chunk]); });
+	return res;
+}
+
+/**
+ * @brief Runs a set operation kernel on the chunks of two sorted collections.
+ * @tparam T The element type.
+ * @tparam KERNEL The type of the kernel.
+ * @param a The first collection.
+ * @param b The second collection.
+ * @param union_bound True if a chunk may produce as many results as it has elements in both
+ *                    inputs, false if it produces at most its elements of `a`.
+ * @param kernel A function taking the arrays and lengths of a chunk of `a` and of `b` and an
+ *               output array, and returning the number of results written.
+ * @return The results.
+ */
+template <typename T, typename KERNEL>
+Collection<T> setops_run(const Collection<T> &a, const Collection<T> &b, bool union_bound, KERNEL kernel)
+{
+	const T *pa = a.data();
+	const T *pb = b.data();
+	std::size_t na = a.size(), nb = b.size();
+	std::size_t chunks = parallel_chunks(na + nb);
+	std::vector<setops_split> splits = setops_partition(pa, na, pb, nb, chunks);
+
+	std::vector<std::size_t> offsets(chunks), counts(chunks);
+	for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+		offsets[chunk] = union_bound ? splits[chunk].a + splits[chunk].b : splits[chunk].a;
+	Collection<T> scratch = Collection<T>::allocate(union_bound ? na + nb : na);
+	T *out = scratch.data();
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   const setops_split &s = splits[chunk];
+					   const setops_split &e = splits[chunk + 1];
+					   counts[chunk] = kernel(pa + s.a, e.a - s.a, pb + s.b, e.b - s.b, out + offsets[chunk]); });
+	return setops_gather(out, offsets, counts);
+}
+
+/**
+ * @brief Keeps the elements of one sorted array which are, or are not, in another.
+ * @details Compares a block of `setops_block` elements of `a` with a block of `b`, all
+ *          against all, and records which elements of the `a` block found a match. The
+ *          block ending at the smaller value is then finished with: a finished `a` block
+ *          emits its kept elements without branching. Each element of `a` meets every block
+ *          of `b` which may hold its value, so its match is always recorded. The elements
+ *          left once either input has no full block are merged one at a time.
+ * @tparam KEEP True to keep the matched elements (intersection), false to keep the others
+ *              (difference).
+ * @tparam T The element type.
+ * @param a The first sorted array.
+ * @param na The number of elements in `a`.
+ * @param b The second sorted array.
+ * @param nb The number of elements in `b`.
+ * @param out The output array, with room for `na` elements.
+ * @return The number of elements written.
+ */
+template <bool KEEP, typename T>
+std::size_t setops_block_filter(const T *a, std::size_t na, const T *b, std::size_t nb, T *out)
+{
+	std::size_t i = 0, j = 0, n = 0;
+	unsigned char found[setops_block] = {};
+	if constexpr (std::is_arithmetic<T>::value)
+	{
+		while (i + setops_block <= na && j + setops_block <= nb)
+		{
+			for (std::size_t k = 0; k < setops_block; ++k)
+			{
+				unsigned char match = 0;
+				for (std::size_t l = 0; l < setops_block; ++l)
+					match |= a[i + k] == b[j + l];
+				found[k] |= match;
+			}
+			T a_last = a[i + setops_block - 1];
+			T b_last = b[j + setops_block - 1];
+			if (!(b_last < a_last))
+			{
+				for (std::size_t k = 0; k < setops_block; ++k)
+				{
+					out[n] = a[i + k];
+					n += KEEP ? found[k] : 1 - found[k];
+					found[k] = 0;
+				}
+				i += setops_block;
+			}
+			if (!(a_last < b_last))
+				j += setops_block;
+		}
+	}
+
+	std::size_t block = i;
+	for (; i < na; ++i)
+	{
+		if constexpr (KEEP)
+			if (j == nb && i >= block + setops_block)
+				break;
+		const T &value = a[i];
+		while (j < nb && b[j] < value)
+			++j;
+		bool match = (i < block + setops_block && found[i - block]) || (j < nb && !(value < b[j]));
+		if (match == KEEP)
+			out[n++] = value;
+	}
+	return n;
+}
+
+/**
+ * @brief Intersects two sorted arrays.
+ * @tparam T The element type.
+ * @param a The first sorted array.
+ * @param na The number of elements in `a`.
+ * @param b The second sorted array.
+ * @param nb The number of elements in `b`.
+ * @param out The output array, with room for `na` elements.
+ * @return The number of elements written.
+ */
+template <typename T>
+std::size_t setops_intersection(const T *a, std::size_t na, const T *b, std::size_t nb, T *out)
+{
+	std::size_t n = 0;
+	if (na * setops_gallop_ratio < nb)
+	{
+		std::size_t j = 0;
+		for (std::size_t i = 0; i < na && j < nb; ++i)
+		{
+			j = gallop(b, j, nb, a[i]);
+			if (j < nb && !(a[i] < b[j]))
+				out[n++] = a[i];
+		}
+		return n;
+	}
+	if (nb * setops_gallop_ratio < na)
+		return setops_intersection(b, nb, a, na, out);
+	return setops_block_filter<true>(a, na, b, nb, out);
+}
+
+/**
+ * @brief Takes the elements of one sorted array which are not in another.
+ * @tparam T The element type.
+ * @param a The sorted array to take elements from.
+ * @param na The number of elements in `a`.
+ * @param b The sorted array of elements to leave out.
+ * @param nb The number of elements in `b`.
+ * @param out The output array, with room for `na` elements.
+ * @return The number of elements written.
+ */
+template <typename T>
+std::size_t setops_difference(const T *a, std::size_t na, const T *b, std::size_t nb, T *out)
+{
+	std::size_t n = 0;
+	if (na * setops_gallop_ratio < nb)
+	{
+		std::size_t j = 0;
+		for (std::size_t i = 0; i < na; ++i)
+		{
+			j = gallop(b, j, nb, a[i]);
+			if (j == nb || a[i] < b[j])
+				out[n++] = a[i];
+		}
+		return n;
+	}
+	if (nb * setops_gallop_ratio < na)
+	{
+		std::size_t i = 0;
+		for (std::size_t j = 0; j < nb && i < na; ++j)
+		{
+			std::size_t next = gallop(a, i, na, b[j]);
+			out = std::copy(a + i, a + next, out);
+			n += next - i;
+			i = next < na && !(b[j] < a[next]) ? next + 1 : next;
+		}
+		std::copy(a + i, a + na, out);
+		return n + (na - i);
+	}
+	return setops_block_filter<false>(a, na, b, nb, out);
+}
+
+/**
+ * @brief Merges two sorted arrays, keeping one copy of the values in both.
+ * @details With balanced sizes, a merge in which each step writes the smaller head and
+ *          advances the inputs it came from by conditional increments rather than branches.
+ *          With skewed sizes, each element of the shorter array is galloped to in the longer
+ *          one, and the run of the longer one before it is copied in bulk.
+ * @tparam T The element type.
+ * @param a The first sorted array.
+ * @param na The number of elements in `a`.
+ * @param b The second sorted array.
+ * @param nb The number of elements in `b`.
+ * @param out The output array, with room for `na + nb` elements.
+ * @return The number of elements written.
+ */
+template <typename T>
+std::size_t setops_union(const T *a, std::size_t na, const T *b, std::size_t nb, T *out)
+{
+	if (nb * setops_gallop_ratio < na)
+		return setops_union(b, nb, a, na, out);
+	T *start = out;
+	std::size_t i = 0, j = 0;
+	if (na * setops_gallop_ratio < nb)
+	{
+		for (; i < na; ++i)
+		{
+			std::size_t next = gallop(b, j, nb, a[i]);
+			out = std::copy(b + j, b + next, out);
+			j = next < nb && !(a[i] < b[next]) ? next + 1 : next;
+			*out++ = a[i];
+		}
+	}
+	else
+	{
+		while (i < na && j < nb)
+		{
+			const T &x = a[i];
+			const T &y = b[j];
+			bool take_a = !(y < x);
+			bool take_b = !(x < y);
+			*out++ = take_a ? x : y;
+			i += take_a;
+			j += take_b;
+		}
+		out = std::copy(a + i, a + na, out);
+	}
+	out = std::copy(b + j, b + nb, out);
+	return out - start;
+}
+
+/**
+ * @brief Computes the union of two sorted collections.
+ * @details Uses a branch-free merge, or galloping search when one input is more than
+ *          `setops_gallop_ratio` times longer, and splits the merge across threads at
+ *          merge-path boundaries.
+ * @code
+ * Collection<int> all = set_union(ids_a, ids_b);
+ * @endcode
+ * @tparam T The element type. Must be less-than comparable.
+ * @param a A collection sorted in ascending order without duplicates.
+ * @param b A collection sorted in ascending order without duplicates.
+ * @return The values in either collection, sorted, without duplicates.
+ */
+template <typename T>
+Collection<T> set_union(const Collection<T> &a, const Collection<T> &b)
+{
+	return setops_run(a, b, true, [](const T *pa, std::size_t na, const T *pb, std::size_t nb, T *out)
+					  { return setops_union(pa, na, pb, nb, out); });
+}
+
+/**
+ * @brief Computes the intersection of two sorted collections.
+ * @details Compares blocks of `setops_block` elements with vector instructions, or gallops
+ *          the shorter input through the longer one when it is more than
+ *          `setops_gallop_ratio` times shorter, and splits the work across threads at
+ *          merge-path boundaries.
+ * @tparam T The element type. Must be less-than comparable.
+ * @param a A collection sorted in ascending order without duplicates.
+ * @param b A collection sorted in ascending order without duplicates.
+ * @return The values in both collections, sorted.
+ */
+template <typename T>
+Collection<T> set_intersection(const Collection<T> &a, const Collection<T> &b)
+{
+	return setops_run(a, b, false, [](const T *pa, std::size_t na, const T *pb, std::size_t nb, T *out)
+					  { return setops_intersection(pa, na, pb, nb, out); });
+}
+
+/**
+ * @brief Computes the difference of two sorted collections.
+ * @details Uses the same kernels as `set_intersection`, keeping the unmatched elements.
+ * @tparam T The element type. Must be less-than comparable.
+ * @param a A collection sorted in ascending order without duplicates.
+ * @param b A collection sorted in ascending order without duplicates.
+ * @return The values of `a` which are not in `b`, sorted.
+ */
+template <typename T>
+Collection<T> set_difference(const Collection<T> &a, const Collection<T> &b)
+{
+	return setops_run(a, b, false, [](const T *pa, std::size_t na, const T *pb, std::size_t nb, T *out)
+					  { return setops_difference(pa, na, pb, nb, out); });
+}
+
+/**
+ * @brief Removes the repeated values from a sorted collection.
+ * @details Each chunk keeps the elements which differ from their predecessor, written with
+ *          a conditional increment rather than a branch, and the chunks are then packed.
+ * @tparam T The element type. Must be equality comparable.
+ * @param c A collection in which equal values are adjacent, such as a sorted one.
+ * @return The first element of each run of equal values, in order.
+ */
+template <typename T>
+Collection<T> dedup(const Collection<T> &c)
+{
+	const T *src = c.data();
+	std::size_t size = c.size();
+	std::size_t chunks = parallel_chunks(size);
+	std::vector<std::size_t> offsets(chunks), counts(chunks);
+	Collection<T> scratch = Collection<T>::allocate(size);
+	T *out = scratch.data();
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t begin = chunk_begin(size, chunks, chunk);
+					   std::size_t end = chunk_begin(size, chunks, chunk + 1);
+					   std::size_t n = 0;
+					   for (std::size_t idx = begin; idx < end; ++idx)
+					   {
+						   out[begin + n] = src[idx];
+						   n += idx == 0 || !(src[idx] == src[idx - 1]);
+					   }
+					   offsets[chunk] = begin;
+					   counts[chunk] = n; });
+	return setops_gather(out, offsets, counts);
+}
+
+#endif // SETOPS_HPP
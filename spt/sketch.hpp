@@ -0,0 +1,623 @@
+/**
+ * @file sketch.hpp
+ * @brief Defines mergeable probabilistic sketches and the parallel reduction that builds them
+ *        from a Collection: HyperLogLog distinct counts, Count-Min frequencies, t-digest
+ *        quantiles and Bloom filters.
+ * @details A sketch summarizes any number of elements in a fixed amount of memory and answers
+ *          queries about them approximately. Every sketch here has `add` to take in one element
+ *          and `merge` to take in another sketch built with the same parameters, with the same
+ *          result as if its elements had been added directly. `sketch_reduce` relies on this:
+ *          each thread builds a private sketch of its chunk, and the sketches are merged at the
+ *          end, so the whole collection is summarized in one parallel pass without locks.
+ *
+ *          HyperLogLog, Count-Min and Bloom sketches depend only on the set (or multiset) of
+ *          elements added, so their results do not depend on the thread count. A t-digest
+ *          depends slightly on the order in which points are merged.
+ */
+
+#ifndef SKETCH_HPP
+#define SKETCH_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Scrambles a 64-bit value so that every input bit affects every output bit.
+ * @details The finalizer of SplitMix64. Nearby inputs such as consecutive integers give
+ *          unrelated outputs, which all the sketches rely on.
+ * @param x The value to scramble.
+ * @return The scrambled value.
+ */
+inline std::uint64_t sketch_mix(std::uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
+/**
+ * @brief Hashes an element to 64 well-mixed bits.
+ * @details Integers and floating point numbers are hashed by value, with `-0.0` hashed as
+ *          `0.0`; other types go through `std::hash`.
+ * @tparam T The element type.
+ * @param value The element.
+ * @return The hash.
+ */
+template <typename T>
+std::uint64_t sketch_hash(const T &value)
+{
+	if constexpr (std::is_floating_point_v<T> && sizeof(T) <= sizeof(std::uint64_t))
+	{
+		T normal = value == T(0) ? T(0) : value;
+		std::uint64_t bits = 0;
+		std::memcpy(&bits, &normal, sizeof(normal));
+		return sketch_mix(bits);
+	}
+	else if constexpr (std::is_integral_v<T>)
+		return sketch_mix(static_cast<std::uint64_t>(value));
+	else
+		return sketch_mix(std::hash<T>{}(value));
+}
+
+/**
+ * @brief Summarizes a collection into a sketch, in parallel.
+ * @details Each chunk is added to its own copy of `empty`, and the chunk sketches are merged
+ *          in chunk order.
+ * @tparam SKETCH The type of the sketch. Needs `add(const T &)` and `merge(const SKETCH &)`.
+ * @tparam T The element type of the collection.
+ * @param c The collection to summarize.
+ * @param empty An empty sketch with the parameters the result should have.
+ * @return A sketch of every element of the collection.
+ */
+template <typename SKETCH, typename T>
+SKETCH sketch_reduce(const Collection<T> &c, const SKETCH &empty)
+{
+	const T *src = c.data();
+	return parallel_reduce(
+		c.size(), empty, [&](std::size_t begin, std::size_t end)
+		{
+			SKETCH part(empty);
+			for (std::size_t idx = begin; idx < end; ++idx)
+				part.add(src[idx]);
+			return part; },
+		[](SKETCH a, const SKETCH &b)
+		{
+			a.merge(b);
+			return a; });
+}
+
+/**
+ * @class HyperLogLog
+ * @brief Estimates the number of distinct elements added to it.
+ * @details The top `precision` bits of each hash select one of `2^precision` registers, which
+ *          keeps the largest number of leading zeros seen in the remaining bits. The relative
+ *          standard error is about `1.04 / sqrt(2^precision)`, 0.8% at the default precision
+ *          of 14, for 16 KiB of registers. Small counts are estimated from the number of
+ *          empty registers instead (linear counting), which is much more accurate there.
+ * @tparam T The element type.
+ */
+template <typename T>
+class HyperLogLog
+{
+private:
+	/** @brief The number of hash bits used to select a register. */
+	unsigned _precision;
+
+	/** @brief For each register, one more than the most leading zeros seen. */
+	std::vector<std::uint8_t> _registers;
+
+public:
+	/**
+	 * @brief Constructs an empty sketch.
+	 * @param precision The number of hash bits used to select a register, from 4 to 18.
+	 */
+	explicit HyperLogLog(unsigned precision = 14)
+		: _precision(precision)
+	{
+		assert_true(precision >= 4 && precision <= 18, "HyperLogLog: Precision must be between 4 and 18");
+		_registers.assign(std::size_t(1) << precision, 0);
+	}
+
+	/**
+	 * @brief Gets the number of hash bits used to select a register.
+	 * @return The precision.
+	 */
+	inline unsigned precision() const { return _precision; }
+
+	/**
+	 * @brief Adds an element.
+	 * @param value The element.
+	 */
+	void add(const T &value)
+	{
+		std::uint64_t hash = sketch_hash(value);
+		std::size_t reg = hash >> (64 - _precision);
+		// The sentinel bit caps the rank when every remaining bit is zero.
+		std::uint64_t rest = (hash << _precision) | (std::uint64_t(1) << (_precision - 1));
+		std::uint8_t rank = std::uint8_t(__builtin_clzll(rest) + 1);
+		_registers[reg] = std::max(_registers[reg], rank);
+	}
+
+	/**
+	 * @brief Adds the elements of another sketch.
+	 * @param other A sketch of the same precision.
+	 */
+	void merge(const HyperLogLog<T> &other)
+	{
+		assert_equal(_precision, other._precision, "HyperLogLog: Cannot merge sketches of different precision");
+		for (std::size_t reg = 0; reg < _registers.size(); ++reg)
+			_registers[reg] = std::max(_registers[reg], other._registers[reg]);
+	}
+
+	/**
+	 * @brief Estimates the number of distinct elements added.
+	 * @return The estimate.
+	 */
+	double estimate() const
+	{
+		double m = double(_registers.size());
+		double inverse_sum = 0.0;
+		std::size_t zeros = 0;
+		for (std::uint8_t rank : _registers)
+		{
+			inverse_sum += std::ldexp(1.0, -int(rank));
+			zeros += rank == 0 ? 1 : 0;
+		}
+		double alpha = 0.7213 / (1.0 + 1.079 / m);
+		double raw = alpha * m * m / inverse_sum;
+		if (raw <= 2.5 * m && zeros > 0)
+			return m * std::log(m / double(zeros));
+		return raw;
+	}
+};
+
+/**
+ * @class CountMinSketch
+ * @brief Estimates how many times each element was added to it.
+ * @details Keeps `depth` rows of `width` counters; each element increments one counter per
+ *          row, chosen by its hash, and its estimate is the smallest of them. Estimates never
+ *          fall below the true count and, with probability `1 - exp(-depth)`, exceed it by at
+ *          most `e / width` times the total of all counts.
+ * @tparam T The element type.
+ */
+template <typename T>
+class CountMinSketch
+{
+private:
+	/** @brief The number of counters in each row. */
+	std::size_t _width;
+
+	/** @brief The number of rows. */
+	std::size_t _depth;
+
+	/** @brief The counters, row after row. */
+	std::vector<std::uint64_t> _counts;
+
+	/** @brief The total of all counts added. */
+	std::uint64_t _total;
+
+	/**
+	 * @brief Gets the counter of an element in one row.
+	 * @param hash The hash of the element.
+	 * @param row The row.
+	 * @return The index of the counter in `_counts`.
+	 */
+	inline std::size_t slot(std::uint64_t hash, std::size_t row) const
+	{
+		// Double hashing: the rows use h1 + row * h2 for two independent hashes.
+		std::uint64_t step = sketch_mix(hash) | 1;
+		return row * _width + std::size_t((hash + row * step) % _width);
+	}
+
+public:
+	/**
+	 * @brief Constructs an empty sketch.
+	 * @param width The number of counters in each row. Must be positive.
+	 * @param depth The number of rows. Must be positive.
+	 */
+	explicit CountMinSketch(std::size_t width = 2048, std::size_t depth = 4)
+		: _width(width), _depth(depth), _counts(width * depth, 0), _total(0)
+	{
+		assert_true(width > 0 && depth > 0, "CountMinSketch: Width and depth must be positive");
+	}
+
+	/**
+	 * @brief Gets the number of counters in each row.
+	 * @return The width.
+	 */
+	inline std::size_t width() const { return _width; }
+
+	/**
+	 * @brief Gets the number of rows.
+	 * @return The depth.
+	 */
+	inline std::size_t depth() const { return _depth; }
+
+	/**
+	 * @brief Gets the total of all counts added.
+	 * @return The total.
+	 */
+	inline std::uint64_t total() const { return _total; }
+
+	/**
+	 * @brief Adds occurrences of an element.
+	 * @param value The element.
+	 * @param count The number of occurrences.
+	 */
+	void add(const T &value, std::uint64_t count = 1)
+	{
+		std::uint64_t hash = sketch_hash(value);
+		for (std::size_t row = 0; row < _depth; ++row)
+			_counts[slot(hash, row)] += count;
+		_total += count;
+	}
+
+	/**
+	 * @brief Adds the counts of another sketch.
+	 * @param other A sketch of the same width and depth.
+	 */
+	void merge(const CountMinSketch<T> &other)
+	{
+		assert_true(_width == other._width && _depth == other._depth, "CountMinSketch: Cannot merge sketches of different shapes");
+		for (std::size_t idx = 0; idx < _counts.size(); ++idx)
+			_counts[idx] += other._counts[idx];
+		_total += other._total;
+	}
+
+	/**
+	 * @brief Estimates how many times an element was added.
+	 * @param value The element.
+	 * @return The estimate, never less than the true count.
+	 */
+	std::uint64_t estimate(const T &value) const
+	{
+		std::uint64_t hash = sketch_hash(value);
+		std::uint64_t res = std::numeric_limits<std::uint64_t>::max();
+		for (std::size_t row = 0; row < _depth; ++row)
+			res = std::min(res, _counts[slot(hash, row)]);
+		return res;
+	}
+};
+
+/**
+ * @class BloomFilter
+ * @brief A set of elements which may report false positives but never false negatives.
+ * @details Each element sets `hashes` bits of a bit array, chosen by double hashing, and is
+ *          reported present if all of them are set. `for_capacity` sizes the array for an
+ *          expected number of elements and false positive rate.
+ * @tparam T The element type.
+ */
+template <typename T>
+class BloomFilter
+{
+private:
+	/** @brief The number of bits in the array. */
+	std::size_t _bits;
+
+	/** @brief The number of bits set by each element. */
+	std::size_t _hashes;
+
+	/** @brief The bit array, 64 bits to a word. */
+	std::vector<std::uint64_t> _words;
+
+	/**
+	 * @brief Calls a function with each bit of an element.
+	 * @tparam FN The type of the function.
+	 * @param value The element.
+	 * @param fn A function taking the index of a word and the mask of the bit in it, and
+	 *           returning false to stop.
+	 * @return false if `fn` stopped early.
+	 */
+	template <typename FN>
+	bool for_each_bit(const T &value, FN fn) const
+	{
+		std::uint64_t hash = sketch_hash(value);
+		std::uint64_t step = sketch_mix(hash) | 1;
+		for (std::size_t k = 0; k < _hashes; ++k)
+		{
+			std::size_t bit = std::size_t((hash + k * step) % _bits);
+			if (!fn(bit / 64, std::uint64_t(1) << (bit % 64)))
+				return false;
+		}
+		return true;
+	}
+
+public:
+	/**
+	 * @brief Constructs an empty filter.
+	 * @param bits The number of bits in the array, rounded up to a multiple of 64. Must be positive.
+	 * @param hashes The number of bits set by each element. Must be positive.
+	 */
+	BloomFilter(std::size_t bits, std::size_t hashes)
+		: _bits((bits + 63) / 64 * 64), _hashes(hashes), _words((bits + 63) / 64, 0)
+	{
+		assert_true(bits > 0 && hashes > 0, "BloomFilter: Bit and hash counts must be positive");
+	}
+
+	/**
+	 * @brief Constructs an empty filter sized for a number of elements and a false positive rate.
+	 * @details Uses `-n ln(p) / ln(2)^2` bits and `ln(2)` hashes per bit per element, which
+	 *          minimizes the false positive rate for that many bits.
+	 * @param capacity The expected number of elements.
+	 * @param false_positive_rate The false positive rate wanted at capacity, between 0 and 1.
+	 * @return The filter.
+	 */
+	static BloomFilter<T> for_capacity(std::size_t capacity, double false_positive_rate)
+	{
+		assert_true(false_positive_rate > 0.0 && false_positive_rate < 1.0, "BloomFilter: False positive rate must be between 0 and 1");
+		double ln2 = std::log(2.0);
+		double bits = std::ceil(-double(std::max<std::size_t>(capacity, 1)) * std::log(false_positive_rate) / (ln2 * ln2));
+		double hashes = std::round(bits / double(std::max<std::size_t>(capacity, 1)) * ln2);
+		return BloomFilter<T>(std::size_t(bits), std::max<std::size_t>(1, std::size_t(hashes)));
+	}
+
+	/**
+	 * @brief Gets the number of bits in the array.
+	 * @return The bit count.
+	 */
+	inline std::size_t bits() const { return _bits; }
+
+	/**
+	 * @brief Gets the number of bits set by each element.
+	 * @return The hash count.
+	 */
+	inline std::size_t hashes() const { return _hashes; }
+
+	/**
+	 * @brief Adds an element.
+	 * @param value The element.
+	 */
+	void add(const T &value)
+	{
+		for_each_bit(value, [this](std::size_t word, std::uint64_t mask)
+					 {
+						 _words[word] |= mask;
+						 return true; });
+	}
+
+	/**
+	 * @brief Adds the elements of another filter.
+	 * @param other A filter with the same bit and hash counts.
+	 */
+	void merge(const BloomFilter<T> &other)
+	{
+		assert_true(_bits == other._bits && _hashes == other._hashes, "BloomFilter: Cannot merge filters of different shapes");
+		for (std::size_t word = 0; word < _words.size(); ++word)
+			_words[word] |= other._words[word];
+	}
+
+	/**
+	 * @brief Tests whether an element may have been added.
+	 * @param value The element.
+	 * @return true if the element was added, or for a false positive.
+	 */
+	bool contains(const T &value) const
+	{
+		return for_each_bit(value, [this](std::size_t word, std::uint64_t mask)
+							{ return (_words[word] & mask) != 0; });
+	}
+};
+
+/**
+ * @struct tdigest_centroid
+ * @brief A cluster of nearby points of a t-digest, kept as their mean and count.
+ */
+struct tdigest_centroid
+{
+	/** @brief The mean of the points. */
+	double mean;
+
+	/** @brief The number of points. */
+	double weight;
+};
+
+/**
+ * @class TDigest
+ * @brief Estimates quantiles of the numbers added to it.
+ * @details Points are buffered, then sorted together with the centroids and merged greedily
+ *          into new centroids, each limited in weight by the arcsine scale function: a
+ *          centroid may span one unit of `compression / (2 pi) * asin(2q - 1)`, where `q` is
+ *          the fraction of points below it. Centroids are thus smallest at the tails, so
+ *          extreme quantiles are estimated most accurately, and there are at most about
+ *          `compression` of them. Quantiles interpolate linearly between centroid means.
+ *          NaNs are ignored.
+ * @tparam T The element type. Must be convertible to double.
+ */
+template <typename T>
+class TDigest
+{
+private:
+	/** @brief The scale parameter, roughly the number of centroids kept. */
+	double _compression;
+
+	/** @brief The centroids, in increasing order of their means. */
+	std::vector<tdigest_centroid> _centroids;
+
+	/** @brief Points and centroids added since the last compression. */
+	std::vector<tdigest_centroid> _buffer;
+
+	/** @brief The number of points added. */
+	double _count;
+
+	/** @brief The smallest point added. */
+	double _min;
+
+	/** @brief The largest point added. */
+	double _max;
+
+	/**
+	 * @brief Maps a quantile to the scale on which centroid sizes are bounded.
+	 * @param q The quantile, from 0 to 1.
+	 * @return The scale value.
+	 */
+	inline double scale(double q) const
+	{
+		const double pi = 3.141592653589793;
+		return _compression / (2.0 * pi) * std::asin(2.0 * std::min(1.0, q) - 1.0);
+	}
+
+	/**
+	 * @brief Folds the buffer into the centroids.
+	 */
+	void compress()
+	{
+		if (_buffer.empty())
+			return;
+		_buffer.insert(_buffer.end(), _centroids.begin(), _centroids.end());
+		std::sort(_buffer.begin(), _buffer.end(), [](const tdigest_centroid &a, const tdigest_centroid &b)
+				  { return a.mean < b.mean; });
+		_centroids.clear();
+		tdigest_centroid current = _buffer[0];
+		double before = 0.0;
+		for (std::size_t idx = 1; idx < _buffer.size(); ++idx)
+		{
+			const tdigest_centroid &next = _buffer[idx];
+			double merged = current.weight + next.weight;
+			if (scale((before + merged) / _count) - scale(before / _count) <= 1.0)
+			{
+				current.mean += (next.mean - current.mean) * next.weight / merged;
+				current.weight = merged;
+			}
+			else
+			{
+				before += current.weight;
+				_centroids.push_back(current);
+				current = next;
+			}
+		}
+		_centroids.push_back(current);
+		_buffer.clear();
+	}
+
+public:
+	/**
+	 * @brief Constructs an empty digest.
+	 * @param compression The scale parameter, roughly the number of centroids kept. Must be at least 10.
+	 */
+	explicit TDigest(double compression = 200.0)
+		: _compression(compression), _count(0.0),
+		  _min(std::numeric_limits<double>::infinity()), _max(-std::numeric_limits<double>::infinity())
+	{
+		assert_true(compression >= 10.0, "TDigest: Compression must be at least 10");
+	}
+
+	/**
+	 * @brief Gets the number of points added.
+	 * @return The count.
+	 */
+	inline double count() const { return _count; }
+
+	/**
+	 * @brief Adds a point.
+	 * @param value The point. NaNs are ignored.
+	 */
+	void add(const T &value)
+	{
+		double x = double(value);
+		if (std::isnan(x))
+			return;
+		_buffer.push_back(tdigest_centroid{x, 1.0});
+		_count += 1.0;
+		_min = std::min(_min, x);
+		_max = std::max(_max, x);
+		if (_buffer.size() >= std::size_t(5.0 * _compression))
+			compress();
+	}
+
+	/**
+	 * @brief Adds the points of another digest.
+	 * @param other A digest with the same compression.
+	 */
+	void merge(const TDigest<T> &other)
+	{
+		assert_equal(_compression, other._compression, "TDigest: Cannot merge digests of different compression");
+		_buffer.insert(_buffer.end(), other._centroids.begin(), other._centroids.end());
+		_buffer.insert(_buffer.end(), other._buffer.begin(), other._buffer.end());
+		_count += other._count;
+		_min = std::min(_min, other._min);
+		_max = std::max(_max, other._max);
+		compress();
+	}
+
+	/**
+	 * @brief Estimates a quantile of the points added.
+	 * @param q The quantile, from 0 (the minimum) to 1 (the maximum).
+	 * @return The estimate, or NaN if no point was added.
+	 */
+	double quantile(double q) const
+	{
+		assert_true(q >= 0.0 && q <= 1.0, "TDigest: Quantile must be between 0 and 1");
+		if (_count == 0.0)
+			return std::numeric_limits<double>::quiet_NaN();
+		if (!_buffer.empty())
+		{
+			TDigest<T> flushed(*this);
+			flushed.compress();
+			return flushed.quantile(q);
+		}
+
+		// Each centroid sits at the middle of its weight; the minimum and maximum at the ends.
+		double target = q * _count;
+		double prev_pos = 0.0;
+		double prev_mean = _min;
+		double before = 0.0;
+		for (const tdigest_centroid &centroid : _centroids)
+		{
+			double pos = before + centroid.weight / 2.0;
+			if (target <= pos)
+			{
+				double t = pos > prev_pos ? (target - prev_pos) / (pos - prev_pos) : 1.0;
+				return prev_mean + t * (centroid.mean - prev_mean);
+			}
+			prev_pos = pos;
+			prev_mean = centroid.mean;
+			before += centroid.weight;
+		}
+		double t = _count > prev_pos ? (target - prev_pos) / (_count - prev_pos) : 1.0;
+		return prev_mean + t * (_max - prev_mean);
+	}
+};
+
+/**
+ * @brief Estimates the number of distinct elements of a collection.
+ * @details Builds a HyperLogLog sketch in one parallel pass.
+ * @tparam T The element type of the collection.
+ * @param c The collection.
+ * @param precision The precision of the sketch, from 4 to 18; the relative standard error
+ *                  is about `1.04 / sqrt(2^precision)`.
+ * @return The estimate.
+ */
+template <typename T>
+double approx_distinct(const Collection<T> &c, unsigned precision = 14)
+{
+	return sketch_reduce(c, HyperLogLog<T>(precision)).estimate();
+}
+
+/**
+ * @brief Estimates a quantile of a collection.
+ * @details Builds a t-digest in one parallel pass.
+ * @tparam T The element type of the collection.
+ * @param c The collection.
+ * @param q The quantile, from 0 to 1.
+ * @param compression The compression of the digest.
+ * @return The estimate, or NaN for an empty collection.
+ */
+template <typename T>
+double approx_quantile(const Collection<T> &c, double q, double compression = 200.0)
+{
+	return sketch_reduce(c, TDigest<T>(compression)).quantile(q);
+}
+
+#endif // SKETCH_HPP
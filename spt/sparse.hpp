@@ -0,0 +1,580 @@
+/**
+ * @file sparse.hpp
+ * @brief Defines sparse vectors and compressed sparse row (CSR) matrices, with sparse dot
+ *        products and a multi-threaded sparse matrix-vector product (SpMV).
+ * @details Only the nonzero elements are stored, as parallel arrays of positions and values,
+ *          so kernels over mostly-zero data read a fraction of the memory the dense
+ *          `Collection` and `Matrix` kernels would. Positions are stored as 32-bit
+ *          `sparse_index` values to halve the index traffic, which limits a sparse vector,
+ *          or the columns of a matrix, to 2^32 positions.
+ *
+ *          Both types convert from their dense counterparts with a threshold and back, and
+ *          their kernels take dense `Collection` operands where that is the natural shape:
+ *          sparse-dense dot, sparse axpy and SpMV. The dot products are named `sparse_dot`
+ *          rather than overloading `dot`, so that `dot<T>` still names a single function.
+ *          Conversions, dots and SpMV are split across threads; SpMV splits by the number of
+ *          nonzeros rather than of rows, so a few very dense rows do not leave one thread
+ *          with most of the work.
+ */
+
+#ifndef SPARSE_HPP
+#define SPARSE_HPP
+
+#include "../spt/natv_collection.hpp"
+#include "../spt/natv_matrix.hpp"
+#include "../spt/blas1.hpp"
+#include "../spt/parallel.hpp"
+#include "../spt/assert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The type of the positions stored in sparse vectors and CSR matrices.
+ */
+using sparse_index = std::uint32_t;
+
+/**
+ * @brief Checks whether a dense element is kept when converting to a sparse representation.
+ * @tparam T The element type.
+ * @param x The element.
+ * @param threshold The largest magnitude which is dropped.
+ * @return True unless `|x| <= threshold`; NaNs are always kept.
+ */
+template <typename T>
+inline bool sparse_keep(const T &x, const T &threshold)
+{
+	if constexpr (std::is_unsigned<T>::value)
+		return x > threshold;
+	else
+		return !(x <= threshold && x >= -threshold);
+}
+
+/**
+ * @brief Compresses a dense array into positions and values, in parallel.
+ * @details Each thread counts the kept elements of its chunk; after a prefix sum over the
+ *          counts, each thread writes its chunk's elements at its own offset.
+ * @tparam T The element type.
+ * @param src The dense array.
+ * @param size The number of elements in the array.
+ * @param threshold The largest magnitude which is dropped.
+ * @return The positions of the kept elements, in increasing order, and the kept elements.
+ */
+template <typename T>
+std::pair<Collection<sparse_index>, Collection<T>> sparse_compress(const T *src, std::size_t size, const T &threshold)
+{
+	std::size_t chunks = parallel_chunks(size);
+	std::vector<std::size_t> offsets(chunks + 1, 0);
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t count = 0;
+					   for (std::size_t idx = chunk_begin(size, chunks, chunk); idx < chunk_begin(size, chunks, chunk + 1); ++idx)
+						   count += sparse_keep(src[idx], threshold) ? 1 : 0;
+					   offsets[chunk + 1] = count; });
+	for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+		offsets[chunk + 1] += offsets[chunk];
+
+	Collection<sparse_index> indices = Collection<sparse_index>::allocate(offsets[chunks]);
+	Collection<T> values = Collection<T>::allocate(offsets[chunks]);
+	sparse_index *idx_out = indices.data();
+	T *val_out = values.data();
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t pos = offsets[chunk];
+					   for (std::size_t idx = chunk_begin(size, chunks, chunk); idx < chunk_begin(size, chunks, chunk + 1); ++idx)
+						   if (sparse_keep(src[idx], threshold))
+						   {
+							   idx_out[pos] = (sparse_index)idx;
+							   val_out[pos++] = src[idx];
+						   } });
+	return std::make_pair(std::move(indices), std::move(values));
+}
+
+/**
+ * @class SparseVector
+ * @brief A vector which stores only its nonzero elements, as increasing positions and their values.
+ * @tparam T The type of elements in the vector.
+ */
+template <typename T>
+class SparseVector
+{
+private:
+	/** @brief The logical number of elements, zeros included. */
+	std::size_t _size;
+
+	/** @brief The positions of the stored elements, strictly increasing. */
+	Collection<sparse_index> _indices;
+
+	/** @brief The stored elements. */
+	Collection<T> _values;
+
+public:
+	/**
+	 * @brief Constructs a sparse vector from its positions and values.
+	 * @param size The logical number of elements, zeros included.
+	 * @param indices The positions of the stored elements. Must be strictly increasing and less than `size`.
+	 * @param values The stored elements, one per position.
+	 */
+	SparseVector(std::size_t size, Collection<sparse_index> &&indices, Collection<T> &&values)
+		: _size(size), _indices(std::move(indices)), _values(std::move(values))
+	{
+		assert_true(size <= (std::size_t)std::numeric_limits<sparse_index>::max() + 1, "SparseVector: Size exceeds the index range");
+		assert_equal(_indices.size(), _values.size(), "SparseVector: Index and value counts differ");
+		for (std::size_t idx = 0; idx < _indices.size(); ++idx)
+		{
+			assert_true(_indices.get(idx) < size, "SparseVector: Index out of bounds");
+			assert_true(idx == 0 || _indices.get(idx - 1) < _indices.get(idx), "SparseVector: Indices must be strictly increasing");
+		}
+	}
+
+	/**
+	 * @brief Move constructor. Takes ownership of the elements of another sparse vector.
+	 * @param src The source vector to move from.
+	 */
+	SparseVector(SparseVector<T> &&src) = default;
+
+	/**
+	 * @brief Creates a sparse vector from the elements of a dense collection above a threshold.
+	 * @param c The dense collection.
+	 * @param threshold Elements with a magnitude at or below this are dropped; NaNs are always kept.
+	 * @return A sparse vector of the same logical size.
+	 */
+	static SparseVector<T> from_dense(const Collection<T> &c, blas_scalar_t<T> threshold = T(0))
+	{
+		assert_true(c.size() <= (std::size_t)std::numeric_limits<sparse_index>::max() + 1, "from_dense: Size exceeds the index range");
+		auto parts = sparse_compress(c.data(), c.size(), static_cast<T>(threshold));
+		return SparseVector<T>(c.size(), std::move(parts.first), std::move(parts.second));
+	}
+
+	/**
+	 * @brief Gets the logical number of elements, zeros included.
+	 * @return The size of the vector.
+	 */
+	inline std::size_t size() const { return _size; }
+
+	/**
+	 * @brief Gets the number of stored elements.
+	 * @return The number of nonzeros.
+	 */
+	inline std::size_t nnz() const { return _values.size(); }
+
+	/**
+	 * @brief Gets the positions of the stored elements.
+	 * @return The positions, in increasing order.
+	 */
+	inline const Collection<sparse_index> &indices() const { return _indices; }
+
+	/**
+	 * @brief Gets the stored elements.
+	 * @return The values, in the order of their positions.
+	 */
+	inline const Collection<T> &values() const { return _values; }
+
+	/**
+	 * @brief Gets the element at a specific position, stored or not.
+	 * @details Finds the position by binary search.
+	 * @param idx The position.
+	 * @return The stored element, or 0.
+	 */
+	T get(std::size_t idx) const
+	{
+		assert_true(idx < _size, "get: Index out of bounds");
+		const sparse_index *first = _indices.data();
+		const sparse_index *last = first + _indices.size();
+		const sparse_index *pos = std::lower_bound(first, last, (sparse_index)idx);
+		return pos != last && *pos == idx ? _values.get(pos - first) : T(0);
+	}
+
+	/**
+	 * @brief Expands the vector into a dense collection.
+	 * @return A collection of `size()` elements.
+	 */
+	Collection<T> to_dense() const
+	{
+		Collection<T> res(_size, [](std::size_t)
+						  { return T(0); });
+		T *out = res.data();
+		const sparse_index *idx = _indices.data();
+		const T *val = _values.data();
+		parallel_for(nnz(), [&](std::size_t begin, std::size_t end)
+					 {
+						 for (std::size_t k = begin; k < end; ++k)
+							 out[idx[k]] = val[k]; });
+		return res;
+	}
+};
+
+/**
+ * @brief Computes the dot product of a sparse vector and a dense collection.
+ * @details Only the stored elements are visited, gathering the matching dense elements.
+ * @tparam T The element type.
+ * @param u The sparse vector.
+ * @param v The dense collection, of the same logical size.
+ * @return The dot product.
+ */
+template <typename T>
+T sparse_dot(const SparseVector<T> &u, const Collection<T> &v)
+{
+	assert_equal(u.size(), v.size(), "sparse_dot: Vector sizes differ");
+	const sparse_index *idx = u.indices().data();
+	const T *val = u.values().data();
+	const T *dense = v.data();
+	return parallel_reduce(
+		u.nnz(), T(0), [&](std::size_t begin, std::size_t end)
+		{
+			T acc = T(0);
+			for (std::size_t k = begin; k < end; ++k)
+				acc += val[k] * dense[idx[k]];
+			return acc; },
+		[](T a, T b)
+		{ return a + b; });
+}
+
+/**
+ * @brief Computes the dot product of a dense collection and a sparse vector.
+ * @tparam T The element type.
+ * @param u The dense collection.
+ * @param v The sparse vector, of the same logical size.
+ * @return The dot product.
+ */
+template <typename T>
+T sparse_dot(const Collection<T> &u, const SparseVector<T> &v)
+{
+	return sparse_dot(v, u);
+}
+
+/**
+ * @brief Computes the dot product of two sparse vectors.
+ * @details The positions of the vector with fewer stored elements are split across threads,
+ *          and each thread finds its starting point in the other vector by binary search.
+ *          Vectors of similar density are then intersected with a linear merge; when the
+ *          other vector is much denser, each position is looked up by binary search
+ *          instead, so the cost follows the sparser vector.
+ * @tparam T The element type.
+ * @param u The first sparse vector.
+ * @param v The second sparse vector, of the same logical size.
+ * @return The dot product.
+ */
+template <typename T>
+T sparse_dot(const SparseVector<T> &u, const SparseVector<T> &v)
+{
+	assert_equal(u.size(), v.size(), "sparse_dot: Vector sizes differ");
+	const SparseVector<T> &a = u.nnz() <= v.nnz() ? u : v;
+	const SparseVector<T> &b = u.nnz() <= v.nnz() ? v : u;
+	const sparse_index *a_idx = a.indices().data();
+	const T *a_val = a.values().data();
+	const sparse_index *b_first = b.indices().data();
+	const sparse_index *b_last = b_first + b.nnz();
+	const T *b_val = b.values().data();
+	bool search = b.nnz() > 16 * a.nnz();
+	if (a.nnz() == 0)
+		return T(0);
+
+	return parallel_reduce(
+		a.nnz(), T(0), [&](std::size_t begin, std::size_t end)
+		{
+			T acc = T(0);
+			const sparse_index *pos = std::lower_bound(b_first, b_last, a_idx[begin]);
+			for (std::size_t k = begin; k < end && pos != b_last; ++k)
+			{
+				if (search)
+					pos = std::lower_bound(pos, b_last, a_idx[k]);
+				else
+					while (pos != b_last && *pos < a_idx[k])
+						++pos;
+				if (pos != b_last && *pos == a_idx[k])
+					acc += a_val[k] * b_val[pos - b_first];
+			}
+			return acc; },
+		[](T x, T y)
+		{ return x + y; });
+}
+
+/**
+ * @brief Adds a multiple of a sparse vector to a dense collection in place: `y = a * x + y`.
+ * @details Only the elements of `y` at the stored positions of `x` are touched.
+ * @tparam T The element type.
+ * @param a The scalar factor.
+ * @param x The sparse vector.
+ * @param y The dense collection, of the same logical size, updated in place.
+ */
+template <typename T>
+void axpy(blas_scalar_t<T> a, const SparseVector<T> &x, Collection<T> &y)
+{
+	assert_equal(x.size(), y.size(), "axpy: Vector sizes differ");
+	const sparse_index *idx = x.indices().data();
+	const T *val = x.values().data();
+	T *out = y.data();
+	parallel_for(x.nnz(), [&](std::size_t begin, std::size_t end)
+				 {
+					 for (std::size_t k = begin; k < end; ++k)
+						 out[idx[k]] += a * val[k]; });
+}
+
+/**
+ * @class CsrMatrix
+ * @brief A sparse matrix in compressed sparse row form.
+ * @details Row `r` stores its elements at positions `row_ptr[r]` to `row_ptr[r + 1] - 1` of
+ *          the column index and value arrays.
+ * @tparam T The type of elements in the matrix.
+ */
+template <typename T>
+class CsrMatrix
+{
+private:
+	/** @brief The number of rows in the matrix. */
+	std::size_t _rows;
+
+	/** @brief The number of columns in the matrix. */
+	std::size_t _cols;
+
+	/** @brief The offset of the first stored element of each row, plus the total count at the end. */
+	Collection<std::size_t> _row_ptr;
+
+	/** @brief The column of each stored element. */
+	Collection<sparse_index> _col_idx;
+
+	/** @brief The stored elements, row by row. */
+	Collection<T> _values;
+
+public:
+	/**
+	 * @brief Constructs a CSR matrix from its arrays.
+	 * @param rows The number of rows in the matrix.
+	 * @param cols The number of columns in the matrix.
+	 * @param row_ptr `rows + 1` nondecreasing offsets, starting at 0 and ending at the number of stored elements.
+	 * @param col_idx The column of each stored element; less than `cols`. Within a row they
+	 *                may be in any order, and repeated columns add up.
+	 * @param values The stored elements.
+	 */
+	CsrMatrix(std::size_t rows, std::size_t cols, Collection<std::size_t> &&row_ptr,
+			  Collection<sparse_index> &&col_idx, Collection<T> &&values)
+		: _rows(rows), _cols(cols), _row_ptr(std::move(row_ptr)), _col_idx(std::move(col_idx)), _values(std::move(values))
+	{
+		assert_true(cols <= (std::size_t)std::numeric_limits<sparse_index>::max() + 1, "CsrMatrix: Column count exceeds the index range");
+		assert_equal(_row_ptr.size(), rows + 1, "CsrMatrix: Row offsets must have one element per row plus one");
+		assert_equal(_col_idx.size(), _values.size(), "CsrMatrix: Column index and value counts differ");
+		assert_equal(_row_ptr.get(0), std::size_t(0), "CsrMatrix: Row offsets must start at 0");
+		assert_equal(_row_ptr.get(rows), _values.size(), "CsrMatrix: Row offsets must end at the number of stored elements");
+		for (std::size_t row = 0; row < rows; ++row)
+			assert_true(_row_ptr.get(row) <= _row_ptr.get(row + 1), "CsrMatrix: Row offsets must be nondecreasing");
+		for (std::size_t k = 0; k < _col_idx.size(); ++k)
+			assert_true(_col_idx.get(k) < cols, "CsrMatrix: Column index out of bounds");
+	}
+
+	/**
+	 * @brief Move constructor. Takes ownership of the elements of another matrix.
+	 * @param src The source matrix to move from.
+	 */
+	CsrMatrix(CsrMatrix<T> &&src) = default;
+
+	/**
+	 * @brief Creates a CSR matrix from the elements of a dense matrix above a threshold.
+	 * @details Rows are split across threads twice: once to count the kept elements of each
+	 *          row, and, after a prefix sum over the counts, once to copy them.
+	 * @param m The dense matrix.
+	 * @param threshold Elements with a magnitude at or below this are dropped; NaNs are always kept.
+	 * @return A CSR matrix of the same shape, with columns in increasing order within each row.
+	 */
+	static CsrMatrix<T> from_dense(const Matrix<T> &m, blas_scalar_t<T> threshold = T(0))
+	{
+		std::size_t rows = m.rows(), cols = m.cols();
+		const T *src = m.data();
+		Collection<std::size_t> row_ptr = Collection<std::size_t>::allocate(rows + 1);
+		std::size_t *ptr = row_ptr.data();
+		ptr[0] = 0;
+		std::size_t grain = std::max<std::size_t>(1, parallel_grain / std::max<std::size_t>(1, cols));
+		parallel_for(
+			rows, [&](std::size_t r0, std::size_t r1)
+			{
+				for (std::size_t row = r0; row < r1; ++row)
+				{
+					std::size_t count = 0;
+					for (std::size_t col = 0; col < cols; ++col)
+						count += sparse_keep(src[row * cols + col], threshold) ? 1 : 0;
+					ptr[row + 1] = count;
+				} },
+			grain);
+		for (std::size_t row = 0; row < rows; ++row)
+			ptr[row + 1] += ptr[row];
+
+		Collection<sparse_index> col_idx = Collection<sparse_index>::allocate(ptr[rows]);
+		Collection<T> values = Collection<T>::allocate(ptr[rows]);
+		sparse_index *idx_out = col_idx.data();
+		T *val_out = values.data();
+		parallel_for(
+			rows, [&](std::size_t r0, std::size_t r1)
+			{
+				for (std::size_t row = r0; row < r1; ++row)
+				{
+					std::size_t pos = ptr[row];
+					for (std::size_t col = 0; col < cols; ++col)
+						if (sparse_keep(src[row * cols + col], threshold))
+						{
+							idx_out[pos] = (sparse_index)col;
+							val_out[pos++] = src[row * cols + col];
+						}
+				} },
+			grain);
+		return CsrMatrix<T>(rows, cols, std::move(row_ptr), std::move(col_idx), std::move(values));
+	}
+
+	/**
+	 * @brief Gets the number of rows in the matrix.
+	 * @return The number of rows.
+	 */
+	inline std::size_t rows() const { return _rows; }
+
+	/**
+	 * @brief Gets the number of columns in the matrix.
+	 * @return The number of columns.
+	 */
+	inline std::size_t cols() const { return _cols; }
+
+	/**
+	 * @brief Gets the number of stored elements.
+	 * @return The number of nonzeros.
+	 */
+	inline std::size_t nnz() const { return _values.size(); }
+
+	/**
+	 * @brief Gets the row offsets.
+	 * @return `rows() + 1` offsets into the column index and value arrays.
+	 */
+	inline const Collection<std::size_t> &row_ptr() const { return _row_ptr; }
+
+	/**
+	 * @brief Gets the column of each stored element.
+	 * @return The column indices, row by row.
+	 */
+	inline const Collection<sparse_index> &col_idx() const { return _col_idx; }
+
+	/**
+	 * @brief Gets the stored elements.
+	 * @return The values, row by row.
+	 */
+	inline const Collection<T> &values() const { return _values; }
+
+	/**
+	 * @brief Finds the first row of each thread's share of an SpMV.
+	 * @details Row `r` counts as `nnz(r) + 1` units of work, so that empty rows still cost
+	 *          something; the split point is the first row where the work done so far
+	 *          reaches the chunk's share.
+	 * @param chunks The number of chunks.
+	 * @param chunk The chunk index, from 0 to `chunks` inclusive.
+	 * @return The first row of the chunk (or `rows()` for `chunk == chunks`).
+	 */
+	std::size_t balanced_row(std::size_t chunks, std::size_t chunk) const
+	{
+		if (chunk >= chunks)
+			return _rows;
+		std::size_t target = (nnz() + _rows) / chunks * chunk;
+		const std::size_t *ptr = _row_ptr.data();
+		std::size_t lo = 0, hi = _rows;
+		while (lo < hi)
+		{
+			std::size_t mid = lo + (hi - lo) / 2;
+			if (ptr[mid] + mid < target)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	/**
+	 * @brief Expands the matrix into a dense matrix.
+	 * @return A dense matrix of the same shape.
+	 */
+	Matrix<T> to_dense() const
+	{
+		Matrix<T> res = Matrix<T>::zeros(_rows, _cols);
+		T *out = res.data();
+		const std::size_t *ptr = _row_ptr.data();
+		const sparse_index *idx = _col_idx.data();
+		const T *val = _values.data();
+		parallel_for(_rows, [&](std::size_t r0, std::size_t r1)
+					 {
+						 for (std::size_t row = r0; row < r1; ++row)
+							 for (std::size_t k = ptr[row]; k < ptr[row + 1]; ++k)
+								 out[row * _cols + idx[k]] += val[k]; });
+		return res;
+	}
+};
+
+/**
+ * @brief Computes the sparse matrix-vector product `y = alpha * A * x + beta * y` in place.
+ * @details The rows are split into one contiguous band per thread holding about the same
+ *          number of stored elements (see `CsrMatrix::balanced_row`), so the split follows
+ *          the work even when a few rows hold most of the elements. Each row is a gathered
+ *          dot product over its stored elements.
+ * @tparam T The element type.
+ * @param alpha The factor the product is multiplied by.
+ * @param a The sparse matrix, `m` by `n`.
+ * @param x The dense vector, with `n` elements.
+ * @param beta The factor y is multiplied by before the product is added. When 0 the old
+ *             contents of y are ignored.
+ * @param y The dense result vector, with `m` elements.
+ */
+template <typename T>
+void spmv(blas_scalar_t<T> alpha, const CsrMatrix<T> &a, const Collection<T> &x, blas_scalar_t<T> beta, Collection<T> &y)
+{
+	assert_equal(a.cols(), x.size(), "spmv: Vector length does not match column count");
+	assert_equal(a.rows(), y.size(), "spmv: Result length does not match row count");
+	const std::size_t *ptr = a.row_ptr().data();
+	const sparse_index *idx = a.col_idx().data();
+	const T *val = a.values().data();
+	const T *xs = x.data();
+	T *ys = y.data();
+
+	std::size_t chunks = parallel_chunks(a.nnz() + a.rows());
+	parallel_tasks(chunks, [&](std::size_t chunk)
+				   {
+					   std::size_t r1 = a.balanced_row(chunks, chunk + 1);
+					   for (std::size_t row = a.balanced_row(chunks, chunk); row < r1; ++row)
+					   {
+						   T acc = T(0);
+						   for (std::size_t k = ptr[row]; k < ptr[row + 1]; ++k)
+							   acc += val[k] * xs[idx[k]];
+						   ys[row] = (beta == T(0) ? T(0) : beta * ys[row]) + alpha * acc;
+					   } });
+}
+
+/**
+ * @brief Computes the sparse matrix-vector product `A * x`.
+ * @tparam T The element type.
+ * @param a The sparse matrix, `m` by `n`.
+ * @param x The dense vector, with `n` elements.
+ * @return A new collection with `m` elements.
+ */
+template <typename T>
+Collection<T> spmv(const CsrMatrix<T> &a, const Collection<T> &x)
+{
+	Collection<T> y = Collection<T>::allocate(a.rows());
+	spmv(T(1), a, x, T(0), y);
+	return y;
+}
+
+/**
+ * @brief Overloads the stream insertion operator to print a sparse vector as `size{index: value, ...}`.
+ * @tparam T The element type.
+ * @param os The output stream.
+ * @param v The sparse vector to print.
+ * @return A reference to the output stream.
+ */
+template <typename T>
+std::ostream &operator<<(std::ostream &os, const SparseVector<T> &v)
+{
+	os << v.size() << "{";
+	for (std::size_t k = 0; k < v.nnz(); ++k)
+		os << (k > 0 ? ", " : "") << v.indices().get(k) << ": " << v.values().get(k);
+	return os << "}";
+}
+
+#endif // SPARSE_HPP
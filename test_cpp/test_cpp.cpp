@@ -4,9 +4,2172 @@
  */
 
 #include "../spt/natv_collection.hpp"
+#include "../spt/natv_grid.hpp"
+#include "../spt/natv_soa.hpp"
+#include "../spt/half.hpp"
+#include "../spt/blas1.hpp"
+#include "../spt/natv_matrix.hpp"
+#include "../spt/stencil.hpp"
+#include "../spt/rolling.hpp"
+#include "../spt/sparse.hpp"
+#include "../spt/natv_complex.hpp"
+#include "../spt/fft.hpp"
+#include "../spt/vmath.hpp"
+#include "../spt/setops.hpp"
+#include "../spt/search.hpp"
+#include "../spt/sketch.hpp"
+#include "../spt/approx.hpp"
+#include "../spt/join.hpp"
+#include "../spt/hash_table.hpp"
+#include "../spt/indexed.hpp"
+#include "../spt/philox.hpp"
 #include "../spt/test_common.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+/**
+ * @brief Tests generation, views, tiled traversal and transposition of a Grid.
+ * @details Uses a grid whose dimensions are not multiples of the tile size so that the
+ *          clipped edge tiles are exercised as well as the full ones.
+ */
+void test_grid()
+{
+    const std::size_t rows = 70;
+    const std::size_t cols = 131;
+    auto fn = [](std::size_t row, std::size_t col)
+    { return (double)(row * 1000 + col); };
+
+    Grid<double> g(rows, cols, fn);
+    assert_equal(g.size(), rows * cols, "test_grid: Grid size mismatch");
+    for (std::size_t row = 0; row < rows; ++row)
+        for (std::size_t col = 0; col < cols; ++col)
+            assert_equal(g.get(row, col), fn(row, col), "test_grid: Failed to verify generated element");
+
+    assert_equal(g.row(3).get(7), fn(3, 7), "test_grid: Row view mismatch");
+    assert_equal(g.col(7).get(3), fn(3, 7), "test_grid: Column view mismatch");
+    assert_equal(g.col(5).size(), rows, "test_grid: Column view size mismatch");
+    assert_equal(g.row(2).reduce(std::plus<double>()), sum(g.row(2).to_collection()),
+                 "test_grid: Row view reduce mismatch");
+
+    std::size_t visited = 0;
+    g.for_each([&](std::size_t row, std::size_t col, double value)
+               {
+                   assert_equal(value, fn(row, col), "test_grid: Tiled traversal visited the wrong element");
+                   ++visited; });
+    assert_equal(visited, rows * cols, "test_grid: Tiled traversal did not visit every element");
+
+    Grid<double> t = g.transpose();
+    assert_equal(t.rows(), cols, "test_grid: Transpose row count mismatch");
+    assert_equal(t.cols(), rows, "test_grid: Transpose column count mismatch");
+    for (std::size_t row = 0; row < rows; ++row)
+        for (std::size_t col = 0; col < cols; ++col)
+            assert_equal(t.get(col, row), g.get(row, col), "test_grid: Transpose element mismatch");
+
+    g.set(1, 2, -1.0);
+    assert_equal(g.get(1, 2), -1.0, "test_grid: Failed to correctly set element in grid");
+}
+
+/**
+ * @brief A struct with mixed field types used to test structure-of-arrays storage.
+ */
+struct particle
+{
+    float x;
+    double mass;
+    unsigned char kind;
+};
+
+/**
+ * @brief Describes the fields of `particle` to SoaCollection.
+ */
+template <>
+struct soa_fields<particle>
+{
+    static constexpr auto members = std::make_tuple(&particle::x, &particle::mass, &particle::kind);
+};
+
+/**
+ * @brief Tests conversion to and from array-of-structs and per-field access of a SoaCollection.
+ */
+void test_soa()
+{
+    auto fn = [](std::size_t idx)
+    { return particle{(float)idx * 0.5f, (double)idx * 2.0, (unsigned char)(idx % 7)}; };
+
+    Collection<particle> aos(1000, fn);
+    SoaCollection<particle> soa(aos);
+    assert_equal(soa.size(), aos.size(), "test_soa: Size mismatch");
+    assert_equal((std::size_t)(soa.field<1>().data()) % Collection<double>::alignment, (std::size_t)0,
+                 "test_soa: Field array is not aligned");
+
+    Collection<particle> back = soa.to_aos();
+    for (std::size_t idx = 0; idx < aos.size(); ++idx)
+    {
+        assert_equal(back.get(idx).x, aos.get(idx).x, "test_soa: Round trip x mismatch");
+        assert_equal(back.get(idx).mass, aos.get(idx).mass, "test_soa: Round trip mass mismatch");
+        assert_equal((int)back.get(idx).kind, (int)aos.get(idx).kind, "test_soa: Round trip kind mismatch");
+    }
+
+    SoaCollection<particle> generated(1000, fn);
+    assert_equal(sum(generated.field<1>()), 999.0 * 1000.0, "test_soa: Field reduce mismatch");
+    assert_equal(generated.field<0>().get(10), 5.0f, "test_soa: Field view mismatch");
+
+    generated.transform_field<1>([](double mass)
+                                 { return mass + 1.0; });
+    assert_equal(generated.get(3).mass, 7.0, "test_soa: Field transform mismatch");
+    assert_equal(generated.get(3).x, 1.5f, "test_soa: Field transform touched another field");
+
+    generated.set(4, particle{-1.0f, -2.0, 3});
+    assert_equal(generated.field<0>().get(4), -1.0f, "test_soa: Failed to correctly set element");
+    assert_equal(generated.get(4).mass, -2.0, "test_soa: Failed to correctly set element");
+}
+
+/**
+ * @brief Tests rounding of the 16-bit storage types and the widening sum and dot product.
+ * @details Checks boundary values of both formats, that the bulk conversion kernels agree
+ *          with the scalar conversions, and that accumulating in a wider type recovers the
+ *          totals which accumulating in the storage type cannot represent.
+ */
+void test_half()
+{
+    assert_equal((int)float16(1.0f).bits, 0x3c00, "test_half: float16(1) bits");
+    assert_equal((int)float16(65504.0f).bits, 0x7bff, "test_half: float16 max bits");
+    assert_equal((int)float16(65520.0f).bits, 0x7c00, "test_half: float16 overflow to infinity");
+    assert_equal((int)float16(std::ldexp(1.0f, -24)).bits, 0x0001, "test_half: float16 smallest subnormal");
+    assert_equal((int)float16(1.0f + std::ldexp(1.0f, -11)).bits, 0x3c00, "test_half: float16 ties to even");
+    assert_true(std::isnan((float)float16(std::numeric_limits<float>::quiet_NaN())), "test_half: float16 NaN");
+    assert_equal((float)float16(-0.333251953125f), -0.333251953125f, "test_half: float16 exact round trip");
+    assert_equal((int)bfloat16(1.0f).bits, 0x3f80, "test_half: bfloat16(1) bits");
+    assert_equal((int)bfloat16(1.0f + std::ldexp(1.0f, -8)).bits, 0x3f80, "test_half: bfloat16 ties to even");
+    assert_true(std::isnan((float)bfloat16(std::numeric_limits<float>::quiet_NaN())), "test_half: bfloat16 NaN");
+
+    auto fn = [](std::size_t idx)
+    { return std::ldexp((float)idx - 5000.0f, (int)(idx % 40) - 25); };
+    Collection<float> wide(10000, fn);
+    Collection<float16> half(10000, [&](std::size_t idx)
+                             { return float16(fn(idx)); });
+    Collection<bfloat16> brain(10000, [&](std::size_t idx)
+                               { return bfloat16(fn(idx)); });
+    std::vector<float16> half_bulk(wide.size());
+    std::vector<bfloat16> brain_bulk(wide.size());
+    std::vector<float> half_back(wide.size());
+    std::vector<double> brain_back(wide.size());
+    convert_n(wide.data(), half_bulk.data(), wide.size());
+    convert_n(wide.data(), brain_bulk.data(), wide.size());
+    convert_n(half.data(), half_back.data(), half.size());
+    convert_n(brain.data(), brain_back.data(), brain.size());
+    for (std::size_t idx = 0; idx < wide.size(); ++idx)
+    {
+        assert_equal(half_bulk[idx].bits, half.get(idx).bits, "test_half: Bulk float16 narrowing mismatch");
+        assert_equal(brain_bulk[idx].bits, brain.get(idx).bits, "test_half: Bulk bfloat16 narrowing mismatch");
+        assert_equal(half_back[idx], (float)half.get(idx), "test_half: Bulk float16 widening mismatch");
+        assert_equal(brain_back[idx], (double)(float)brain.get(idx), "test_half: Bulk bfloat16 widening mismatch");
+    }
+
+    Collection<float16> ones(5000, [](std::size_t)
+                             { return float16(1.0f); });
+    assert_equal((float)sum(ones), 2048.0f, "test_half: float16 accumulation should saturate");
+    assert_equal(sum<float16, float>(ones), 5000.0f, "test_half: Widening float16 sum mismatch");
+    assert_equal(sum<float16, double>(ones), 5000.0, "test_half: Widening float16 sum mismatch");
+    assert_equal(dot<float16, double>(ones, ones), 5000.0, "test_half: Widening float16 dot mismatch");
+
+    double expected = 0.0;
+    for (std::size_t idx = 0; idx < wide.size(); ++idx)
+        expected += (double)wide.get(idx) * (double)wide.get(idx);
+    assert_near(dot<float, double>(wide, wide), expected, expected * 1e-12, "test_half: Widening float dot mismatch");
+
+    // Long enough for the widening kernels to split the work across threads.
+    set_thread_count(3);
+    const std::size_t count = 100003;
+    Collection<float16> many(count, [](std::size_t idx)
+                             { return float16((float)(idx % 7)); });
+    Collection<float> ramp(count, [](std::size_t idx)
+                           { return (float)(idx % 1000); });
+    double many_sum = 0.0, many_squares = 0.0;
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        many_sum += (double)(idx % 7);
+        many_squares += (double)(idx % 7) * (double)(idx % 7);
+    }
+    assert_equal(sum<float16, double>(many), many_sum, "test_half: Parallel widening sum mismatch");
+    assert_equal(dot<float16, double>(many, many), many_squares, "test_half: Parallel widening dot mismatch");
+    Collection<float> shifted = many + 1.0f;
+    Collection<float> scaled = many * ramp;
+    set_thread_count(0);
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        assert_equal(shifted.get(idx), (float)many.get(idx) + 1.0f, "test_half: Parallel widening map mismatch");
+        assert_equal(scaled.get(idx), (float)many.get(idx) * ramp.get(idx), "test_half: Parallel widening zip mismatch");
+    }
+}
+
+/**
+ * @brief Tests zipping and arithmetic between collections of different element types.
+ * @details Checks the promoted element type of each operator and that mixed-type results
+ *          match applying the operation to individually converted elements.
+ */
+void test_mixed_zip()
+{
+    Collection<float> f(1000, [](std::size_t idx)
+                        { return (float)idx * 0.25f + 0.1f; });
+    Collection<double> d(1000, [](std::size_t idx)
+                         { return (double)idx / 3.0; });
+    Collection<int> i(1000, [](std::size_t idx)
+                      { return (int)idx - 500; });
+    Collection<float16> h(1000, [](std::size_t idx)
+                          { return float16((float)idx / 8.0f); });
+    Collection<bfloat16> b(1000, [](std::size_t idx)
+                           { return bfloat16((float)idx / 16.0f); });
+
+    static_assert(std::is_same<decltype(f * d), Collection<double>>::value, "float * double should be double");
+    static_assert(std::is_same<decltype(i + f), Collection<float>>::value, "int + float should be float");
+    static_assert(std::is_same<decltype(h * f), Collection<float>>::value, "float16 * float should be float");
+    static_assert(std::is_same<decltype(h + b), Collection<float>>::value, "float16 + bfloat16 should be float");
+    static_assert(std::is_same<decltype(i * h), Collection<float>>::value, "int * float16 should be float");
+    static_assert(std::is_same<decltype(h - h), Collection<float16>>::value, "float16 - float16 should stay float16");
+
+    Collection<double> fd = f * d;
+    Collection<float> fi = i + f;
+    Collection<float> hf = h * f;
+    Collection<float> hb = h / b;
+    Collection<double> dz(f, i, [](float x, int y)
+                          { return (double)x - y; });
+    Collection<double> dm = f.zip<double>(i, [](float x, int y)
+                                          { return (double)x * y; });
+    for (std::size_t idx = 0; idx < 1000; ++idx)
+    {
+        assert_equal(fd.get(idx), (double)f.get(idx) * d.get(idx), "test_mixed_zip: float * double mismatch");
+        assert_equal(fi.get(idx), (float)i.get(idx) + f.get(idx), "test_mixed_zip: int + float mismatch");
+        assert_equal(hf.get(idx), (float)h.get(idx) * f.get(idx), "test_mixed_zip: float16 * float mismatch");
+        if (idx > 0)
+            assert_equal(hb.get(idx), (float)h.get(idx) / (float)b.get(idx), "test_mixed_zip: float16 / bfloat16 mismatch");
+        assert_equal(dz.get(idx), (double)f.get(idx) - i.get(idx), "test_mixed_zip: Mixed zip constructor mismatch");
+        assert_equal(dm.get(idx), (double)f.get(idx) * i.get(idx), "test_mixed_zip: Mixed zip method mismatch");
+    }
+
+    Collection<double> shorter(10, [](std::size_t idx)
+                               { return (double)idx; });
+    assert_equal((f + shorter).size(), (std::size_t)10, "test_mixed_zip: Result should have the shorter operand's size");
+}
+
+/**
+ * @brief Tests arithmetic between collections and scalars, and row/column broadcasting on grids.
+ */
+void test_scalar_broadcast()
+{
+    Collection<float> f(1000, [](std::size_t idx)
+                        { return (float)idx * 0.5f + 1.0f; });
+    Collection<int> i(1000, [](std::size_t idx)
+                      { return (int)idx - 500; });
+
+    static_assert(std::is_same<decltype(f * 2.0), Collection<double>>::value, "float * double scalar should be double");
+    static_assert(std::is_same<decltype(2.0f * f), Collection<float>>::value, "float scalar * float should be float");
+    static_assert(std::is_same<decltype(i + 1), Collection<int>>::value, "int + int scalar should be int");
+
+    Collection<float> fs = f * 3.0f;
+    Collection<float> sf = 10.0f - f;
+    Collection<double> fd = f / 4.0;
+    Collection<double> id = 1.5 + i;
+    Collection<double> zs = f.zip<double>(2, [](float x, int y)
+                                          { return (double)x * y; });
+    for (std::size_t idx = 0; idx < 1000; ++idx)
+    {
+        assert_equal(fs.get(idx), f.get(idx) * 3.0f, "test_scalar_broadcast: Collection * scalar mismatch");
+        assert_equal(sf.get(idx), 10.0f - f.get(idx), "test_scalar_broadcast: scalar - Collection mismatch");
+        assert_equal(fd.get(idx), (double)f.get(idx) / 4.0, "test_scalar_broadcast: Collection / wider scalar mismatch");
+        assert_equal(id.get(idx), 1.5 + i.get(idx), "test_scalar_broadcast: scalar + int Collection mismatch");
+        assert_equal(zs.get(idx), (double)f.get(idx) * 2, "test_scalar_broadcast: Scalar zip mismatch");
+    }
+
+    Grid<double> g(3, 4, [](std::size_t row, std::size_t col)
+                   { return (double)(row * 4 + col); });
+    Collection<double> row_vec(4, [](std::size_t idx)
+                               { return (double)idx * 10.0; });
+    Collection<int> col_vec(3, [](std::size_t idx)
+                            { return (int)idx + 1; });
+    Grid<double> rb = g.broadcast_row<double>(row_vec, std::plus<double>());
+    Grid<double> cb = g.broadcast_col<double>(col_vec, [](double x, int y)
+                                              { return x * y; });
+    for (std::size_t row = 0; row < 3; ++row)
+        for (std::size_t col = 0; col < 4; ++col)
+        {
+            assert_equal(rb.get(row, col), g.get(row, col) + col * 10.0, "test_scalar_broadcast: Row broadcast mismatch");
+            assert_equal(cb.get(row, col), g.get(row, col) * (row + 1), "test_scalar_broadcast: Column broadcast mismatch");
+        }
+
+    bool thrown = false;
+    try
+    {
+        g.broadcast_row<double>(col_vec, std::plus<double>());
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_scalar_broadcast: Mismatched broadcast vector should be rejected");
+}
+
+/**
+ * @brief Tests the N-ary zip and the parallel map and zip kernels against serial results.
+ */
+void test_variadic_zip()
+{
+    const std::size_t size = 100003;
+    set_thread_count(4);
+
+    Collection<double> x(size, [](std::size_t idx)
+                         { return (double)idx * 0.5; });
+    Collection<float> y(size, [](std::size_t idx)
+                        { return (float)idx / 7.0f; });
+    Collection<int> z(size + 10, [](std::size_t idx)
+                      { return (int)(idx % 13) - 6; });
+
+    const double a = 2.5;
+    auto axpy = zip([a](double xi, float yi)
+                    { return a * xi + yi; },
+                    x, y);
+    static_assert(std::is_same<decltype(axpy), Collection<double>>::value, "zip should deduce the result type");
+    Collection<float> three = zip<float>([](double xi, float yi, int zi)
+                                         { return (float)(xi - yi * zi); },
+                                         x, y, z);
+    auto one = zip([](int zi)
+                   { return zi * 2; },
+                   z);
+    Collection<double> mapped = x.map<double>([](double xi)
+                                              { return xi + 1.0; });
+    Collection<double> zipped(x, z, [](double xi, int zi)
+                              { return xi * zi; });
+
+    assert_equal(three.size(), size, "test_variadic_zip: Result should have the shortest input's size");
+    assert_equal(one.size(), size + 10, "test_variadic_zip: Unary zip size mismatch");
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+        assert_equal(axpy.get(idx), a * x.get(idx) + y.get(idx), "test_variadic_zip: Binary zip mismatch");
+        assert_equal(three.get(idx), (float)(x.get(idx) - y.get(idx) * z.get(idx)), "test_variadic_zip: Ternary zip mismatch");
+        assert_equal(one.get(idx), z.get(idx) * 2, "test_variadic_zip: Unary zip mismatch");
+        assert_equal(mapped.get(idx), x.get(idx) + 1.0, "test_variadic_zip: Parallel map mismatch");
+        assert_equal(zipped.get(idx), x.get(idx) * z.get(idx), "test_variadic_zip: Parallel zip constructor mismatch");
+    }
+
+    double total = parallel_reduce(
+        size, 0.0, [&](std::size_t begin, std::size_t end)
+        {
+            double part = 0.0;
+            for (std::size_t idx = begin; idx < end; ++idx)
+                part += x.get(idx);
+            return part; },
+        std::plus<double>());
+    assert_near(total, 0.5 * (double)size * (double)(size - 1) / 2.0, 1e-6, "test_variadic_zip: Parallel reduce mismatch");
+
+    bool thrown = false;
+    try
+    {
+        zip([](double xi)
+            {
+                if (xi > 40000.0)
+                    assert_true(false, "test_variadic_zip: Expected failure");
+                return xi; },
+            x);
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_variadic_zip: Exceptions in worker threads should reach the caller");
+
+    set_thread_count(0);
+}
+
+/**
+ * @brief Tests the multi-output map (unzip) for collections and grids, in both the tuple and slot forms.
+ */
+void test_unzip()
+{
+    const std::size_t size = 50001;
+    set_thread_count(3);
+
+    Collection<double> r(size, [](std::size_t idx)
+                         { return 1.0 + (double)idx * 1e-3; });
+    Collection<float> t(size, [](std::size_t idx)
+                        { return (float)idx * 1e-4f; });
+
+    auto polar = unzip<double, double>([](double ri, float ti)
+                                       { return std::make_pair(ri * std::cos(ti), ri * std::sin(ti)); },
+                                       r, t);
+    auto split = r.unzip<long, double, bool>([](double ri, long &whole, double &frac, bool &odd)
+                                             {
+                                                 whole = (long)ri;
+                                                 frac = ri - (double)whole;
+                                                 odd = (whole % 2) != 0; });
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+        assert_equal(std::get<0>(polar).get(idx), r.get(idx) * std::cos(t.get(idx)), "test_unzip: First tuple output mismatch");
+        assert_equal(std::get<1>(polar).get(idx), r.get(idx) * std::sin(t.get(idx)), "test_unzip: Second tuple output mismatch");
+        long whole = (long)r.get(idx);
+        assert_equal(std::get<0>(split).get(idx), whole, "test_unzip: First slot output mismatch");
+        assert_equal(std::get<1>(split).get(idx), r.get(idx) - (double)whole, "test_unzip: Second slot output mismatch");
+        assert_equal(std::get<2>(split).get(idx), (whole % 2) != 0, "test_unzip: Third slot output mismatch");
+    }
+
+    std::size_t calls = 0;
+    std::mutex calls_lock;
+    auto rc = generate_unzip<std::size_t, std::size_t>(300, 200, [&](std::size_t row, std::size_t col)
+                                                         {
+                                                             std::lock_guard<std::mutex> guard(calls_lock);
+                                                             ++calls;
+                                                             return std::make_tuple(row, col); });
+    assert_equal(calls, (std::size_t)(300 * 200), "test_unzip: Generator should run once per cell");
+    assert_equal(std::get<0>(rc).rows(), (std::size_t)300, "test_unzip: Grid output row count mismatch");
+    assert_equal(std::get<1>(rc).cols(), (std::size_t)200, "test_unzip: Grid output column count mismatch");
+    for (std::size_t row = 0; row < 300; ++row)
+        for (std::size_t col = 0; col < 200; ++col)
+        {
+            assert_equal(std::get<0>(rc).get(row, col), row, "test_unzip: Grid row output mismatch");
+            assert_equal(std::get<1>(rc).get(row, col), col, "test_unzip: Grid column output mismatch");
+        }
+
+    set_thread_count(0);
+}
+
+/**
+ * @brief Reference Euclidean norm, accumulated in long double.
+ */
+template <typename T>
+long double reference_nrm2(const Collection<T> &x, long double scale)
+{
+    long double ssq = 0.0L;
+    for (std::size_t idx = 0; idx < x.size(); ++idx)
+    {
+        long double value = x.get(idx) / scale;
+        ssq += value * value;
+    }
+    return scale * std::sqrt(ssq);
+}
+
+/**
+ * @brief Tests the BLAS level-1 kernels for one element type against straightforward reference loops.
+ */
+template <typename T>
+void test_blas1_type(T tolerance)
+{
+    const std::size_t size = 100003;
+    Collection<T> x(size, [](std::size_t idx)
+                    { return (T)std::sin((double)idx * 0.01) * (T)3; });
+    Collection<T> y(size, [](std::size_t idx)
+                    { return (T)std::cos((double)idx * 0.003) - (T)0.5; });
+
+    long double ref_asum = 0.0L;
+    std::size_t ref_iamax = 0;
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+        ref_asum += std::abs(x.get(idx));
+        if (std::abs(x.get(idx)) > std::abs(x.get(ref_iamax)))
+            ref_iamax = idx;
+    }
+    assert_near((long double)asum(x), ref_asum, ref_asum * tolerance, "test_blas1: asum mismatch");
+    assert_near((long double)nrm2(x), reference_nrm2(x, 1.0L), reference_nrm2(x, 1.0L) * tolerance, "test_blas1: nrm2 mismatch");
+    assert_equal(iamax(x), ref_iamax, "test_blas1: iamax mismatch");
+
+    Collection<T> axpy_y = y.template map<T>([](T v)
+                                             { return v; });
+    axpy((T)2, x, axpy_y);
+    Collection<T> axpby_y = y.template map<T>([](T v)
+                                              { return v; });
+    axpby((T)2, x, (T)-3, axpby_y);
+    Collection<T> scal_x = x.template map<T>([](T v)
+                                             { return v; });
+    scal((T)0.5, scal_x);
+    Collection<T> fm = fmadd(x, y, x);
+    Collection<T> fa = fmadd((T)2, x, y);
+    Collection<T> rx = x.template map<T>([](T v)
+                                         { return v; });
+    Collection<T> ry = y.template map<T>([](T v)
+                                         { return v; });
+    rot(rx, ry, (T)0.6, (T)0.8);
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+        T xi = x.get(idx);
+        T yi = y.get(idx);
+        assert_near(axpy_y.get(idx), (T)2 * xi + yi, tolerance * 8, "test_blas1: axpy mismatch");
+        assert_near(axpby_y.get(idx), (T)2 * xi - (T)3 * yi, tolerance * 8, "test_blas1: axpby mismatch");
+        assert_equal(scal_x.get(idx), (T)0.5 * xi, "test_blas1: scal mismatch");
+        assert_near(fm.get(idx), xi * yi + xi, tolerance * 8, "test_blas1: fmadd mismatch");
+        assert_near(fa.get(idx), (T)2 * xi + yi, tolerance * 8, "test_blas1: Scalar fmadd mismatch");
+        assert_near(rx.get(idx), (T)0.6 * xi + (T)0.8 * yi, tolerance * 8, "test_blas1: rot x mismatch");
+        assert_near(ry.get(idx), (T)0.6 * yi - (T)0.8 * xi, tolerance * 8, "test_blas1: rot y mismatch");
+    }
+
+    // Elements whose squares overflow, and elements whose squares underflow.
+    const T big = std::numeric_limits<T>::max() / (T)64;
+    Collection<T> huge(1000, [big](std::size_t idx)
+                       { return idx % 2 ? big : -big; });
+    long double huge_norm = reference_nrm2(huge, (long double)big);
+    assert_near((long double)nrm2(huge), huge_norm, huge_norm * tolerance, "test_blas1: nrm2 should not overflow");
+    const T tiny = std::numeric_limits<T>::denorm_min() * (T)3;
+    Collection<T> small(1000, [tiny](std::size_t)
+                        { return tiny; });
+    long double small_norm = reference_nrm2(small, (long double)tiny);
+    assert_near((long double)nrm2(small), small_norm, small_norm * 0.5L, "test_blas1: nrm2 should not underflow");
+    const T top = std::numeric_limits<T>::max();
+    Collection<T> top_binade(1000, [top](std::size_t idx)
+                             { return idx == 600 ? -top : (T)1; });
+    assert_equal(nrm2(Collection<T>(1, [top](std::size_t)
+                                    { return top; })),
+                 top, "test_blas1: nrm2 should not overflow in the top binade");
+    assert_equal(nrm2(top_binade), top, "test_blas1: nrm2 should not overflow in the top binade");
+
+    Collection<T> special(size, [](std::size_t idx)
+                          { return (T)(idx % 7); });
+    special.data()[5000] = -(T)9;
+    special.data()[70000] = (T)9;
+    special.data()[3] = std::numeric_limits<T>::quiet_NaN();
+    assert_equal(iamax(special), (std::size_t)3, "test_blas1: iamax should return the first NaN");
+    assert_true(std::isnan(nrm2(special)), "test_blas1: nrm2 should propagate NaN");
+    special.data()[3] = (T)3;
+    special.data()[90000] = std::numeric_limits<T>::quiet_NaN();
+    special.data()[95000] = std::numeric_limits<T>::quiet_NaN();
+    assert_equal(iamax(special), (std::size_t)90000, "test_blas1: iamax should return the first NaN in a later chunk");
+    special.data()[90000] = (T)3;
+    special.data()[95000] = (T)3;
+    assert_equal(iamax(special), (std::size_t)5000, "test_blas1: iamax should return the first largest magnitude");
+    Collection<T> all_nan(size, [](std::size_t)
+                          { return std::numeric_limits<T>::quiet_NaN(); });
+    assert_equal(iamax(all_nan), (std::size_t)0, "test_blas1: iamax should return the first of several chunks of NaNs");
+    special.data()[3] = std::numeric_limits<T>::infinity();
+    assert_true(std::isinf(nrm2(special)), "test_blas1: nrm2 should be infinite for an infinite element");
+}
+
+/**
+ * @brief Tests the BLAS level-1 kernels for float and double, and the rotation construction.
+ */
+void test_blas1()
+{
+    set_thread_count(4);
+    test_blas1_type<double>(1e-12);
+    test_blas1_type<float>(1e-5f);
+    set_thread_count(0);
+
+    double a = 3.0, b = 4.0, c, s;
+    rotg(a, b, c, s);
+    assert_near(a, 5.0, 1e-15, "test_blas1: rotg r mismatch");
+    assert_near(c, 0.6, 1e-15, "test_blas1: rotg c mismatch");
+    assert_near(s, 0.8, 1e-15, "test_blas1: rotg s mismatch");
+    assert_near(b, 1.0 / 0.6, 1e-14, "test_blas1: rotg z mismatch");
+
+    float fa = -5.0f, fb = 0.0f, fc, fs;
+    rotg(fa, fb, fc, fs);
+    assert_equal(fa, -5.0f, "test_blas1: rotg r should keep the sign of the larger component");
+    assert_equal(fc, 1.0f, "test_blas1: rotg c mismatch for b = 0");
+    assert_equal(fs, -0.0f, "test_blas1: rotg s mismatch for b = 0");
+}
+
+/**
+ * @brief Checks one GEMM and GEMV shape against a naive triple loop accumulated in long double.
+ */
+template <typename T>
+void test_matrix_shape(std::size_t m, std::size_t n, std::size_t k, T tolerance)
+{
+    Matrix<T> a(m, k, [](std::size_t row, std::size_t col)
+                { return T((row * 31 + col * 17) % 23) / T(23) - T(0.5); });
+    Matrix<T> b(k, n, [](std::size_t row, std::size_t col)
+                { return T((row * 13 + col * 29) % 19) / T(19) - T(0.5); });
+    Matrix<T> c(m, n, [](std::size_t row, std::size_t col)
+                { return T((row + col) % 7); });
+    Collection<T> x(k, [](std::size_t idx)
+                    { return T(idx % 11) / T(11); });
+    Collection<T> y(m, [](std::size_t idx)
+                    { return T(idx % 3); });
+
+    Matrix<T> ab = gemm(a, b);
+    gemm(T(2), a, b, T(-1), c);
+    Collection<T> ax = gemv(a, x);
+    gemv(T(0.5), a, x, T(3), y);
+
+    for (std::size_t row = 0; row < m; ++row)
+    {
+        for (std::size_t col = 0; col < n; ++col)
+        {
+            long double ref = 0.0L;
+            for (std::size_t p = 0; p < k; ++p)
+                ref += (long double)a.get(row, p) * b.get(p, col);
+            T scale = T(1) + T(k);
+            assert_near(ab.get(row, col), (T)ref, tolerance * scale, "test_matrix: gemm mismatch");
+            T old_c = T((row + col) % 7);
+            assert_near(c.get(row, col), (T)(2 * ref - old_c), 2 * tolerance * scale, "test_matrix: gemm with alpha and beta mismatch");
+        }
+        long double ref = 0.0L;
+        for (std::size_t p = 0; p < k; ++p)
+            ref += (long double)a.get(row, p) * x.get(p);
+        assert_near(ax.get(row), (T)ref, tolerance * (T(1) + T(k)), "test_matrix: gemv mismatch");
+        assert_near(y.get(row), (T)(0.5L * ref + 3 * (row % 3)), tolerance * (T(1) + T(k)), "test_matrix: gemv with alpha and beta mismatch");
+    }
+}
+
+/**
+ * @brief Tests the Matrix class and the blocked GEMM and GEMV kernels on shapes which cross
+ *        the micro-kernel, cache block and thread band boundaries.
+ */
+void test_matrix()
+{
+    set_thread_count(3);
+    test_matrix_shape<double>(1, 1, 1, 1e-14);
+    test_matrix_shape<double>(37, 53, 29, 1e-14);
+    test_matrix_shape<double>(250, 70, 300, 1e-14);
+    test_matrix_shape<double>(7, 2100, 3, 1e-14);
+    test_matrix_shape<float>(131, 45, 270, 1e-6f);
+    test_matrix_shape<double>(5, 4, 0, 1e-14);
+    set_thread_count(0);
+
+    Matrix<double> m(2, 3, [](std::size_t row, std::size_t col)
+                     { return (double)(row * 3 + col); });
+    assert_equal(m.get(1, 2), 5.0, "test_matrix: Generated element mismatch");
+    m.set(0, 1, -1.0);
+    assert_equal(m.to_vector()[1], -1.0, "test_matrix: set mismatch");
+
+    Matrix<double> nan_c(2, 2, [](std::size_t, std::size_t)
+                         { return std::numeric_limits<double>::quiet_NaN(); });
+    Matrix<double> eye(3, 2, [](std::size_t row, std::size_t col)
+                       { return row == col ? 1.0 : 0.0; });
+    gemm(1.0, m, eye, 0.0, nan_c);
+    assert_equal(nan_c.get(0, 1), -1.0, "test_matrix: beta = 0 should overwrite C, NaNs included");
+    assert_equal(nan_c.get(1, 0), 3.0, "test_matrix: beta = 0 should overwrite C, NaNs included");
+
+    bool thrown = false;
+    try
+    {
+        gemm(m, m);
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_matrix: Mismatched inner dimensions should be rejected");
+}
+
+/**
+ * @brief Maps an index to the element it reads under each boundary mode, without using the library's mapping.
+ * @return The index in `[0, n)`, or -1 for the fill value.
+ */
+std::ptrdiff_t reference_boundary(std::ptrdiff_t idx, std::ptrdiff_t n, boundary_mode mode)
+{
+    while (idx < 0 || idx >= n)
+    {
+        if (mode == boundary_mode::constant)
+            return -1;
+        if (mode == boundary_mode::clamp)
+            idx = idx < 0 ? 0 : n - 1;
+        else if (mode == boundary_mode::wrap)
+            idx += idx < 0 ? n : -n;
+        else
+            idx = idx < 0 ? -idx - 1 : 2 * n - 1 - idx;
+    }
+    return idx;
+}
+
+/**
+ * @brief Reads element `idx` of a 1D input, or the fill value.
+ */
+double reference_boundary(const std::vector<double> &x, std::ptrdiff_t idx, boundary_mode mode, double fill)
+{
+    std::ptrdiff_t pos = reference_boundary(idx, (std::ptrdiff_t)x.size(), mode);
+    return pos < 0 ? fill : x[pos];
+}
+
+/**
+ * @brief Reads element `(row, col)` of a grid, or the fill value.
+ */
+double reference_boundary(const std::vector<std::vector<double>> &g, std::ptrdiff_t row, std::ptrdiff_t col, boundary_mode mode, double fill)
+{
+    std::ptrdiff_t pos = reference_boundary(row, (std::ptrdiff_t)g.size(), mode);
+    return pos < 0 ? fill : reference_boundary(g[pos], col, mode, fill);
+}
+
+/**
+ * @brief Applies `stencil` a number of times, one full pass per step.
+ */
+template <typename C, typename FN>
+C repeat_stencil(const C &c, std::size_t radius, std::size_t steps, FN fn, boundary_mode mode, double fill)
+{
+    C next = stencil(c, radius, fn, mode, fill);
+    if (steps == 1)
+        return next;
+    return repeat_stencil(next, radius, steps - 1, fn, mode, fill);
+}
+
+/**
+ * @brief Tests stencils, convolutions and repeated stencils on collections and grids against direct definitions.
+ */
+void test_stencil()
+{
+    set_thread_count(3);
+    const boundary_mode modes[] = {boundary_mode::clamp, boundary_mode::reflect, boundary_mode::wrap, boundary_mode::constant};
+    auto weights1 = [](const double *p)
+    { return p[-2] + 2 * p[-1] + 3 * p[0] + 5 * p[1] + 7 * p[2]; };
+
+    for (boundary_mode mode : modes)
+    {
+        for (std::size_t n : {std::size_t(50001), std::size_t(5), std::size_t(1)})
+        {
+            Collection<double> c(n, [](std::size_t idx)
+                                 { return (double)((idx * 37) % 101); });
+            std::vector<double> x = c.to_vector();
+            Collection<double> s = stencil(c, 2, weights1, mode, -1.0);
+            for (std::size_t idx = 0; idx < n; ++idx)
+            {
+                double ref = 0.0;
+                const double w[] = {1, 2, 3, 5, 7};
+                for (std::ptrdiff_t off = -2; off <= 2; ++off)
+                    ref += w[off + 2] * reference_boundary(x, (std::ptrdiff_t)idx + off, mode, -1.0);
+                assert_equal(s.get(idx), ref, "test_stencil: 1D stencil mismatch");
+            }
+
+            Collection<double> kernel(3, [](std::size_t tap)
+                                      { return (double)(1 << tap); });
+            Collection<double> conv = convolve(c, kernel, mode, -1.0);
+            for (std::size_t idx = 0; idx < n; ++idx)
+            {
+                double ref = 0.0;
+                for (std::ptrdiff_t off = -1; off <= 1; ++off)
+                    ref += kernel.get(off + 1) * reference_boundary(x, (std::ptrdiff_t)idx + off, mode, -1.0);
+                assert_near(conv.get(idx), ref, 1e-12, "test_stencil: 1D convolution mismatch");
+            }
+        }
+
+        for (std::size_t n : {std::size_t(20000), std::size_t(3)})
+        {
+            Collection<double> c(n, [](std::size_t idx)
+                                 { return (double)((idx * 13) % 17); });
+            auto heat = [](const double *p)
+            { return 0.6 * p[0] + 0.3 * p[-1] + 0.1 * p[2]; };
+            Collection<double> expected = repeat_stencil(c, 2, 50, heat, mode, 4.0);
+            Collection<double> actual = iterate_stencil(c, 2, 50, heat, mode, 4.0);
+            for (std::size_t idx = 0; idx < n; ++idx)
+                assert_equal(actual.get(idx), expected.get(idx), "test_stencil: Repeated 1D stencil mismatch");
+        }
+
+        for (auto shape : {std::make_pair(150, 130), std::make_pair(3, 2)})
+        {
+            std::size_t rows = shape.first, cols = shape.second;
+            Grid<double> g(rows, cols, [](std::size_t row, std::size_t col)
+                           { return (double)((row * 7 + col * 11) % 23); });
+            std::vector<std::vector<double>> ref_grid(rows);
+            for (std::size_t row = 0; row < rows; ++row)
+                for (std::size_t col = 0; col < cols; ++col)
+                    ref_grid[row].push_back(g.get(row, col));
+            Grid<double> s = stencil(g, 2, [](StencilWindow<double> w)
+                                     { return w(-2, 1) + 2 * w(0, -1) + 3 * w(0, 0) + 5 * w(1, 2) + 7 * w(2, 0); },
+                                     mode, 0.5);
+            for (std::size_t row = 0; row < rows; ++row)
+                for (std::size_t col = 0; col < cols; ++col)
+                {
+                    std::ptrdiff_t r = (std::ptrdiff_t)row, c = (std::ptrdiff_t)col;
+                    double ref = reference_boundary(ref_grid, r - 2, c + 1, mode, 0.5) +
+                                 2 * reference_boundary(ref_grid, r, c - 1, mode, 0.5) +
+                                 3 * reference_boundary(ref_grid, r, c, mode, 0.5) +
+                                 5 * reference_boundary(ref_grid, r + 1, c + 2, mode, 0.5) +
+                                 7 * reference_boundary(ref_grid, r + 2, c, mode, 0.5);
+                    assert_equal(s.get(row, col), ref, "test_stencil: 2D stencil mismatch");
+                }
+        }
+
+        for (auto shape : {std::make_pair(60, 3000), std::make_pair(4, 3)})
+        {
+            std::size_t rows = shape.first, cols = shape.second;
+            Grid<float> g(rows, cols, [](std::size_t row, std::size_t col)
+                          { return (float)((row * 5 + col * 3) % 29); });
+            std::vector<std::vector<double>> ref_grid(rows);
+            for (std::size_t row = 0; row < rows; ++row)
+                for (std::size_t col = 0; col < cols; ++col)
+                    ref_grid[row].push_back(g.get(row, col));
+            Collection<double> row_kernel(3, [](std::size_t tap)
+                                          { return 1.0 + tap; });
+            Collection<double> col_kernel(5, [](std::size_t tap)
+                                          { return tap == 1 ? -1.0 : 0.5 * tap; });
+            Grid<double> conv = convolve(g, row_kernel, col_kernel, mode, 2.0f);
+            for (std::size_t row = 0; row < rows; ++row)
+                for (std::size_t col = 0; col < cols; ++col)
+                {
+                    double ref = 0.0;
+                    for (std::ptrdiff_t dr = -2; dr <= 2; ++dr)
+                        for (std::ptrdiff_t dc = -1; dc <= 1; ++dc)
+                            ref += col_kernel.get(dr + 2) * row_kernel.get(dc + 1) *
+                                   reference_boundary(ref_grid, (std::ptrdiff_t)row + dr, (std::ptrdiff_t)col + dc, mode, 2.0);
+                    assert_near(conv.get(row, col), ref, 1e-9, "test_stencil: Separable 2D convolution mismatch");
+                }
+        }
+
+        for (auto shape : {std::make_pair(70, 3000), std::make_pair(2, 3)})
+        {
+            std::size_t rows = shape.first, cols = shape.second;
+            Grid<double> g(rows, cols, [](std::size_t row, std::size_t col)
+                           { return (double)((row * 3 + col) % 19); });
+            auto diffuse = [](StencilWindow<double> w)
+            { return 0.5 * w(0, 0) + 0.2 * w(-1, 0) + 0.1 * w(1, 1) + 0.2 * w(0, -1); };
+            Grid<double> expected = repeat_stencil(g, 1, 5, diffuse, mode, 1.0);
+            Grid<double> actual = iterate_stencil(g, 1, 5, diffuse, mode, 1.0);
+            for (std::size_t row = 0; row < rows; ++row)
+                for (std::size_t col = 0; col < cols; ++col)
+                    assert_equal(actual.get(row, col), expected.get(row, col), "test_stencil: Repeated 2D stencil mismatch");
+        }
+    }
+    set_thread_count(0);
+
+    Collection<double> gauss = gaussian_kernel<double>(1.5);
+    assert_equal(gauss.size(), std::size_t(11), "test_stencil: Gaussian kernel radius mismatch");
+    assert_near(sum(gauss), 1.0, 1e-12, "test_stencil: Gaussian kernel should be normalized");
+    assert_near(sum(box_kernel<double>(3)), 1.0, 1e-12, "test_stencil: Box kernel should be normalized");
+    Collection<double> flat(100, [](std::size_t)
+                            { return 3.0; });
+    Collection<double> blurred = convolve(flat, gauss, boundary_mode::reflect);
+    assert_near(blurred.get(0), 3.0, 1e-12, "test_stencil: Blurring a constant should leave it unchanged");
+
+    bool thrown = false;
+    try
+    {
+        convolve(flat, Collection<double>(2, [](std::size_t)
+                                          { return 0.5; }));
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_stencil: Even kernels should be rejected");
+}
+
+/**
+ * @brief An affine map `x -> a * x + b` modulo a prime, used to check non-commutative rolling reductions.
+ */
+struct rolling_affine
+{
+    std::uint64_t a = 1;
+    std::uint64_t b = 0;
+};
+
+/**
+ * @brief Tests the rolling reductions against direct reductions of each window.
+ */
+void test_rolling()
+{
+    set_thread_count(3);
+    const std::size_t n = 100003;
+    Collection<double> xs(n, [](std::size_t idx)
+                          { return (idx % 3 == 0 ? 1e8 : 1e-3) * (double)((idx * 7919) % 1009) - 5e5; });
+    Collection<int> ints(n, [](std::size_t idx)
+                         { return (int)((idx * 31) % 97) - 40; });
+    const std::uint64_t prime = 1000000007;
+    Collection<rolling_affine> maps(n, [](std::size_t idx)
+                                    { return rolling_affine{idx % 1000 + 2, idx % 777}; });
+    auto compose = [prime](const rolling_affine &f, const rolling_affine &g)
+    { return rolling_affine{g.a * f.a % prime, (g.a * f.b + g.b) % prime}; };
+
+    for (std::size_t window : {std::size_t(1), std::size_t(2), std::size_t(7), std::size_t(300)})
+    {
+        Collection<double> sums = rolling_sum(xs, window);
+        Collection<double> plus = rolling(xs, window, std::plus<double>());
+        Collection<double> mins = rolling_min(xs, window);
+        Collection<double> maxs = rolling_max(xs, window);
+        Collection<double> means = rolling_mean(ints, window);
+        Collection<int> int_maxs = rolling(ints, window, [](int a, int b)
+                                           { return std::max(a, b); });
+        Collection<rolling_affine> composed = rolling(maps, window, compose);
+        assert_equal(sums.size(), n - window + 1, "test_rolling: Result size mismatch");
+        assert_equal(composed.size(), n - window + 1, "test_rolling: Result size mismatch");
+
+        std::size_t stride = window > 10 ? 37 : 1;
+        for (std::size_t idx = 0; idx < sums.size(); idx += stride)
+        {
+            long double sum = 0.0L, magnitude = 0.0L;
+            double lo = xs.get(idx), hi = xs.get(idx);
+            long int_sum = 0;
+            int int_hi = ints.get(idx);
+            rolling_affine map = maps.get(idx);
+            for (std::size_t k = idx; k < idx + window; ++k)
+            {
+                sum += xs.get(k);
+                magnitude += std::fabs(xs.get(k));
+                lo = std::min(lo, xs.get(k));
+                hi = std::max(hi, xs.get(k));
+                int_sum += ints.get(k);
+                int_hi = std::max(int_hi, ints.get(k));
+                if (k > idx)
+                    map = compose(map, maps.get(k));
+            }
+            double tolerance = 4 * std::numeric_limits<double>::epsilon() * (double)magnitude;
+            assert_near(sums.get(idx), (double)sum, tolerance, "test_rolling: Rolling sum mismatch");
+            assert_equal(plus.get(idx), sums.get(idx), "test_rolling: std::plus should use the rolling sum");
+            assert_equal(mins.get(idx), lo, "test_rolling: Rolling min mismatch");
+            assert_equal(maxs.get(idx), hi, "test_rolling: Rolling max mismatch");
+            assert_near(means.get(idx), (double)int_sum / window, 1e-12, "test_rolling: Rolling mean mismatch");
+            assert_equal(int_maxs.get(idx), int_hi, "test_rolling: Two-stack rolling max mismatch");
+            assert_equal(composed.get(idx).a, map.a, "test_rolling: Two-stack composition mismatch");
+            assert_equal(composed.get(idx).b, map.b, "test_rolling: Two-stack composition mismatch");
+        }
+    }
+    set_thread_count(0);
+
+    Collection<double> three(3, [](std::size_t idx)
+                             { return (double)idx; });
+    Collection<int> three_ints(3, [](std::size_t idx)
+                               { return (int)idx; });
+    assert_equal(rolling_sum(three, 3).size(), std::size_t(1), "test_rolling: A window as wide as the input should give one result");
+    assert_equal(rolling_sum(three, 3).get(0), 3.0, "test_rolling: Single full window mismatch");
+    assert_equal(rolling_mean(three, 3).get(0), 1.0, "test_rolling: Single full window mismatch");
+    assert_equal(rolling_min(three, 3).get(0), 0.0, "test_rolling: Single full window mismatch");
+    assert_equal(rolling_max(three, 3).get(0), 2.0, "test_rolling: Single full window mismatch");
+    assert_equal(rolling(three_ints, 3, [](int a, int b)
+                         { return a * 10 + b; })
+                     .get(0),
+                 12, "test_rolling: Single full window mismatch");
+    for (std::size_t window : {4, 1000})
+    {
+        assert_equal(rolling_sum(three, window).size(), std::size_t(0), "test_rolling: Windows wider than the input should give no results");
+        assert_equal(rolling_mean(three_ints, window).size(), std::size_t(0), "test_rolling: Windows wider than the input should give no results");
+        assert_equal(rolling_min(three, window).size(), std::size_t(0), "test_rolling: Windows wider than the input should give no results");
+        assert_equal(rolling_max(three, window).size(), std::size_t(0), "test_rolling: Windows wider than the input should give no results");
+        assert_equal(rolling(three_ints, window, std::multiplies<int>()).size(), std::size_t(0),
+                     "test_rolling: Windows wider than the input should give no results");
+    }
+
+    bool thrown = false;
+    try
+    {
+        rolling_min(three, 0);
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_rolling: Empty windows should be rejected");
+}
+
+/**
+ * @brief Tests sparse vectors, CSR matrices, sparse dot products and SpMV against their dense equivalents.
+ */
+void test_sparse()
+{
+    set_thread_count(3);
+    const std::size_t n = 200003;
+    Collection<double> dense_u(n, [](std::size_t idx)
+                               { return idx % 97 == 0 ? (double)(idx % 13) - 6.0 : 1e-9; });
+    Collection<double> dense_v(n, [](std::size_t idx)
+                               { return idx % 5 == 0 ? 0.5 * (double)(idx % 7) : 0.0; });
+    Collection<double> dense_w(n, [](std::size_t idx)
+                               { return idx == 485 || idx == 199990 ? 3.0 : 0.0; });
+
+    SparseVector<double> u = SparseVector<double>::from_dense(dense_u, 1e-6);
+    SparseVector<double> v = SparseVector<double>::from_dense(dense_v);
+    SparseVector<double> w = SparseVector<double>::from_dense(dense_w);
+    Collection<double> clean_u = u.to_dense();
+
+    std::size_t expected_nnz = 0;
+    for (std::size_t idx = 0; idx < n; ++idx)
+    {
+        double expected = idx % 97 == 0 ? (double)(idx % 13) - 6.0 : 0.0;
+        expected_nnz += expected != 0.0 ? 1 : 0;
+        assert_equal(clean_u.get(idx), expected, "test_sparse: Threshold conversion round trip mismatch");
+    }
+    assert_equal(u.nnz(), expected_nnz, "test_sparse: Stored element count mismatch");
+    assert_equal(w.nnz(), std::size_t(2), "test_sparse: Stored element count mismatch");
+    assert_equal(u.get(97 * 3), (double)((97 * 3) % 13) - 6.0, "test_sparse: get mismatch");
+    assert_equal(u.get(98), 0.0, "test_sparse: get should give 0 for unstored elements");
+
+    Collection<double> clean_v = v.to_dense();
+    Collection<double> clean_w = w.to_dense();
+    assert_near(sparse_dot(u, dense_v), dot(clean_u, dense_v), 1e-9, "test_sparse: Sparse-dense dot mismatch");
+    assert_near(sparse_dot(dense_v, u), dot(clean_u, dense_v), 1e-9, "test_sparse: Dense-sparse dot mismatch");
+    assert_near(sparse_dot(u, v), dot(clean_u, clean_v), 1e-9, "test_sparse: Sparse-sparse dot mismatch");
+    assert_near(sparse_dot(v, u), dot(clean_u, clean_v), 1e-9, "test_sparse: Sparse-sparse dot mismatch");
+    assert_near(sparse_dot(w, v), dot(clean_w, clean_v), 1e-12, "test_sparse: Sparse-sparse dot with very different densities mismatch");
+    assert_near(sparse_dot(u, w), dot(clean_u, clean_w), 1e-12, "test_sparse: Sparse-sparse dot with very different densities mismatch");
+
+    SparseVector<double> empty = SparseVector<double>::from_dense(Collection<double>(n, [](std::size_t)
+                                                                                     { return 0.0; }));
+    assert_equal(empty.nnz(), std::size_t(0), "test_sparse: Stored element count mismatch");
+    assert_equal(sparse_dot(empty, v), 0.0, "test_sparse: Dot with an empty sparse vector should be 0");
+    assert_equal(sparse_dot(u, empty), 0.0, "test_sparse: Dot with an empty sparse vector should be 0");
+    assert_equal(sparse_dot(empty, empty), 0.0, "test_sparse: Dot with an empty sparse vector should be 0");
+    assert_equal(sparse_dot(empty, dense_v), 0.0, "test_sparse: Dot with an empty sparse vector should be 0");
+
+    Collection<double> y(n, [](std::size_t idx)
+                         { return (double)(idx % 3); });
+    axpy(2.0, u, y);
+    for (std::size_t idx = 0; idx < n; idx += 7)
+        assert_equal(y.get(idx), (double)(idx % 3) + 2.0 * clean_u.get(idx), "test_sparse: Sparse axpy mismatch");
+
+    Matrix<double> m(40, 30, [](std::size_t row, std::size_t col)
+                     { return (row * 7 + col * 3) % 11 == 0 ? (double)row - (double)col : 0.0; });
+    CsrMatrix<double> small = CsrMatrix<double>::from_dense(m);
+    Matrix<double> back = small.to_dense();
+    for (std::size_t row = 0; row < m.rows(); ++row)
+        for (std::size_t col = 0; col < m.cols(); ++col)
+            assert_equal(back.get(row, col), m.get(row, col), "test_sparse: CSR round trip mismatch");
+    Collection<double> x30(30, [](std::size_t idx)
+                           { return 1.0 + (double)idx; });
+    Collection<double> dense_y = gemv(m, x30);
+    Collection<double> sparse_y = spmv(small, x30);
+    for (std::size_t row = 0; row < m.rows(); ++row)
+        assert_near(sparse_y.get(row), dense_y.get(row), 1e-12, "test_sparse: SpMV on a converted matrix mismatch");
+
+    // A skewed matrix: most rows hold a few elements, one holds a whole dense row.
+    const std::size_t rows = 30000, cols = 5000, heavy = 17;
+    std::vector<std::size_t> ptr(1, 0);
+    std::vector<sparse_index> idx;
+    std::vector<double> val;
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        std::size_t count = row == heavy ? cols : row % 4;
+        for (std::size_t k = 0; k < count; ++k)
+        {
+            idx.push_back((sparse_index)(row == heavy ? k : (row * 31 + k * 977) % cols));
+            val.push_back((double)((row + k) % 9) - 4.0);
+        }
+        ptr.push_back(idx.size());
+    }
+    CsrMatrix<double> skewed(rows, cols,
+                             Collection<std::size_t>(ptr.size(), [&](std::size_t k)
+                                                     { return ptr[k]; }),
+                             Collection<sparse_index>(idx.size(), [&](std::size_t k)
+                                                      { return idx[k]; }),
+                             Collection<double>(val.size(), [&](std::size_t k)
+                                                { return val[k]; }));
+    Collection<double> x(cols, [](std::size_t k)
+                         { return (double)(k % 17) * 0.25; });
+    Collection<double> z(rows, [](std::size_t row)
+                         { return (double)row; });
+    spmv(0.5, skewed, x, 2.0, z);
+    for (std::size_t row = 0; row < rows; ++row)
+    {
+        double acc = 0.0;
+        for (std::size_t k = ptr[row]; k < ptr[row + 1]; ++k)
+            acc += val[k] * x.get(idx[k]);
+        assert_near(z.get(row), 2.0 * (double)row + 0.5 * acc, 1e-9, "test_sparse: Balanced SpMV mismatch");
+    }
+    set_thread_count(0);
+
+    bool thrown = false;
+    try
+    {
+        SparseVector<double> bad(10, Collection<sparse_index>(2, [](std::size_t k)
+                                                              { return (sparse_index)(5 - k); }),
+                                 Collection<double>(2, [](std::size_t)
+                                                    { return 1.0; }));
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_sparse: Unordered indices should be rejected");
+}
+
+/**
+ * @brief Tests the structure-of-arrays complex collection against std::complex arithmetic.
+ */
+void test_complex()
+{
+    set_thread_count(3);
+    const std::size_t n = 100001;
+    auto gen_a = [](std::size_t idx)
+    { return std::complex<double>((double)(idx % 17) - 8.0, (double)(idx % 11) * 0.5); };
+    auto gen_b = [](std::size_t idx)
+    { return std::complex<double>((double)(idx % 5) * 0.25, 3.0 - (double)(idx % 7)); };
+    ComplexCollection<double> a(n, gen_a);
+    ComplexCollection<double> b(Collection<std::complex<double>>(n, gen_b));
+    assert_equal(a.size(), n, "test_complex: Size mismatch");
+    assert_equal(a.real().size(), n, "test_complex: Real part size mismatch");
+
+    ComplexCollection<double> sum_ab = a + b;
+    ComplexCollection<double> diff_ab = a - b;
+    ComplexCollection<double> prod_ab = a * b;
+    const std::complex<double> s(0.5, -2.0);
+    ComplexCollection<double> scaled = s * a;
+    ComplexCollection<double> conj_a = a.conj();
+    Collection<double> norm_a = a.norm();
+    Collection<double> abs_a = a.abs();
+    std::complex<double> expected_u, expected_c;
+    for (std::size_t idx = 0; idx < n; ++idx)
+    {
+        std::complex<double> x = gen_a(idx), y = gen_b(idx);
+        assert_true(sum_ab.get(idx) == x + y, "test_complex: Addition mismatch");
+        assert_true(diff_ab.get(idx) == x - y, "test_complex: Subtraction mismatch");
+        assert_true(prod_ab.get(idx) == x * y, "test_complex: Multiplication mismatch");
+        assert_true(scaled.get(idx) == s * x, "test_complex: Scalar multiplication mismatch");
+        assert_true(conj_a.get(idx) == std::conj(x), "test_complex: Conjugate mismatch");
+        assert_equal(norm_a.get(idx), std::norm(x), "test_complex: Squared magnitude mismatch");
+        assert_near(abs_a.get(idx), std::abs(x), 1e-14, "test_complex: Magnitude mismatch");
+        expected_u += x * y;
+        expected_c += std::conj(x) * y;
+    }
+    std::complex<double> actual_u = dotu(a, b), actual_c = dotc(a, b);
+    assert_near(actual_u.real(), expected_u.real(), 1e-6, "test_complex: dotu mismatch");
+    assert_near(actual_u.imag(), expected_u.imag(), 1e-6, "test_complex: dotu mismatch");
+    assert_near(actual_c.real(), expected_c.real(), 1e-6, "test_complex: dotc mismatch");
+    assert_near(actual_c.imag(), expected_c.imag(), 1e-6, "test_complex: dotc mismatch");
+    assert_near(dotc(a, a).imag(), 0.0, 1e-9, "test_complex: dotc(a, a) should be real");
+    assert_near(dotc(a, a).real(), sum(norm_a), 1e-6, "test_complex: dotc(a, a) should be the squared norm");
+
+    ComplexCollection<double> squared = a.map([](double re, double im)
+                                              { return std::complex<double>(re * re - im * im, 2 * re * im); });
+    Collection<std::complex<double>> back = squared.to_aos();
+    for (std::size_t idx = 0; idx < n; idx += 13)
+        assert_true(back.get(idx) == gen_a(idx) * gen_a(idx), "test_complex: map mismatch");
+    set_thread_count(0);
+
+    ComplexCollection<float> f(Collection<float>(2, [](std::size_t idx)
+                                                 { return (float)idx + 1.0f; }),
+                               Collection<float>(2, [](std::size_t)
+                                                 { return 2.0f; }));
+    f.set(0, std::complex<float>(3.0f, -4.0f));
+    assert_equal(f.abs().get(0), 5.0f, "test_complex: set mismatch");
+    assert_true(f.to_vector()[1] == std::complex<float>(2.0f, 2.0f), "test_complex: to_vector mismatch");
+
+    bool thrown = false;
+    try
+    {
+        ComplexCollection<float> bad(Collection<float>(2, [](std::size_t)
+                                                       { return 0.0f; }),
+                                     Collection<float>(3, [](std::size_t)
+                                                       { return 0.0f; }));
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_complex: Mismatched parts should be rejected");
+}
+
+/**
+ * @brief Computes one component of a discrete Fourier transform directly.
+ * @param x The samples.
+ * @param k The frequency.
+ * @param sign -1 for the forward transform, 1 for the inverse (unscaled).
+ * @return The component.
+ */
+std::complex<double> naive_dft(const std::vector<std::complex<double>> &x, std::size_t k, double sign)
+{
+    const long double pi = 3.141592653589793238462643383279502884L;
+    std::complex<long double> acc;
+    for (std::size_t j = 0; j < x.size(); ++j)
+    {
+        long double angle = sign * 2.0L * pi * (long double)((j * k) % x.size()) / (long double)x.size();
+        acc += std::complex<long double>(x[j].real(), x[j].imag()) * std::complex<long double>(std::cos(angle), std::sin(angle));
+    }
+    return std::complex<double>((double)acc.real(), (double)acc.imag());
+}
+
+/**
+ * @brief Tests the FFTs against direct evaluation of the DFT.
+ * @details Covers every mix of radix 8, 4 and 2 passes, the six-step path for large sizes,
+ *          round trips through the inverse transforms, real transforms and 2D transforms.
+ */
+void test_fft()
+{
+    auto gen = [](std::size_t idx)
+    { return std::complex<double>(std::sin(0.37 * idx) + (double)(idx % 7) * 0.1, std::cos(1.3 * idx) - 0.25); };
+
+    for (std::size_t n = 1; n <= 512; n *= 2)
+    {
+        ComplexCollection<double> x(n, gen);
+        std::vector<std::complex<double>> samples = x.to_vector();
+        ComplexCollection<double> spectrum = fft(x);
+        ComplexCollection<double> back = ifft(spectrum);
+        double tol = 1e-13 * n;
+        for (std::size_t k = 0; k < n; ++k)
+        {
+            std::complex<double> expected = naive_dft(samples, k, -1.0);
+            assert_near(spectrum.get(k).real(), expected.real(), tol, "test_fft: Forward mismatch");
+            assert_near(spectrum.get(k).imag(), expected.imag(), tol, "test_fft: Forward mismatch");
+            assert_near(back.get(k).real(), samples[k].real(), 1e-14, "test_fft: Round trip mismatch");
+            assert_near(back.get(k).imag(), samples[k].imag(), 1e-14, "test_fft: Round trip mismatch");
+        }
+    }
+
+    set_thread_count(3);
+    const std::size_t big = std::size_t(1) << 19;
+    ComplexCollection<double> x(big, gen);
+    std::vector<std::complex<double>> samples = x.to_vector();
+    ComplexCollection<double> spectrum = fft(x);
+    for (std::size_t k : {std::size_t(0), std::size_t(1), std::size_t(3), std::size_t(1000), big / 2, big - 1})
+    {
+        std::complex<double> expected = naive_dft(samples, k, -1.0);
+        assert_near(spectrum.get(k).real(), expected.real(), 1e-9, "test_fft: Six-step mismatch");
+        assert_near(spectrum.get(k).imag(), expected.imag(), 1e-9, "test_fft: Six-step mismatch");
+    }
+    ComplexCollection<double> back = ifft(spectrum);
+    for (std::size_t idx = 0; idx < big; ++idx)
+    {
+        assert_near(back.get(idx).real(), samples[idx].real(), 1e-13, "test_fft: Six-step round trip mismatch");
+        assert_near(back.get(idx).imag(), samples[idx].imag(), 1e-13, "test_fft: Six-step round trip mismatch");
+    }
+
+    for (std::size_t n : {std::size_t(1), std::size_t(2), std::size_t(64), big})
+    {
+        Collection<double> real(n, [](std::size_t idx)
+                                { return std::sin(0.11 * idx) + (double)(idx % 3); });
+        ComplexCollection<double> half = rfft(real);
+        ComplexCollection<double> full = fft(ComplexCollection<double>(n, [&](std::size_t idx)
+                                                                       { return std::complex<double>(real.get(idx), 0.0); }));
+        assert_equal(half.size(), n / 2 + 1, "test_fft: rfft size mismatch");
+        for (std::size_t k = 0; k < half.size(); ++k)
+        {
+            assert_near(half.get(k).real(), full.get(k).real(), 1e-9, "test_fft: rfft mismatch");
+            assert_near(half.get(k).imag(), full.get(k).imag(), 1e-9, "test_fft: rfft mismatch");
+        }
+        Collection<double> restored = irfft(half, n);
+        for (std::size_t idx = 0; idx < n; ++idx)
+            assert_near(restored.get(idx), real.get(idx), 1e-12, "test_fft: irfft mismatch");
+    }
+
+    const std::size_t rows = 8, cols = 32;
+    ComplexCollection<double> image(rows * cols, gen);
+    ComplexCollection<double> image_spectrum = fft2(image, rows, cols);
+    for (std::size_t k = 0; k < rows; ++k)
+        for (std::size_t l = 0; l < cols; l += 5)
+        {
+            std::complex<double> expected;
+            for (std::size_t r = 0; r < rows; ++r)
+                for (std::size_t c = 0; c < cols; ++c)
+                    expected += gen(r * cols + c) * std::polar(1.0, -2.0 * M_PI * ((double)(r * k) / rows + (double)(c * l) / cols));
+            assert_near(image_spectrum.get(k * cols + l).real(), expected.real(), 1e-10, "test_fft: fft2 mismatch");
+            assert_near(image_spectrum.get(k * cols + l).imag(), expected.imag(), 1e-10, "test_fft: fft2 mismatch");
+        }
+    ComplexCollection<double> image_back = ifft2(image_spectrum, rows, cols);
+    for (std::size_t idx = 0; idx < rows * cols; ++idx)
+        assert_near(std::abs(image_back.get(idx) - gen(idx)), 0.0, 1e-13, "test_fft: ifft2 mismatch");
+    set_thread_count(0);
+
+    ComplexCollection<float> tone(256, [](std::size_t idx)
+                                  { return std::polar(1.0f, (float)(2.0 * M_PI * 5.0 * idx / 256.0)); });
+    ComplexCollection<float> peak = fft(tone);
+    for (std::size_t k = 0; k < 256; ++k)
+        assert_near(std::abs(peak.get(k)), k == 5 ? 256.0f : 0.0f, 1e-3f, "test_fft: Float tone mismatch");
+
+    bool thrown = false;
+    try
+    {
+        fft(ComplexCollection<double>(12, gen));
+    }
+    catch (assertion_error &)
+    {
+        thrown = true;
+    }
+    assert_true(thrown, "test_fft: Sizes other than powers of two should be rejected");
+}
+
+/**
+ * @brief Measures the error of a result in units in the last place of the exact value.
+ * @tparam T float or double.
+ * @param got The computed result.
+ * @param exact The exact value, in long double.
+ * @return The error in ulps; 0 when both are the same infinity or both NaN, and a huge value
+ *         when only one is.
+ */
+template <typename T>
+double ulp_error(T got, long double exact)
+{
+    if (std::isnan(exact) || std::isinf(exact) || std::isnan(got) || std::isinf(got))
+        return (std::isnan(exact) && std::isnan(got)) || (long double)got == exact ? 0.0 : 1e30;
+    T rounded = std::abs((T)exact);
+    T ulp = std::max(std::nextafter(rounded, std::numeric_limits<T>::infinity()) - rounded,
+                     std::numeric_limits<T>::denorm_min());
+    return (double)(std::abs((long double)got - exact) / ulp);
+}
+
+/**
+ * @brief Checks a named math operation against a long double reference over a range.
+ * @details The arguments are spread evenly over `[lo, hi]`, or logarithmically for a positive
+ *          range when `logarithmic` is set, and mapped through `Collection::map`, which runs
+ *          the bulk kernel. Each result, and the scalar form of the operation on the same
+ *          argument, must be within `max_ulp` of the reference. The two may differ in the last
+ *          bit, since the bulk kernel may run a version compiled with fused multiply-adds.
+ * @tparam T float or double.
+ * @tparam OP The type of the named operation.
+ * @tparam REF The type of the reference function.
+ * @param op The named operation.
+ * @param ref The reference function on long double.
+ * @param lo The lowest argument.
+ * @param hi The highest argument.
+ * @param logarithmic Whether to space the arguments logarithmically.
+ * @param max_ulp The documented error bound.
+ * @param msg The message for a failure.
+ */
+template <typename T, typename OP, typename REF>
+void check_vmath(OP op, REF ref, double lo, double hi, bool logarithmic, double max_ulp, const char *msg)
+{
+    const std::size_t n = 200003;
+    Collection<T> x(n, [&](std::size_t idx)
+                    {
+                        double frac = (double)idx / (n - 1);
+                        return (T)(logarithmic ? std::exp(std::log(lo) + frac * (std::log(hi) - std::log(lo))) : lo + frac * (hi - lo)); });
+    Collection<T> y = x.template map<T>(op);
+    double worst = 0.0;
+    for (std::size_t idx = 0; idx < n; ++idx)
+    {
+        long double exact = ref((long double)x.get(idx));
+        worst = std::max(worst, ulp_error(y.get(idx), exact));
+        worst = std::max(worst, ulp_error(op(x.get(idx)), exact));
+    }
+    assert_true(worst <= max_ulp, msg);
+}
+
+/**
+ * @brief Tests the vectorized math functions against long double references.
+ * @details Checks the error bounds documented in vmath.hpp over wide ranges for float and
+ *          double, the special values, the standard library fallback of sin and cos for
+ *          large arguments, and pow through `Collection::zip`.
+ */
+template <typename T>
+void test_vmath_type()
+{
+    const bool is_double = std::is_same<T, double>::value;
+    const double trig_max = vmath_consts<T>::trig_max;
+    check_vmath<T>(math_exp, [](long double x)
+                   { return std::exp(x); }, is_double ? -745.0 : -103.0, is_double ? 709.0 : 88.0, false, is_double ? 1.0 : 1.5, "test_vmath: exp error too large");
+    check_vmath<T>(math_exp, [](long double x)
+                   { return std::exp(x); }, -1.0, 1.0, false, is_double ? 1.0 : 1.5, "test_vmath: exp error too large near zero");
+    check_vmath<T>(math_log, [](long double x)
+                   { return std::log(x); }, is_double ? 1e-310 : 1e-40, is_double ? 1e300 : 1e38, true, 1.0, "test_vmath: log error too large");
+    check_vmath<T>(math_log, [](long double x)
+                   { return std::log(x); }, 0.5, 2.0, false, 1.0, "test_vmath: log error too large near one");
+    check_vmath<T>(math_sin, [](long double x)
+                   { return std::sin(x); }, -trig_max, trig_max, false, 2.0, "test_vmath: sin error too large");
+    check_vmath<T>(math_cos, [](long double x)
+                   { return std::cos(x); }, -4.0, 4.0, false, 2.0, "test_vmath: cos error too large");
+    check_vmath<T>(math_sin, [](long double x)
+                   { return std::sin(x); }, trig_max, 1e6, false, 2.0, "test_vmath: sin fallback error too large");
+    check_vmath<T>(math_tanh, [](long double x)
+                   { return std::tanh(x); }, -20.0, 20.0, false, 1.5, "test_vmath: tanh error too large");
+    check_vmath<T>(math_sqrt, [](long double x)
+                   { return std::sqrt(x); }, 0.0, 1e6, false, 0.5, "test_vmath: sqrt error too large");
+
+    const T inf = std::numeric_limits<T>::infinity();
+    const T nan = std::numeric_limits<T>::quiet_NaN();
+    assert_equal(math_exp(-inf), T(0), "test_vmath: exp(-inf) should be 0");
+    assert_equal(math_exp(inf), inf, "test_vmath: exp(inf) should be inf");
+    assert_equal(math_exp(T(1000)), inf, "test_vmath: exp should overflow to inf");
+    assert_true(std::isnan(math_exp(nan)), "test_vmath: exp(NaN) should be NaN");
+    assert_equal(math_log(T(0)), -inf, "test_vmath: log(0) should be -inf");
+    assert_equal(math_log(inf), inf, "test_vmath: log(inf) should be inf");
+    assert_true(std::isnan(math_log(T(-1))), "test_vmath: log of a negative value should be NaN");
+    assert_true(std::isnan(math_sin(inf)), "test_vmath: sin(inf) should be NaN");
+    assert_equal(math_tanh(inf), T(1), "test_vmath: tanh(inf) should be 1");
+    assert_equal(math_tanh(-inf), T(-1), "test_vmath: tanh(-inf) should be -1");
+
+    const std::size_t n = 100003;
+    Collection<T> base(n, [](std::size_t idx)
+                       { return (T)std::exp(-5.0 + 10.0 * idx / (n - 1)); });
+    Collection<T> power(n, [&](std::size_t idx)
+                        { return (T)((is_double ? 140.0 : 15.0) * std::sin(0.7 * idx)); });
+    Collection<T> result = base.template zip<T>(power, math_pow);
+    for (std::size_t idx = 0; idx < n; ++idx)
+    {
+        double err = ulp_error(result.get(idx), std::pow((long double)base.get(idx), (long double)power.get(idx)));
+        assert_true(err <= (is_double ? 2.0 : 1.0), "test_vmath: pow error too large");
+    }
+
+    // Bases near sqrt(2) and sqrt(1/2), where the series of the log converges slowest, with
+    // exponents large enough to magnify any error of the log.
+    const double y_max = is_double ? 1000.0 : 250.0;
+    Collection<T> edge_base(n, [](std::size_t idx)
+                            { return (T)(idx % 2 ? 1.4142 - 0.02 * idx / n : 0.70711 + 0.01 * idx / n); });
+    Collection<T> edge_power(n, [&](std::size_t idx)
+                             { return (T)((idx % 4 < 2 ? y_max : -y_max) * (0.5 + 0.5 * std::abs(std::sin(0.37 * idx)))); });
+    Collection<T> edge = edge_base.template zip<T>(edge_power, math_pow);
+    for (std::size_t idx = 0; idx < n; ++idx)
+    {
+        double err = ulp_error(edge.get(idx), std::pow((long double)edge_base.get(idx), (long double)edge_power.get(idx)));
+        assert_true(err <= (is_double ? 2.0 : 1.0), "test_vmath: pow error too large for large exponents");
+    }
+    assert_true(ulp_error(math_pow(T(0.708), T(is_double ? -997.5 : -247.5)),
+                          std::pow((long double)T(0.708), (long double)(is_double ? -997.5 : -247.5))) <= (is_double ? 2.0 : 1.0),
+                "test_vmath: pow error too large for large exponents");
+
+    const T specials[] = {T(0), -T(0), T(1), T(-1), T(2), T(-2), T(0.5), T(-0.5), T(3), T(2.5), inf, -inf, nan};
+    for (T x : specials)
+        for (T y : specials)
+        {
+            T got = math_pow(x, y);
+            T expected = std::pow(x, y);
+            bool same = (std::isnan(got) && std::isnan(expected)) ||
+                        (got == expected && std::signbit(got) == std::signbit(expected)) ||
+                        ulp_error(got, (long double)expected) <= 2.0;
+            assert_true(same, "test_vmath: pow special value mismatch");
+        }
+}
+
+/**
+ * @brief Tests the vectorized math functions for float and double.
+ */
+void test_vmath()
+{
+    test_vmath_type<double>();
+    test_vmath_type<float>();
+}
+
+/**
+ * @brief Checks the set operations on two sorted collections against the standard algorithms.
+ * @param a The first sorted input, without duplicates.
+ * @param b The second sorted input, without duplicates.
+ */
+void check_setops(const std::vector<int> &a, const std::vector<int> &b)
+{
+    Collection<int> ca(a.size(), [&](std::size_t idx)
+                       { return a[idx]; });
+    Collection<int> cb(b.size(), [&](std::size_t idx)
+                       { return b[idx]; });
+    std::vector<int> expected;
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+    assert_true(set_union(ca, cb).to_vector() == expected, "test_setops: Union mismatch");
+    expected.clear();
+    std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+    assert_true(set_intersection(ca, cb).to_vector() == expected, "test_setops: Intersection mismatch");
+    expected.clear();
+    std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(expected));
+    assert_true(set_difference(ca, cb).to_vector() == expected, "test_setops: Difference mismatch");
+    expected.clear();
+    std::set_difference(b.begin(), b.end(), a.begin(), a.end(), std::back_inserter(expected));
+    assert_true(set_difference(cb, ca).to_vector() == expected, "test_setops: Difference mismatch");
+}
+
+/**
+ * @brief Tests union, intersection, difference and dedup of sorted collections.
+ * @details Covers empty and tiny inputs, balanced inputs on the block-compare and merge
+ *          kernels, skewed inputs on the galloping kernels, and inputs split across threads.
+ */
+void test_setops()
+{
+    auto sorted_ids = [](std::size_t n, std::size_t stride, std::size_t seed)
+    {
+        std::vector<int> ids(n);
+        std::size_t value = seed % stride;
+        for (std::size_t idx = 0; idx < n; ++idx)
+        {
+            ids[idx] = (int)value;
+            value += 1 + (idx * 2654435761u + seed) % (2 * stride - 1);
+        }
+        return ids;
+    };
+
+    check_setops({}, {});
+    check_setops({}, {1, 2, 3});
+    check_setops({1, 2, 3}, {});
+    check_setops({1, 3, 5, 7, 9, 11, 13, 15, 17, 19}, {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 20});
+    for (std::size_t threads : {1, 3})
+    {
+        set_thread_count(threads);
+        check_setops(sorted_ids(1000, 3, 1), sorted_ids(1200, 3, 2));
+        check_setops(sorted_ids(200000, 2, 3), sorted_ids(150000, 3, 4));
+        check_setops(sorted_ids(500, 2000, 5), sorted_ids(300000, 4, 6));
+        check_setops(sorted_ids(400000, 3, 7), sorted_ids(2000, 500, 8));
+    }
+    set_thread_count(0);
+
+    std::vector<int> repeated;
+    for (std::size_t idx = 0; idx < 100000; ++idx)
+        repeated.push_back((int)(idx / (1 + idx % 4)));
+    std::sort(repeated.begin(), repeated.end());
+    set_thread_count(3);
+    Collection<int> unique_values = dedup(Collection<int>(repeated.size(), [&](std::size_t idx)
+                                                          { return repeated[idx]; }));
+    set_thread_count(0);
+    repeated.erase(std::unique(repeated.begin(), repeated.end()), repeated.end());
+    assert_true(unique_values.to_vector() == repeated, "test_setops: Dedup mismatch");
+    assert_equal(dedup(Collection<int>(0, [](std::size_t)
+                                       { return 0; }))
+                     .size(),
+                 std::size_t(0), "test_setops: Dedup of an empty collection should be empty");
+}
+
+/**
+ * @brief Tests the early-terminating predicate queries and count_if.
+ * @details Checks the answers against a serial scan, on one and on several threads, and
+ *          checks that a match near the front stops the scan long before the end.
+ */
+void test_search()
+{
+    const std::size_t size = 1000000;
+    Collection<double> values(size, [](std::size_t idx)
+                              { return double(idx % 1000); });
+    Collection<double> empty = Collection<double>::allocate(0);
+
+    for (std::size_t threads : {1, 3})
+    {
+        set_thread_count(threads);
+        assert_true(any_of(values, [](double x)
+                           { return x == 999.0; }),
+                    "test_search: any_of should find a present value");
+        assert_true(!any_of(values, [](double x)
+                            { return x != x; }),
+                    "test_search: any_of should not find NaN in finite data");
+        assert_true(none_of(values, [](double x)
+                            { return x < 0.0; }),
+                    "test_search: none_of should hold for an absent value");
+        assert_true(all_of(values, [](double x)
+                           { return x < 1000.0; }),
+                    "test_search: all_of should hold when every element matches");
+        assert_true(!all_of(values, [](double x)
+                            { return x < 999.0; }),
+                    "test_search: all_of should fail when one element does not match");
+        assert_equal(find_first(values, [](double x)
+                                { return x == 10.0; }),
+                     std::size_t(10), "test_search: find_first should return the first match");
+        assert_equal(find_first(values, [](double x)
+                                { return x == 777.0; }),
+                     std::size_t(777), "test_search: find_first should return the first match");
+        assert_equal(find_last(values, [](double x)
+                               { return x == 10.0; }),
+                     size - 990, "test_search: find_last should return the last match");
+        assert_equal(find_first(values, [](double x)
+                                { return x > 1000.0; }),
+                     size, "test_search: find_first should return the size when nothing matches");
+        assert_equal(find_last(values, [](double x)
+                               { return x > 1000.0; }),
+                     size, "test_search: find_last should return the size when nothing matches");
+        assert_equal(count_if(values, [](double x)
+                              { return x < 250.0; }),
+                     size / 4, "test_search: count_if mismatch");
+
+        std::atomic<std::size_t> calls{0};
+        assert_equal(find_first(values, [&calls](double x)
+                                {
+                                    calls.fetch_add(1, std::memory_order_relaxed);
+                                    return x == 10.0; }),
+                     std::size_t(10), "test_search: find_first should return the first match");
+        assert_true(calls.load() <= 2 * threads * search_block,
+                    "test_search: find_first should stop soon after an early match");
+    }
+    set_thread_count(0);
+
+    assert_true(!any_of(empty, [](double)
+                        { return true; }),
+                "test_search: any_of of an empty collection should be false");
+    assert_true(all_of(empty, [](double)
+                       { return false; }),
+                "test_search: all_of of an empty collection should be true");
+    assert_equal(find_first(empty, [](double)
+                            { return true; }),
+                 std::size_t(0), "test_search: find_first of an empty collection should return 0");
+    assert_equal(count_if(empty, [](double)
+                          { return true; }),
+                 std::size_t(0), "test_search: count_if of an empty collection should be 0");
+}
+
+/**
+ * @brief Tests the HyperLogLog, Count-Min, Bloom filter and t-digest sketches.
+ * @details Each sketch is built by `sketch_reduce` on one and on several threads, and its
+ *          answers are checked against the exact ones within the sketch's error bounds.
+ */
+void test_sketch()
+{
+    const std::size_t size = 1000000;
+    const std::size_t distinct = 200000;
+    // Every value of [0, distinct) appears, most of them several times, in a scrambled order.
+    Collection<std::int64_t> keys(size, [](std::size_t idx)
+                                  { return std::int64_t((idx * 7919) % distinct); });
+    Collection<double> values(size, [](std::size_t idx)
+                              { return double((idx * 7919) % size); });
+
+    set_thread_count(1);
+    HyperLogLog<std::int64_t> serial_hll = sketch_reduce(keys, HyperLogLog<std::int64_t>());
+    set_thread_count(3);
+    HyperLogLog<std::int64_t> hll = sketch_reduce(keys, HyperLogLog<std::int64_t>());
+    assert_equal(hll.estimate(), serial_hll.estimate(), "test_sketch: HyperLogLog should not depend on the thread count");
+    assert_near(hll.estimate(), double(distinct), 0.03 * distinct, "test_sketch: HyperLogLog estimate out of bounds");
+    assert_near(approx_distinct(keys, 16), double(distinct), 0.015 * distinct, "test_sketch: approx_distinct out of bounds");
+    Collection<std::int64_t> few(100, [](std::size_t idx)
+                                 { return std::int64_t(idx % 37); });
+    assert_near(approx_distinct(few), 37.0, 0.5, "test_sketch: Small distinct counts should be nearly exact");
+
+    // Key 0 is a heavy hitter on top of the uniform keys.
+    Collection<std::int64_t> skewed(size, [](std::size_t idx)
+                                    { return idx % 10 == 0 ? std::int64_t(0) : std::int64_t(idx % distinct); });
+    CountMinSketch<std::int64_t> cms = sketch_reduce(skewed, CountMinSketch<std::int64_t>(4096, 4));
+    assert_equal(cms.total(), std::uint64_t(size), "test_sketch: Count-Min total mismatch");
+    double slack = std::exp(1.0) / 4096 * size;
+    std::uint64_t heavy = size / 10 + 4;
+    assert_true(cms.estimate(0) >= heavy && cms.estimate(0) <= heavy + slack, "test_sketch: Count-Min heavy hitter out of bounds");
+    std::size_t over = 0;
+    for (std::int64_t key = 1; key < 1000; ++key)
+    {
+        std::uint64_t exact = (size / distinct) - (key % 10 == 0 ? size / distinct : 0);
+        std::uint64_t estimate = cms.estimate(key);
+        assert_true(estimate >= exact, "test_sketch: Count-Min should never underestimate");
+        over += estimate > exact + slack ? 1 : 0;
+    }
+    assert_true(over < 50, "test_sketch: Count-Min overestimates too often");
+
+    BloomFilter<std::int64_t> bloom = sketch_reduce(keys, BloomFilter<std::int64_t>::for_capacity(distinct, 0.01));
+    std::size_t false_positives = 0;
+    for (std::int64_t key = 0; key < std::int64_t(distinct); ++key)
+    {
+        assert_true(bloom.contains(key), "test_sketch: Bloom filter should have no false negatives");
+        false_positives += bloom.contains(key + std::int64_t(distinct)) ? 1 : 0;
+    }
+    assert_true(false_positives < distinct / 50, "test_sketch: Bloom filter false positive rate too high");
+
+    TDigest<double> digest = sketch_reduce(values, TDigest<double>());
+    set_thread_count(0);
+    assert_equal(digest.count(), double(size), "test_sketch: t-digest count mismatch");
+    assert_equal(digest.quantile(0.0), 0.0, "test_sketch: t-digest minimum mismatch");
+    assert_equal(digest.quantile(1.0), double(size - 1), "test_sketch: t-digest maximum mismatch");
+    for (double q : {0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999})
+        assert_near(digest.quantile(q), q * size, 0.005 * size, "test_sketch: t-digest quantile out of bounds");
+    assert_near(approx_quantile(values, 0.25), 0.25 * size, 0.005 * size, "test_sketch: approx_quantile out of bounds");
+    assert_true(std::isnan(approx_quantile(Collection<double>::allocate(0), 0.5)), "test_sketch: Quantile of an empty collection should be NaN");
+}
+
+/**
+ * @brief Tests the sampling-based approximate sum, mean and count.
+ * @details Checks that the intervals hold the exact answers, that the estimates do not depend
+ *          on the thread count, and that small collections and tight bounds give exact answers.
+ */
+void test_approx()
+{
+    const std::size_t size = 4000000;
+    // A trend along the collection plus scrambled noise, so stratification matters.
+    Collection<double> values(size, [](std::size_t idx)
+                              { return double(idx) / size + double((idx * 2654435761u) % 1000) / 1000.0; });
+    double exact_sum = 0.0;
+    std::size_t exact_count = 0;
+    for (std::size_t idx = 0; idx < size; ++idx)
+    {
+        exact_sum += values.get(idx);
+        exact_count += values.get(idx) > 1.2 ? 1 : 0;
+    }
+
+    assert_near(approx_critical(0.95), 1.959964, 1e-5, "test_approx: Critical value mismatch");
+    set_thread_count(1);
+    approx_result serial = approx_sum(values, 0.01, 0.999, 0.0, 7);
+    set_thread_count(3);
+    approx_result sum = approx_sum(values, 0.01, 0.999, 0.0, 7);
+    assert_equal(sum.value, serial.value, "test_approx: Estimate should not depend on the thread count");
+    assert_true(sum.samples < size / 10, "test_approx: A loose bound should need few samples");
+    assert_true(sum.error <= 0.01 * sum.value, "test_approx: Interval wider than requested");
+    assert_true(sum.lower() <= exact_sum && exact_sum <= sum.upper(), "test_approx: Sum interval should hold the exact sum");
+
+    approx_result mean = approx_mean(values, 0.005, 0.999, 0.0, 11);
+    assert_true(mean.samples < size, "test_approx: The mean should be estimated by sampling");
+    assert_true(mean.lower() <= exact_sum / size && exact_sum / size <= mean.upper(), "test_approx: Mean interval should hold the exact mean");
+    approx_result count = approx_count_if(values, [](double x)
+                                          { return x > 1.2; },
+                                          0.01, 0.999, 0.0, 13);
+    assert_true(count.lower() <= exact_count && exact_count <= count.upper(), "test_approx: Count interval should hold the exact count");
+
+    approx_result quick = approx_sum(values, 0.0, 0.95, 1e-9);
+    assert_equal(quick.samples, approx_strata * approx_initial_samples, "test_approx: An expired budget should stop after one round");
+    approx_result exact = approx_sum(values, 0.0);
+
+    // A rare heavy tail: few or no samples land on a spike, so every stratum may look constant.
+    Collection<double> spiky(size, [](std::size_t idx)
+                             { return idx % 50000 == 17 ? 1e6 : 1.0; });
+    double spiky_sum = double(size) + 80.0 * (1e6 - 1.0);
+    approx_result tail = approx_sum(spiky, 0.01, 0.95, 0.0, 5);
+    assert_true(tail.error > 0.0 || tail.samples == size, "test_approx: Only an exact sum should have no error");
+    assert_true(tail.lower() <= spiky_sum && spiky_sum <= tail.upper(), "test_approx: Heavy-tail interval should hold the exact sum");
+    approx_result rare = approx_count_if(spiky, [](double x)
+                                         { return x > 2.0; },
+                                         0.01, 0.95, 0.0, 5);
+    assert_true(rare.error > 0.0 || rare.samples == size, "test_approx: Only an exact count should have no error");
+    assert_true(rare.lower() <= 80.0 && 80.0 <= rare.upper(), "test_approx: Rare-match interval should hold the exact count");
+    approx_result flat = approx_sum(spiky, 0.0, 0.95, 1e-9, 5);
+    assert_true(std::isinf(flat.error), "test_approx: A round of equal samples should give no bound");
+    set_thread_count(0);
+    assert_equal(exact.samples, size, "test_approx: An unreachable bound should fall back to the exact sum");
+    assert_equal(exact.error, 0.0, "test_approx: An exact sum should have no error");
+    assert_near(exact.value, exact_sum, 1e-9 * exact_sum, "test_approx: Exact sum mismatch");
+
+    Collection<int> small(100, [](std::size_t idx)
+                          { return int(idx); });
+    assert_equal(approx_sum(small).value, 4950.0, "test_approx: Small collections should be summed exactly");
+    assert_equal(approx_sum(Collection<int>::allocate(0)).value, 0.0, "test_approx: An empty sum should be 0");
+}
+
+/**
+ * @brief Lists the records of a join by looking each left key up in the sorted right keys.
+ * @param keys_a The keys of the left input.
+ * @param vals_a The values of the left input.
+ * @param keys_b The keys of the right input.
+ * @param vals_b The values of the right input.
+ * @return The joined records, sorted.
+ */
+std::vector<std::tuple<int, int, double>> join_reference(const std::vector<int> &keys_a, const std::vector<int> &vals_a,
+                                                         const std::vector<int> &keys_b, const std::vector<double> &vals_b)
+{
+    std::vector<std::pair<int, double>> right;
+    for (std::size_t j = 0; j < keys_b.size(); ++j)
+        right.emplace_back(keys_b[j], vals_b[j]);
+    std::sort(right.begin(), right.end());
+    std::vector<std::tuple<int, int, double>> res;
+    for (std::size_t i = 0; i < keys_a.size(); ++i)
+    {
+        auto first = std::lower_bound(right.begin(), right.end(), std::make_pair(keys_a[i], -std::numeric_limits<double>::infinity()));
+        for (auto it = first; it != right.end() && it->first == keys_a[i]; ++it)
+            res.emplace_back(keys_a[i], vals_a[i], it->second);
+    }
+    std::sort(res.begin(), res.end());
+    return res;
+}
+
+/**
+ * @brief Checks a materialized join against the expected records.
+ * @param joined The joined records.
+ * @param expected The expected records, sorted.
+ * @param msg The message reported on a mismatch.
+ */
+void check_join(const join_result<int, int, double> &joined, const std::vector<std::tuple<int, int, double>> &expected, const char *msg)
+{
+    std::vector<std::tuple<int, int, double>> actual;
+    for (std::size_t idx = 0; idx < joined.keys.size(); ++idx)
+        actual.emplace_back(joined.keys.get(idx), joined.left.get(idx), joined.right.get(idx));
+    std::sort(actual.begin(), actual.end());
+    assert_true(actual == expected, msg);
+}
+
+/**
+ * @brief Tests the hash join and the merge join, materialized and fused with a reduction.
+ * @details Both inputs have duplicate keys and keys missing from the other input. The merge
+ *          join is also checked to list its pairs in key order.
+ */
+void test_join()
+{
+    std::vector<int> keys_a, vals_a, keys_b;
+    std::vector<double> vals_b;
+    for (std::size_t idx = 0; idx < 30000; ++idx)
+    {
+        keys_a.push_back(int((idx * 7919) % 12000));
+        vals_a.push_back(int(idx));
+    }
+    for (std::size_t idx = 0; idx < 9000; ++idx)
+    {
+        keys_b.push_back(int((idx * 104729) % 10000) + (idx % 3 == 0 ? 5000 : 0));
+        vals_b.push_back(double(idx) / 4);
+    }
+    auto to_collection = [](const auto &vec)
+    {
+        using T = typename std::decay_t<decltype(vec)>::value_type;
+        return Collection<T>(vec.size(), [&](std::size_t idx)
+                             { return vec[idx]; });
+    };
+    auto sum = [](double acc, int key, int a, double b)
+    { return acc + key + a * b; };
+    auto add = [](double x, double y)
+    { return x + y; };
+
+    Collection<int> ka = to_collection(keys_a);
+    Collection<int> va = to_collection(vals_a);
+    Collection<int> kb = to_collection(keys_b);
+    Collection<double> vb = to_collection(vals_b);
+    std::vector<std::size_t> order_a(keys_a.size()), order_b(keys_b.size());
+    for (std::size_t idx = 0; idx < order_a.size(); ++idx)
+        order_a[idx] = idx;
+    for (std::size_t idx = 0; idx < order_b.size(); ++idx)
+        order_b[idx] = idx;
+    std::stable_sort(order_a.begin(), order_a.end(), [&](std::size_t x, std::size_t y)
+                     { return keys_a[x] < keys_a[y]; });
+    std::stable_sort(order_b.begin(), order_b.end(), [&](std::size_t x, std::size_t y)
+                     { return keys_b[x] < keys_b[y]; });
+    Collection<int> sorted_ka(order_a.size(), [&](std::size_t idx)
+                              { return keys_a[order_a[idx]]; });
+    Collection<int> sorted_va(order_a.size(), [&](std::size_t idx)
+                              { return vals_a[order_a[idx]]; });
+    Collection<int> sorted_kb(order_b.size(), [&](std::size_t idx)
+                              { return keys_b[order_b[idx]]; });
+    Collection<double> sorted_vb(order_b.size(), [&](std::size_t idx)
+                                 { return vals_b[order_b[idx]]; });
+
+    std::vector<std::tuple<int, int, double>> pairs = join_reference(keys_a, vals_a, keys_b, vals_b);
+    double expected = 0.0;
+    for (const auto &pair : pairs)
+        expected = sum(expected, std::get<0>(pair), std::get<1>(pair), std::get<2>(pair));
+
+    for (std::size_t threads : {1, 3})
+    {
+        set_thread_count(threads);
+        check_join(hash_join(ka, va, kb, vb), pairs, "test_join: Hash join mismatch");
+        join_result<int, int, double> merged = merge_join(sorted_ka, sorted_va, sorted_kb, sorted_vb);
+        check_join(merged, pairs, "test_join: Merge join mismatch");
+        for (std::size_t idx = 1; idx < merged.keys.size(); ++idx)
+            assert_true(merged.keys.get(idx - 1) <= merged.keys.get(idx), "test_join: Merge join should list pairs in key order");
+        assert_near(hash_join_reduce(ka, va, kb, vb, 0.0, sum, add), expected, 1e-9 * expected, "test_join: Fused hash join mismatch");
+        assert_near(merge_join_reduce(sorted_ka, sorted_va, sorted_kb, sorted_vb, 0.0, sum, add), expected, 1e-9 * expected,
+                    "test_join: Fused merge join mismatch");
+    }
+    set_thread_count(0);
+
+    // Unique right keys, as for a dimension table, take the early-exit probe.
+    Collection<int> dim_keys(5000, [](std::size_t idx)
+                             { return int(idx * 3); });
+    Collection<double> dim_vals(5000, [](std::size_t idx)
+                                { return double(idx); });
+    join_result<int, int, double> enriched = hash_join(ka, va, dim_keys, dim_vals);
+    std::size_t matched = 0;
+    for (int key : keys_a)
+        matched += key % 3 == 0 && key < 15000 ? 1 : 0;
+    assert_equal(enriched.keys.size(), matched, "test_join: Each left record should meet its one right record");
+    for (std::size_t idx = 0; idx < enriched.keys.size(); ++idx)
+        assert_equal(enriched.right.get(idx), double(enriched.keys.get(idx) / 3), "test_join: Joined value mismatch");
+
+    Collection<int> no_keys = Collection<int>::allocate(0);
+    Collection<double> no_vals = Collection<double>::allocate(0);
+    assert_equal(hash_join(ka, va, no_keys, no_vals).keys.size(), std::size_t(0), "test_join: Joining an empty input should be empty");
+    assert_equal(merge_join(no_keys, Collection<int>::allocate(0), sorted_kb, sorted_vb).keys.size(), std::size_t(0),
+                 "test_join: Joining an empty input should be empty");
+}
+
+/**
+ * @brief Tests the concurrent hash table and keyed aggregation against std::map.
+ * @details The table starts small, so it grows several times while threads insert into it,
+ *          and is also updated by threads calling insert_or_update directly.
+ */
+void test_hash_table()
+{
+    const std::size_t count = 200000;
+    Collection<std::int64_t> keys(count, [](std::size_t idx)
+                                  { return std::int64_t((idx * 7919) % 30011) - 15000; });
+    Collection<double> values(count, [](std::size_t idx)
+                              { return double(idx % 17); });
+    std::map<std::int64_t, double> sums, maxima;
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        sums[keys.get(idx)] += values.get(idx);
+        auto found = maxima.find(keys.get(idx));
+        if (found == maxima.end() || found->second < values.get(idx))
+            maxima[keys.get(idx)] = values.get(idx);
+    }
+    auto check = [](const std::pair<Collection<std::int64_t>, Collection<double>> &result,
+                    const std::map<std::int64_t, double> &expected, const char *msg)
+    {
+        assert_equal(result.first.size(), expected.size(), msg);
+        std::map<std::int64_t, double> actual;
+        for (std::size_t idx = 0; idx < result.first.size(); ++idx)
+            actual[result.first.get(idx)] = result.second.get(idx);
+        assert_true(actual == expected, msg);
+    };
+
+    for (std::size_t threads : {1, 3})
+    {
+        set_thread_count(threads);
+        ConcurrentHashTable<std::int64_t, double> table(16);
+        table.insert_all(keys, values);
+        assert_equal(table.size(), sums.size(), "test_hash_table: Size mismatch");
+        assert_true(table.slots() >= table.size(), "test_hash_table: Table should have grown to hold its keys");
+        double value = 0.0;
+        assert_true(table.find(-15000, value), "test_hash_table: Key should be found");
+        assert_equal(value, sums[-15000], "test_hash_table: Found value mismatch");
+        assert_true(!table.find(20000, value), "test_hash_table: Absent key should not be found");
+        check(table.to_collections(), sums, "test_hash_table: Bulk insert mismatch");
+
+        ConcurrentHashTable<std::int64_t, double> direct(16);
+        parallel_tasks(4, [&](std::size_t task)
+                       {
+                           for (std::size_t idx = task; idx < count; idx += 4)
+                               direct.insert_or_update(keys.get(idx), values.get(idx)); });
+        check(direct.to_collections(), sums, "test_hash_table: Concurrent insert mismatch");
+
+        check(aggregate_by_key(keys, values), sums, "test_hash_table: Aggregated sums mismatch");
+        check(aggregate_by_key(keys, values, [](double a, double b)
+                               { return std::max(a, b); }),
+              maxima, "test_hash_table: Aggregated maxima mismatch");
+
+        // Look up keys inserted before a bulk insert while it grows the table many times over.
+        // The old keys share their first group, so most of them sit further along their probe
+        // sequence, and the bulk insert adds 0 to each of them along the way.
+        ConcurrentHashTable<std::int64_t, double> growing(16);
+        std::vector<std::int64_t> old_keys;
+        for (std::int64_t key = -1; old_keys.size() < 48; --key)
+            if (((sketch_hash(key) >> 7) & 4095) == 0)
+                old_keys.push_back(key);
+        for (std::size_t idx = 0; idx < old_keys.size(); ++idx)
+            growing.insert_or_update(old_keys[idx], double(idx + 1));
+        Collection<std::int64_t> fresh(count, [&](std::size_t idx)
+                                       { return idx % 64 == 0 ? old_keys[idx / 64 % old_keys.size()] : std::int64_t(idx); });
+        Collection<double> zeros(count, [](std::size_t)
+                                 { return 0.0; });
+        std::atomic<bool> done{false};
+        std::size_t misses = 0;
+        std::thread reader([&]()
+                           {
+                               do
+                               {
+                                   for (std::size_t idx = 0; idx < old_keys.size(); ++idx)
+                                   {
+                                       double found = -1.0;
+                                       if (!growing.find(old_keys[idx], found) || found != double(idx + 1))
+                                           ++misses;
+                                   }
+                               } while (!done.load()); });
+        growing.insert_all(fresh, zeros);
+        done.store(true);
+        reader.join();
+        assert_equal(misses, std::size_t(0), "test_hash_table: Keys should be found with their whole value while the table grows");
+    }
+    set_thread_count(0);
+
+    ConcurrentHashTable<std::int64_t, double> empty;
+    assert_equal(empty.size(), std::size_t(0), "test_hash_table: New table should be empty");
+    assert_equal(empty.to_collections().first.size(), std::size_t(0), "test_hash_table: New table should export nothing");
+}
+
+/**
+ * @brief Tests the Fenwick and segment tree indexed collections against a plain copy.
+ * @details Interleaves point updates with range reductions of random bounds, including
+ *          ranges inside one block and empty ranges. The segment tree is also checked with
+ *          an operation that is not commutative, keeping the first nonzero element.
+ */
+void test_indexed()
+{
+    const std::size_t count = 10000;
+    std::vector<std::int64_t> copy(count);
+    for (std::size_t idx = 0; idx < count; ++idx)
+        copy[idx] = std::int64_t((idx * 7919) % 1000) - 500;
+    auto make = [&]()
+    {
+        return Collection<std::int64_t>(count, [&](std::size_t idx)
+                                        { return copy[idx]; });
+    };
+    auto min_op = [](std::int64_t a, std::int64_t b)
+    { return std::min(a, b); };
+    auto first_op = [](std::int64_t a, std::int64_t b)
+    { return a != 0 ? a : b; };
+    const std::int64_t none = std::numeric_limits<std::int64_t>::max();
+
+    for (std::size_t threads : {1, 3})
+    {
+        set_thread_count(threads);
+        FenwickCollection<std::int64_t> sums(make());
+        SegmentTreeCollection<std::int64_t, decltype(min_op)> minima(make(), none, min_op);
+        SegmentTreeCollection<std::int64_t, decltype(first_op)> firsts(make(), 0, first_op);
+        std::vector<std::int64_t> values = copy;
+
+        std::uint64_t state = 12345;
+        auto next = [&state](std::size_t bound)
+        {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return std::size_t((state >> 33) % bound);
+        };
+        for (std::size_t round = 0; round < 2000; ++round)
+        {
+            std::size_t idx = next(count);
+            std::int64_t value = round % 5 == 0 ? 0 : std::int64_t(next(2001)) - 1000;
+            values[idx] = value;
+            sums.set(idx, value);
+            minima.set(idx, value);
+            firsts.set(idx, value);
+
+            std::size_t begin = next(count + 1);
+            std::size_t end = round % 3 == 0 ? std::min(count, begin + next(100)) : begin + next(count + 1 - begin);
+            std::int64_t sum = 0, least = none, first = 0;
+            for (std::size_t pos = begin; pos < end; ++pos)
+            {
+                sum += values[pos];
+                least = std::min(least, values[pos]);
+                first = first_op(first, values[pos]);
+            }
+            assert_equal(sums.reduce(begin, end), sum, "test_indexed: Fenwick range sum mismatch");
+            assert_equal(minima.reduce(begin, end), least, "test_indexed: Segment tree range minimum mismatch");
+            assert_equal(firsts.reduce(begin, end), first, "test_indexed: Segment tree should reduce in element order");
+            if (round % 100 == 0)
+            {
+                std::int64_t total = 0;
+                for (std::int64_t v : values)
+                    total += v;
+                assert_equal(sums.reduce(), total, "test_indexed: Fenwick total mismatch");
+                assert_equal(sums.reduce(), sums.reduce(0, count), "test_indexed: Cached total should match the full range");
+                assert_equal(minima.reduce(), *std::min_element(values.begin(), values.end()), "test_indexed: Segment tree total mismatch");
+            }
+        }
+        assert_equal(sums.get(17), values[17], "test_indexed: Element mismatch");
+    }
+    set_thread_count(0);
+
+    FenwickCollection<double> empty(Collection<double>::allocate(0));
+    assert_equal(empty.reduce(), 0.0, "test_indexed: Empty collection should reduce to the identity");
+    SegmentTreeCollection<std::int64_t, decltype(min_op)> one(Collection<std::int64_t>(1, [](std::size_t)
+                                                                                       { return std::int64_t(7); }),
+                                                              none, min_op);
+    assert_equal(one.reduce(), std::int64_t(7), "test_indexed: Single element reduction mismatch");
+    assert_equal(one.reduce(1, 1), none, "test_indexed: Empty range should reduce to the identity");
+}
+
+/**
+ * @brief Tests block callbacks for generation, map and zip against per-element results.
+ * @details Also checks that the blocks cover every element exactly once and are never longer
+ *          than `span_block`.
+ */
+void test_spans()
+{
+    const std::size_t count = 100003;
+    for (std::size_t threads : {1, 3})
+    {
+        set_thread_count(threads);
+        std::atomic<std::size_t> covered{0};
+        std::atomic<bool> oversized{false};
+        Collection<double> xs(count, [&](Span<double> out, std::size_t start)
+                              {
+                                  covered += out.size();
+                                  if (out.size() > span_block)
+                                      oversized = true;
+                                  for (std::size_t k = 0; k < out.size(); ++k)
+                                      out[k] = double(start + k) * 0.5; });
+        assert_equal(covered.load(), count, "test_spans: Blocks should cover every element once");
+        assert_true(!oversized.load(), "test_spans: Blocks should not exceed span_block");
+        for (std::size_t idx = 0; idx < count; idx += 997)
+            assert_equal(xs.get(idx), double(idx) * 0.5, "test_spans: Generated element mismatch");
+
+        Collection<float> ys = xs.map<float>([](Span<const double> in, Span<float> out, std::size_t)
+                                             {
+                                                 for (std::size_t k = 0; k < in.size(); ++k)
+                                                     out[k] = float(in[k] + 1.0); });
+        Collection<double> sums = xs.zip<double>(ys, [](Span<const double> a, Span<const float> b, Span<double> out, std::size_t)
+                                                 {
+                                                     for (std::size_t k = 0; k < out.size(); ++k)
+                                                         out[k] = a[k] + b[k]; });
+        Collection<std::size_t> ids(count, [](std::size_t idx)
+                                    { return idx; });
+        Collection<double> mixed = zip<double>([](Span<const double> a, Span<const float> b, Span<const std::size_t> c,
+                                                  Span<double> out, std::size_t start)
+                                               {
+                                                   for (std::size_t k = 0; k < out.size(); ++k)
+                                                       out[k] = a[k] * b[k] - double(c[k]) + double(start + k); },
+                                               xs, ys, ids);
+        for (std::size_t idx = 0; idx < count; idx += 997)
+        {
+            float y = float(xs.get(idx) + 1.0);
+            assert_equal(ys.get(idx), y, "test_spans: Mapped element mismatch");
+            assert_equal(sums.get(idx), xs.get(idx) + y, "test_spans: Zipped element mismatch");
+            assert_equal(mixed.get(idx), xs.get(idx) * y, "test_spans: N-ary zipped element mismatch");
+        }
+    }
+    set_thread_count(0);
+
+    Collection<int> empty(0, [](Span<int> out, std::size_t)
+                          {
+                              for (int &value : out)
+                                  value = 1; });
+    assert_equal(empty.size(), std::size_t(0), "test_spans: Empty generation should be empty");
+}
+
+/**
+ * @brief Tests the Philox generator and random collections.
+ * @details Checks Philox4x32-10 against the published known-answer vectors, that random
+ *          collections are bit-identical for any thread count and match drawing each element
+ *          on its own, and the moments of the uniform and normal distributions.
+ */
+void test_random()
+{
+    philox_block zero = philox4x32(0, 0, 0);
+    assert_true(zero.word[0] == 0x6627e8d5u && zero.word[1] == 0xe169c58du && zero.word[2] == 0xbc57ac4cu && zero.word[3] == 0x9b00dbd8u,
+                "test_random: Philox zero vector mismatch");
+    philox_block pi = philox4x32(0x299f31d0a4093822ull, 0x85a308d3243f6a88ull, 0x0370734413198a2eull);
+    assert_true(pi.word[0] == 0xd16cfe09u && pi.word[1] == 0x94fdccebu && pi.word[2] == 0x5001e420u && pi.word[3] == 0x24126ea1u,
+                "test_random: Philox pi vector mismatch");
+
+    const std::size_t count = 200000;
+    std::uniform_int_distribution<int> dice(1, 6);
+    set_thread_count(1);
+    Collection<double> uniform_1 = Collection<double>::random(count, philox_uniform<double>(-1.0, 3.0), 7);
+    Collection<float> normal_1 = Collection<float>::random(count, philox_normal<float>(2.0f, 0.5f), 7);
+    Collection<int> dice_1 = Collection<int>::random(count, dice, 7);
+    set_thread_count(3);
+    Collection<double> uniform_3 = Collection<double>::random(count, philox_uniform<double>(-1.0, 3.0), 7);
+    Collection<float> normal_3 = Collection<float>::random(count, philox_normal<float>(2.0f, 0.5f), 7);
+    Collection<int> dice_3 = Collection<int>::random(count, dice, 7);
+    Collection<double> reseeded = Collection<double>::random(count, philox_uniform<double>(-1.0, 3.0), 8);
+    set_thread_count(0);
+
+    assert_true(uniform_1.to_vector() == uniform_3.to_vector(), "test_random: Uniform fill should not depend on the thread count");
+    assert_true(normal_1.to_vector() == normal_3.to_vector(), "test_random: Normal fill should not depend on the thread count");
+    assert_true(dice_1.to_vector() == dice_3.to_vector(), "test_random: Standard distribution fill should not depend on the thread count");
+    assert_true(uniform_1.to_vector() != reseeded.to_vector(), "test_random: Different seeds should give different streams");
+    for (std::size_t idx = 0; idx < count; idx += 4999)
+    {
+        assert_equal(uniform_1.get(idx), philox_sample(philox_uniform<double>(-1.0, 3.0), 7, idx), "test_random: Element should depend only on seed and index");
+        assert_equal(dice_1.get(idx), philox_sample(dice, 7, idx), "test_random: Standard distribution element mismatch");
+    }
+
+    double u_sum = 0.0, u_sq = 0.0, n_sum = 0.0, n_sq = 0.0, d_sum = 0.0;
+    bool in_range = true;
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        double u = uniform_1.get(idx), n = normal_1.get(idx);
+        int d = dice_1.get(idx);
+        in_range = in_range && u >= -1.0 && u < 3.0 && d >= 1 && d <= 6;
+        u_sum += u;
+        u_sq += u * u;
+        n_sum += n;
+        n_sq += n * n;
+        d_sum += d;
+    }
+    assert_true(in_range, "test_random: Values should lie in their distribution's range");
+    double u_mean = u_sum / count, n_mean = n_sum / count;
+    assert_near(u_mean, 1.0, 0.02, "test_random: Uniform mean mismatch");
+    assert_near(u_sq / count - u_mean * u_mean, 16.0 / 12.0, 0.02, "test_random: Uniform variance mismatch");
+    assert_near(n_mean, 2.0, 0.01, "test_random: Normal mean mismatch");
+    assert_near(n_sq / count - n_mean * n_mean, 0.25, 0.01, "test_random: Normal variance mismatch");
+    assert_near(d_sum / count, 3.5, 0.02, "test_random: Standard distribution mean mismatch");
+}
+
+/**
+ * @brief Tests the fused generate-reduce functions against materialized collections.
+ * @details Integer sums and a maximum are checked exactly for several thread counts, along
+ *          with an empty range and a Monte Carlo estimate of pi.
+ */
+void test_generate_reduce()
+{
+    const std::size_t count = 300007;
+    auto gen = [](std::size_t idx)
+    { return std::int64_t((idx * 7919) % 1009) - 500; };
+    Collection<std::int64_t> values(count, gen);
+    std::int64_t total = sum(values);
+    std::int64_t largest = values.reduce([](std::int64_t a, std::int64_t b)
+                                         { return std::max(a, b); });
+    std::int64_t squares = 0;
+    for (std::size_t idx = 0; idx < count; ++idx)
+        squares += gen(idx) * gen(idx);
+
+    for (std::size_t threads : {1, 3})
+    {
+        set_thread_count(threads);
+        assert_equal(generate_reduce(count, std::int64_t(0), gen, std::plus<std::int64_t>()), total, "test_generate_reduce: Sum mismatch");
+        assert_equal(generate_reduce(count, std::numeric_limits<std::int64_t>::min(), gen, [](std::int64_t a, std::int64_t b)
+                                     { return std::max(a, b); }),
+                     largest, "test_generate_reduce: Maximum mismatch");
+        assert_equal(generate_transform_reduce(count, std::int64_t(0), gen, [](std::int64_t v)
+                                               { return v * v; },
+                                               std::plus<std::int64_t>()),
+                     squares, "test_generate_reduce: Sum of squares mismatch");
+    }
+    set_thread_count(0);
+    assert_equal(generate_reduce(0, -1, [](std::size_t)
+                                 { return 1; },
+                                 [](int a, int b)
+                                 { return std::max(a, b); }),
+                 -1, "test_generate_reduce: Empty range should give the identity");
+
+    const std::size_t samples = 1000000;
+    double inside = generate_transform_reduce(
+        samples, 0.0, [](std::size_t idx)
+        { return philox4x32(3, idx); },
+        [](const philox_block &bits)
+        {
+            double x = philox_unit_double(bits.word[0], bits.word[1]);
+            double y = philox_unit_double(bits.word[2], bits.word[3]);
+            return x * x + y * y < 1.0 ? 1.0 : 0.0;
+        },
+        std::plus<double>());
+    assert_near(4.0 * inside / samples, 3.14159265358979, 0.01, "test_generate_reduce: Monte Carlo estimate of pi mismatch");
+}
 
 /**
  * @brief Main entry point for the collection test executable.
@@ -63,6 +2226,31 @@ int main()
         test_reduce(v, sum<double>, std::plus<double>());
         test_reduce(v, prod<double>, std::multiplies<double>());
         test_dot(u, v, dot<double>, std::multiplies<Collection<double>>(), sum<double>);
+        test_grid();
+        test_soa();
+        test_half();
+        test_mixed_zip();
+        test_scalar_broadcast();
+        test_variadic_zip();
+        test_unzip();
+        test_blas1();
+        test_matrix();
+        test_stencil();
+        test_rolling();
+        test_sparse();
+        test_complex();
+        test_fft();
+        test_vmath();
+        test_setops();
+        test_search();
+        test_sketch();
+        test_approx();
+        test_join();
+        test_hash_table();
+        test_indexed();
+        test_spans();
+        test_random();
+        test_generate_reduce();
         std::cout << "All tests passed!" << std::endl;
     }
     catch (assertion_error e)